@@ -1,6 +1,671 @@
+// Record the frames from all the cameras to disk. Each camera has its own directory of segment files, under the output directory.
+// For example, record from all the connected cameras for a minute, triggered by line 0:
+// ./recorder --output /data/run1 --duration 60
+// Record from 2 specific cameras, until ctrl+c:
+// ./recorder --output /data/run2 --cameras DEV_1AB22C00A1B2,DEV_1AB22C00A1B3 --duration 0
+// Only save 5 seconds before and 10 seconds after each event, where an event is triggered with kill -USR1 <recorder pid>:
+// ./recorder --output /data/run3 --duration 0 --events 5,10
+// Degrade the recording step by step when the disk is falling behind, instead of losing frames in bursts:
+// ./recorder --output /data/run4 --governor preview,drop,compress
+// Stripe the frames over 3 disks, each camera has a writer thread for each disk:
+// ./recorder --output /data0/run5 --volumes /data0/run5,/data1/run5,/data2/run5
+// Stream the frames to a viewer while recording, at most 800 Mbit/s for each camera:
+// ./recorder --output /data/run6 --stream 192.168.1.10:5000 --stream-rate 800
+// The same, with jumbo frames, and without copying the frames, the kernel is sending them from the buffers of the camera:
+// ./recorder --output /data/run6 --stream 192.168.1.10:5000 --stream-rate 800 --mtu 9000 --stream-zerocopy on
+// Send a preview at 1/8 of the size, 5 times a second, to a viewer, with up to 5% of a core for each camera:
+// ./recorder --output /data/run7 --preview 192.168.1.10:5001 --preview-fps 5 --preview-scale 8 --preview-budget 0.05
+// Let a remote application change the exposure, stop and start the recording and so on, over TCP (see control/protocol.hh),
+// each new recording is written to <output>/take-<N>/:
+// ./recorder --output /data/run8 --duration 0 --control 5100
+#include "camera_controller/camera.hh"
+#include "camera_controller/cameras_context.hh"
+#include "camera_controller/camera_startup.hh"
+#include "recording/recorder.hh"
+#include "streaming/stream_server.hh"
+#include "streaming/preview.hh"
+#include "control/control_server.hh"
+#include <csignal>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <mutex>
+#include <sstream>
 #include <iostream>
+#include <iterator>
+#include <cstdlib>
+#include <unistd.h>
 
-auto main(int, char**) -> int {
-	std::cerr << "This is not implemented yet!!\n";
-	return -1;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::atomic<bool> interrupted{false};
+std::atomic<bool> event{false};
+
+struct Options {
+    std::filesystem::path output{"recording"};
+    std::vector<std::filesystem::path> volumes;
+    recording::Striping striping{recording::Striping::Load};
+    std::vector<std::string> cameras;           // empty for all the cameras that are connected
+    std::size_t count{0};                       // use the first N cameras, 0 for all
+    std::chrono::seconds duration{10};          // 0 to record until interrupted
+    camera::HardWareTriggerSource trigger{camera::HardWareTriggerSource::Line0};
+    bool free_running{false};                   // don't use a trigger at all
+    int buffers{static_cast<int>(camera::DEFAULT_NUMBER_OF_BUFFERS)};
+    std::size_t queue_size{8};
+    recording::SegmentSettings segments;
+    recording::RecordingMode mode{recording::RecordingMode::Continuous};
+    recording::EventSettings events;
+    recording::GovernorSettings governor;
+    std::optional<streaming::ServerSettings> stream;
+    std::optional<streaming::ServerSettings> preview_stream;   // the viewer of the preview
+    streaming::PreviewSettings preview;
+    std::optional<uint16_t> control_port;
+};
+
+auto usage(const char* name) -> void {
+    std::cerr << "usage: " << name << " [options]\n"
+        << "\t--output <directory>\tthe directory to write the recording to (default: recording)\n"
+        << "\t--volumes <dir,dir..>\tstripe the frames over these directories, each one on its own disk, the output directory is keeping the list of them (default: only the output)\n"
+        << "\t--striping <round-robin|load>\thow to choose the volume for each frame, load is giving less frames to the slower disks (default: load)\n"
+        << "\t--cameras <N|id,id..>\tthe number of cameras to use, or a list of cameras ids (default: all)\n"
+        << "\t--duration <seconds>\thow long to record, 0 to record until ctrl+c (default: 10)\n"
+        << "\t--trigger <free|lineN>\tthe source of the trigger (default: line0)\n"
+        << "\t--buffers <N>\t\tthe number of frame buffers per camera (default: " << camera::DEFAULT_NUMBER_OF_BUFFERS << ")\n"
+        << "\t--queue <N>\t\tthe number of frames that can wait for the disk per camera (default: 8)\n"
+        << "\t--segment-size <MB>\tstart a new segment file after this size (default: " << recording::DEFAULT_SEGMENT_SIZE / (1024 * 1024) << ")\n"
+        << "\t--segment-time <seconds>\tstart a new segment file after this time, 0 for no limit (default: " << recording::DEFAULT_SEGMENT_DURATION.count() << ")\n"
+        << "\t--io <buffered|direct|threads>\thow to write to the disk, direct is O_DIRECT with io_uring, threads is O_DIRECT with a pool of threads (default: buffered)\n"
+        << "\t--io-depth <N>\t\tthe number of writes in flight per camera for direct IO (default: " << recording::DirectSettings{}.queue_depth << ")\n"
+        << "\t--compression <none|bayer>\tlossless compression of the 8 bits Bayer and Mono frames, on all the cores (default: none)\n"
+        << "\t--codec-threads <N>\tthe number of threads that are compressing the frames of each camera, 0 for all the cores (default: 0)\n"
+        << "\t--governor <off|step,step..>\twhen the disk is falling behind, apply these steps one by one, from preview, drop, compress (default: off)\n"
+        << "\t--drop-every <N>\twith the drop step, do not record 1 of N frames (default: " << recording::GovernorSettings{}.drop_every << ")\n"
+        << "\t--stream <address:port>\tstream the frames over UDP to this address while recording (default: no streaming)\n"
+        << "\t--stream-rate <Mbit/s>\tpace the datagrams of each camera to this rate, 0 to send as fast as we can (default: 0)\n"
+        << "\t--mtu <bytes>\t\tthe largest datagram for streaming (default: " << streaming::DEFAULT_MTU << ")\n"
+        << "\t--stream-zerocopy <on|off>\tsend the frames with MSG_ZEROCOPY, the camera buffers are held until the kernel sent them (default: off)\n"
+        << "\t--preview <address:port>\tsend a small RGB preview over UDP to this address, made on its own thread (default: no preview)\n"
+        << "\t--preview-fps <N>\tthe frame rate of the preview of each camera (default: " << streaming::PreviewSettings{}.fps << ")\n"
+        << "\t--preview-scale <N>\tthe preview is 1/N of the frame in each direction (default: " << streaming::PreviewSettings{}.scale << ")\n"
+        << "\t--preview-budget <part>\tthe most of a core for the preview of each camera, 0 for no limit (default: " << streaming::PreviewSettings{}.budget << ")\n"
+        << "\t--control <port>\tlet remote applications control the cameras and the recording over TCP on this port (default: no remote control)\n"
+        << "\t--events <pre,post>\tonly save the seconds before and after each event, an event is triggered with SIGUSR1 (default: save all the frames)\n"
+        << "\t--fps <N>\t\tthe expected frame rate, for the memory that is needed for the events mode (default: " << recording::EventSettings{}.frame_rate << ")\n";
+}
+
+auto split(std::string_view from, char sep) -> std::vector<std::string> {
+    std::vector<std::string> output;
+    while (!from.empty()) {
+        const auto at{std::min(from.find(sep), from.size())};
+        if (at > 0) {
+            output.emplace_back(from.substr(0, at));
+        }
+        from.remove_prefix(std::min(at + 1, from.size()));
+    }
+    return output;
+}
+
+auto set_events(std::string_view value, Options& options) -> bool {
+    const auto windows{split(value, ',')};
+    if (windows.size() != 2) {
+        return false;
+    }
+    const auto to_ms = [](const std::string& seconds) {
+        return std::chrono::milliseconds{static_cast<int64_t>(std::atof(seconds.c_str()) * 1000)};
+    };
+    options.mode = recording::RecordingMode::Events;
+    options.events.pre = to_ms(windows[0]);
+    options.events.post = to_ms(windows[1]);
+    return options.events.pre.count() >= 0 && options.events.post.count() >= 0;
+}
+
+auto set_governor(std::string_view value, Options& options) -> bool {
+    options.governor.policy.clear();
+    options.governor.enabled = value != "off";
+    if (!options.governor.enabled) {
+        return true;
+    }
+    for (auto&& step : split(value, ',')) {
+        if (step == "preview") {
+            options.governor.policy.push_back(recording::Degradation::DecimatePreview);
+        } else if (step == "drop") {
+            options.governor.policy.push_back(recording::Degradation::DropFrames);
+        } else if (step == "compress") {
+            options.governor.policy.push_back(recording::Degradation::Compress);
+        } else {
+            return false;
+        }
+    }
+    return !options.governor.policy.empty();
+}
+
+auto set_stream(std::string_view value, std::optional<streaming::ServerSettings>& to) -> bool {
+    const auto at{value.rfind(':')};
+    if (at == std::string_view::npos || at == 0) {
+        return false;
+    }
+    const auto port{std::strtoul(std::string{value.substr(at + 1)}.c_str(), nullptr, 10)};
+    if (port == 0 || port > 65535) {
+        return false;
+    }
+    auto& stream{to ? to.value() : to.emplace()};
+    stream.address = value.substr(0, at);
+    stream.port = static_cast<uint16_t>(port);
+    return true;
+}
+
+auto set_trigger(std::string_view name, Options& options) -> bool {
+    constexpr uint32_t LINES = static_cast<uint32_t>(camera::HardWareTriggerSource::Line20) + 1;
+    if (name == "free") {
+        options.free_running = true;
+        return true;
+    }
+    if (name.starts_with("line") && name.size() > 4) {
+        char* end{nullptr};
+        const std::string number{name.substr(4)};
+        if (const auto line = std::strtoul(number.c_str(), &end, 10); *end == '\0' && line < LINES) {
+            options.free_running = false;
+            options.trigger = static_cast<camera::HardWareTriggerSource>(line);
+            return true;
+        }
+    }
+    return false;
+}
+
+auto parse(int argc, char** argv) -> std::optional<Options> {
+    Options options;
+    double stream_rate{0};
+    std::size_t mtu{streaming::DEFAULT_MTU};
+    bool zerocopy{false};
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return std::nullopt;
+        }
+        const std::string_view value{argv[++i]};
+        if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--volumes") {
+            const auto volumes{split(value, ',')};
+            options.volumes.assign(volumes.begin(), volumes.end());
+        } else if (arg == "--striping") {
+            if (value == "round-robin") {
+                options.striping = recording::Striping::RoundRobin;
+            } else if (value == "load") {
+                options.striping = recording::Striping::Load;
+            } else {
+                std::cerr << "invalid striping " << value << "\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--cameras") {
+            if (std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                options.count = std::strtoul(value.data(), nullptr, 10);
+            } else {
+                options.cameras = split(value, ',');
+            }
+        } else if (arg == "--duration") {
+            options.duration = std::chrono::seconds{std::atoi(value.data())};
+        } else if (arg == "--trigger") {
+            if (!set_trigger(value, options)) {
+                std::cerr << "invalid trigger " << value << "\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--buffers") {
+            options.buffers = std::atoi(value.data());
+        } else if (arg == "--queue") {
+            options.queue_size = std::strtoul(value.data(), nullptr, 10);
+        } else if (arg == "--segment-size") {
+            options.segments.max_size = std::strtoull(value.data(), nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--segment-time") {
+            options.segments.max_duration = std::chrono::seconds{std::atoi(value.data())};
+        } else if (arg == "--io") {
+            if (value == "buffered") {
+                options.segments.io = recording::DiskIo::Buffered;
+            } else if (value == "direct" || value == "threads") {
+                options.segments.io = recording::DiskIo::Direct;
+                options.segments.direct.use_uring = value == "direct";
+            } else {
+                std::cerr << "invalid IO mode " << value << "\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--io-depth") {
+            options.segments.direct.queue_depth = std::strtoul(value.data(), nullptr, 10);
+        } else if (arg == "--compression") {
+            if (value == "none") {
+                options.segments.compression = recording::Compression::None;
+            } else if (value == "bayer") {
+                options.segments.compression = recording::Compression::Bayer;
+            } else {
+                std::cerr << "invalid compression " << value << "\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--codec-threads") {
+            options.segments.codec.threads = std::strtoul(value.data(), nullptr, 10);
+        } else if (arg == "--governor") {
+            if (!set_governor(value, options)) {
+                std::cerr << "invalid governor policy " << value << ", expecting off or a list of preview, drop and compress\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--drop-every") {
+            options.governor.drop_every = std::strtoul(value.data(), nullptr, 10);
+        } else if (arg == "--stream") {
+            if (!set_stream(value, options.stream)) {
+                std::cerr << "invalid stream address " << value << ", expecting <address>:<port>\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--stream-rate") {
+            stream_rate = std::atof(value.data());
+        } else if (arg == "--mtu") {
+            mtu = std::strtoul(value.data(), nullptr, 10);
+        } else if (arg == "--stream-zerocopy") {
+            if (value != "on" && value != "off") {
+                std::cerr << "invalid value for --stream-zerocopy " << value << ", expecting on or off\n";
+                return std::nullopt;
+            }
+            zerocopy = value == "on";
+        } else if (arg == "--preview") {
+            if (!set_stream(value, options.preview_stream)) {
+                std::cerr << "invalid preview address " << value << ", expecting <address>:<port>\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--preview-fps") {
+            options.preview.fps = std::atof(value.data());
+        } else if (arg == "--preview-scale") {
+            options.preview.scale = static_cast<uint32_t>(std::strtoul(value.data(), nullptr, 10));
+        } else if (arg == "--preview-budget") {
+            options.preview.budget = std::atof(value.data());
+        } else if (arg == "--control") {
+            const auto port{std::strtoul(value.data(), nullptr, 10)};
+            if (port == 0 || port > 65535) {
+                std::cerr << "invalid control port " << value << "\n";
+                return std::nullopt;
+            }
+            options.control_port = static_cast<uint16_t>(port);
+        } else if (arg == "--events") {
+            if (!set_events(value, options)) {
+                std::cerr << "invalid events windows " << value << ", expecting <seconds before>,<seconds after>\n";
+                return std::nullopt;
+            }
+        } else if (arg == "--fps") {
+            options.events.frame_rate = std::atof(value.data());
+        } else {
+            std::cerr << "unknown option " << arg << "\n";
+            return std::nullopt;
+        }
+    }
+    if (options.buffers <= 0 || options.queue_size == 0 || options.segments.max_size == 0 || options.segments.direct.queue_depth == 0 || options.governor.drop_every < 2 ||
+            options.duration.count() < 0 || options.segments.max_duration.count() < 0 || options.events.frame_rate <= 0 ||
+            options.preview.fps <= 0 || options.preview.scale == 0 || options.preview.budget < 0) {
+        std::cerr << "the number of buffers, the queue size, the segments size, the frame rates, the preview scale and the durations must be positive, and --drop-every at least 2\n";
+        return std::nullopt;
+    }
+    if (options.stream) {
+        options.stream->stream.rate = std::max(stream_rate, 0.0);
+        options.stream->mtu = mtu;
+        options.stream->zerocopy = zerocopy;
+    }
+    if (options.preview_stream) {
+        options.preview_stream->mtu = mtu;
+    }
+    return options;
+}
+
+auto select(const std::vector<camera::DeviceInfo>& devices, const Options& options) -> std::vector<camera::DeviceInfo> {
+    if (options.cameras.empty()) {
+        const auto count{options.count ? std::min(options.count, devices.size()) : devices.size()};
+        return std::vector<camera::DeviceInfo>(devices.begin(), devices.begin() + count);
+    }
+    std::vector<camera::DeviceInfo> selected;
+    for (auto&& id : options.cameras) {
+        if (auto i = std::find_if(devices.begin(), devices.end(), [&id](auto&& d) { return d.id == id; }); i != devices.end()) {
+            selected.push_back(*i);
+        } else {
+            std::cerr << "camera " << id << " is not connected\n";
+        }
+    }
+    return selected;
+}
+
+auto recording_profile(const Options& options) -> camera::CameraProfile {
+    auto profile{camera::CameraProfile{}
+        .set<camera::features::PixelFormat>(camera::PixelFormat::RawRGGB8)
+        .set<camera::features::AcquisitionMode>(camera::AcquisitionMode::Continuous)};
+    if (options.free_running) {
+        return profile.set<camera::features::TriggerMode>(camera::TriggerMode::Off);
+    }
+    return profile.set<camera::features::TriggerMode>(camera::TriggerMode::On)
+        .set<camera::features::TriggerSource>(camera::to_trigger_source(options.trigger))
+        .set<camera::features::TriggerActivation>(camera::ActivationMode::RisingEdge);
+}
+
+struct Recording {
+    std::string id;
+    recording::recorder_t recorder;     // nullptr while the remote control stopped the recording
+    recording::RecorderStatistics last;
+    // these are only used by the remote control
+    recording::RecorderSettings settings;
+    std::shared_ptr<camera::IdleCamera> idle;       // the camera, while the recording is stopped
+    uint32_t takes{0};
+};
+
+// The remote control is replacing the recorders, and the main thread is reporting them
+std::mutex recordings_guard;
+
+auto report(std::vector<Recording>& recordings, std::chrono::duration<double> period) -> void {
+    std::lock_guard lock{recordings_guard};
+    for (auto&& r : recordings) {
+        if (!r.recorder) {
+            continue;
+        }
+        const auto current{recording::statistics(*r.recorder)};
+        std::cout << r.id << ": " << (current.frames - r.last.frames) / period.count() << " FPS, "
+            << (current.bytes - r.last.bytes) / period.count() / (1024.0 * 1024.0) << " MB/s, dropped "
+            << current.dropped - r.last.dropped << ", missing " << current.missing - r.last.missing;
+        if (current.ring) {
+            std::cout << ", events " << current.events;
+        }
+        for (std::size_t v = 0; v < current.volumes.size(); v++) {
+            const auto& now{current.volumes[v]};
+            const auto before{v < r.last.volumes.size() ? r.last.volumes[v] : recording::VolumeStatistics{}};
+            std::cout << "\n\t" << now.directory.string() << ": " << (now.bytes - before.bytes) / period.count() / (1024.0 * 1024.0)
+                << " MB/s, " << static_cast<int>(now.fill() * 100) << "% full";
+        }
+        std::cout << "\n";
+        r.last = current;
+    }
+    std::cout << std::flush;
+}
+
+// Run the commands of the remote control for one camera, this is called on the thread of this camera in the control server,
+// so the commands of each camera are running one at a time, and only the recorder itself is shared with the main thread.
+auto remote(std::vector<Recording>& recordings, std::size_t index, std::stop_token cancellation) -> control::handler_f {
+    return [&recordings, index, cancellation](const control::Request& request) -> control::Reply {
+        auto& r{recordings[index]};
+        recording::recorder_t recorder;
+        {
+            std::lock_guard lock{recordings_guard};
+            recorder = r.recorder;
+        }
+        // the live features are changed on the camera that is capturing for the recorder, or on the idle camera
+        const auto live = [&recorder, &r](auto&& f) {
+            return recorder ? recording::with_camera(*recorder, f) : (r.idle && f(*r.idle));
+        };
+        const auto status = [](bool ok) {
+            return control::Reply{.status = ok ? control::Status::Ok : control::Status::Failed, .payload = {}};
+        };
+        const auto number{control::decode_double(request.payload)};
+        const auto integer{control::decode_integer(request.payload)};
+        switch (request.command) {
+            case control::Command::SetExposure:
+                if (!number || number.value() <= 0) {
+                    return control::Reply{.status = control::Status::Invalid, .payload = {}};
+                }
+                return status(live([value = number.value()](auto& camera) {
+                    return camera::set<camera::features::ExposureAuto>(camera, camera::ExposureAuto::Off) &&
+                        camera::set<camera::features::ExposureTime>(camera, value);
+                }));
+            case control::Command::AutoExposure:
+            case control::Command::WhiteBalance:
+                if (!integer || integer.value() < 0 || integer.value() > static_cast<int64_t>(camera::ExposureAuto::Continuous)) {
+                    return control::Reply{.status = control::Status::Invalid, .payload = {}};
+                }
+                return status(live([mode = static_cast<camera::ExposureAuto>(integer.value()), balance = request.command == control::Command::WhiteBalance](auto& camera) {
+                    return balance ? camera::set<camera::features::BalanceWhiteAuto>(camera, mode) : camera::set<camera::features::ExposureAuto>(camera, mode);
+                }));
+            case control::Command::SetGain:
+                if (!number) {
+                    return control::Reply{.status = control::Status::Invalid, .payload = {}};
+                }
+                return status(live([value = number.value()](auto& camera) {
+                    return camera::set<camera::features::Gain>(camera, value);
+                }));
+            case control::Command::TriggerMode: {
+                constexpr int64_t LINES = static_cast<int64_t>(camera::HardWareTriggerSource::Line20) + 1;
+                if (!integer || integer.value() < -1 || integer.value() >= LINES) {
+                    return control::Reply{.status = control::Status::Invalid, .payload = {}};
+                }
+                if (recorder || !r.idle) {
+                    return control::Reply{.status = control::Status::NotAllowed, .payload = {}};       // this can only be changed when we are not capturing
+                }
+                if (integer.value() < 0) {
+                    return status(camera::set<camera::features::TriggerMode>(*r.idle, camera::TriggerMode::Off));
+                }
+                const auto line{static_cast<camera::HardWareTriggerSource>(integer.value())};
+                return status(camera::set<camera::features::TriggerMode>(*r.idle, camera::TriggerMode::On) &&
+                    camera::set<camera::features::TriggerSource>(*r.idle, camera::to_trigger_source(line)));
+            }
+            case control::Command::StartAcquisition:
+                return status(live([](auto& camera) { return camera::run<camera::features::AcquisitionStart>(camera); }));
+            case control::Command::StopAcquisition:
+                return status(live([](auto& camera) { return camera::run<camera::features::AcquisitionStop>(camera); }));
+            case control::Command::StartRecording: {
+                if (recorder || !r.idle) {
+                    return control::Reply{.status = control::Status::NotAllowed, .payload = {}};
+                }
+                auto settings{r.settings};
+                settings.output = settings.output / ("take-" + std::to_string(++r.takes));
+                // the recorder is only taking the camera when it is created successfully, so we keep it until then
+                auto camera{r.idle};
+                auto next{recording::make_recorder(std::move(camera), r.id, settings)};
+                if (!next) {
+                    return status(false);
+                }
+                r.idle.reset();
+                if (!recording::start(*next, cancellation)) {
+                    r.idle = recording::release(*next);
+                    return status(false);
+                }
+                std::lock_guard lock{recordings_guard};
+                r.recorder = std::move(next);
+                r.last = {};
+                return status(true);
+            }
+            case control::Command::StopRecording: {
+                if (!recorder) {
+                    return control::Reply{.status = control::Status::NotAllowed, .payload = {}};
+                }
+                r.idle = recording::release(*recorder);
+                std::cout << r.id << " -> " << recording::output_path(*recorder) << ": " << recording::statistics(*recorder) << std::endl;
+                std::lock_guard lock{recordings_guard};
+                r.recorder.reset();
+                return status(r.idle != nullptr);
+            }
+            case control::Command::Trigger:
+                // in the events mode this is saving an event, otherwise it is a software trigger
+                if (recorder && recording::trigger(*recorder)) {
+                    return status(true);
+                }
+                return status(live([](auto& camera) { return camera::run<camera::features::TriggerSoftware>(camera); }));
+            case control::Command::Statistics: {
+                if (!recorder) {
+                    return control::Reply{.status = control::Status::NotAllowed, .payload = {}};
+                }
+                std::ostringstream text;
+                text << recording::statistics(*recorder);
+                return control::Reply{.status = control::Status::Ok, .payload = text.str()};
+            }
+            default:
+                return control::Reply{.status = control::Status::UnknownCommand, .payload = {}};
+        }
+    };
+}
+
+}       // end of local namespace
+
+auto main(int argc, char** argv) -> int {
+    const auto options{parse(argc, argv)};
+    if (!options) {
+        usage(argv[0]);
+        return -1;
+    }
+    auto devices_ctx{camera::make_context()};
+    if (std::holds_alternative<camera::error_type>(devices_ctx)) {
+        std::cerr << "failed to create device context: " << std::get<camera::error_type>(devices_ctx) << "\n";
+        return -1;
+    }
+    auto& ctx{std::get<camera::context_type>(devices_ctx)};
+    const auto devices{select(camera::enumerate(*ctx), options.value())};
+    if (devices.empty()) {
+        std::cerr << "no camera to record from\n";
+        return -1;
+    }
+
+    std::stop_source stop_source;
+    std::vector<std::string> ids;
+    std::transform(devices.begin(), devices.end(), std::back_inserter(ids), [](auto&& d) { return d.id; });
+    streaming::server_t server;
+    if (options->stream) {
+        server = streaming::make_server(options->stream.value(), ids, std::stop_token{});     // stopped after the recorders, with the frames it has
+        if (!server) {
+            std::cerr << "failed to stream to " << options->stream->address << ":" << options->stream->port << "\n";
+            return -1;
+        }
+    }
+    // the preview is sent with its own server, so the full frames are not waiting for it, or it for them
+    streaming::server_t preview_server;
+    streaming::preview_t preview;
+    if (options->preview_stream) {
+        preview_server = streaming::make_server(options->preview_stream.value(), ids, std::stop_token{});
+        if (!preview_server) {
+            std::cerr << "failed to send the preview to " << options->preview_stream->address << ":" << options->preview_stream->port << "\n";
+            return -1;
+        }
+        preview = streaming::make_preview(options->preview, ids, [preview_server](std::size_t camera, const camera::ImageView& rgb) {
+            (void)streaming::send(*preview_server, camera, rgb);
+        }, std::stop_token{});
+    }
+    const recording::RecorderSettings settings{
+        .output = options->output, .volumes = options->volumes, .striping = options->striping, .buffers = options->buffers, .queue_size = options->queue_size, .segments = options->segments,
+        .mode = options->mode, .events = options->events, .governor = options->governor, .tap = {}      // set for each camera below
+    };
+    std::vector<Recording> recordings;
+    for (auto&& result : camera::open_all(ctx, devices, recording_profile(options.value()))) {
+        std::cout << result << std::endl;
+        if (!result) {
+            std::cerr << "failed to open " << result.device << " for recording\n";
+            return -1;
+        }
+        auto camera_settings{settings};
+        if (server || preview) {
+            const auto stream{static_cast<std::size_t>(std::find_if(devices.begin(), devices.end(), [&result](auto&& d) { return d.id == result.device.id; }) - devices.begin())};
+            camera_settings.tap = [server, preview, stream](const camera::FrameLease& frame) {
+                // the frames that the network cannot take, and that are not needed for the preview, are counted by the server and the preview
+                if (server) {
+                    (void)streaming::send(*server, stream, frame);      // sent from the buffer of the camera
+                }
+                if (preview) {
+                    (void)streaming::offer(*preview, stream, frame.image());
+                }
+            };
+        }
+        auto recorder{recording::make_recorder(std::move(result.camera), result.device.id, camera_settings)};
+        if (!recorder) {
+            std::cerr << "failed to create the recorder for " << result.device << "\n";
+            return -1;
+        }
+        recordings.push_back(Recording{.id = result.device.id, .recorder = std::move(recorder), .last = {}, .settings = camera_settings, .idle = {}, .takes = 0});
+    }
+
+    std::signal(SIGINT, [](int) { interrupted = true; });
+    std::signal(SIGTERM, [](int) { interrupted = true; });
+    std::signal(SIGUSR1, [](int) { event = true; });
+    for (auto&& r : recordings) {
+        if (!recording::start(*r.recorder, stop_source.get_token())) {
+            std::cerr << "failed to start recording from " << r.id << "\n";
+            return -1;
+        }
+    }
+    control::control_server_t control_server;
+    if (options->control_port) {
+        std::vector<control::Target> targets;
+        for (std::size_t i = 0; i < recordings.size(); i++) {
+            targets.push_back(control::Target{.camera = recordings[i].id, .handler = remote(recordings, i, stop_source.get_token())});
+        }
+        control_server = control::make_control_server(control::ControlSettings{.port = options->control_port.value()}, std::move(targets), stop_source.get_token());
+        if (!control_server) {
+            std::cerr << "failed to listen for the remote control on port " << options->control_port.value() << "\n";
+            return -1;
+        }
+    }
+    std::cout << "recording from " << recordings.size() << " cameras into " << options->output;
+    if (options->duration.count()) {
+        std::cout << " for " << options->duration.count() << " seconds" << std::endl;
+    } else {
+        std::cout << " until interrupted" << std::endl;
+    }
+    if (options->mode == recording::RecordingMode::Events) {
+        std::cout << "only saving the events, " << options->events.pre.count() << "ms before and " << options->events.post.count()
+            << "ms after each, to trigger an event: kill -USR1 " << ::getpid() << std::endl;
+    }
+
+    using clock_type = std::chrono::steady_clock;
+    const auto start{clock_type::now()};
+    const auto end{start + options->duration};
+    auto last_report{start};
+    while (!interrupted && (options->duration.count() == 0 || clock_type::now() < end)) {
+        std::this_thread::sleep_for(100ms);
+        if (event.exchange(false)) {
+            std::cout << "event" << std::endl;
+            std::lock_guard lock{recordings_guard};
+            for (auto&& r : recordings) {
+                if (r.recorder) {
+                    recording::trigger(*r.recorder);
+                }
+            }
+        }
+        if (const auto now = clock_type::now(); now - last_report >= 1s) {
+            report(recordings, now - last_report);
+            last_report = now;
+        }
+    }
+    stop_source.request_stop();
+    if (control_server) {
+        control::stop(*control_server);     // so the recordings are not replaced anymore
+    }
+    for (auto&& r : recordings) {
+        if (r.recorder) {
+            recording::stop(*r.recorder);
+        }
+    }
+    if (server) {
+        streaming::stop(*server);
+    }
+    if (preview) {
+        streaming::stop(*preview);
+        streaming::stop(*preview_server);
+    }
+
+    const std::chrono::duration<double> elapsed{clock_type::now() - start};
+    auto success{true};
+    for (auto&& r : recordings) {
+        if (!r.recorder) {
+            continue;       // the remote control stopped it, and it was already reported
+        }
+        const auto stats{recording::statistics(*r.recorder)};
+        std::cout << r.id << " -> " << recording::output_path(*r.recorder) << ": " << stats
+            << ", " << stats.frames / elapsed.count() << " FPS" << std::endl;
+        success = success && stats.errors == 0 && (stats.frames > 0 || options->mode == recording::RecordingMode::Events);
+    }
+    if (server) {
+        for (auto&& s : streaming::statistics(*server)) {
+            std::cout << "streamed " << s << std::endl;
+        }
+    }
+    if (preview) {
+        for (auto&& s : streaming::statistics(*preview)) {
+            std::cout << "preview " << s << std::endl;
+        }
+    }
+    if (control_server) {
+        std::cout << "remote control: " << control::statistics(*control_server) << std::endl;
+    }
+    return success ? 0 : -1;
 }
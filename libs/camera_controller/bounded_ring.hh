@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+#include <cstddef>
+
+namespace camera {
+
+// Fixed size, lock free queue, that support multiple producers and multiple consumers.
+// This is based on the bounded MPMC queue by Dmitry Vyukov: each cell has a sequence number
+// that tell whether it is ready for the next push or the next pop, so the producers and the consumers
+// are only contending on a single atomic each.
+// Note that the capacity is rounded up to the next power of 2.
+template<typename T>
+struct BoundedRing {
+    explicit BoundedRing(std::size_t capacity) : mask{round_up(capacity) - 1}, cells{new Cell[mask + 1]} {
+        for (std::size_t i = 0; i <= mask; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedRing(const BoundedRing&) = delete;
+    auto operator = (const BoundedRing&) -> BoundedRing& = delete;
+
+    // Push the value into the ring, return false if the ring is full.
+    // Note that the value is only moved from if we successfully pushed it.
+    auto try_push(T& value) -> bool {
+        auto pos{enqueue_pos.load(std::memory_order_relaxed)};
+        Cell* cell{nullptr};
+        for (;;) {
+            cell = &cells[pos & mask];
+            const auto seq{cell->sequence.load(std::memory_order_acquire)};
+            const auto diff{static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos)};
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop the next value from the ring, return false if the ring is empty
+    auto try_pop(T& value) -> bool {
+        auto pos{dequeue_pos.load(std::memory_order_relaxed)};
+        Cell* cell{nullptr};
+        for (;;) {
+            cell = &cells[pos & mask];
+            const auto seq{cell->sequence.load(std::memory_order_acquire)};
+            const auto diff{static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1)};
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->data = T{};
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Note that this is only a snapshot, and may be out of date by the time you are using it
+    auto size() const -> std::size_t {
+        const auto head{dequeue_pos.load(std::memory_order_relaxed)};
+        const auto tail{enqueue_pos.load(std::memory_order_relaxed)};
+        return tail > head ? tail - head : 0;
+    }
+
+    auto capacity() const -> std::size_t {
+        return mask + 1;
+    }
+
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    static constexpr auto round_up(std::size_t v) -> std::size_t {
+        std::size_t r{2};
+        while (r < v) {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    struct Cell {
+        std::atomic<std::size_t> sequence{0};
+        T data{};
+    };
+
+    const std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(CACHE_LINE) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(CACHE_LINE) std::atomic<std::size_t> dequeue_pos{0};
+};
+
+}   // end of namespace camera
@@ -1,7 +1,11 @@
 #include "camera.hh"
-#ifdef BUILD_WITH_VIMBA_SDK
+#include "camera_profile.hh"
+#if defined(BUILD_WITH_VIMBA_SDK)
 #   include "vimba/internal_settings.hpp"
 #   include "vimba/cameras_impl.hpp"
+#elif defined(BUILD_WITH_SIMULATED_CAMERA)
+#   include "simulator/internal_settings.hpp"
+#   include "simulator/cameras_impl.hpp"
 #endif
 #include "log/logging.h"
 #include <iostream>
@@ -18,9 +22,12 @@ namespace {
 //using CapturingCamera = vimba_sdk::CaptureModeCamera;
 using vimba_sdk::do_capture_once;
 using vimba_sdk::async_capture_impl;
-using vimba_sdk::map_pixel_type;
 using vimba_sdk::start_acquisition;
 using vimba_sdk::do_software_trigger;
+using vimba_sdk::run_command;
+using vimba_sdk::execute_and_wait;
+using vimba_sdk::write_feature_value;
+using vimba_sdk::read_feature_value;
 struct IdleCamera : vimba_sdk::IdleModeCamera {
     using vimba_sdk::IdleModeCamera::IdleModeCamera;
 };
@@ -29,10 +36,62 @@ struct CapturingCamera : vimba_sdk::CaptureModeCamera {
     using vimba_sdk::CaptureModeCamera::CaptureModeCamera;
 };
 
+#elif defined(BUILD_WITH_SIMULATED_CAMERA)
+using simulator::do_capture_once;
+using simulator::async_capture_impl;
+using simulator::run_command;
+using simulator::execute_and_wait;
+using simulator::write_feature_value;
+using simulator::read_feature_value;
+struct IdleCamera : simulator::IdleModeCamera {
+    using simulator::IdleModeCamera::IdleModeCamera;
+};
+
+struct CapturingCamera : simulator::CaptureModeCamera {
+    using simulator::CaptureModeCamera::CaptureModeCamera;
+};
+
 #endif  // BUILD_WITH_VIMBA_SDK
 ///////////////////////////////////////////////////////////////////////////////
 
 
+///////////////////////////////////////////////////////////////////////////////
+/// Typed features access (see features.hh)
+///////////////////////////////////////////////////////////////////////////////
+namespace features {
+namespace detail {
+
+auto write(IdleCamera& camera, std::size_t index, const char* name, const value_t& value) -> bool {
+    return write_feature_value(*camera.features, index, name, value);
+}
+
+auto write(CapturingCamera& camera, std::size_t index, const char* name, const value_t& value) -> bool {
+    return write_feature_value(*camera.features, index, name, value);
+}
+
+auto read(IdleCamera& camera, std::size_t index, const char* name, FeatureKind kind) -> std::optional<value_t> {
+    return read_feature_value(*camera.features, index, name, kind);
+}
+
+auto execute(IdleCamera& camera, std::size_t index, const char* name) -> bool {
+    return run_command(*camera.features, index, name);
+}
+
+auto execute(CapturingCamera& camera, std::size_t index, const char* name) -> bool {
+    return run_command(*camera.features, index, name);
+}
+
+auto execute(IdleCamera& camera, std::size_t index, const char* name, std::chrono::milliseconds timeout) -> bool {
+    return execute_and_wait(*camera.features, index, name, timeout) == CommandResult::Done;
+}
+
+auto execute(CapturingCamera& camera, std::size_t index, const char* name, std::chrono::milliseconds timeout) -> bool {
+    return execute_and_wait(*camera.features, index, name, timeout) == CommandResult::Done;
+}
+
+}   // end of namespace detail
+}   // end of namespace features
+
 ///////////////////////////////////////////////////////////////////////////////
 /// API implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -49,7 +108,7 @@ auto From(IdleCamera&& cam) -> std::shared_ptr<CapturingCamera> {
 }
 
 auto Back(std::shared_ptr<CapturingCamera>&& cam) -> std::shared_ptr<IdleCamera> {
-    auto ret{std::make_shared<IdleCamera>(std::move(cam->camera))};
+    auto ret{std::make_shared<IdleCamera>(std::move(cam->camera), std::move(cam->features))};
     cam.reset();
     return ret;
 }
@@ -65,90 +124,99 @@ auto create(const Context& ctx, const DeviceInfo& dev_id) -> std::shared_ptr<Idl
 
 
 auto set_capture_type(IdleCamera& camera, PixelFormat pixel_format) -> bool {
-    return camera.set_value("PixelFormat", map_pixel_type(pixel_format));
+    return set<features::PixelFormat>(camera, pixel_format);
 }
 
 
 auto set_software_trigger(IdleCamera& camera) -> bool {
-    return camera.set_value("TriggerMode", "On") &&
-           camera.set_value("TriggerSource", "Software");
+    return set<features::TriggerMode>(camera, TriggerMode::On) &&
+           set<features::TriggerSource>(camera, TriggerSource::Software);
 }
 
 auto set_hardware_trigger(IdleCamera& camera, HardWareTriggerSource src, ActivationMode am) -> bool {
-    
+    return set<features::TriggerMode>(camera, TriggerMode::On) &&
+            set<features::TriggerActivation>(camera, am) &&
+            set<features::TriggerSource>(camera, to_trigger_source(src));
+}
 
-    return camera.set_value( "TriggerMode", "On") &&
-            camera.set_value("TriggerActivation", to_string(am)) &&
-            camera.set_value("TriggerSource", to_string(src));
 
+auto feature_statistics(const IdleCamera& camera) -> FeatureStatistics {
+    const auto [lookups, hits]{camera.features->statistics()};
+    return FeatureStatistics{.lookups = lookups, .hits = hits};
 }
 
+auto forget_features(IdleCamera& camera) -> void {
+    camera.features->clear();
+}
+
+auto operator << (std::ostream& os, const FeatureStatistics& fs) -> std::ostream& {
+    return os << "features looked up by name: " << fs.lookups << ", taken from the cache: " << fs.hits;
+}
 
 auto get_frame_size(IdleCamera& camera) -> std::optional<int64_t> {
-    if (auto v = camera.get_value<VmbInt64_t>("PayloadSize"); v) {
-        return int64_t{v.value()};
-    }
-    return {};
+    return get<features::PayloadSize>(camera);
 }
 
 
 auto set_acquisition_mode(IdleCamera& camera, AcquisitionMode mode) -> bool {
-    return camera.set_value("AcquisitionMode", to_string(mode));
+    return set<features::AcquisitionMode>(camera, mode);
 }
 
 
 auto set_exposure_mode(IdleCamera& camera, ExposureMode mode) -> bool {
-    return camera.set_value( "ExposureMode", to_string(mode));
+    return set<features::ExposureMode>(camera, mode);
 }
 
 auto auto_exposure(IdleCamera& camera, bool once_flag) -> bool {
     return set_exposure_mode(camera, ExposureMode::Timed) &&
-        camera.set_value( "ExposureAuto", (once_flag ? "Once" : "Continuous"));
+        set<features::ExposureAuto>(camera, (once_flag ? ExposureAuto::Once : ExposureAuto::Continuous));
 }
 
 
 auto manual_exposure(IdleCamera& camera, double time) -> bool {
     return set_exposure_mode(camera, ExposureMode::Off) &&
-        camera.set_value( "ExposureAuto", "Off") && 
-        camera.set_value( "ExposureTime", time);
+        set<features::ExposureAuto>(camera, ExposureAuto::Off) &&
+        set<features::ExposureTime>(camera, time);
 }
 
 
 auto set_auto_whitebalance(IdleCamera& camera, bool on, bool continues) -> bool {
     if (on) {
-        if (continues) {
-            return camera.set_value( "BalanceWhiteAuto", "Continuous");
-        }
-        return camera.set_value( "BalanceWhiteAuto", "Once");
+        return set<features::BalanceWhiteAuto>(camera, (continues ? ExposureAuto::Continuous : ExposureAuto::Once));
     }
-    return camera.set_value( "BalanceWhiteAuto", "Off");
+    return set<features::BalanceWhiteAuto>(camera, ExposureAuto::Off);
 }
 
 
+// These are only writing the settings that the camera doesn't already have (see camera_profile.hh)
 auto set_default_software_mode(IdleCamera& camera, ActivationMode am) -> bool {
     LOG(INFO) << "Setting the camera to use trigger by software" << ENDL;
 
-    return set_capture_type(camera, PixelFormat::RawRGGB8) &&
-        set_software_trigger(camera) &&
-        set_acquisition_mode(camera, AcquisitionMode::Continuous) &&
-        auto_exposure(camera, false) && camera.set_value("TriggerActivation", to_string(am)) &&
-        set_auto_whitebalance(camera, true, false);
+    const auto report{configure(camera, default_software_profile(am))};
+    LOG(INFO) << "software trigger mode configuration: " << report << ENDL;
+    return report.ok;
 }
 
 
 auto set_default_hardware_mode(IdleCamera& camera, HardWareTriggerSource source, ActivationMode am) -> bool {
     LOG(INFO) << "Setting the camera to be triggered by hardware" << ENDL;
-    
-    return set_capture_type(camera, PixelFormat::RawRGGB8) &&
-        set_hardware_trigger(camera, source, am) &&
-        set_acquisition_mode(camera, AcquisitionMode::Continuous) &&
-        auto_exposure(camera, false) &&
-        set_auto_whitebalance(camera, true, false);
+
+    const auto report{configure(camera, default_hardware_profile(source, am))};
+    LOG(INFO) << "hardware trigger mode configuration: " << report << ENDL;
+    return report.ok;
+}
+
+auto run_command_and_wait(IdleCamera& camera, const char* name, std::chrono::milliseconds timeout) -> CommandResult {
+    return execute_and_wait(camera.features->get(name), name, timeout);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Implement the capture mode
 
+auto run_command_and_wait(CapturingCamera& camera, const char* name, std::chrono::milliseconds timeout) -> CommandResult {
+    return execute_and_wait(camera.features->get(name), name, timeout);
+}
+
 auto capture_once(CapturingCamera& camera, uint32_t timeout) -> std::optional<Image> {
     return do_capture_once(camera, timeout);
 }
@@ -169,6 +237,32 @@ auto make_async_context(CapturingCamera& camera, frame_processing_f&& process_f,
     return std::make_shared<AsyncCaptureContxt>(camera.camera, std::move(process_f), std::move(cancellation));
 }
 
+auto make_async_lease_context(CapturingCamera& camera, frame_lease_f&& process_f, std::stop_token cancellation) -> async_context_t {
+    return std::make_shared<AsyncCaptureContxt>(camera.camera, std::move(process_f), std::move(cancellation));
+}
+
+auto lease_statistics(const AsyncCaptureContxt& context) -> LeaseStatistics {
+    return context.lease_statistics();
+}
+
+auto make_async_pool_context(CapturingCamera& camera, frame_processing_f&& process_f, std::stop_token cancellation, const DispatchSettings& settings) -> async_context_t {
+    auto dispatcher{std::make_shared<FrameDispatcher>(std::move(process_f), settings)};
+    return std::make_shared<AsyncCaptureContxt>(camera.camera, std::move(dispatcher), std::move(cancellation));
+}
+
+auto make_async_pool_context(CapturingCamera& camera, frame_lease_f&& process_f, std::stop_token cancellation, const DispatchSettings& settings) -> async_context_t {
+    auto dispatcher{std::make_shared<FrameDispatcher>(std::move(process_f), settings)};
+    return std::make_shared<AsyncCaptureContxt>(camera.camera, std::move(dispatcher), std::move(cancellation));
+}
+
+auto dispatch_statistics(const AsyncCaptureContxt& context) -> DispatchStatistics {
+    return context.dispatch_statistics();
+}
+
+auto pool_statistics(const AsyncCaptureContxt& context) -> PoolStatistics {
+    return context.pool_statistics();
+}
+
 auto make_software_context(IdleCamera& camera, frame_processing_f&& process_f, std::stop_token cancellation, int queue_size) -> software_context_t {
     // set the device so that we can trigger with source trigger before we are creating this context.
     // Note that if this is single mode and not Continuous you would need to trigger for each frame.
@@ -1,8 +1,13 @@
 #pragma once
 #include "cameras_fwd.hh"
 #include "camera_settings.hh"
+#include "features.hh"
 #include "cameras_context.hh"
 #include "image.hh"
+#include "frame_lease.hh"
+#include "frame_dispatcher.hh"
+#include "frame_buffer_pool.hh"
+#include "command_wait.hh"
 #include <vector>
 #include <optional>
 #include <iosfwd>
@@ -10,6 +15,7 @@
 #include <memory>
 #include <functional>
 #include <stop_token>
+#include <chrono>
 
 namespace camera {
 
@@ -23,6 +29,21 @@ struct CapturingCamera;
 // Create the camera based on the id, you can get the ID from the context
 [[nodiscard]] auto create(const Context& ctx, const DeviceInfo& dev_id) -> std::shared_ptr<IdleCamera>;
 
+// Note that beside the functions here, you can access the camera features directly with
+// camera::set<features::...>, camera::get<features::...> and camera::run<features::...> (see features.hh).
+
+// The handles of the features are looked up by name once, and then taken from a cache (see feature_cache.hh)
+struct FeatureStatistics {
+    uint64_t lookups{0};        // features that were looked up by name
+    uint64_t hits{0};           // accesses that were using a cached handle
+};
+auto operator << (std::ostream& os, const FeatureStatistics& fs) -> std::ostream&;
+
+[[nodiscard]] auto feature_statistics(const IdleCamera& camera) -> FeatureStatistics;
+
+// Drop the cached handles, so the next access to each feature is looking it up by name again
+auto forget_features(IdleCamera& camera) -> void;
+
 // Set the format of the captured images, this is content of the frame that we are reading from the camera. 
 [[nodiscard]] auto set_capture_type(IdleCamera& camera, PixelFormat pixel_format) -> bool;
 
@@ -63,10 +84,17 @@ struct CapturingCamera;
 // Set the camera to use trigger by hardware, recording in RAW RGGB auto exposure and continue mode.
 [[nodiscard]] auto set_default_hardware_mode(IdleCamera& camera, HardWareTriggerSource source, ActivationMode am) -> bool;
 
+// Run a GenICam command by its name, and wait for the device to finish it, for no more than the timeout.
+// Note that we are not spinning while waiting, and that the time it took is recorded (see command_statistics()).
+[[nodiscard]] auto run_command_and_wait(IdleCamera& camera, const char* name, std::chrono::milliseconds timeout = DEFAULT_COMMAND_TIMEOUT) -> CommandResult;
+
 ///////////////////////////////////////////////////////////////////////////////
 // In capture mode
 ///////////////////////////////////////////////////////////////////////////////
 
+// The same as for the idle mode, for commands that can run while capturing.
+[[nodiscard]] auto run_command_and_wait(CapturingCamera& camera, const char* name, std::chrono::milliseconds timeout = DEFAULT_COMMAND_TIMEOUT) -> CommandResult;
+
 // For a stream of images (capturing more than a single image), we would like to have a context where we can store a state
 // to make the image memory allocation better. Use this when you are about to read more than single image.
 // In order to crate the context we need to know how many buffers will be allocated between the device and the host.
@@ -123,9 +151,43 @@ auto make_capture_context() -> capture_context_t;
 
 [[nodiscard]] auto make_async_context(CapturingCamera& camera, frame_processing_f&& process_f, std::stop_token cancellation) -> async_context_t;
 
+// This is the same as make_async_context, but instead of getting a view to the frame that is only valid
+// inside the call, the function-like is getting a lease on the frame. The frame is not returned to the camera
+// until the last copy of the lease is released, so you can pass the lease to another thread without copying
+// the image. Note that the number of leases that you can hold at the same time is limited by the number of
+// buffers that you passed to async_capture - once all of them are held by the application, the camera will drop frames.
+// For example:
+// auto ctx = make_async_lease_context(camera, [&queue](FrameLease frame) { queue.push(std::move(frame)); return true; }, stop_source.get_token());
+[[nodiscard]] auto make_async_lease_context(CapturingCamera& camera, frame_lease_f&& process_f, std::stop_token cancellation) -> async_context_t;
+
+// This is the same as make_async_context, but the function-like is not called from the camera thread, but from a pool
+// of worker threads. The camera thread is only passing the frame to the workers, so slow processing is not stalling the
+// camera. What happens when the workers cannot keep up, is controlled by the overflow policy in the settings.
+// Note that with more than one worker, the function-like is called concurrently, and the frames can be processed out of order.
+// The ring size in the settings should be less than the number of buffers that you passed to async_capture, otherwise
+// the frames that are waiting in the ring will starve the camera.
+// For example:
+// auto ctx = make_async_pool_context(camera, [](const ImageView& frame) { do_heavy_stuff(frame); return true; }, stop_source.get_token(), DispatchSettings{.workers = 4});
+[[nodiscard]] auto make_async_pool_context(CapturingCamera& camera, frame_processing_f&& process_f, std::stop_token cancellation, const DispatchSettings& settings) -> async_context_t;
+
+// This is the same as make_async_pool_context, but the workers are getting the lease on the frame (see make_async_lease_context),
+// so a worker can pass the frame on (for streaming for example) without copying it.
+[[nodiscard]] auto make_async_pool_context(CapturingCamera& camera, frame_lease_f&& process_f, std::stop_token cancellation, const DispatchSettings& settings) -> async_context_t;
+
 // The function will return true if successful.
 [[nodiscard]] auto async_capture(AsyncCaptureContxt& context, CapturingCamera& camera, int queue_size) -> bool;
 
+// Return the statistics about the leases for the context (only relevant for make_async_lease_context).
+[[nodiscard]] auto lease_statistics(const AsyncCaptureContxt& context) -> LeaseStatistics;
+
+// Return the statistics about the workers queue for the context (only relevant for make_async_pool_context).
+[[nodiscard]] auto dispatch_statistics(const AsyncCaptureContxt& context) -> DispatchStatistics;
+
+// Return how the memory for the frames was allocated for this context. The buffers for the camera are allocated
+// from a single pool, that is locked in memory and using huge pages when they are available.
+// You can get the total memory that is used for capturing in this process with capture_memory().
+[[nodiscard]] auto pool_statistics(const AsyncCaptureContxt& context) -> PoolStatistics;
+
 // We would support software trigger mode with capture. There is an issue here with it:
 // This would only work with async mode, otherwise the trigger will not work.
 // So we will allocate internal buffers, then run this with its own context where we collect the data.
@@ -0,0 +1,365 @@
+#include "camera_group.hh"
+#include "camera_profile.hh"
+#include "camera_startup.hh"
+#include "log/logging.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+#include <algorithm>
+#include <limits>
+#include <iostream>
+
+namespace camera {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// A set of frames that is still waiting for some of the cameras
+struct PendingSet {
+    uint64_t key{0};                    // either the frame id (relative to the first frame) or the timestamp
+    clock_type::time_point created;
+    std::vector<FrameLease> frames;
+    std::size_t count{0};
+};
+
+// All the cameras in the group are using the same trigger configuration
+auto group_profile(const GroupSettings& settings) -> CameraProfile {
+    return CameraProfile{}
+        .set<features::PixelFormat>(settings.format)
+        .set<features::TriggerMode>(TriggerMode::On)
+        .set<features::TriggerSource>(to_trigger_source(settings.source))
+        .set<features::TriggerActivation>(settings.activation)
+        .set<features::AcquisitionMode>(AcquisitionMode::Continuous);
+}
+
+}       // end of local namespace
+
+struct CameraGroup {
+    struct Member {
+        std::shared_ptr<IdleCamera> idle;
+        std::shared_ptr<CapturingCamera> capturing;
+        async_context_t context;
+        std::optional<uint64_t> first_id;
+        MemberStatistics stats;
+        uint64_t skew_count{0};
+    };
+
+    CameraGroup(std::vector<std::shared_ptr<IdleCamera>>&& cameras, const GroupSettings& s) : settings{s}, members(cameras.size()) {
+        for (std::size_t i = 0; i < cameras.size(); i++) {
+            members[i].idle = std::move(cameras[i]);
+        }
+    }
+
+    ~CameraGroup() {
+        stop();
+    }
+
+    auto start(frame_set_f&& consumer, std::stop_token cancellation) -> bool;
+    auto stop() -> void;
+    auto statistics() const -> GroupStatistics;
+
+private:
+    // This is called from the camera threads
+    auto on_frame(std::size_t index, FrameLease frame) -> bool;
+    auto key_of(std::size_t index, const ImageView& image) -> uint64_t;
+    auto matching(const PendingSet& set, std::size_t index, uint64_t key) const -> bool;
+    auto is_late(uint64_t key) const -> bool;
+    auto finalize(PendingSet&& set, bool complete) -> void;
+    auto expire(clock_type::time_point now) -> void;
+    auto deliver() -> void;
+
+public:
+    const GroupSettings settings;
+    std::vector<Member> members;
+
+private:
+    mutable std::mutex guard;
+    std::condition_variable_any ready;
+    std::deque<PendingSet> pending;
+    std::deque<FrameSet> sets;          // waiting for the consumer
+    std::optional<uint64_t> last_key;   // the last set that we were done with
+    uint64_t sequence{0};
+    uint64_t complete_sets{0};
+    uint64_t incomplete_sets{0};
+    uint64_t dropped_sets{0};
+    frame_set_f consumer_op;
+    std::stop_source internal;
+    std::optional<std::stop_callback<std::function<void()>>> forward_stop;
+    std::jthread consumer;
+};
+
+auto CameraGroup::start(frame_set_f&& consumer_f, std::stop_token cancellation) -> bool {
+    if (consumer.joinable()) {
+        LOG(WARNING) << "the camera group is already running" << ENDL;
+        return false;
+    }
+    internal = std::stop_source{};
+    forward_stop.emplace(std::move(cancellation), std::function<void()>{[this]() {
+        internal.request_stop();
+    }});
+    consumer_op = std::move(consumer_f);
+    consumer = std::jthread([this]() {
+        deliver();
+    });
+    // the cameras are only started once everything is ready to accept frames
+    for (std::size_t i = 0; i < members.size(); i++) {
+        auto& m{members[i]};
+        m.capturing = From(std::move(m.idle));
+        m.context = make_async_lease_context(*m.capturing, [this, i](FrameLease frame) {
+            return on_frame(i, std::move(frame));
+        }, internal.get_token());
+        if (!m.context || !async_capture(*m.context, *m.capturing, settings.buffers)) {
+            LOG(ERROR) << "failed to start capture for camera number " << i << " in the group" << ENDL;
+            stop();
+            return false;
+        }
+    }
+    LOG(INFO) << "started capturing from " << members.size() << " cameras, matching by " << settings.match << ENDL;
+    return true;
+}
+
+auto CameraGroup::stop() -> void {
+    internal.request_stop();
+    for (auto&& m : members) {
+        m.context.reset();          // this is stopping the acquisition
+        if (m.capturing) {
+            m.idle = Back(std::move(m.capturing));
+        }
+    }
+    ready.notify_all();
+    if (consumer.joinable()) {
+        consumer.join();
+    }
+    std::lock_guard lock{guard};
+    while (!pending.empty()) {      // no one is going to complete these
+        auto set{std::move(pending.front())};
+        pending.pop_front();
+        finalize(std::move(set), false);
+    }
+    sets.clear();
+    forward_stop.reset();
+}
+
+auto CameraGroup::key_of(std::size_t index, const ImageView& image) -> uint64_t {
+    if (settings.match == MatchBy::Timestamp) {
+        return image.timestamp;
+    }
+    auto& m{members[index]};
+    if (!m.first_id) {
+        m.first_id = image.number;
+    }
+    return image.number - m.first_id.value();
+}
+
+auto CameraGroup::matching(const PendingSet& set, std::size_t index, uint64_t key) const -> bool {
+    if (!set.frames[index].empty()) {
+        return false;
+    }
+    if (settings.match == MatchBy::Timestamp) {
+        const uint64_t tolerance = std::chrono::nanoseconds{settings.tolerance}.count();
+        return (key > set.key ? key - set.key : set.key - key) <= tolerance;
+    }
+    return key == set.key;
+}
+
+auto CameraGroup::is_late(uint64_t key) const -> bool {
+    if (!last_key) {
+        return false;
+    }
+    if (settings.match == MatchBy::Timestamp) {
+        return key <= last_key.value() + std::chrono::nanoseconds{settings.tolerance}.count();
+    }
+    return key <= last_key.value();
+}
+
+auto CameraGroup::on_frame(std::size_t index, FrameLease frame) -> bool {
+    const auto now{clock_type::now()};
+    std::lock_guard lock{guard};
+    if (internal.stop_requested()) {
+        return false;
+    }
+    auto& m{members[index]};
+    ++m.stats.frames;
+    const auto key{key_of(index, frame.image())};
+    if (is_late(key)) {
+        ++m.stats.late;
+        return true;    // the lease is returned to the camera here
+    }
+    auto it{std::find_if(pending.begin(), pending.end(), [&](const auto& set) {
+        return matching(set, index, key);
+    })};
+    if (it == pending.end()) {
+        it = pending.insert(pending.end(), PendingSet{.key = key, .created = now, .frames = std::vector<FrameLease>(members.size())});
+    }
+    it->frames[index] = std::move(frame);
+    if (++it->count == members.size()) {
+        // the frames from each camera are arriving in order, so once a set is complete,
+        // there is no chance that any of the sets before it would get the missing frames
+        const auto done{std::distance(pending.begin(), it)};
+        for (decltype(pending)::difference_type i = 0; i <= done; i++) {
+            auto set{std::move(pending.front())};
+            pending.pop_front();
+            finalize(std::move(set), i == done);
+        }
+    }
+    expire(now);
+    return true;
+}
+
+auto CameraGroup::expire(clock_type::time_point now) -> void {
+    // don't let the pending sets hold too many of the camera buffers
+    const auto max_pending{std::max<std::size_t>(settings.buffers / 2, 1)};
+    while (!pending.empty() && (pending.front().created + settings.max_wait < now || pending.size() > max_pending)) {
+        auto set{std::move(pending.front())};
+        pending.pop_front();
+        finalize(std::move(set), false);
+    }
+}
+
+auto CameraGroup::finalize(PendingSet&& set, bool complete) -> void {
+    uint64_t earliest{std::numeric_limits<uint64_t>::max()};
+    for (auto&& f : set.frames) {
+        if (!f.empty()) {
+            earliest = std::min<uint64_t>(earliest, f.image().timestamp);
+        }
+    }
+    for (std::size_t i = 0; i < set.frames.size(); i++) {
+        auto& stats{members[i].stats};
+        if (set.frames[i].empty()) {
+            ++stats.missed;
+            continue;
+        }
+        const auto skew{set.frames[i].image().timestamp - earliest};
+        stats.max_skew = std::max(stats.max_skew, skew);
+        stats.mean_skew += (static_cast<double>(skew) - stats.mean_skew) / static_cast<double>(++members[i].skew_count);
+        if (complete) {
+            ++stats.matched;
+        }
+    }
+    last_key = last_key ? std::max(last_key.value(), set.key) : set.key;
+    if (complete) {
+        ++complete_sets;
+    } else {
+        ++incomplete_sets;
+        if (!settings.deliver_incomplete) {
+            return;     // the frames are returned to the cameras here
+        }
+    }
+    if (sets.size() >= std::max<std::size_t>(settings.queue_size, 1)) {
+        sets.pop_front();
+        ++dropped_sets;
+    }
+    sets.push_back(FrameSet{.sequence = sequence++, .timestamp = earliest, .frames = std::move(set.frames)});
+    ready.notify_one();
+}
+
+auto CameraGroup::deliver() -> void {
+    auto token{internal.get_token()};
+    while (!token.stop_requested()) {
+        FrameSet next;
+        {
+            std::unique_lock lock{guard};
+            if (!ready.wait(lock, token, [this]() { return !sets.empty(); })) {
+                return;
+            }
+            next = std::move(sets.front());
+            sets.pop_front();
+        }
+        if (!consumer_op(next)) {
+            LOG(INFO) << "consumer notify to stop the processing at set number " << next.sequence << ENDL;
+            internal.request_stop();
+        }
+    }
+}
+
+auto CameraGroup::statistics() const -> GroupStatistics {
+    std::lock_guard lock{guard};
+    GroupStatistics gs{.complete = complete_sets, .incomplete = incomplete_sets, .dropped = dropped_sets, .cameras = {}};
+    for (auto&& m : members) {
+        gs.cameras.push_back(m.stats);
+    }
+    return gs;
+}
+
+auto FrameSet::complete() const -> bool {
+    return missing() == 0;
+}
+
+auto FrameSet::missing() const -> std::size_t {
+    return std::count_if(frames.begin(), frames.end(), [](auto&& f) { return f.empty(); });
+}
+
+auto make_group(const context_type& ctx, const std::vector<DeviceInfo>& devices, const GroupSettings& settings) -> camera_group_t {
+    if (devices.empty()) {
+        LOG(ERROR) << "no cameras for the group" << ENDL;
+        return {};
+    }
+    std::vector<std::shared_ptr<IdleCamera>> cameras;
+    for (auto&& result : open_all(ctx, devices, group_profile(settings))) {
+        if (!result) {
+            LOG(ERROR) << "failed to open " << result << " for the camera group" << ENDL;
+            return {};
+        }
+        cameras.push_back(std::move(result.camera));
+    }
+    return std::make_shared<CameraGroup>(std::move(cameras), settings);
+}
+
+auto make_group(std::vector<std::shared_ptr<IdleCamera>>&& cameras, const GroupSettings& settings) -> camera_group_t {
+    if (cameras.empty()) {
+        LOG(ERROR) << "no cameras for the group" << ENDL;
+        return {};
+    }
+    const auto profile{group_profile(settings)};
+    for (auto&& camera : cameras) {
+        if (auto report = configure(*camera, profile); !report.ok) {
+            LOG(ERROR) << "failed to set the trigger configuration for the camera group: " << report << ENDL;
+            return {};
+        }
+    }
+    return std::make_shared<CameraGroup>(std::move(cameras), settings);
+}
+
+auto start(CameraGroup& group, frame_set_f&& consumer, std::stop_token cancellation) -> bool {
+    return group.start(std::move(consumer), std::move(cancellation));
+}
+
+auto stop(CameraGroup& group) -> void {
+    group.stop();
+}
+
+auto statistics(const CameraGroup& group) -> GroupStatistics {
+    return group.statistics();
+}
+
+auto size(const CameraGroup& group) -> std::size_t {
+    return group.members.size();
+}
+
+auto operator << (std::ostream& os, MatchBy mb) -> std::ostream& {
+    switch (mb) {
+    case MatchBy::FrameId:
+        return os << "frame id";
+    case MatchBy::Timestamp:
+        return os << "timestamp";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const MemberStatistics& ms) -> std::ostream& {
+    return os << "frames: " << ms.frames << ", matched: " << ms.matched << ", missed: " << ms.missed
+        << ", late: " << ms.late << ", skew max: " << ms.max_skew / 1000.0 << "us, mean: " << ms.mean_skew / 1000.0 << "us";
+}
+
+auto operator << (std::ostream& os, const GroupStatistics& gs) -> std::ostream& {
+    os << "complete sets: " << gs.complete << ", incomplete sets: " << gs.incomplete << ", dropped sets: " << gs.dropped;
+    for (std::size_t i = 0; i < gs.cameras.size(); i++) {
+        os << "\n\tcamera " << i << ": " << gs.cameras[i];
+    }
+    return os;
+}
+
+}   // end of namespace camera
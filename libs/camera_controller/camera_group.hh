@@ -0,0 +1,93 @@
+#pragma once
+#include "camera.hh"
+#include "cameras_context.hh"
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Capture from multiple cameras that are sharing the same hardware trigger.
+// The frames from all the cameras are matched, so that the application is getting a single
+// set of frames per trigger, one from each camera, instead of an unrelated callback per camera.
+// For example:
+// auto group = camera::make_group(ctx, camera::enumerate(*ctx), camera::GroupSettings{});
+// if (!group || !camera::start(*group, [](const camera::FrameSet& fs) { save(fs); return true; }, stop_source.get_token())) {
+//      std::cerr << "failed to start the group\n"; exit(1);
+// }
+// ...
+// camera::stop(*group);
+// std::cout << camera::statistics(*group) << "\n";
+
+namespace camera {
+
+enum class MatchBy : uint32_t {
+    FrameId,        // the frame numbers from the cameras are the same for the same trigger (relative to the first frame)
+    Timestamp       // the device timestamps are within the tolerance (the cameras clocks must be synchronized, i.e. PTP)
+};
+auto operator << (std::ostream& os, MatchBy mb) -> std::ostream&;
+
+struct GroupSettings {
+    HardWareTriggerSource source{HardWareTriggerSource::Line0};
+    ActivationMode activation{ActivationMode::RisingEdge};
+    PixelFormat format{PixelFormat::RawRGGB8};
+    MatchBy match{MatchBy::Timestamp};
+    std::chrono::microseconds tolerance{1000};      // max difference between the timestamps of the same trigger
+    std::chrono::milliseconds max_wait{500};        // after this time we are not waiting for missing frames
+    int buffers{static_cast<int>(DEFAULT_NUMBER_OF_BUFFERS)};   // per camera
+    std::size_t queue_size{4};                      // number of sets that can wait for the consumer
+    bool deliver_incomplete{false};                 // pass sets with missing frames to the consumer
+};
+
+// The frames from all the cameras in the group for a single trigger.
+// The frames are in the same order as the devices that were passed to make_group.
+// Note that the frames are leases on the camera buffers, so if you need to keep them
+// after returning from the callback, just copy the lease (not the image).
+struct FrameSet {
+    uint64_t sequence{0};           // running number of the sets that were matched
+    uint64_t timestamp{0};          // the earliest device timestamp in the set
+    std::vector<FrameLease> frames; // empty lease for a camera that missed this trigger
+
+    auto complete() const -> bool;
+    auto missing() const -> std::size_t;
+};
+using frame_set_f = std::function<bool(const FrameSet&)>;
+
+struct MemberStatistics {
+    uint64_t frames{0};             // frames that we got from the camera
+    uint64_t matched{0};            // frames that were part of a complete set
+    uint64_t missed{0};             // sets that this camera was missing from
+    uint64_t late{0};               // frames that arrived after their set was already delivered
+    uint64_t max_skew{0};           // in nanoseconds, from the earliest frame in the set
+    double mean_skew{0};            // in nanoseconds
+};
+
+struct GroupStatistics {
+    uint64_t complete{0};           // sets that were delivered with all the frames
+    uint64_t incomplete{0};         // sets that had at least one missing frame
+    uint64_t dropped{0};            // sets that were dropped since the consumer was too slow
+    std::vector<MemberStatistics> cameras;
+};
+
+auto operator << (std::ostream& os, const MemberStatistics& ms) -> std::ostream&;
+auto operator << (std::ostream& os, const GroupStatistics& gs) -> std::ostream&;
+
+struct CameraGroup;
+using camera_group_t = std::shared_ptr<CameraGroup>;
+
+// Open all the devices, and set them to the same hardware trigger configuration.
+// This would return nullptr if we failed to open any of them.
+[[nodiscard]] auto make_group(const context_type& ctx, const std::vector<DeviceInfo>& devices, const GroupSettings& settings) -> camera_group_t;
+// Same as above, for cameras that are already open.
+[[nodiscard]] auto make_group(std::vector<std::shared_ptr<IdleCamera>>&& cameras, const GroupSettings& settings) -> camera_group_t;
+
+// Start capturing from all the cameras. The consumer is called from a single thread (not the cameras threads),
+// and should return false to stop the capture.
+[[nodiscard]] auto start(CameraGroup& group, frame_set_f&& consumer, std::stop_token cancellation) -> bool;
+auto stop(CameraGroup& group) -> void;
+[[nodiscard]] auto statistics(const CameraGroup& group) -> GroupStatistics;
+[[nodiscard]] auto size(const CameraGroup& group) -> std::size_t;
+
+}   // end of namespace camera
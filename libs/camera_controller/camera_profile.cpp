@@ -0,0 +1,160 @@
+#include "camera_profile.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <iostream>
+
+namespace camera {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// The camera may round the floating point values to its own resolution, so we are not expecting to read back the exact value
+constexpr double FLOAT_TOLERANCE = 1e-6;
+
+auto same(const features::value_t& left, const features::value_t& right) -> bool {
+    if (auto l = std::get_if<double>(&left), r = std::get_if<double>(&right); l && r) {
+        return std::abs(*l - *r) <= FLOAT_TOLERANCE * std::max({1.0, std::abs(*l), std::abs(*r)});
+    }
+    return left == right;
+}
+
+auto same(const std::optional<features::value_t>& left, const std::optional<features::value_t>& right) -> bool {
+    return left.has_value() == right.has_value() && (!left || same(left.value(), right.value()));
+}
+
+auto print(std::ostream& os, const features::value_t& value) -> std::ostream& {
+    std::visit([&os](auto&& v) { os << v; }, value);
+    return os;
+}
+
+auto writable(const features::Info& feature) -> bool {
+    return feature.access == features::Access::Idle || feature.access == features::Access::Live;
+}
+
+auto since(clock_type::time_point start) -> std::chrono::microseconds {
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start);
+}
+
+}       // end of local namespace
+
+auto CameraProfile::size() const -> std::size_t {
+    return std::count_if(values.begin(), values.end(), [](auto&& v) { return v.has_value(); });
+}
+
+auto operator == (const CameraProfile& left, const CameraProfile& right) -> bool {
+    for (std::size_t i = 0; i < features::COUNT; i++) {
+        if (!same(left.values[i], right.values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto operator << (std::ostream& os, const CameraProfile& profile) -> std::ostream& {
+    os << "{";
+    const char* sep{""};
+    for (std::size_t i = 0; i < features::COUNT; i++) {
+        if (const auto& v = profile.values[i]; v) {
+            os << sep << features::info[i].name << ": ";
+            print(os, v.value());
+            sep = ", ";
+        }
+    }
+    return os << "}";
+}
+
+auto operator << (std::ostream& os, const ProfileReport& report) -> std::ostream& {
+    os << (report.ok ? "success" : "failed") << ", reads: " << report.reads << ", writes: " << report.writes
+        << ", skipped: " << report.skipped << ", took " << report.duration.count() << "us";
+    if (!report.ok) {
+        os << ", failed to write " << (report.failed ? report.failed : "unknown") << ", rolled back: " << report.rolled_back;
+    }
+    return os;
+}
+
+auto read_profile(IdleCamera& camera) -> CameraProfile {
+    CameraProfile profile;
+    for (std::size_t i = 0; i < features::COUNT; i++) {
+        if (const auto& feature{features::info[i]}; writable(feature)) {
+            profile.values[i] = features::detail::read(camera, i, feature.name, feature.kind);
+        }
+    }
+    return profile;
+}
+
+auto diff(const CameraProfile& current, const CameraProfile& target) -> CameraProfile {
+    CameraProfile changes;
+    for (std::size_t i = 0; i < features::COUNT; i++) {
+        if (const auto& v = target.values[i]; v && !(current.values[i] && same(current.values[i].value(), v.value()))) {
+            changes.values[i] = v;
+        }
+    }
+    return changes;
+}
+
+auto configure(IdleCamera& camera, const CameraProfile& target, const CameraProfile& current) -> ProfileReport {
+    const auto start{clock_type::now()};
+    const auto changes{diff(current, target)};
+    ProfileReport report;
+    report.skipped = target.size() - changes.size();
+    std::vector<std::size_t> written;
+    for (std::size_t i = 0; i < features::COUNT && report.ok; i++) {
+        if (const auto& v = changes.values[i]; v) {
+            if (features::detail::write(camera, i, features::info[i].name, v.value())) {
+                written.push_back(i);
+                ++report.writes;
+            } else {
+                report.ok = false;
+                report.failed = features::info[i].name;
+            }
+        }
+    }
+    if (!report.ok) {
+        // restore the values in the reverse order, so the dependencies between the features are kept
+        for (auto i = written.rbegin(); i != written.rend(); ++i) {
+            if (const auto& previous = current.values[*i]; previous && features::detail::write(camera, *i, features::info[*i].name, previous.value())) {
+                ++report.rolled_back;
+            } else {
+                LOG(WARNING) << "failed to restore the value of " << features::info[*i].name << " while rolling back the camera configuration" << ENDL;
+            }
+        }
+    }
+    report.duration = since(start);
+    return report;
+}
+
+auto configure(IdleCamera& camera, const CameraProfile& target) -> ProfileReport {
+    const auto start{clock_type::now()};
+    CameraProfile current;
+    std::size_t reads{0};
+    for (std::size_t i = 0; i < features::COUNT; i++) {
+        if (target.values[i]) {
+            current.values[i] = features::detail::read(camera, i, features::info[i].name, features::info[i].kind);
+            ++reads;
+        }
+    }
+    auto report{configure(camera, target, current)};
+    report.reads = reads;
+    report.duration = since(start);
+    return report;
+}
+
+auto default_software_profile(ActivationMode am) -> CameraProfile {
+    return CameraProfile{}
+        .set<features::PixelFormat>(PixelFormat::RawRGGB8)
+        .set<features::TriggerMode>(TriggerMode::On)
+        .set<features::TriggerSource>(TriggerSource::Software)
+        .set<features::TriggerActivation>(am)
+        .set<features::AcquisitionMode>(AcquisitionMode::Continuous)
+        .set<features::ExposureMode>(ExposureMode::Timed)
+        .set<features::ExposureAuto>(ExposureAuto::Continuous)
+        .set<features::BalanceWhiteAuto>(ExposureAuto::Once);
+}
+
+auto default_hardware_profile(HardWareTriggerSource source, ActivationMode am) -> CameraProfile {
+    return default_software_profile(am).set<features::TriggerSource>(to_trigger_source(source));
+}
+
+}   // end of namespace camera
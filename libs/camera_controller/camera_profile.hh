@@ -0,0 +1,89 @@
+#pragma once
+#include "camera.hh"
+#include "features.hh"
+#include <array>
+#include <optional>
+#include <chrono>
+#include <iosfwd>
+#include <stdint.h>
+
+// A complete configuration for the camera, that is applied as a single batch.
+// Instead of writing each setting to the camera one after the other (each one is a round trip to the device),
+// we are reading what the camera has, and only writing the values that are different, in the order of the
+// features table (see features.hh). If we failed to write any of them, the values that we already wrote are
+// restored, so the camera is left in the same state that it was before.
+// For example:
+// auto profile{camera::CameraProfile{}
+//      .set<camera::features::ExposureAuto>(camera::ExposureAuto::Off)
+//      .set<camera::features::ExposureTime>(12000.0)};
+// if (auto report = camera::configure(camera, profile); !report.ok) {
+//      std::cerr << "failed to configure the camera: " << report << "\n";
+// }
+
+namespace camera {
+
+struct CameraProfile {
+    template<typename F>
+    auto set(typename F::value_type value) -> CameraProfile& {
+        static_assert(F::access == features::Access::Idle || F::access == features::Access::Live, "only features that we can write can be part of a profile");
+        values[F::index] = features::detail::encode<F>(value);
+        return *this;
+    }
+
+    template<typename F>
+    auto get() const -> std::optional<typename F::value_type> {
+        if (const auto& v = values[F::index]; v) {
+            return features::detail::decode<F>(v.value());
+        }
+        return {};
+    }
+
+    template<typename F>
+    auto erase() -> CameraProfile& {
+        values[F::index].reset();
+        return *this;
+    }
+
+    // Number of features that are set in this profile
+    auto size() const -> std::size_t;
+    auto empty() const -> bool {
+        return size() == 0;
+    }
+
+    // The values are indexed by the feature index, so this is only valid for the features in features::all
+    std::array<std::optional<features::value_t>, features::COUNT> values;
+};
+
+auto operator << (std::ostream& os, const CameraProfile& profile) -> std::ostream&;
+auto operator == (const CameraProfile& left, const CameraProfile& right) -> bool;
+
+struct ProfileReport {
+    bool ok{true};
+    std::size_t reads{0};           // the values that we read from the camera in order to find what we need to change
+    std::size_t writes{0};          // the values that we wrote to the camera (not including the rollback)
+    std::size_t skipped{0};         // the camera already had these values
+    std::size_t rolled_back{0};
+    const char* failed{nullptr};    // the name of the feature that we failed to write
+    std::chrono::microseconds duration{0};
+};
+
+auto operator << (std::ostream& os, const ProfileReport& report) -> std::ostream&;
+
+// Read all the features that we can write from the camera. The features that we failed to read are not set.
+[[nodiscard]] auto read_profile(IdleCamera& camera) -> CameraProfile;
+
+// Return the values from the target that are not the same in current (including the values that are not set in current).
+[[nodiscard]] auto diff(const CameraProfile& current, const CameraProfile& target) -> CameraProfile;
+
+// Read the features that are set in the target from the camera, and write only the ones that are different.
+[[nodiscard]] auto configure(IdleCamera& camera, const CameraProfile& target) -> ProfileReport;
+
+// The same as above, when we already know what the camera has (for example from a previous read_profile),
+// so we are not reading it again. Note that if current is wrong, we may skip a value that we need to write.
+[[nodiscard]] auto configure(IdleCamera& camera, const CameraProfile& target, const CameraProfile& current) -> ProfileReport;
+
+// These are the profiles for set_default_software_mode and set_default_hardware_mode
+[[nodiscard]] auto default_software_profile(ActivationMode am) -> CameraProfile;
+[[nodiscard]] auto default_hardware_profile(HardWareTriggerSource source, ActivationMode am) -> CameraProfile;
+
+}   // end of namespace camera
@@ -19,8 +19,14 @@ auto operator << (std::ostream& os, ExposureMode ea) -> std::ostream& {
 }
 
 auto operator << (std::ostream& os, ExposureAuto ea) -> std::ostream& {
-    return os << (ea == ExposureAuto::Continuous ? 
-                "Continuous" : ea == ExposureAuto::Once ? "Once" :  "Off");
+    return os << to_string(ea);
+}
+
+auto operator << (std::ostream& os, TriggerMode tm) -> std::ostream& {
+    return os << to_string(tm);
+}
 
+auto operator << (std::ostream& os, TriggerSource ts) -> std::ostream& {
+    return os << to_string(ts);
 }
 }       // end of namespace camera
\ No newline at end of file
@@ -58,6 +58,25 @@ enum class ExposureAuto : uint32_t {
 };
 auto operator << (std::ostream& os, ExposureAuto ea) -> std::ostream&;
 
+enum class TriggerMode : uint32_t {
+    Off,
+    On
+};
+auto operator << (std::ostream& os, TriggerMode tm) -> std::ostream&;
+
+// The source for the trigger - either the software trigger command, or one of the hardware lines
+enum class TriggerSource : uint32_t {
+    Software,
+    Line0, Line1, Line2,
+    Line3, Line4, Line5,
+    Line6, Line7, Line8,
+    Line9, Line10, Line11,
+    Line12, Line13, Line14,
+    Line15, Line16, Line17,
+    Line18, Line19, Line20
+};
+auto operator << (std::ostream& os, TriggerSource ts) -> std::ostream&;
+
 inline constexpr auto to_string(ActivationMode src) -> const char* {
     switch (src) {            
         case ActivationMode::FallingEdge:
@@ -83,7 +102,7 @@ inline constexpr auto to_string(ExposureMode em) -> const char* {
         case ExposureMode::TriggerControlled:
             return "TriggerControlled";
         case ExposureMode::TriggerWidth:
-            return "ExposureMode";
+            return "TriggerWidth";
         default:
             return "Off";
     }
@@ -151,4 +170,31 @@ inline constexpr auto to_string(AcquisitionMode mode) {
     }
 }
 
+constexpr auto to_trigger_source(HardWareTriggerSource src) -> TriggerSource {
+    return static_cast<TriggerSource>(static_cast<uint32_t>(src) + 1);
+}
+
+inline constexpr auto to_string(TriggerMode tm) -> const char* {
+    return tm == TriggerMode::On ? "On" : "Off";
+}
+
+inline constexpr auto to_string(TriggerSource ts) -> const char* {
+    if (ts == TriggerSource::Software) {
+        return "Software";
+    }
+    return to_string(static_cast<HardWareTriggerSource>(static_cast<uint32_t>(ts) - 1));
+}
+
+inline constexpr auto to_string(ExposureAuto ea) -> const char* {
+    switch (ea) {
+        case ExposureAuto::Once:
+            return "Once";
+        case ExposureAuto::Continuous:
+            return "Continuous";
+        case ExposureAuto::Off:
+        default:
+            return "Off";
+    }
+}
+
 }       // end of namespace camera
\ No newline at end of file
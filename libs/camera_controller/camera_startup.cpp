@@ -0,0 +1,119 @@
+#include "camera_startup.hh"
+#include "log/logging.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+
+namespace camera {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+auto since(clock_type::time_point start) -> std::chrono::microseconds {
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start);
+}
+
+// This is shared with the threads that are opening the cameras, since a thread that
+// timed out may still be running after open_all has returned.
+struct Startup {
+    explicit Startup(const std::vector<DeviceInfo>& devices) : results(devices.size()), done(devices.size(), false) {
+        for (std::size_t i = 0; i < devices.size(); i++) {
+            results[i].device = devices[i];
+        }
+    }
+
+    auto finish(std::size_t index, OpenResult&& result) -> void {
+        std::lock_guard lock{guard};
+        if (abandoned) {
+            LOG(WARNING) << "camera " << result.device.id << " finished opening after the timeout with status " << result.status << ", releasing it" << ENDL;
+            return;
+        }
+        results[index] = std::move(result);
+        done[index] = true;
+        notify.notify_all();
+    }
+
+    std::mutex guard;
+    std::condition_variable notify;
+    std::vector<OpenResult> results;
+    std::vector<bool> done;
+    bool abandoned{false};
+};
+
+auto open_one(const Context& ctx, const DeviceInfo& device, const CameraProfile& profile) -> OpenResult {
+    OpenResult result;
+    result.device = device;
+    const auto start{clock_type::now()};
+    auto camera{create(ctx, device)};
+    result.open_time = since(start);
+    if (!camera) {
+        result.status = OpenStatus::OpenFailed;
+        return result;
+    }
+    const auto configure_start{clock_type::now()};
+    result.configuration = configure(*camera, profile);
+    result.configure_time = since(configure_start);
+    if (!result.configuration.ok) {
+        result.status = OpenStatus::ConfigureFailed;
+        return result;
+    }
+    result.status = OpenStatus::Ok;
+    result.camera = std::move(camera);
+    return result;
+}
+
+}       // end of local namespace
+
+auto open_all(const context_type& ctx, const std::vector<DeviceInfo>& devices, const CameraProfile& profile,
+                std::chrono::milliseconds timeout) -> std::vector<OpenResult> {
+    const auto start{clock_type::now()};
+    auto state{std::make_shared<Startup>(devices)};
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        // the threads are detached, so a camera that is stuck will not block us from returning, and they may
+        // outlive the caller, so they are holding the context as well
+        std::thread([state, i, ctx, device = devices[i], profile]() {
+            state->finish(i, open_one(*ctx, device, profile));
+        }).detach();
+    }
+    std::unique_lock lock{state->guard};
+    state->notify.wait_until(lock, start + timeout, [&state]() {
+        return std::all_of(state->done.begin(), state->done.end(), [](bool d) { return d; });
+    });
+    state->abandoned = true;
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        if (!state->done[i]) {
+            LOG(ERROR) << "timeout while opening camera " << devices[i].id << " after " << timeout.count() << "ms" << ENDL;
+            state->results[i].open_time = since(start);
+        }
+    }
+    const auto opened{std::count_if(state->results.begin(), state->results.end(), [](auto&& r) { return bool(r); })};
+    LOG(INFO) << "opened " << opened << " out of " << devices.size() << " cameras in " << since(start).count() << "us" << ENDL;
+    return std::move(state->results);
+}
+
+auto operator << (std::ostream& os, OpenStatus status) -> std::ostream& {
+    switch (status) {
+    case OpenStatus::Ok:
+        return os << "ok";
+    case OpenStatus::OpenFailed:
+        return os << "open failed";
+    case OpenStatus::ConfigureFailed:
+        return os << "configure failed";
+    case OpenStatus::Timeout:
+        return os << "timeout";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const OpenResult& result) -> std::ostream& {
+    os << result.device.id << ": " << result.status << ", open took " << result.open_time.count() << "us";
+    if (result.status == OpenStatus::Ok || result.status == OpenStatus::ConfigureFailed) {
+        os << ", configure took " << result.configure_time.count() << "us (" << result.configuration << ")";
+    }
+    return os;
+}
+
+}   // end of namespace camera
@@ -0,0 +1,54 @@
+#pragma once
+#include "camera.hh"
+#include "camera_profile.hh"
+#include "cameras_context.hh"
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <iosfwd>
+#include <stdint.h>
+
+// Open and configure all the cameras at the same time. Opening a camera is mostly waiting for the device
+// (the connection and the packet size negotiation), so doing this one camera after the other means that the
+// startup time is growing with the number of cameras.
+// For example:
+// auto results{camera::open_all(ctx, camera::enumerate(*ctx), camera::default_hardware_profile(source, am))};
+// for (auto&& r : results) {
+//      std::cout << r << "\n";
+//      if (r) { cameras.push_back(std::move(r.camera)); }
+// }
+
+namespace camera {
+
+constexpr auto DEFAULT_OPEN_TIMEOUT = std::chrono::milliseconds{10'000};
+
+enum class OpenStatus : uint32_t {
+    Ok,
+    OpenFailed,         // we failed to open the camera, or to negotiate the packet size
+    ConfigureFailed,    // the camera is open, but we failed to apply the profile
+    Timeout             // the camera didn't finish in time, it is left to finish in the background and then released
+};
+auto operator << (std::ostream& os, OpenStatus status) -> std::ostream&;
+
+struct OpenResult {
+    DeviceInfo device;
+    std::shared_ptr<IdleCamera> camera;     // only set if the status is Ok
+    OpenStatus status{OpenStatus::Timeout};
+    std::chrono::microseconds open_time{0};         // including the packet size negotiation
+    std::chrono::microseconds configure_time{0};
+    ProfileReport configuration;
+
+    explicit operator bool () const {
+        return status == OpenStatus::Ok;
+    }
+};
+auto operator << (std::ostream& os, const OpenResult& result) -> std::ostream&;
+
+// Open all the devices concurrently, and apply the profile to each one of them (an empty profile is not writing anything).
+// The results are in the same order as the devices. We are not waiting for more than the timeout for any of the cameras,
+// so one camera that is not responding is not blocking the others. A camera that timed out is still opening in the
+// background, so it is keeping its own copy of the context.
+[[nodiscard]] auto open_all(const context_type& ctx, const std::vector<DeviceInfo>& devices, const CameraProfile& profile,
+                std::chrono::milliseconds timeout = DEFAULT_OPEN_TIMEOUT) -> std::vector<OpenResult>;
+
+}   // end of namespace camera
@@ -1,10 +1,16 @@
 #include "cameras_context.hh"
 #include "log/logging.h"
-#include "vmb_common/ErrorCodeToMessage.h"
-#include <VimbaCPP/Include/VimbaCPP.h>
+#if defined(BUILD_WITH_VIMBA_SDK)
+#   include "vmb_common/ErrorCodeToMessage.h"
+#   include <VimbaCPP/Include/VimbaCPP.h>
+#elif defined(BUILD_WITH_SIMULATED_CAMERA)
+#   include "simulator/simulated_system.hpp"
+#endif
+#include <iostream>
 
 namespace camera {
 
+#if defined(BUILD_WITH_VIMBA_SDK)
 using namespace AVT::VmbAPI;
 
 struct Context {
@@ -31,10 +37,6 @@ auto make_context() -> std::variant<context_type, error_type> {
     return {std::make_shared<Context>()};
 }
 
-auto stop(Context& ctx) -> bool {
-    return ctx.stop();
-}
-
 auto enumerate(Context& ctx) -> std::vector<DeviceInfo> {
     CameraPtrVector cameras;
     if (auto e = VimbaSystem::GetInstance().GetCameras(cameras); e != VmbErrorSuccess || cameras.empty()) {
@@ -53,10 +55,56 @@ auto enumerate(Context& ctx) -> std::vector<DeviceInfo> {
     return output;
 }
 
+#elif defined(BUILD_WITH_SIMULATED_CAMERA)
+
+struct Context {
+
+    ~Context() {
+        stop();
+    }
+
+    static auto stop() -> bool {
+        LOG(INFO) << "Closing the simulated cameras context" << ENDL;
+        return simulator::System::instance().shutdown();
+    }
+};
+
+auto make_simulated_context(const simulator::Settings& settings) -> std::variant<context_type, error_type> {
+    if (!simulator::System::instance().startup(settings)) {
+        return {std::string{"failed to start the simulated cameras"}};
+    }
+    LOG(INFO) << "successfully setup the simulated cameras context: " << settings << ENDL;
+    return {std::make_shared<Context>()};
+}
+
+auto make_context() -> std::variant<context_type, error_type> {
+    return make_simulated_context(simulator::Settings::from_environment());
+}
+
+auto enumerate(Context&) -> std::vector<DeviceInfo> {
+    const auto cameras{simulator::System::instance().cameras()};
+    if (cameras.empty()) {
+        LOG(ERROR) << "failed to get cameras list - no simulated camera" << ENDL;
+        return {};
+    }
+    LOG(INFO) << "successfully found " << cameras.size() << " simulated cameras on this host" << ENDL;
+    std::vector<DeviceInfo> output;
+    for (auto&& camera : cameras) {
+        output.push_back(camera->device_info());
+    }
+    return output;
+}
+
+#endif  // BUILD_WITH_VIMBA_SDK
+
+auto stop(Context& ctx) -> bool {
+    return ctx.stop();
+}
+
 auto operator << (std::ostream& os, const DeviceInfo& dev) -> std::ostream& {
-    return os << "device id: " << dev.id 
+    return os << "device id: " << dev.id
         << "\n\tinterface id: " << dev.interface_id
         << "\n\tmodel: " << dev.mode;
 }
 
-}   // end of namespace camera
\ No newline at end of file
+}   // end of namespace camera
@@ -11,6 +11,8 @@ using capture_context_t = std::shared_ptr<CaptureContext>;
 struct AsyncCaptureContxt;
 using async_context_t = std::shared_ptr<AsyncCaptureContxt>;
 using frame_processing_f = std::function<bool(ImageView)>;
+struct FrameLease;
+using frame_lease_f = std::function<bool(FrameLease)>;
 struct SoftwareCaptureContxt;
 using software_context_t = std::shared_ptr<SoftwareCaptureContxt>;
 
@@ -0,0 +1,80 @@
+#include "command_wait.hh"
+#include <mutex>
+#include <map>
+#include <iostream>
+
+namespace camera {
+namespace {
+
+struct Registry {
+    std::mutex guard;
+    std::map<std::string, CommandStatistics, std::less<>> commands;
+};
+
+auto registry() -> Registry& {
+    static Registry r;
+    return r;
+}
+
+}       // end of local namespace
+
+namespace detail {
+
+auto record_command(const char* name, CommandResult result, std::chrono::microseconds duration, uint64_t polls) -> void {
+    auto& r{registry()};
+    std::lock_guard lock{r.guard};
+    auto i{r.commands.find(std::string_view{name})};
+    if (i == r.commands.end()) {
+        i = r.commands.emplace(name, CommandStatistics{.name = name}).first;
+    }
+    auto& stats{i->second};
+    ++stats.runs;
+    stats.polls += polls;
+    stats.last = duration;
+    stats.max = std::max(stats.max, duration);
+    switch (result) {
+    case CommandResult::Done:
+        stats.total += duration;
+        break;
+    case CommandResult::Timeout:
+        ++stats.timeouts;
+        break;
+    default:
+        ++stats.failures;
+        break;
+    }
+}
+
+}   // end of namespace detail
+
+auto command_statistics() -> std::vector<CommandStatistics> {
+    auto& r{registry()};
+    std::lock_guard lock{r.guard};
+    std::vector<CommandStatistics> output;
+    for (auto&& [name, stats] : r.commands) {
+        output.push_back(stats);
+    }
+    return output;
+}
+
+auto operator << (std::ostream& os, CommandResult result) -> std::ostream& {
+    switch (result) {
+    case CommandResult::Done:
+        return os << "done";
+    case CommandResult::Timeout:
+        return os << "timeout";
+    case CommandResult::Failed:
+        return os << "failed";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const CommandStatistics& cs) -> std::ostream& {
+    const auto completed{cs.runs - cs.timeouts - cs.failures};
+    return os << cs.name << ": runs " << cs.runs << ", timeouts " << cs.timeouts << ", failures " << cs.failures
+        << ", polls " << cs.polls << ", last " << cs.last.count() << "us, max " << cs.max.count() << "us, mean "
+        << (completed ? cs.total.count() / completed : 0) << "us";
+}
+
+}   // end of namespace camera
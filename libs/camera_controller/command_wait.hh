@@ -0,0 +1,80 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <iosfwd>
+#include <stdint.h>
+
+// Wait for a GenICam command to complete. Some commands (the packet size negotiation for example) take
+// a long time on the device, and the only way to know that they are done is to poll the device.
+// Instead of polling in a loop (that is taking a full core), we are sleeping between the polls, with
+// a sleep that is getting longer each time, and we are giving up at the deadline.
+
+namespace camera {
+
+constexpr auto DEFAULT_COMMAND_TIMEOUT = std::chrono::milliseconds{2'000};
+
+enum class CommandResult : uint32_t {
+    Done,
+    Timeout,
+    Failed          // we failed to run the command, or to read whether it is done
+};
+auto operator << (std::ostream& os, CommandResult result) -> std::ostream&;
+
+// How long each command took, for all the cameras in this process
+struct CommandStatistics {
+    std::string name;
+    uint64_t runs{0};
+    uint64_t timeouts{0};
+    uint64_t failures{0};
+    uint64_t polls{0};                      // the number of times that we checked whether the command is done
+    std::chrono::microseconds last{0};
+    std::chrono::microseconds max{0};
+    std::chrono::microseconds total{0};     // only for the commands that are done
+};
+auto operator << (std::ostream& os, const CommandStatistics& cs) -> std::ostream&;
+[[nodiscard]] auto command_statistics() -> std::vector<CommandStatistics>;
+
+namespace detail {
+auto record_command(const char* name, CommandResult result, std::chrono::microseconds duration, uint64_t polls) -> void;
+}   // end of namespace detail
+
+constexpr auto FIRST_COMMAND_POLL = std::chrono::microseconds{20};
+constexpr auto MAX_COMMAND_POLL = std::chrono::milliseconds{5};
+
+// The run function-like should return true if the command was started, and is_done should return
+// false if we failed to read the state of the command, otherwise it should set done.
+template<typename Run, typename IsDone>
+auto run_and_wait(const char* name, Run&& run, IsDone&& is_done, std::chrono::milliseconds timeout) -> CommandResult {
+    using clock_type = std::chrono::steady_clock;
+
+    const auto start{clock_type::now()};
+    const auto deadline{start + timeout};
+    const auto done_with = [&](CommandResult result, uint64_t polls) {
+        detail::record_command(name, result, std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start), polls);
+        return result;
+    };
+    if (!run()) {
+        return done_with(CommandResult::Failed, 0);
+    }
+    std::chrono::microseconds sleep{FIRST_COMMAND_POLL};
+    for (uint64_t polls = 1; ; polls++) {
+        bool done{false};
+        if (!is_done(done)) {
+            return done_with(CommandResult::Failed, polls);
+        }
+        if (done) {
+            return done_with(CommandResult::Done, polls);
+        }
+        const auto now{clock_type::now()};
+        if (now >= deadline) {
+            return done_with(CommandResult::Timeout, polls);
+        }
+        std::this_thread::sleep_for(std::min<clock_type::duration>(sleep, deadline - now));
+        sleep = std::min<std::chrono::microseconds>(sleep * 2, MAX_COMMAND_POLL);
+    }
+}
+
+}   // end of namespace camera
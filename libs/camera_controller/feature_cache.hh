@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <stdint.h>
+
+namespace camera {
+
+// Keep the handles for the camera features, so that we are only looking them up by name once per camera.
+// The lookup itself is backend specific, so it is passed as a function-like that return an empty handle on failure.
+// This is shared between the idle and the capture mode of the camera, so we are not losing the handles when we are switching.
+// The features that are known at compile time (see features.hh) are kept in a fixed slot by their index, so we are not
+// even hashing the name for them.
+template<typename Handle>
+struct FeatureCache {
+    using resolve_f = std::function<Handle(const char*)>;
+
+    explicit FeatureCache(resolve_f r, std::size_t slots_count = 0) : resolver{std::move(r)}, slots(slots_count) {
+
+    }
+
+    FeatureCache(const FeatureCache&) = delete;
+    auto operator = (const FeatureCache&) -> FeatureCache& = delete;
+
+    // Return an empty handle if we failed to find the feature
+    auto get(const char* name) -> Handle {
+        std::lock_guard lock{guard};
+        if (auto i = handles.find(std::string_view{name}); i != handles.end()) {
+            ++hits;
+            return i->second;
+        }
+        auto handle{resolver(name)};
+        if (handle) {       // don't keep the failures, we may succeed next time
+            ++lookups;
+            handles.emplace(name, handle);
+        }
+        return handle;
+    }
+
+    // The same as above, but the handle is kept at a fixed slot, note that the name is only used for the first lookup
+    auto get(std::size_t index, const char* name) -> Handle {
+        std::lock_guard lock{guard};
+        if (index >= slots.size()) {
+            return {};
+        }
+        if (slots[index]) {
+            ++hits;
+            return slots[index];
+        }
+        auto handle{resolver(name)};
+        if (handle) {
+            ++lookups;
+            slots[index] = handle;
+        }
+        return handle;
+    }
+
+    auto clear() -> void {
+        std::lock_guard lock{guard};
+        handles.clear();
+        std::fill(slots.begin(), slots.end(), Handle{});
+    }
+
+    // Number of times we had to resolve the feature by name, and number of times we used a cached handle
+    auto statistics() const -> std::pair<uint64_t, uint64_t> {
+        std::lock_guard lock{guard};
+        return {lookups, hits};
+    }
+
+private:
+    struct NameHash {
+        using is_transparent = void;
+        auto operator () (std::string_view name) const -> std::size_t {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    resolve_f resolver;
+    mutable std::mutex guard;
+    std::unordered_map<std::string, Handle, NameHash, std::equal_to<>> handles;
+    std::vector<Handle> slots;
+    uint64_t lookups{0};
+    uint64_t hits{0};
+};
+
+}   // end of namespace camera
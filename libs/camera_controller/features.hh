@@ -0,0 +1,294 @@
+#pragma once
+#include "camera_settings.hh"
+#include "image.hh"
+#include <array>
+#include <tuple>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <optional>
+#include <utility>
+#include <type_traits>
+#include <chrono>
+#include <stdint.h>
+
+// Typed access to the GenICam features of the camera.
+// Each feature is described at compile time with its name, the type of its value and whether we can write it,
+// so for example, this would not compile:
+// set<features::ExposureTime>(camera, "12000");     // wrong type
+// set<features::PayloadSize>(camera, 100);          // read only feature
+// set<features::PixelFormat>(capturing, ...);       // cannot change the format while capturing
+// and the correct way:
+// if (!camera::set<camera::features::ExposureTime>(camera, 12000.0)) { ... }
+// auto size{camera::get<camera::features::PayloadSize>(camera)};
+// Since each feature has a fixed index, the handle for the feature is looked up by the index and not by the name.
+
+namespace camera {
+
+struct IdleCamera;
+struct CapturingCamera;
+
+namespace features {
+
+enum class FeatureKind : uint32_t {
+    Integer,
+    Float,
+    Boolean,
+    Enumeration,
+    Format,         // the pixel format, which is an enumeration, but each SDK has its own mapping for it
+    Command
+};
+
+enum class Access : uint32_t {
+    ReadOnly,
+    Idle,           // can only be changed when we are not capturing
+    Live,           // can be changed while capturing
+    Execute         // this is a command
+};
+
+// The allowed values for each of the enumerations that we are using as feature values
+template<typename E>
+struct enum_entries;
+
+namespace detail {
+template<typename E, std::size_t... I>
+constexpr auto sequence(std::index_sequence<I...>) -> std::array<E, sizeof...(I)> {
+    return {static_cast<E>(I)...};
+}
+
+template<typename E, std::size_t N>
+constexpr auto sequence() -> std::array<E, N> {
+    return sequence<E>(std::make_index_sequence<N>{});
+}
+}   // end of namespace detail
+
+template<> struct enum_entries<TriggerMode> {
+    static constexpr auto values{detail::sequence<TriggerMode, 2>()};
+};
+template<> struct enum_entries<TriggerSource> {
+    static constexpr auto values{detail::sequence<TriggerSource, 22>()};
+};
+template<> struct enum_entries<ActivationMode> {
+    static constexpr auto values{detail::sequence<ActivationMode, 5>()};
+};
+template<> struct enum_entries<AcquisitionMode> {
+    static constexpr auto values{detail::sequence<AcquisitionMode, 3>()};
+};
+template<> struct enum_entries<ExposureMode> {
+    static constexpr auto values{detail::sequence<ExposureMode, 4>()};
+};
+template<> struct enum_entries<ExposureAuto> {
+    static constexpr auto values{detail::sequence<ExposureAuto, 3>()};
+};
+template<> struct enum_entries<camera::PixelFormat> {
+    static constexpr auto values{detail::sequence<camera::PixelFormat, static_cast<std::size_t>(PixelFormat::YUV444) + 1>()};
+};
+
+template<typename E>
+auto from_string(std::string_view name) -> std::optional<E> {
+    for (auto v : enum_entries<E>::values) {
+        if (name == to_string(v)) {
+            return v;
+        }
+    }
+    return {};
+}
+
+template<std::size_t I, typename V, FeatureKind K, Access A>
+struct Descriptor {
+    static constexpr std::size_t index = I;
+    static constexpr FeatureKind kind = K;
+    static constexpr Access access = A;
+    using value_type = V;
+};
+
+struct PixelFormat : Descriptor<0, camera::PixelFormat, FeatureKind::Format, Access::Idle> {
+    static constexpr const char* name = "PixelFormat";
+};
+struct Width : Descriptor<1, int64_t, FeatureKind::Integer, Access::Idle> {
+    static constexpr const char* name = "Width";
+};
+struct Height : Descriptor<2, int64_t, FeatureKind::Integer, Access::Idle> {
+    static constexpr const char* name = "Height";
+};
+struct OffsetX : Descriptor<3, int64_t, FeatureKind::Integer, Access::Idle> {
+    static constexpr const char* name = "OffsetX";
+};
+struct OffsetY : Descriptor<4, int64_t, FeatureKind::Integer, Access::Idle> {
+    static constexpr const char* name = "OffsetY";
+};
+struct PayloadSize : Descriptor<5, int64_t, FeatureKind::Integer, Access::ReadOnly> {
+    static constexpr const char* name = "PayloadSize";
+};
+struct TriggerMode : Descriptor<6, camera::TriggerMode, FeatureKind::Enumeration, Access::Idle> {
+    static constexpr const char* name = "TriggerMode";
+};
+struct TriggerSource : Descriptor<7, camera::TriggerSource, FeatureKind::Enumeration, Access::Idle> {
+    static constexpr const char* name = "TriggerSource";
+};
+struct TriggerActivation : Descriptor<8, ActivationMode, FeatureKind::Enumeration, Access::Idle> {
+    static constexpr const char* name = "TriggerActivation";
+};
+struct AcquisitionMode : Descriptor<9, camera::AcquisitionMode, FeatureKind::Enumeration, Access::Idle> {
+    static constexpr const char* name = "AcquisitionMode";
+};
+struct AcquisitionFrameRate : Descriptor<10, double, FeatureKind::Float, Access::Live> {
+    static constexpr const char* name = "AcquisitionFrameRate";
+};
+struct ExposureMode : Descriptor<11, camera::ExposureMode, FeatureKind::Enumeration, Access::Idle> {
+    static constexpr const char* name = "ExposureMode";
+};
+struct ExposureAuto : Descriptor<12, camera::ExposureAuto, FeatureKind::Enumeration, Access::Live> {
+    static constexpr const char* name = "ExposureAuto";
+};
+struct ExposureTime : Descriptor<13, double, FeatureKind::Float, Access::Live> {
+    static constexpr const char* name = "ExposureTime";
+};
+// This is using the same values as the exposure auto (Off, Once, Continuous)
+struct BalanceWhiteAuto : Descriptor<14, camera::ExposureAuto, FeatureKind::Enumeration, Access::Live> {
+    static constexpr const char* name = "BalanceWhiteAuto";
+};
+struct Gain : Descriptor<15, double, FeatureKind::Float, Access::Live> {
+    static constexpr const char* name = "Gain";
+};
+struct GVSPPacketSize : Descriptor<16, int64_t, FeatureKind::Integer, Access::ReadOnly> {
+    static constexpr const char* name = "GVSPPacketSize";
+};
+struct GVSPAdjustPacketSize : Descriptor<17, void, FeatureKind::Command, Access::Execute> {
+    static constexpr const char* name = "GVSPAdjustPacketSize";
+};
+struct AcquisitionStart : Descriptor<18, void, FeatureKind::Command, Access::Execute> {
+    static constexpr const char* name = "AcquisitionStart";
+};
+struct AcquisitionStop : Descriptor<19, void, FeatureKind::Command, Access::Execute> {
+    static constexpr const char* name = "AcquisitionStop";
+};
+struct TriggerSoftware : Descriptor<20, void, FeatureKind::Command, Access::Execute> {
+    static constexpr const char* name = "TriggerSoftware";
+};
+// When set, the camera sends the exposure and the gain with each frame (see ImageView)
+struct ChunkModeActive : Descriptor<21, bool, FeatureKind::Boolean, Access::Idle> {
+    static constexpr const char* name = "ChunkModeActive";
+};
+
+// When adding a new feature, add it here as well, with the next index.
+// Note that this is also the order in which a profile is written to the camera (see camera_profile.hh),
+// so a feature that depends on another one must come after it (ExposureAuto before ExposureTime for example).
+using all = std::tuple<
+    PixelFormat, Width, Height, OffsetX, OffsetY, PayloadSize,
+    TriggerMode, TriggerSource, TriggerActivation, AcquisitionMode, AcquisitionFrameRate,
+    ExposureMode, ExposureAuto, ExposureTime, BalanceWhiteAuto, Gain,
+    GVSPPacketSize, GVSPAdjustPacketSize, AcquisitionStart, AcquisitionStop, TriggerSoftware,
+    ChunkModeActive
+>;
+constexpr std::size_t COUNT = std::tuple_size_v<all>;
+
+namespace detail {
+template<std::size_t... I>
+constexpr auto valid_indices(std::index_sequence<I...>) -> bool {
+    return ((std::tuple_element_t<I, all>::index == I) && ...);
+}
+}   // end of namespace detail
+static_assert(detail::valid_indices(std::make_index_sequence<COUNT>{}), "the features index must match their location in the table");
+
+// The same information, for when we only have the index of the feature at runtime
+struct Info {
+    const char* name;
+    FeatureKind kind;
+    Access access;
+};
+
+namespace detail {
+template<std::size_t... I>
+constexpr auto make_info(std::index_sequence<I...>) -> std::array<Info, sizeof...(I)> {
+    return {Info{std::tuple_element_t<I, all>::name, std::tuple_element_t<I, all>::kind, std::tuple_element_t<I, all>::access}...};
+}
+}   // end of namespace detail
+inline constexpr auto info{detail::make_info(std::make_index_sequence<COUNT>{})};
+
+// The value as it is passed to the camera
+using value_t = std::variant<int64_t, double, bool, std::string, camera::PixelFormat>;
+
+namespace detail {
+// These are implemented by the backend
+auto write(IdleCamera& camera, std::size_t index, const char* name, const value_t& value) -> bool;
+auto write(CapturingCamera& camera, std::size_t index, const char* name, const value_t& value) -> bool;
+auto read(IdleCamera& camera, std::size_t index, const char* name, FeatureKind kind) -> std::optional<value_t>;
+auto execute(IdleCamera& camera, std::size_t index, const char* name) -> bool;
+auto execute(CapturingCamera& camera, std::size_t index, const char* name) -> bool;
+auto execute(IdleCamera& camera, std::size_t index, const char* name, std::chrono::milliseconds timeout) -> bool;
+auto execute(CapturingCamera& camera, std::size_t index, const char* name, std::chrono::milliseconds timeout) -> bool;
+
+template<typename F>
+auto encode(typename F::value_type value) -> value_t {
+    if constexpr (F::kind == FeatureKind::Enumeration) {
+        return std::string{to_string(value)};
+    } else {
+        return value;
+    }
+}
+
+template<typename F>
+auto decode(const value_t& value) -> std::optional<typename F::value_type> {
+    using V = typename F::value_type;
+    if constexpr (F::kind == FeatureKind::Enumeration) {
+        if (auto s = std::get_if<std::string>(&value); s) {
+            return from_string<V>(*s);
+        }
+    } else if (auto v = std::get_if<V>(&value); v) {
+        return *v;
+    }
+    return {};
+}
+}   // end of namespace detail
+
+}   // end of namespace features
+
+template<typename F>
+[[nodiscard]] auto set(IdleCamera& camera, typename F::value_type value) -> bool {
+    static_assert(F::access == features::Access::Idle || F::access == features::Access::Live, "this feature cannot be written");
+    return features::detail::write(camera, F::index, F::name, features::detail::encode<F>(value));
+}
+
+// Only the features that can be changed while the camera is capturing
+template<typename F>
+[[nodiscard]] auto set(CapturingCamera& camera, typename F::value_type value) -> bool {
+    static_assert(F::access == features::Access::Live, "this feature cannot be changed while capturing");
+    return features::detail::write(camera, F::index, F::name, features::detail::encode<F>(value));
+}
+
+template<typename F>
+[[nodiscard]] auto get(IdleCamera& camera) -> std::optional<typename F::value_type> {
+    static_assert(F::kind != features::FeatureKind::Command, "cannot read the value of a command");
+    if (auto v = features::detail::read(camera, F::index, F::name, F::kind); v) {
+        return features::detail::decode<F>(v.value());
+    }
+    return {};
+}
+
+template<typename F>
+[[nodiscard]] auto run(IdleCamera& camera) -> bool {
+    static_assert(F::kind == features::FeatureKind::Command, "this feature is not a command");
+    return features::detail::execute(camera, F::index, F::name);
+}
+
+template<typename F>
+[[nodiscard]] auto run(CapturingCamera& camera) -> bool {
+    static_assert(F::kind == features::FeatureKind::Command, "this feature is not a command");
+    return features::detail::execute(camera, F::index, F::name);
+}
+
+// Run the command, and wait for the device to finish it (see command_wait.hh)
+template<typename F>
+[[nodiscard]] auto run(IdleCamera& camera, std::chrono::milliseconds timeout) -> bool {
+    static_assert(F::kind == features::FeatureKind::Command, "this feature is not a command");
+    return features::detail::execute(camera, F::index, F::name, timeout);
+}
+
+template<typename F>
+[[nodiscard]] auto run(CapturingCamera& camera, std::chrono::milliseconds timeout) -> bool {
+    static_assert(F::kind == features::FeatureKind::Command, "this feature is not a command");
+    return features::detail::execute(camera, F::index, F::name, timeout);
+}
+
+}   // end of namespace camera
@@ -0,0 +1,162 @@
+#include "frame_buffer_pool.hh"
+#include "log/logging.h"
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <iostream>
+#ifdef __linux__
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif  // __linux__
+
+namespace camera {
+namespace {
+
+constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr std::size_t NORMAL_PAGE_SIZE = 4096;
+
+struct Accounting {
+    std::atomic<uint64_t> pools{0};
+    std::atomic<uint64_t> mapped{0};
+    std::atomic<uint64_t> locked{0};
+    std::atomic<uint64_t> huge_pages{0};
+};
+
+auto accounting() -> Accounting& {
+    static Accounting instance;
+    return instance;
+}
+
+constexpr auto round_up(std::size_t value, std::size_t to) -> std::size_t {
+    return ((value + to - 1) / to) * to;
+}
+
+}       // end of local namespace
+
+auto FrameBufferPool::make(std::size_t count, std::size_t buffer_size, const PoolSettings& settings) -> std::shared_ptr<FrameBufferPool> {
+    if (count == 0 || buffer_size == 0) {
+        LOG(ERROR) << "invalid frame buffers pool size, " << count << " buffers of " << buffer_size << " bytes" << ENDL;
+        return {};
+    }
+    std::shared_ptr<FrameBufferPool> pool{new FrameBufferPool{}};
+    pool->stats.buffers = count;
+    pool->stats.buffer_size = buffer_size;
+    pool->stats.stride = round_up(buffer_size, std::max<std::size_t>(settings.alignment, 64));
+    if (!pool->allocate(settings)) {
+        return {};
+    }
+    if (settings.prefault) {
+        pool->prefault();
+    }
+    auto& acc{accounting()};
+    ++acc.pools;
+    acc.mapped += pool->stats.mapped;
+    acc.locked += pool->stats.locked ? pool->stats.mapped : 0;
+    acc.huge_pages += pool->stats.huge_pages ? pool->stats.mapped : 0;
+    LOG(INFO) << "allocated frame buffers pool: " << pool->stats << ENDL;
+    return pool;
+}
+
+FrameBufferPool::~FrameBufferPool() {
+    if (!memory) {
+        return;
+    }
+    auto& acc{accounting()};
+    --acc.pools;
+    acc.mapped -= stats.mapped;
+    acc.locked -= stats.locked ? stats.mapped : 0;
+    acc.huge_pages -= stats.huge_pages ? stats.mapped : 0;
+#ifdef __linux__
+    if (stats.locked) {
+        munlock(memory, stats.mapped);
+    }
+    munmap(memory, stats.mapped);
+#else
+    ::operator delete[](memory, std::align_val_t{NORMAL_PAGE_SIZE});
+#endif  // __linux__
+}
+
+#ifdef __linux__
+auto FrameBufferPool::allocate(const PoolSettings& settings) -> bool {
+    const auto required{stats.stride * stats.buffers};
+    if (settings.huge_pages) {
+        const auto size{round_up(required, HUGE_PAGE_SIZE)};
+        if (auto m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0); m != MAP_FAILED) {
+            memory = static_cast<uint8_t*>(m);
+            stats.mapped = size;
+            stats.huge_pages = true;
+        } else {
+            LOG(WARNING) << "no huge pages for " << size << " bytes of frame buffers (" << std::strerror(errno) << "), using normal pages" << ENDL;
+        }
+    }
+    if (!memory) {
+        const auto size{round_up(required, settings.huge_pages ? HUGE_PAGE_SIZE : NORMAL_PAGE_SIZE)};
+        auto m{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+        if (m == MAP_FAILED) {
+            LOG(ERROR) << "failed to allocate " << size << " bytes of frame buffers: " << std::strerror(errno) << ENDL;
+            return false;
+        }
+        memory = static_cast<uint8_t*>(m);
+        stats.mapped = size;
+        if (settings.huge_pages) {      // this is the next best thing - ask for transparent huge pages
+            madvise(memory, size, MADV_HUGEPAGE);
+        }
+    }
+    if (settings.lock) {
+        if (mlock(memory, stats.mapped) == 0) {
+            stats.locked = true;
+        } else {
+            LOG(WARNING) << "failed to lock " << stats.mapped << " bytes of frame buffers (" << std::strerror(errno) << "), please check 'ulimit -l'" << ENDL;
+        }
+    }
+    return true;
+}
+#else
+auto FrameBufferPool::allocate(const PoolSettings&) -> bool {
+    stats.mapped = round_up(stats.stride * stats.buffers, NORMAL_PAGE_SIZE);
+    memory = static_cast<uint8_t*>(::operator new[](stats.mapped, std::align_val_t{NORMAL_PAGE_SIZE}, std::nothrow));
+    if (!memory) {
+        LOG(ERROR) << "failed to allocate " << stats.mapped << " bytes of frame buffers" << ENDL;
+        return false;
+    }
+    return true;
+}
+#endif  // __linux__
+
+auto FrameBufferPool::prefault() -> void {
+    // mlock is already faulting the pages in, but we don't always have the permission to lock,
+    // so we are touching all the pages in any case
+    const auto start{std::chrono::steady_clock::now()};
+    const auto step{stats.huge_pages ? HUGE_PAGE_SIZE : NORMAL_PAGE_SIZE};
+    for (std::size_t offset = 0; offset < stats.mapped; offset += step) {
+        memory[offset] = 0;
+    }
+    stats.prefault_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+auto FrameBufferPool::buffer(std::size_t index) const -> uint8_t* {
+    return index < stats.buffers ? memory + index * stats.stride : nullptr;
+}
+
+auto capture_memory() -> CaptureMemory {
+    auto& acc{accounting()};
+    return CaptureMemory{
+        .pools = acc.pools.load(), .mapped = acc.mapped.load(),
+        .locked = acc.locked.load(), .huge_pages = acc.huge_pages.load()
+    };
+}
+
+auto operator << (std::ostream& os, const PoolStatistics& ps) -> std::ostream& {
+    return os << ps.buffers << " buffers of " << ps.buffer_size << " bytes (stride " << ps.stride << "), total "
+        << ps.mapped << " bytes, huge pages " << (ps.huge_pages ? "yes" : "no") << ", locked " << (ps.locked ? "yes" : "no")
+        << ", prefault took " << ps.prefault_ms << "ms";
+}
+
+auto operator << (std::ostream& os, const CaptureMemory& cm) -> std::ostream& {
+    return os << cm.pools << " pools, mapped " << cm.mapped << " bytes, locked " << cm.locked << " bytes, huge pages " << cm.huge_pages << " bytes";
+}
+
+}   // end of namespace camera
@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <iosfwd>
+#include <cstddef>
+#include <stdint.h>
+
+namespace camera {
+
+struct PoolSettings {
+    bool huge_pages{true};          // try to use 2MB pages, we will fallback to normal pages if there are none
+    bool lock{true};                // lock the memory so it would not be swapped out (this is limited by "ulimit -l")
+    bool prefault{true};            // touch all the pages before we are giving them to the camera
+    std::size_t alignment{4096};    // the alignment of each of the buffers inside the pool
+};
+
+struct PoolStatistics {
+    std::size_t buffers{0};
+    std::size_t buffer_size{0};     // the size that was requested for each buffer
+    std::size_t stride{0};          // the actual space that each buffer is taking (with the alignment)
+    std::size_t mapped{0};          // total bytes that we allocated
+    bool huge_pages{false};
+    bool locked{false};
+    double prefault_ms{0};          // how long it took to touch all the pages
+};
+auto operator << (std::ostream& os, const PoolStatistics& ps) -> std::ostream&;
+
+// All the capture memory that is allocated by the pools in this process
+struct CaptureMemory {
+    uint64_t pools{0};
+    uint64_t mapped{0};
+    uint64_t locked{0};
+    uint64_t huge_pages{0};         // bytes that are backed by huge pages
+};
+auto operator << (std::ostream& os, const CaptureMemory& cm) -> std::ostream&;
+[[nodiscard]] auto capture_memory() -> CaptureMemory;
+
+// Allocate the buffers that the camera is writing the images into, from a single region of memory.
+// Since all the pages are allocated (and locked) up front, the camera is not hitting page faults
+// while it is writing the images, and with huge pages we are also saving a lot of TLB misses for
+// large images.
+// Note that to use huge pages you need to reserve them first, for example:
+// echo 512 | sudo tee /proc/sys/vm/nr_hugepages
+struct FrameBufferPool {
+    // Return nullptr if we failed to allocate the memory
+    static auto make(std::size_t count, std::size_t buffer_size, const PoolSettings& settings = PoolSettings{}) -> std::shared_ptr<FrameBufferPool>;
+
+    ~FrameBufferPool();
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    auto operator = (const FrameBufferPool&) -> FrameBufferPool& = delete;
+
+    auto buffer(std::size_t index) const -> uint8_t*;
+
+    auto size() const -> std::size_t {
+        return stats.buffers;
+    }
+
+    auto buffer_size() const -> std::size_t {
+        return stats.buffer_size;
+    }
+
+    auto statistics() const -> const PoolStatistics& {
+        return stats;
+    }
+
+private:
+    FrameBufferPool() = default;
+
+    auto allocate(const PoolSettings& settings) -> bool;
+    auto prefault() -> void;
+
+    uint8_t* memory{nullptr};
+    PoolStatistics stats;
+};
+
+}   // end of namespace camera
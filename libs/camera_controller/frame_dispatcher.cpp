@@ -0,0 +1,155 @@
+#include "frame_dispatcher.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace camera {
+
+FrameDispatcher::FrameDispatcher(frame_processing_f&& process_f, const DispatchSettings& settings) :
+        FrameDispatcher{[f = std::move(process_f)](FrameLease frame) { return f(frame.image()); }, settings} {
+}
+
+FrameDispatcher::FrameDispatcher(frame_lease_f&& process_f, const DispatchSettings& settings) :
+        processing_op{std::move(process_f)}, overflow{settings.overflow}, drain{settings.drain}, ring{std::max<std::size_t>(settings.ring_size, 1)} {
+    const auto count{std::max<std::size_t>(settings.workers, 1)};
+    for (std::size_t i = 0; i < count; i++) {
+        workers.emplace_back([this](std::stop_token st) {
+            work(st);
+        });
+    }
+    LOG(INFO) << "started " << count << " frame processing workers, ring of " << ring.capacity() << " frames, overflow policy " << overflow << ENDL;
+}
+
+FrameDispatcher::~FrameDispatcher() {
+    stop();
+    LOG(INFO) << "frames dispatch statistics: " << statistics() << ENDL;
+}
+
+auto FrameDispatcher::stop() -> void {
+    stopping = true;
+    wake_pusher();
+    while (drain && !done && !workers.empty() && ring.size() > 0) {
+        wake_workers(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    for (auto&& w : workers) {
+        w.request_stop();
+    }
+    wake_workers(true);
+    for (auto&& w : workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+    workers.clear();
+    FrameLease frame;
+    while (ring.try_pop(frame)) {   // return all the frames that are still waiting
+        frame.release();
+    }
+}
+
+auto FrameDispatcher::wake_workers(bool all) -> void {
+    signal.fetch_add(1, std::memory_order_release);
+    if (all) {
+        signal.notify_all();
+    } else {
+        signal.notify_one();
+    }
+}
+
+auto FrameDispatcher::wake_pusher() -> void {
+    // taking the lock, so the change is not missed by the camera thread, between checking it and starting to wait
+    { std::lock_guard lock{space_guard}; }
+    space.notify_all();
+}
+
+auto FrameDispatcher::push(FrameLease frame) -> bool {
+    if (done || stopping) {
+        return false;
+    }
+    bool waited{false};
+    while (!ring.try_push(frame)) {
+        switch (overflow) {
+        case OverflowPolicy::DropNewest:
+            ++dropped_newest;
+            return true;        // the frame is returned to the camera when we are leaving
+        case OverflowPolicy::DropOldest:
+            if (FrameLease oldest; ring.try_pop(oldest)) {
+                ++dropped_oldest;
+            }
+            break;
+        case OverflowPolicy::Block: {
+            if (!waited) {
+                waited = true;
+                ++blocked;
+            }
+            std::unique_lock lock{space_guard};
+            space.wait(lock, [this] {
+                return done || stopping || ring.size() < ring.capacity();
+            });
+            if (done || stopping) {
+                return false;
+            }
+            break;
+        }
+        }
+    }
+    ++pushed;
+    const uint64_t depth{ring.size()};
+    auto max{max_depth.load(std::memory_order_relaxed)};
+    while (depth > max && !max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {
+    }
+    wake_workers(false);
+    return !done;
+}
+
+auto FrameDispatcher::work(std::stop_token st) -> void {
+    FrameLease frame;
+    while (!st.stop_requested()) {
+        const auto current{signal.load(std::memory_order_acquire)};
+        if (!ring.try_pop(frame)) {
+            signal.wait(current, std::memory_order_acquire);
+            continue;
+        }
+        if (overflow == OverflowPolicy::Block) {
+            wake_pusher();      // there is space in the ring now
+        }
+        if (!done && !processing_op(frame)) {
+            LOG(INFO) << "processing function notify to stop the processing for frame number " << frame.image().number << ENDL;
+            done = true;
+            wake_pusher();
+        }
+        frame.release();
+        ++processed;
+    }
+}
+
+auto FrameDispatcher::statistics() const -> DispatchStatistics {
+    return DispatchStatistics{
+        .pushed = pushed.load(), .processed = processed.load(),
+        .dropped_oldest = dropped_oldest.load(), .dropped_newest = dropped_newest.load(),
+        .blocked = blocked.load(), .max_depth = max_depth.load()
+    };
+}
+
+auto operator << (std::ostream& os, OverflowPolicy op) -> std::ostream& {
+    switch (op) {
+    case OverflowPolicy::DropOldest:
+        return os << "drop oldest";
+    case OverflowPolicy::DropNewest:
+        return os << "drop newest";
+    case OverflowPolicy::Block:
+        return os << "block";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const DispatchStatistics& ds) -> std::ostream& {
+    return os << "pushed: " << ds.pushed << ", processed: " << ds.processed
+        << ", dropped oldest: " << ds.dropped_oldest << ", dropped newest: " << ds.dropped_newest
+        << ", blocked: " << ds.blocked << ", max depth: " << ds.max_depth;
+}
+
+}   // end of namespace camera
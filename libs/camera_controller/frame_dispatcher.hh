@@ -0,0 +1,84 @@
+#pragma once
+#include "cameras_fwd.hh"
+#include "frame_lease.hh"
+#include "bounded_ring.hh"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <iosfwd>
+#include <stdint.h>
+
+namespace camera {
+
+// What to do when the frames are arriving faster than the workers can process them
+enum class OverflowPolicy : uint32_t {
+    DropOldest,     // remove the oldest frame that is waiting, and push the new one
+    DropNewest,     // drop the frame that just arrived
+    Block           // wait until there is space - note that this is blocking the camera thread
+};
+auto operator << (std::ostream& os, OverflowPolicy op) -> std::ostream&;
+
+struct DispatchSettings {
+    std::size_t workers{2};             // number of threads that are running the processing function
+    std::size_t ring_size{8};           // number of frames that can wait for processing, this should be less than the number of buffers
+    OverflowPolicy overflow{OverflowPolicy::DropOldest};
+    bool drain{false};                  // on stop, process the frames that are still waiting instead of dropping them
+};
+
+struct DispatchStatistics {
+    uint64_t pushed{0};             // frames that were passed to the workers
+    uint64_t processed{0};          // frames that the workers finished processing
+    uint64_t dropped_oldest{0};
+    uint64_t dropped_newest{0};
+    uint64_t blocked{0};            // number of times that the camera thread had to wait for space
+    uint64_t max_depth{0};          // the most frames that were waiting at the same time
+};
+auto operator << (std::ostream& os, const DispatchStatistics& ds) -> std::ostream&;
+
+// Pass the frames from the camera thread to a pool of workers, that are running the processing function.
+// The only thing that is done on the camera thread is pushing the frame lease into a lock free ring, so slow
+// processing is not delaying the camera from getting its buffers back (as long as there are enough buffers).
+// Note that with more than a single worker, the processing function is called concurrently, and the frames
+// may be processed out of order.
+struct FrameDispatcher {
+    FrameDispatcher(frame_processing_f&& process_f, const DispatchSettings& settings);
+    // The processing function is getting the lease itself, so it can keep the frame after it returns
+    FrameDispatcher(frame_lease_f&& process_f, const DispatchSettings& settings);
+    ~FrameDispatcher();
+
+    FrameDispatcher(const FrameDispatcher&) = delete;
+    auto operator = (const FrameDispatcher&) -> FrameDispatcher& = delete;
+
+    // This is called from the camera thread. Return false when the processing function requested to stop.
+    auto push(FrameLease frame) -> bool;
+
+    auto stop() -> void;
+
+    auto statistics() const -> DispatchStatistics;
+
+private:
+    auto work(std::stop_token st) -> void;
+    auto wake_workers(bool all) -> void;
+    auto wake_pusher() -> void;
+
+    frame_lease_f                   processing_op;
+    const OverflowPolicy            overflow;
+    const bool                      drain;
+    BoundedRing<FrameLease>         ring;
+    std::atomic<uint32_t>           signal{0};
+    std::mutex                      space_guard;        // with OverflowPolicy::Block, the camera thread is waiting
+    std::condition_variable         space;              // on this for the workers to take a frame from the ring
+    std::atomic<bool>               done{false};        // the processing function requested to stop
+    std::atomic<bool>               stopping{false};
+    std::atomic<uint64_t>           pushed{0};
+    std::atomic<uint64_t>           processed{0};
+    std::atomic<uint64_t>           dropped_oldest{0};
+    std::atomic<uint64_t>           dropped_newest{0};
+    std::atomic<uint64_t>           blocked{0};
+    std::atomic<uint64_t>           max_depth{0};
+    std::vector<std::jthread>       workers;
+};
+
+}   // end of namespace camera
@@ -0,0 +1,40 @@
+#include "frame_lease.hh"
+#include <iostream>
+
+namespace camera {
+
+auto LeaseTracker::acquired() -> void {
+    ++leased;
+    const auto current{++outstanding};
+    auto max{max_outstanding.load()};
+    while (current > max && !max_outstanding.compare_exchange_weak(max, current)) {
+    }
+    if (const auto b = buffers.load(); b != 0 && current >= b) {
+        ++starvation;   // the camera don't have any buffer left to fill
+    }
+}
+
+auto LeaseTracker::released() -> void {
+    --outstanding;
+}
+
+auto LeaseTracker::statistics() const -> LeaseStatistics {
+    return LeaseStatistics{
+        .leased = leased.load(), .outstanding = outstanding.load(),
+        .max_outstanding = max_outstanding.load(), .starvation = starvation.load()
+    };
+}
+
+auto operator << (std::ostream& os, const LeaseStatistics& ls) -> std::ostream& {
+    return os << "leased: " << ls.leased << ", outstanding: " << ls.outstanding
+        << ", max outstanding: " << ls.max_outstanding << ", buffer starvation: " << ls.starvation;
+}
+
+auto operator << (std::ostream& os, const FrameLease& fl) -> std::ostream& {
+    if (fl.empty()) {
+        return os << "empty lease";
+    }
+    return os << "lease for " << fl.image();
+}
+
+}   // end of namespace camera
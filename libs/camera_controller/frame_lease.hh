@@ -0,0 +1,94 @@
+#pragma once
+#include "image.hh"
+#include <memory>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <iosfwd>
+#include <stdint.h>
+
+namespace camera {
+
+struct LeaseStatistics {
+    uint64_t leased{0};             // total number of frames that were given to the application
+    uint64_t outstanding{0};        // frames that the application is still holding
+    uint64_t max_outstanding{0};    // the most frames that were held by the application at the same time
+    uint64_t starvation{0};         // number of times that all the buffers were held by the application
+};
+
+auto operator << (std::ostream& os, const LeaseStatistics& ls) -> std::ostream&;
+
+// Track the leases for a single camera - this is shared between the capture context and the leases.
+struct LeaseTracker {
+    auto set_buffers(std::size_t count) -> void {
+        buffers = count;
+    }
+
+    auto acquired() -> void;
+    auto released() -> void;
+    auto statistics() const -> LeaseStatistics;
+
+private:
+    std::atomic<std::size_t> buffers{0};
+    std::atomic<uint64_t> leased{0};
+    std::atomic<uint64_t> outstanding{0};
+    std::atomic<uint64_t> max_outstanding{0};
+    std::atomic<uint64_t> starvation{0};
+};
+
+// A frame that is "borrowed" from the camera. As long as there is at least one copy of the lease,
+// the buffer of the frame is not returned to the camera, so you can pass it to another thread (for
+// writing to disk or streaming) without copying the image.
+// Once the last copy of the lease is released, the buffer is queued back to the camera.
+// Note that while you are holding the lease the camera has one less buffer to fill, holding too
+// many leases for too long will cause the camera to drop frames.
+struct FrameLease {
+    FrameLease() = default;
+
+    // Create a lease for the image, on_release is called once the last copy of this lease is released.
+    template<typename F>
+    static auto make(ImageView image, std::shared_ptr<LeaseTracker> tracker, F&& on_release) -> FrameLease {
+        struct Holder {
+            Holder(F&& f, std::shared_ptr<LeaseTracker> t) : release{std::forward<F>(f)}, tracker{std::move(t)} {
+                tracker->acquired();
+            }
+            ~Holder() {
+                release();
+                tracker->released();
+            }
+            std::decay_t<F> release;
+            std::shared_ptr<LeaseTracker> tracker;
+        };
+        return FrameLease{image, std::make_shared<Holder>(std::forward<F>(on_release), std::move(tracker))};
+    }
+
+    auto image() const -> const ImageView& {
+        return view;
+    }
+
+    auto empty() const -> bool {
+        return !holder;
+    }
+
+    explicit operator bool () const {
+        return !empty();
+    }
+
+    // Release this copy of the lease before it goes out of scope
+    auto release() -> void {
+        holder.reset();
+        view = ImageView{};
+    }
+
+private:
+    FrameLease(ImageView v, std::shared_ptr<const void> h) : view{v}, holder{std::move(h)} {
+
+    }
+
+    ImageView view;
+    std::shared_ptr<const void> holder;
+};
+
+auto operator << (std::ostream& os, const FrameLease& fl) -> std::ostream&;
+
+}   // end of namespace camera
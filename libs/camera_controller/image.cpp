@@ -1,8 +1,28 @@
 #include "image.hh"
 #include <iostream>
+#include <chrono>
 
 namespace camera {
 
+auto host_time() -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+auto operator << (std::ostream& os, ReceiveStatus rs) -> std::ostream& {
+    switch (rs) {
+    case ReceiveStatus::Complete:
+        return os << "complete";
+    case ReceiveStatus::Incomplete:
+        return os << "incomplete";
+    case ReceiveStatus::TooSmall:
+        return os << "too small";
+    case ReceiveStatus::Invalid:
+        return os << "invalid";
+    default:
+        return os << "unknown";
+    }
+}
+
 auto operator << (std::ostream& os, const ImageView& iv) -> std::ostream& {
     return os << iv.number << ", image size: " << iv.size << " bytes [" << iv.width << " X " << iv.height << "], empty " << (iv.data ? "no" : "yes");
 }
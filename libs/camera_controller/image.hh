@@ -33,6 +33,18 @@ enum class PixelFormat : uint32_t {
 auto operator << (std::ostream& os, PixelFormat ea) -> std::ostream&;
 auto to_string(PixelFormat ea) -> const char*;
 
+// How the frame was received from the camera
+enum class ReceiveStatus : uint32_t {
+    Complete,
+    Incomplete,     // some of the packets are missing
+    TooSmall,       // the buffer was too small for the frame
+    Invalid
+};
+auto operator << (std::ostream& os, ReceiveStatus rs) -> std::ostream&;
+
+// The host time now, in nanoseconds since the epoch
+[[nodiscard]] auto host_time() -> uint64_t;
+
 // none owning image
 struct ImageView {
     uint32_t size{0};
@@ -41,10 +53,16 @@ struct ImageView {
     unsigned long long number{0};
     const uint8_t* data{nullptr};
     PixelFormat type{PixelFormat::RawRGGB8};
+    uint64_t timestamp{0};      // the time the device took the image, in the device clock ticks (for our cameras this is nanoseconds)
+    // These are only for keeping with the recording (see recording/metadata.hh)
+    uint64_t arrived{0};        // the host time that we got the frame (see host_time), 0 if unknown
+    float exposure{0};          // the exposure time in microseconds, 0 if the camera did not send it with the frame
+    float gain{0};              // in dB
+    ReceiveStatus status{ReceiveStatus::Complete};
 
     constexpr ImageView() = default;
-    constexpr ImageView(uint32_t s, uint32_t w, uint32_t h, unsigned long long n, const uint8_t* d, PixelFormat pf) :
-            size{s}, width{w}, height{h}, number{n}, data{d}, type{pf} {
+    constexpr ImageView(uint32_t s, uint32_t w, uint32_t h, unsigned long long n, const uint8_t* d, PixelFormat pf, uint64_t ts = 0) :
+            size{s}, width{w}, height{h}, number{n}, data{d}, type{pf}, timestamp{ts} {
 
     }
 };
@@ -58,6 +76,7 @@ struct Image {
     unsigned long long number{0};
     std::vector<uint8_t> data;
     PixelFormat type{PixelFormat::RawRGGB8};
+    uint64_t timestamp{0};
 
     constexpr auto size() const -> std::size_t {
         return data.size();
@@ -70,7 +89,7 @@ struct Image {
     Image() = default;
     Image(const ImageView& from) : 
         width{from.width}, height{from.height}, number{from.number},
-        data(construct(from)), type{from.type} {
+        data(construct(from)), type{from.type}, timestamp{from.timestamp} {
 
     }
 
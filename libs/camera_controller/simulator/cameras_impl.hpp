@@ -0,0 +1,346 @@
+#pragma once
+#include "cameras_context.hh"
+#include "cameras_fwd.hh"
+#include "image.hh"
+#include "frame_lease.hh"
+#include "frame_dispatcher.hh"
+#include "frame_buffer_pool.hh"
+#include "simulator/internal_settings.hpp"
+#include "log/logging.h"
+
+
+namespace camera {
+
+using simulator::FrameObserverPtr;
+using simulator::FrameObserver;
+using simulator::FramePtr;
+using simulator::CameraPtr;
+
+namespace simulator {
+    struct CaptureModeCamera;
+    auto register_buffers(CameraPtr& camera, std::vector<FramePtr>& frames, FrameObserverPtr fop) -> bool;
+    auto do_software_trigger(feature_cache_t& features) -> bool;
+    auto start_acquisition(feature_cache_t& features) -> bool;
+    auto stop_acquisition(feature_cache_t& features) -> bool;
+    auto do_software_trigger_once(feature_cache_t& features) -> bool;
+}
+
+struct CaptureContext : std::enable_shared_from_this<CaptureContext> {
+    auto read(simulator::CaptureModeCamera& camera, uint32_t timeout) -> std::optional<ImageView>;
+private:
+    FramePtr frame;
+};
+
+auto make_capture_context_impl() -> std::shared_ptr<CaptureContext>;
+
+struct AsyncCaptureContxt : std::enable_shared_from_this<AsyncCaptureContxt> {
+    AsyncCaptureContxt(CameraPtr cp, frame_processing_f&& pf, std::stop_token sp) :
+            source{std::make_shared<FrameGrabber>(cp, this)}, camera{cp},
+            processing_op{std::move(pf)}, cancellation{std::move(sp)} {
+
+    }
+
+    // In this mode the frames are passed to the application as a lease, and not returned to the camera on return
+    AsyncCaptureContxt(CameraPtr cp, frame_lease_f&& lf, std::stop_token sp) :
+            source{std::make_shared<FrameGrabber>(cp, this)}, camera{cp},
+            lease_op{std::move(lf)}, cancellation{std::move(sp)} {
+
+    }
+
+    // In this mode the frames are passed to a pool of workers, the camera thread is only pushing the lease to the pool
+    AsyncCaptureContxt(CameraPtr cp, std::shared_ptr<FrameDispatcher> fd, std::stop_token sp) :
+            source{std::make_shared<FrameGrabber>(cp, this)}, camera{cp},
+            lease_op{[fd](FrameLease fl) { return fd->push(std::move(fl)); }},
+            dispatcher{fd}, cancellation{std::move(sp)} {
+
+    }
+
+    ~AsyncCaptureContxt() {
+        stop();
+        if (dispatcher) {
+            dispatcher->stop();
+        }
+        if (lease_op) {
+            LOG(INFO) << "frames lease statistics: " << leases->statistics() << ENDL;
+        }
+    }
+
+    auto get_observer() -> FrameObserverPtr {
+        return source;
+    }
+
+    auto stop() -> void {
+        source->stop();
+    }
+
+    auto set_buffers(int queue_size) -> void {
+        leases->set_buffers(queue_size);
+    }
+
+    auto lease_statistics() const -> LeaseStatistics {
+        return leases->statistics();
+    }
+
+    auto dispatch_statistics() const -> DispatchStatistics {
+        return dispatcher ? dispatcher->statistics() : DispatchStatistics{};
+    }
+
+    // Allocate the frames from a single memory pool, and register them with the camera
+    auto allocate_frames(int count, int64_t size) -> bool {
+        pool = FrameBufferPool::make(count, size);
+        if (!pool) {
+            return false;
+        }
+        frames.resize(count);
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            frames[i] = std::make_shared<simulator::Frame>(pool->buffer(i), size);
+        }
+        set_buffers(count);
+        return simulator::register_buffers(camera, frames, get_observer());
+    }
+
+    auto pool_statistics() const -> PoolStatistics {
+        return pool ? pool->statistics() : PoolStatistics{};
+    }
+
+    // Return true if the frame was passed to the application as a lease, in which case
+    // the lease is responsible for returning the frame to the camera.
+    auto process(const FramePtr f) -> bool {
+        if (cancellation.stop_requested()) {
+            LOG(INFO) << "got stop request from the application, will cancel capture" << ENDL;
+            stop();
+            return false;
+        }
+        if (auto frame{simulator::TryInto(f)}; frame) {
+            if (lease_op) {
+                return lease(f, frame.value());
+            }
+            if (!processing_op(frame.value())) {    // we were told stop
+                LOG(INFO) << "processing function notify to stop the processing for frame number " << frame->number << ENDL;
+                stop();
+            }
+        } else {
+            LOG(WARNING) << "something is wrong the frame, dropping" << ENDL;
+        }
+        return false;
+    }
+
+private:
+    auto lease(const FramePtr& f, const ImageView& image) -> bool {
+        auto fl{FrameLease::make(image, leases, [cp = camera, f, p = pool] () mutable {
+            cp->queue_frame(f);
+        })};
+        if (!lease_op(std::move(fl))) {    // we were told stop
+            LOG(INFO) << "processing function notify to stop the processing for frame number " << image.number << ENDL;
+            stop();
+        }
+        return true;
+    }
+
+    struct FrameGrabber : FrameObserver {
+        FrameGrabber(CameraPtr cp, AsyncCaptureContxt* self) : FrameObserver{cp}, patent{self} {
+
+        }
+
+        auto camera_ptr() -> CameraPtr& {
+            return camera;
+        }
+
+        auto stop() -> void {
+            LOG(INFO) << "Stopping the frame processing for camera " << camera->id() << " " << camera->statistics() << ENDL;
+            camera->stop_continuous_acquisition();
+        }
+
+        auto frame_received(const FramePtr f) -> void override {
+            if (!patent->process(f)) {
+                camera->queue_frame(f);
+            }
+        }
+
+        AsyncCaptureContxt* patent{nullptr};
+    };
+
+    std::shared_ptr<FrameGrabber>       source;
+    CameraPtr                           camera;
+    frame_processing_f                  processing_op;
+    frame_lease_f                       lease_op;
+    std::shared_ptr<LeaseTracker>       leases{std::make_shared<LeaseTracker>()};
+    std::shared_ptr<FrameDispatcher>    dispatcher;
+    std::shared_ptr<FrameBufferPool>    pool;       // this must outlive the frames
+    std::vector<FramePtr>               frames;
+    std::stop_token                     cancellation;
+};
+
+struct SoftwareCaptureContxt : AsyncCaptureContxt {
+    SoftwareCaptureContxt(CameraPtr cp, frame_processing_f&& pf, std::stop_token sp, int queue_size, int64_t image_size) :
+                AsyncCaptureContxt(cp, std::move(pf), std::move(sp)) {
+        if (!allocate_frames(queue_size, image_size)) {
+            throw std::runtime_error("failed to register the frames to the device, this will result in critical error");
+        }
+    }
+};
+
+namespace simulator {
+
+auto run_command(feature_cache_t& features, std::size_t index, const char* name) -> bool {
+    auto feature{features.get(index, name)};
+    if (!feature) {
+        return false;
+    }
+    if (!feature->run_command()) {
+        LOG(WARNING) << "failed to run " << name << ENDL;
+        return false;
+    }
+    return true;
+}
+
+template<typename Command>
+auto run_command(feature_cache_t& cache) -> bool {
+    return run_command(cache, Command::index, Command::name);
+}
+
+// We are waiting for the acquisition start and stop, but not for the trigger, since we don't want to add latency to it
+auto do_software_trigger_once(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStart>(features) &&
+        run_command<features::TriggerSoftware>(features) &&
+        execute_and_wait<features::AcquisitionStop>(features);
+}
+
+auto do_software_trigger(feature_cache_t& features) -> bool {
+    return run_command<features::TriggerSoftware>(features);
+}
+
+auto start_acquisition(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStart>(features);
+}
+
+auto stop_acquisition(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStop>(features);
+}
+
+auto register_buffers(CameraPtr& camera, std::vector<FramePtr>& frames, FrameObserverPtr fop) -> bool {
+
+    for (auto&& f: frames) {
+        f->register_observer(fop);
+        if (!camera->announce_frame(f)) {
+            LOG(ERROR) << "failed to connect frame of to camera queue" << ENDL;
+            return false;
+        }
+    }
+    if (!camera->start_capture()) {
+        LOG(ERROR) << "failed to start capture" << ENDL;
+        return false;
+    }
+    for (auto&& f: frames) {
+        if (!camera->queue_frame(f)) {
+            LOG(ERROR) << "failed to queue frame to camera queue" << ENDL;
+            return false;
+        }
+    }
+    LOG(INFO) << "successfully registered " << frames.size() << " to the camera" << ENDL;
+    return true;
+}
+
+struct IdleModeCamera : std::enable_shared_from_this<IdleModeCamera> {
+    using Self = IdleModeCamera;
+
+    explicit IdleModeCamera(CameraPtr c, std::shared_ptr<feature_cache_t> f = {}) :
+            camera{std::move(c)}, features{f ? std::move(f) : make_feature_cache(camera)} {
+
+    }
+
+    static auto TryNew(const Context&, const DeviceInfo& dev_id) -> std::unique_ptr<Self> {
+        LOG(INFO) << "Trying to open by id " << dev_id.id << ENDL;
+        auto camera{System::instance().open_camera_by_id(dev_id.id)};
+        if (!camera) {
+            LOG(ERROR) << "Failed to open simulated camera '" << dev_id << "'" << ENDL;
+            return {};
+        }
+        if (auto idle{std::make_unique<IdleModeCamera>(camera)}; set_comm_speed(*idle->features)) {
+            return idle;
+        }
+        return {};
+    }
+
+    template<typename T>
+    auto set_value(const char* name, T val) -> bool {
+        return set_value_impl(*features, name, val);
+    }
+
+    template<typename T>
+    auto get_value(const char* name) -> std::optional<T> {
+        return get_value_impl<T>(*features, name);
+    }
+
+    CameraPtr camera;
+    std::shared_ptr<feature_cache_t> features;
+};
+
+struct CaptureModeCamera : std::enable_shared_from_this<CaptureModeCamera> {
+
+    explicit CaptureModeCamera(IdleModeCamera&& from) : camera{std::move(from.camera)}, features{std::move(from.features)} {
+
+    }
+
+    template<typename T>
+    auto set_value(const char* name, T val) -> bool {
+        return set_value_impl(*features, name, val);
+    }
+
+    auto start_acquisition() -> bool {
+        return simulator::start_acquisition(*features);
+    }
+
+    auto stop_acquisition() -> bool {
+        return simulator::stop_acquisition(*features);
+    }
+
+    auto trigger() -> bool {
+        return simulator::do_software_trigger(*features);
+    }
+
+    auto trigger_once() -> bool {
+        return simulator::do_software_trigger_once(*features);
+    }
+
+    CameraPtr camera;
+    std::shared_ptr<feature_cache_t> features;
+};
+
+auto Into(CaptureModeCamera from) -> IdleModeCamera {
+    return IdleModeCamera{std::move(from.camera), std::move(from.features)};
+}
+
+
+auto do_capture_once(CaptureModeCamera& camera, uint32_t timeout) -> std::optional<Image> {
+    auto cc{make_capture_context_impl()};
+    if (auto res = cc->read(camera, timeout); res) {
+        return Image{res.value()};
+    }
+    return {};
+}
+
+auto async_capture_impl(AsyncCaptureContxt& context, CaptureModeCamera& camera, int queue_size) -> bool {
+    // we are not letting the SDK allocate the frames, so we would know where they are, and how much memory we are using
+    const auto image_size{get_value_impl<int_value_t>(*camera.features, features::PayloadSize::index, features::PayloadSize::name)};
+    if (!(image_size && context.allocate_frames(queue_size, image_size.value()) && start_acquisition(*camera.features))) {
+        LOG(ERROR) << "failed to register for capturing from the camera" << ENDL;
+        context.stop();
+        return false;
+    }
+    LOG(INFO) << "successfully registered for getting images from the camera" << ENDL;
+    return true;
+}
+
+}       // end of namespace simulator
+
+auto CaptureContext::read(simulator::CaptureModeCamera& camera, uint32_t timeout) -> std::optional<ImageView> {
+    return simulator::do_acquisition(camera.camera, timeout, frame);
+}
+
+auto make_capture_context_impl() -> std::shared_ptr<CaptureContext> {
+    return std::make_shared<CaptureContext>();
+}
+
+
+}       // end of namespace camera
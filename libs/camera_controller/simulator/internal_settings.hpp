@@ -0,0 +1,202 @@
+#pragma once
+#include "log/logging.h"
+#include "simulator/simulated_system.hpp"
+#include "feature_cache.hh"
+#include "features.hh"
+#include "command_wait.hh"
+#include <type_traits>
+
+namespace camera {
+namespace simulator {
+
+// The type that we are using to read integer values from the camera
+using int_value_t = int64_t;
+
+// Negotiating the packet size with the device can take a few seconds
+constexpr auto PACKET_SIZE_TIMEOUT = std::chrono::milliseconds{5'000};
+
+// Resolve the feature by name only once for each camera (see feature_cache.hh)
+using feature_cache_t = FeatureCache<FeaturePtr>;
+
+auto make_feature_cache(CameraPtr camera) -> std::shared_ptr<feature_cache_t> {
+    return std::make_shared<feature_cache_t>([camera](const char* name) {
+        FeaturePtr feature;
+        if (!camera->feature_by_name(name, feature)) {
+            LOG(ERROR) << "failed to get feature " << name << " from the camera" << ENDL;
+            return FeaturePtr{};
+        }
+        return feature;
+    }, features::COUNT);
+}
+
+template<typename Value>
+auto set_feature_value(FeaturePtr& feature, const char* key, Value val) -> bool {
+    const auto set = [&feature](auto v) {
+        return feature->set_value(feature_value_t{v});
+    };
+    bool done{false};
+    if constexpr (std::is_convertible_v<Value, std::string>) {
+        done = set(std::string{val});
+    } else if constexpr (std::is_same_v<Value, bool>) {
+        done = set(val);
+    } else if constexpr (std::is_floating_point_v<Value>) {
+        done = set(static_cast<double>(val));
+    } else {
+        done = set(static_cast<int64_t>(val));
+    }
+    if (!done) {
+        LOG(ERROR) << "failed to set value " << val << " for " << key << ENDL;
+    }
+    return done;
+}
+
+template<typename Value>
+auto get_feature_value(FeaturePtr& feature, const char* key) -> std::optional<Value> {
+    if (auto v = feature->get_value(); v) {
+        if (auto value = std::get_if<Value>(&v.value()); value) {
+            return *value;
+        }
+    }
+    LOG(WARNING) << "failed to get the value for " << key << ENDL;
+    return {};
+}
+
+template<typename Value>
+auto set_value_impl(feature_cache_t& cache, const char* key, Value val) -> bool {
+    auto feature{cache.get(key)};
+    return feature && set_feature_value(feature, key, val);
+}
+
+template<typename Value>
+auto get_value_impl(feature_cache_t& cache, const char* key) -> std::optional<Value> {
+    if (auto feature{cache.get(key)}; feature) {
+        return get_feature_value<Value>(feature, key);
+    }
+    return {};
+}
+
+template<typename Value>
+auto set_value_impl(feature_cache_t& cache, std::size_t index, const char* key, Value val) -> bool {
+    auto feature{cache.get(index, key)};
+    return feature && set_feature_value(feature, key, val);
+}
+
+template<typename Value>
+auto get_value_impl(feature_cache_t& cache, std::size_t index, const char* key) -> std::optional<Value> {
+    if (auto feature{cache.get(index, key)}; feature) {
+        return get_feature_value<Value>(feature, key);
+    }
+    return {};
+}
+
+// Run the command and wait for the device to finish it, without spinning (see command_wait.hh)
+auto execute_and_wait(FeaturePtr feature, const char* key, std::chrono::milliseconds timeout) -> CommandResult {
+    const auto result{run_and_wait(key, [&feature]() {
+        return feature && feature->run_command();
+    }, [&feature](bool& done) {
+        return feature->is_command_done(done);
+    }, timeout)};
+    if (result != CommandResult::Done) {
+        LOG(WARNING) << "command " << key << " is not done: " << result << " (timeout " << timeout.count() << "ms)" << ENDL;
+    }
+    return result;
+}
+
+auto execute_and_wait(feature_cache_t& cache, std::size_t index, const char* key, std::chrono::milliseconds timeout) -> CommandResult {
+    return execute_and_wait(cache.get(index, key), key, timeout);
+}
+
+template<typename Command>
+auto execute_and_wait(feature_cache_t& cache, std::chrono::milliseconds timeout = DEFAULT_COMMAND_TIMEOUT) -> bool {
+    return execute_and_wait(cache, Command::index, Command::name, timeout) == CommandResult::Done;
+}
+
+auto set_comm_speed(feature_cache_t& cache) -> bool {
+    const auto done{execute_and_wait<features::GVSPAdjustPacketSize>(cache, PACKET_SIZE_TIMEOUT)};
+    LOG(INFO) << "we have " << (done ? "successfully" : "failed") << " set the feature comm speed" << ENDL;
+    return done;
+}
+
+// The simulated cameras are using the GenICam names for the pixel formats
+auto map_pixel_type(PixelFormat from) -> const char* {
+    return to_string(from);
+}
+
+// The simulated cameras are holding all the enumerations (including the pixel format) as strings
+auto write_feature_value(feature_cache_t& cache, std::size_t index, const char* key, const features::value_t& val) -> bool {
+    return std::visit([&](auto&& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, PixelFormat>) {
+            return set_value_impl(cache, index, key, map_pixel_type(v));
+        } else {
+            return set_value_impl(cache, index, key, v);
+        }
+    }, val);
+}
+
+auto read_feature_value(feature_cache_t& cache, std::size_t index, const char* key, features::FeatureKind kind) -> std::optional<features::value_t> {
+    const auto read = [&](auto type) -> std::optional<features::value_t> {
+        if (auto v = get_value_impl<decltype(type)>(cache, index, key); v) {
+            return v.value();
+        }
+        return {};
+    };
+    switch (kind) {
+        case features::FeatureKind::Integer:
+            return read(int64_t{});
+        case features::FeatureKind::Float:
+            return read(double{});
+        case features::FeatureKind::Boolean:
+            return read(bool{});
+        case features::FeatureKind::Enumeration:
+            return read(std::string{});
+        case features::FeatureKind::Format:
+            if (auto v = get_value_impl<std::string>(cache, index, key); v) {
+                if (auto pf = features::from_string<PixelFormat>(v.value()); pf) {
+                    return pf.value();
+                }
+            }
+            return {};
+        default:
+            return {};
+    }
+}
+
+auto receive_status(FrameStatus status) -> ReceiveStatus {
+    switch (status) {
+    case FrameStatus::Complete:
+        return ReceiveStatus::Complete;
+    case FrameStatus::Incomplete:
+        return ReceiveStatus::Incomplete;
+    case FrameStatus::TooSmall:
+        return ReceiveStatus::TooSmall;
+    default:
+        return ReceiveStatus::Invalid;
+    }
+}
+
+// As with the real cameras, the frames that were not received in full are passed on with their status,
+// it is up to the application to decide what to do with them
+auto TryInto(const FramePtr& from) -> std::optional<ImageView> {
+    ImageView image{from->image_size, from->width, from->height, from->frame_id, from->buffer, from->format, from->timestamp};
+    image.arrived = host_time();
+    image.exposure = from->exposure;
+    image.gain = from->gain;
+    image.status = receive_status(from->status);
+    return image;
+}
+
+auto do_acquisition(CameraPtr& camera, uint32_t timeout, FramePtr& frame) -> std::optional<ImageView> {
+    if (!camera->acquire_single_image(frame, timeout)) {
+        LOG(WARNING) << "failed to read image from device after " << timeout << " ms" << ENDL;
+        return {};
+    }
+    if (frame->status != FrameStatus::Complete) {
+        LOG(WARNING) << "we don't have the full image after " << timeout << ENDL;
+        return {};
+    }
+    return TryInto(frame);
+}
+
+}   // simulator
+}   // end of namespace camera
@@ -0,0 +1,724 @@
+#include "simulator/simulated_system.hpp"
+#include "log/logging.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace camera {
+namespace simulator {
+namespace {
+
+constexpr int64_t ADJUSTED_PACKET_SIZE = 8228;
+constexpr auto PACKET_SIZE_NEGOTIATION = std::chrono::milliseconds{50};
+
+auto bytes_per_pixel(PixelFormat format) -> uint32_t {
+    switch (format) {
+    case PixelFormat::Mono8:
+    case PixelFormat::RawRGGB8:
+    case PixelFormat::RawGR8:
+    case PixelFormat::RawGB8:
+    case PixelFormat::RawBG8:
+        return 1;
+    case PixelFormat::Mono10:
+    case PixelFormat::Mono12:
+    case PixelFormat::Mono14:
+    case PixelFormat::Mono16:
+        return 2;
+    default:
+        return 0;   // we are not simulating this format
+    }
+}
+
+auto bits_per_pixel(PixelFormat format) -> uint32_t {
+    switch (format) {
+    case PixelFormat::Mono10:
+        return 10;
+    case PixelFormat::Mono12:
+        return 12;
+    case PixelFormat::Mono14:
+        return 14;
+    case PixelFormat::Mono16:
+        return 16;
+    default:
+        return 8;
+    }
+}
+
+auto format_from_name(const std::string& name) -> std::optional<PixelFormat> {
+    for (auto i = static_cast<uint32_t>(PixelFormat::Mono8); i <= static_cast<uint32_t>(PixelFormat::YUV444); i++) {
+        if (name == to_string(static_cast<PixelFormat>(i))) {
+            return static_cast<PixelFormat>(i);
+        }
+    }
+    return {};
+}
+
+// Which color is at the given location for the Bayer formats: 0 - red, 1 - green, 2 - blue
+auto cfa_color(PixelFormat format, uint32_t x, uint32_t y) -> int {
+    const auto odd_row{(y & 1) != 0};
+    const auto odd_column{(x & 1) != 0};
+    switch (format) {
+    case PixelFormat::RawRGGB8:
+        return odd_row == odd_column ? (odd_row ? 2 : 0) : 1;
+    case PixelFormat::RawBG8:
+        return odd_row == odd_column ? (odd_row ? 0 : 2) : 1;
+    case PixelFormat::RawGR8:
+        return odd_row != odd_column ? (odd_row ? 2 : 0) : 1;
+    case PixelFormat::RawGB8:
+        return odd_row != odd_column ? (odd_row ? 0 : 2) : 1;
+    default:
+        return 1;
+    }
+}
+
+auto make_pattern(uint32_t width, uint32_t height, PixelFormat format) -> std::vector<uint8_t> {
+    const auto bpp{bytes_per_pixel(format)};
+    const auto max_value{(1u << bits_per_pixel(format)) - 1};
+    std::vector<uint8_t> pattern(std::size_t{width} * height * bpp);
+    auto out{pattern.data()};
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t value{0};
+            switch (cfa_color(format, x, y)) {
+            case 0:
+                value = uint64_t{x} * max_value / width;
+                break;
+            case 2:
+                value = max_value - uint64_t{x} * max_value / width;
+                break;
+            default:
+                value = uint64_t{x + y} * max_value / (width + height);
+                break;
+            }
+            *out++ = value & 0xff;
+            if (bpp == 2) {
+                *out++ = (value >> 8) & 0xff;
+            }
+        }
+    }
+    return pattern;
+}
+
+// The pattern is the same for all the cameras that are using the same geometry, so we are only creating it once.
+auto shared_pattern(uint32_t width, uint32_t height, PixelFormat format) -> std::shared_ptr<const std::vector<uint8_t>> {
+    static std::mutex guard;
+    static std::map<std::tuple<uint32_t, uint32_t, PixelFormat>, std::shared_ptr<const std::vector<uint8_t>>> patterns;
+
+    std::lock_guard lock{guard};
+    auto& entry{patterns[{width, height, format}]};
+    if (!entry) {
+        entry = std::make_shared<const std::vector<uint8_t>>(make_pattern(width, height, format));
+    }
+    return entry;
+}
+
+auto read_env(const char* name, auto default_value) {
+    if (const auto v = std::getenv(name); v && *v) {
+        if constexpr (std::is_floating_point_v<decltype(default_value)>) {
+            return static_cast<decltype(default_value)>(std::strtod(v, nullptr));
+        } else {
+            return static_cast<decltype(default_value)>(std::strtoull(v, nullptr, 10));
+        }
+    }
+    return default_value;
+}
+
+}       // end of local namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+auto Settings::from_environment() -> Settings {
+    Settings s;
+    s.cameras = read_env("SIMCAM_CAMERAS", s.cameras);
+    s.width = read_env("SIMCAM_WIDTH", s.width);
+    s.height = read_env("SIMCAM_HEIGHT", s.height);
+    s.fps = read_env("SIMCAM_FPS", s.fps);
+    s.jitter_us = read_env("SIMCAM_JITTER_US", s.jitter_us);
+    s.drop_rate = read_env("SIMCAM_DROP_RATE", s.drop_rate);
+    s.incomplete_rate = read_env("SIMCAM_INCOMPLETE_RATE", s.incomplete_rate);
+    s.seed = read_env("SIMCAM_SEED", s.seed);
+    if (const auto v = std::getenv("SIMCAM_FORMAT"); v) {
+        if (auto f = format_from_name(v); f && bytes_per_pixel(f.value()) != 0) {
+            s.format = f.value();
+        } else {
+            LOG(WARNING) << "the pixel format " << v << " is not supported by the simulated cameras, using " << s.format << ENDL;
+        }
+    }
+    return s;
+}
+
+auto operator << (std::ostream& os, const Settings& s) -> std::ostream& {
+    return os << s.cameras << " cameras [" << s.width << " X " << s.height << "] " << s.format
+        << " at " << s.fps << " FPS, jitter " << s.jitter_us << " us, drop rate " << s.drop_rate << ", incomplete rate " << s.incomplete_rate << ", seed " << s.seed;
+}
+
+auto operator << (std::ostream& os, const Statistics& s) -> std::ostream& {
+    return os << "exposures: " << s.exposures << ", delivered: " << s.delivered
+        << ", dropped: " << s.dropped << ", incomplete: " << s.incomplete << ", starved: " << s.starved;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Frame::Frame(int64_t buffer_size) : owned{new uint8_t[buffer_size]}, buffer{owned.get()}, capacity{buffer_size} {
+
+}
+
+Frame::Frame(uint8_t* b, int64_t buffer_size) : buffer{b}, capacity{buffer_size} {
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+auto Feature::set_value(feature_value_t v) -> bool {
+    if (auto device{owner.lock()}; device) {
+        return device->write(*this, std::move(v));
+    }
+    return false;
+}
+
+auto Feature::get_value() const -> std::optional<feature_value_t> {
+    if (auto device{owner.lock()}; device && kind != Kind::Command) {
+        std::lock_guard lock{device->guard};
+        return value;
+    }
+    return {};
+}
+
+auto Feature::run_command() -> bool {
+    if (auto device{owner.lock()}; device) {
+        return device->execute(*this);
+    }
+    return false;
+}
+
+auto Feature::is_command_done(bool& done) const -> bool {
+    if (auto device{owner.lock()}; device && kind == Kind::Command) {
+        std::lock_guard lock{device->guard};
+        done = clock_type::now() >= done_at;
+        return true;
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Device::Device(DeviceInfo i, const Settings& s, uint32_t ix, clock_type::time_point e) :
+        info{std::move(i)}, settings{s}, index{ix}, epoch{e}, random{s.seed * 0x9E3779B97F4A7C15ull + ix} {
+    using namespace std::string_literals;
+
+    const auto pixel_formats = [] {
+        std::vector<std::string> names;
+        for (auto i = static_cast<uint32_t>(PixelFormat::Mono8); i <= static_cast<uint32_t>(PixelFormat::YUV444); i++) {
+            if (bytes_per_pixel(static_cast<PixelFormat>(i)) != 0) {
+                names.emplace_back(to_string(static_cast<PixelFormat>(i)));
+            }
+        }
+        return names;
+    };
+    const auto trigger_sources = [] {
+        std::vector<std::string> names{"Software"s};
+        for (auto i = static_cast<uint32_t>(HardWareTriggerSource::Line0); i <= static_cast<uint32_t>(HardWareTriggerSource::Line20); i++) {
+            names.emplace_back(to_string(static_cast<HardWareTriggerSource>(i)));
+        }
+        return names;
+    };
+    const std::vector<std::string> auto_modes{"Off", "Once", "Continuous"};
+
+    add_feature("PixelFormat", Feature::Kind::Value, std::string{to_string(settings.format)}, pixel_formats());
+    add_feature("Width", Feature::Kind::ReadOnly, int64_t{settings.width});
+    add_feature("Height", Feature::Kind::ReadOnly, int64_t{settings.height});
+    add_feature("OffsetX", Feature::Kind::ReadOnly, int64_t{0});
+    add_feature("OffsetY", Feature::Kind::ReadOnly, int64_t{0});
+    add_feature("PayloadSize", Feature::Kind::ReadOnly, payload_size());
+    add_feature("TriggerSelector", Feature::Kind::Value, "FrameStart"s, {"FrameStart"});
+    add_feature("TriggerMode", Feature::Kind::Value, "Off"s, {"Off", "On"});
+    add_feature("TriggerSource", Feature::Kind::Value, "Software"s, trigger_sources());
+    add_feature("TriggerActivation", Feature::Kind::Value, "RisingEdge"s, {"RisingEdge", "FallingEdge", "AnyEdge", "LevelHigh", "LevelLow"});
+    add_feature("AcquisitionMode", Feature::Kind::Value, "Continuous"s, {"SingleFrame", "MultiFrame", "Burst", "Continuous"});
+    add_feature("AcquisitionFrameRate", Feature::Kind::Value, settings.fps);
+    add_feature("ExposureMode", Feature::Kind::Value, "Timed"s, {"Off", "Timed", "TriggerWidth", "TriggerControlled"});
+    add_feature("ExposureAuto", Feature::Kind::Value, "Off"s, auto_modes);
+    add_feature("ExposureTime", Feature::Kind::Value, 10'000.0);
+    add_feature("BalanceWhiteAuto", Feature::Kind::Value, "Off"s, auto_modes);
+    add_feature("Gain", Feature::Kind::Value, 0.0);
+    add_feature("GVSPPacketSize", Feature::Kind::ReadOnly, int64_t{1500});
+    add_feature("GVSPAdjustPacketSize", Feature::Kind::Command, false);
+    add_feature("AcquisitionStart", Feature::Kind::Command, false);
+    add_feature("AcquisitionStop", Feature::Kind::Command, false);
+    add_feature("TriggerSoftware", Feature::Kind::Command, false);
+    add_feature("ChunkModeActive", Feature::Kind::Value, true);
+}
+
+Device::~Device() {
+    std::unique_lock lock{guard};
+    capturing = false;
+    notify.notify_all();
+    stop_worker(lock);
+}
+
+auto Device::add_feature(std::string name, Feature::Kind kind, feature_value_t v, std::vector<std::string> entries) -> void {
+    auto feature{std::make_shared<Feature>(name, kind, std::move(v), std::move(entries))};
+    features.emplace(std::move(name), std::move(feature));
+}
+
+auto Device::open() -> bool {
+    std::lock_guard lock{guard};
+    if (is_open) {
+        LOG(ERROR) << "simulated camera " << info.id << " is already open" << ENDL;
+        return false;
+    }
+    for (auto&& [name, feature] : features) {
+        feature->owner = weak_from_this();
+    }
+    is_open = true;
+    return true;
+}
+
+auto Device::close() -> void {
+    stop_continuous_acquisition();
+    std::lock_guard lock{guard};
+    is_open = false;
+}
+
+auto Device::feature_by_name(const char* name, FeaturePtr& feature) -> bool {
+    std::lock_guard lock{guard};
+    if (!is_open) {
+        return false;
+    }
+    if (auto i = features.find(name); i != features.end()) {
+        feature = i->second;
+        return true;
+    }
+    return false;
+}
+
+auto Device::text_value(const char* name) const -> const std::string& {
+    return std::get<std::string>(features.find(name)->second->value);
+}
+
+auto Device::number_value(const char* name) const -> double {
+    const auto& v{features.find(name)->second->value};
+    if (auto i = std::get_if<int64_t>(&v); i) {
+        return static_cast<double>(*i);
+    }
+    return std::get<double>(v);
+}
+
+auto Device::payload_size() const -> int64_t {
+    const auto format{format_from_name(text_value("PixelFormat"))};
+    return int64_t{settings.width} * settings.height * bytes_per_pixel(format.value_or(settings.format));
+}
+
+auto Device::frame_period() const -> clock_type::duration {
+    return std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>{1.0 / number_value("AcquisitionFrameRate")});
+}
+
+auto Device::software_triggered() const -> bool {
+    return text_value("TriggerMode") == "On" && text_value("TriggerSource") == "Software";
+}
+
+auto Device::line_triggered() const -> bool {
+    return text_value("TriggerMode") == "On" && text_value("TriggerSource") != "Software";
+}
+
+auto Device::next_exposure_time(clock_type::time_point from) const -> clock_type::time_point {
+    const auto period{frame_period()};
+    if (line_triggered()) {
+        // The external trigger is shared by all the cameras in the system, so they are exposing at the same time
+        return epoch + ((from - epoch) / period + 1) * period;
+    }
+    return from + period;
+}
+
+auto Device::lost_frame() -> bool {
+    return settings.drop_rate > 0.0 && std::uniform_real_distribution<double>{0.0, 1.0}(random) < settings.drop_rate;
+}
+
+auto Device::incomplete_frame() -> bool {
+    return settings.incomplete_rate > 0.0 && std::uniform_real_distribution<double>{0.0, 1.0}(random) < settings.incomplete_rate;
+}
+
+auto Device::delivery_jitter() -> clock_type::duration {
+    if (settings.jitter_us == 0) {
+        return clock_type::duration::zero();
+    }
+    return std::chrono::microseconds{std::uniform_int_distribution<uint32_t>{0, settings.jitter_us}(random)};
+}
+
+auto Device::write(Feature& feature, feature_value_t v) -> bool {
+    std::lock_guard lock{guard};
+    if (feature.kind != Feature::Kind::Value) {
+        LOG(WARNING) << "feature " << feature.name << " on " << info.id << " is not writable" << ENDL;
+        return false;
+    }
+    if (v.index() != feature.value.index()) {
+        if (auto i = std::get_if<int64_t>(&v); i && std::holds_alternative<double>(feature.value)) {
+            v = static_cast<double>(*i);
+        } else {
+            LOG(WARNING) << "wrong value type for feature " << feature.name << " on " << info.id << ENDL;
+            return false;
+        }
+    }
+    if (!feature.enum_entries.empty() &&
+            std::find(feature.enum_entries.begin(), feature.enum_entries.end(), std::get<std::string>(v)) == feature.enum_entries.end()) {
+        LOG(WARNING) << "invalid value " << std::get<std::string>(v) << " for feature " << feature.name << " on " << info.id << ENDL;
+        return false;
+    }
+    if (feature.name == "PixelFormat" && capturing) {
+        LOG(WARNING) << "cannot change the pixel format while capturing on " << info.id << ENDL;
+        return false;
+    }
+    if (feature.name == "AcquisitionFrameRate" && std::get<double>(v) <= 0.0) {
+        return false;
+    }
+    feature.value = std::move(v);
+    if (feature.name == "PixelFormat") {
+        features.find("PayloadSize")->second->value = payload_size();
+    }
+    notify.notify_all();
+    return true;
+}
+
+auto Device::execute(Feature& feature) -> bool {
+    std::lock_guard lock{guard};
+    if (feature.kind != Feature::Kind::Command) {
+        return false;
+    }
+    const auto now{clock_type::now()};
+    feature.done_at = now;
+    if (feature.name == "AcquisitionStart") {
+        acquiring = true;
+        next_exposure = next_exposure_time(now);
+    } else if (feature.name == "AcquisitionStop") {
+        acquiring = false;
+    } else if (feature.name == "TriggerSoftware") {
+        if (acquiring && software_triggered()) {
+            ++pending_triggers;
+        }
+    } else if (feature.name == "GVSPAdjustPacketSize") {
+        features.find("GVSPPacketSize")->second->value = ADJUSTED_PACKET_SIZE;
+        feature.done_at = now + PACKET_SIZE_NEGOTIATION;
+    }
+    notify.notify_all();
+    return true;
+}
+
+auto Device::announce_frame(const FramePtr& frame) -> bool {
+    std::lock_guard lock{guard};
+    if (!is_open || !frame) {
+        return false;
+    }
+    announced.push_back(frame);
+    return true;
+}
+
+auto Device::revoke_all_frames() -> bool {
+    std::lock_guard lock{guard};
+    if (capturing) {
+        return false;
+    }
+    for (auto&& f : announced) {
+        f->unregister_observer();
+    }
+    announced.clear();
+    return true;
+}
+
+auto Device::start_capture() -> bool {
+    std::unique_lock lock{guard};
+    if (!is_open || capturing) {
+        return false;
+    }
+    stop_worker(lock);
+    prepare_pattern();
+    capturing = true;
+    worker = std::thread([self = shared_from_this(), s = ++session] () {
+        self->generate(s);
+    });
+    return true;
+}
+
+auto Device::end_capture() -> bool {
+    std::unique_lock lock{guard};
+    if (!capturing) {
+        return false;
+    }
+    capturing = false;
+    acquiring = false;
+    pending_triggers = 0;
+    ready.clear();
+    queued.clear();
+    notify.notify_all();
+    stop_worker(lock);
+    return true;
+}
+
+auto Device::queue_frame(const FramePtr& frame) -> bool {
+    std::lock_guard lock{guard};
+    if (!capturing || std::find(announced.begin(), announced.end(), frame) == announced.end()) {
+        return false;
+    }
+    queued.push_back(frame);
+    return true;
+}
+
+auto Device::flush_queue() -> void {
+    std::lock_guard lock{guard};
+    queued.clear();
+}
+
+auto Device::start_continuous_acquisition(int queue_size, FrameObserverPtr observer) -> bool {
+    int64_t size{0};
+    {
+        std::lock_guard lock{guard};
+        size = payload_size();
+    }
+    for (auto i = 0; i < queue_size; i++) {
+        auto frame{std::make_shared<Frame>(size)};
+        frame->register_observer(observer);
+        if (!announce_frame(frame)) {
+            return false;
+        }
+    }
+    if (!start_capture()) {
+        return false;
+    }
+    {
+        std::lock_guard lock{guard};
+        queued.assign(announced.begin(), announced.end());
+    }
+    return features.find("AcquisitionStart")->second->run_command();
+}
+
+auto Device::stop_continuous_acquisition() -> bool {
+    {
+        std::lock_guard lock{guard};
+        acquiring = false;
+    }
+    end_capture();
+    return revoke_all_frames();
+}
+
+auto Device::acquire_single_image(FramePtr& frame, uint32_t timeout) -> bool {
+    std::unique_lock lock{guard};
+    if (!is_open || capturing) {
+        LOG(WARNING) << "cannot read single image while capturing on " << info.id << ENDL;
+        return false;
+    }
+    const auto now{clock_type::now()};
+    const auto deadline{now + std::chrono::milliseconds{timeout}};
+    if (software_triggered()) {     // no one will trigger this camera
+        lock.unlock();
+        std::this_thread::sleep_until(deadline);
+        return false;
+    }
+    const auto exposure{next_exposure_time(now)};
+    const auto deliver_at{exposure + delivery_jitter()};
+    if (deliver_at > deadline) {
+        lock.unlock();
+        std::this_thread::sleep_until(deadline);
+        return false;
+    }
+    const auto size{payload_size()};
+    if (!frame || frame->capacity < size) {
+        frame = std::make_shared<Frame>(size);
+    }
+    const auto id{next_frame_id++};
+    const auto format{format_from_name(text_value("PixelFormat")).value_or(settings.format)};
+    frame->exposure = static_cast<float>(number_value("ExposureTime"));
+    frame->gain = static_cast<float>(number_value("Gain"));
+    const auto lost{lost_frame()};
+    prepare_pattern();
+    ++stats.exposures;
+    lock.unlock();
+
+    std::this_thread::sleep_until(deliver_at);
+    fill(*frame, id, exposure, format);
+    lock.lock();
+    if (lost) {
+        frame->status = FrameStatus::Incomplete;
+        ++stats.dropped;
+    } else {
+        ++stats.delivered;
+    }
+    return true;
+}
+
+auto Device::statistics() const -> Statistics {
+    std::lock_guard lock{guard};
+    return stats;
+}
+
+auto Device::prepare_pattern() -> void {
+    pattern = shared_pattern(settings.width, settings.height, format_from_name(text_value("PixelFormat")).value_or(settings.format));
+}
+
+auto Device::fill(Frame& frame, uint64_t frame_id, clock_type::time_point exposure, PixelFormat format) const -> void {
+    frame.width = settings.width;
+    frame.height = settings.height;
+    frame.format = format;
+    frame.frame_id = frame_id;
+    frame.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(exposure - epoch).count();
+    const auto row_size{std::size_t{settings.width} * bytes_per_pixel(format)};
+    const auto size{row_size * settings.height};
+    if (frame.capacity < static_cast<int64_t>(size)) {
+        frame.image_size = 0;
+        frame.status = FrameStatus::TooSmall;
+        return;
+    }
+    // The image is "moving" one row for each frame, so each frame is unique, but we are always generating
+    // the same content for the same frame number
+    const auto shift{(frame_id + index * 97) % settings.height};
+    const auto split{shift * row_size};
+    std::memcpy(frame.buffer, pattern->data() + split, size - split);
+    std::memcpy(frame.buffer + size - split, pattern->data(), split);
+    frame.image_size = static_cast<uint32_t>(size);
+    frame.status = FrameStatus::Complete;
+}
+
+auto Device::expose(clock_type::time_point at) -> void {
+    const auto id{next_frame_id++};
+    ++stats.exposures;
+    if (lost_frame()) {
+        ++stats.dropped;
+        return;
+    }
+    if (queued.empty()) {
+        ++stats.starved;
+        return;
+    }
+    // as with the chunk data of a real camera, these are the settings at the time of the exposure
+    queued.front()->exposure = static_cast<float>(number_value("ExposureTime"));
+    queued.front()->gain = static_cast<float>(number_value("Gain"));
+    ready.push_back(Exposure{
+        .frame = std::move(queued.front()), .id = id, .at = at,
+        .format = format_from_name(text_value("PixelFormat")).value_or(settings.format),
+        .incomplete = incomplete_frame()
+    });
+    queued.pop_front();
+}
+
+auto Device::stop_worker(std::unique_lock<std::mutex>& lock) -> void {
+    auto w{std::move(worker)};
+    lock.unlock();
+    if (w.joinable()) {
+        if (w.get_id() == std::this_thread::get_id()) {
+            w.detach();     // we were called from the frame observer, this thread would exit on its own
+        } else {
+            w.join();
+        }
+    }
+    lock.lock();
+}
+
+// This is the camera thread - it is "exposing" the frames at the time they should be taken, and deliver
+// them to the host. Like a real camera, it keeps on exposing even when the host is slow to process the frames,
+// in which case we would run out of buffers and lose frames.
+auto Device::generate(uint64_t s) -> void {
+    std::unique_lock lock{guard};
+    const auto active = [this, s] {
+        return capturing && session == s;
+    };
+    while (active()) {
+        const auto now{clock_type::now()};
+        for (; pending_triggers > 0; --pending_triggers) {
+            expose(now);
+        }
+        while (acquiring && !software_triggered() && next_exposure <= now) {
+            expose(next_exposure);
+            next_exposure = next_exposure_time(next_exposure);
+            if (text_value("AcquisitionMode") == "SingleFrame") {
+                acquiring = false;
+            }
+        }
+        if (ready.empty()) {
+            if (acquiring && !software_triggered()) {
+                notify.wait_until(lock, next_exposure, [&] {
+                    return !active() || pending_triggers > 0 || !acquiring || software_triggered();
+                });
+            } else {
+                notify.wait(lock, [&] {
+                    return !active() || pending_triggers > 0 || (acquiring && !software_triggered());
+                });
+            }
+            continue;
+        }
+        auto exposure{std::move(ready.front())};
+        ready.pop_front();
+        const auto deliver_at{exposure.at + delivery_jitter()};
+        if (notify.wait_until(lock, deliver_at, [&] { return !active(); })) {
+            break;
+        }
+        lock.unlock();
+        fill(*exposure.frame, exposure.id, exposure.at, exposure.format);
+        if (exposure.incomplete) {
+            exposure.frame->status = FrameStatus::Incomplete;
+        }
+        if (auto observer{exposure.frame->observer}; observer) {
+            observer->frame_received(exposure.frame);
+        }
+        lock.lock();
+        ++stats.delivered;
+        stats.incomplete += exposure.incomplete ? 1 : 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+auto System::instance() -> System& {
+    static System system;
+    return system;
+}
+
+auto System::startup(const Settings& settings) -> bool {
+    if (settings.cameras == 0 || settings.width == 0 || settings.height == 0 || settings.fps <= 0.0 ||
+            bytes_per_pixel(settings.format) == 0) {
+        LOG(ERROR) << "invalid settings for the simulated cameras: " << settings << ENDL;
+        return false;
+    }
+    shutdown();
+    std::lock_guard lock{guard};
+    const auto epoch{clock_type::now()};
+    for (uint32_t i = 0; i < settings.cameras; i++) {
+        auto id{"DEV_SIM" + std::to_string(1000 + i)};
+        DeviceInfo info{.id = id, .interface_id = "simulated", .mode = "Simulated " + std::to_string(settings.width) + "x" + std::to_string(settings.height)};
+        devices.push_back(std::make_shared<Device>(std::move(info), settings, i, epoch));
+    }
+    return true;
+}
+
+auto System::shutdown() -> bool {
+    std::vector<CameraPtr> closing;
+    {
+        std::lock_guard lock{guard};
+        closing.swap(devices);
+    }
+    for (auto&& d : closing) {
+        d->close();
+    }
+    return true;
+}
+
+auto System::cameras() const -> std::vector<CameraPtr> {
+    std::lock_guard lock{guard};
+    return devices;
+}
+
+auto System::camera_by_id(const std::string& id) const -> CameraPtr {
+    std::lock_guard lock{guard};
+    if (auto i = std::find_if(devices.begin(), devices.end(), [&id](auto&& d) { return d->id() == id; }); i != devices.end()) {
+        return *i;
+    }
+    return {};
+}
+
+auto System::open_camera_by_id(const std::string& id) -> CameraPtr {
+    if (auto camera{camera_by_id(id)}; camera && camera->open()) {
+        return camera;
+    }
+    return {};
+}
+
+}   // end of namespace simulator
+}   // end of namespace camera
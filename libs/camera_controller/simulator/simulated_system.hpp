@@ -0,0 +1,231 @@
+#pragma once
+// This is the "SDK" for the simulated cameras. It is modeled after the way the GenICam SDKs are working:
+// the cameras are exposing features by name, the application is announcing buffers (frames) to the camera,
+// the camera fill them, and notify an observer about the ready frame from its own thread. The application
+// then need to queue the frame back to the camera so it can be used again.
+#include "simulator/simulation.hh"
+#include "cameras_context.hh"
+#include "camera_settings.hh"
+#include "image.hh"
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <variant>
+#include <optional>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <stdint.h>
+
+namespace camera {
+namespace simulator {
+
+using clock_type = std::chrono::steady_clock;
+using feature_value_t = std::variant<int64_t, double, bool, std::string>;
+
+struct Device;
+using CameraPtr = std::shared_ptr<Device>;
+
+enum class FrameStatus : uint32_t {
+    Complete,
+    Incomplete,
+    TooSmall,
+    Invalid
+};
+
+struct Frame;
+using FramePtr = std::shared_ptr<Frame>;
+
+// The observer is notified from the camera thread, about the next frame that is ready.
+struct FrameObserver {
+    explicit FrameObserver(CameraPtr c) : camera{std::move(c)} {
+
+    }
+    virtual ~FrameObserver() = default;
+
+    virtual auto frame_received(const FramePtr f) -> void = 0;
+
+protected:
+    CameraPtr camera;
+};
+using FrameObserverPtr = std::shared_ptr<FrameObserver>;
+
+struct Frame {
+    // Allocate the buffer for the frame internally
+    explicit Frame(int64_t buffer_size);
+    // Use the buffer that the application allocated, the application must keep it alive as long as the frame is in use.
+    Frame(uint8_t* buffer, int64_t buffer_size);
+
+    auto register_observer(FrameObserverPtr o) -> void {
+        observer = std::move(o);
+    }
+
+    auto unregister_observer() -> void {
+        observer.reset();
+    }
+
+    std::unique_ptr<uint8_t[]> owned;
+    uint8_t* buffer{nullptr};
+    int64_t capacity{0};
+    uint32_t image_size{0};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint64_t frame_id{0};
+    uint64_t timestamp{0};      // in nanoseconds from the time the system was started
+    float exposure{0};          // the settings of the camera when the frame was taken, in microseconds
+    float gain{0};              // and dB
+    PixelFormat format{PixelFormat::RawRGGB8};
+    FrameStatus status{FrameStatus::Invalid};
+    FrameObserverPtr observer;
+};
+
+// A single named value or command on the camera. Note that this is a handle, you can keep it
+// for as long as you would like and use it without looking it up again by name.
+struct Feature {
+    enum class Kind {
+        Value,
+        ReadOnly,
+        Command
+    };
+
+    Feature(std::string n, Kind k, feature_value_t v, std::vector<std::string> entries = {}) :
+            name{std::move(n)}, kind{k}, value{std::move(v)}, enum_entries{std::move(entries)} {
+
+    }
+
+    auto set_value(feature_value_t v) -> bool;
+    auto get_value() const -> std::optional<feature_value_t>;
+    auto run_command() -> bool;
+    auto is_command_done(bool& done) const -> bool;
+
+    const std::string name;
+    const Kind kind;
+    feature_value_t value;                      // protected by the device lock
+    const std::vector<std::string> enum_entries;    // if not empty, this is the list of allowed values
+    clock_type::time_point done_at{};           // when the last command is done
+    std::weak_ptr<Device> owner;
+};
+using FeaturePtr = std::shared_ptr<Feature>;
+
+struct Statistics {
+    uint64_t exposures{0};          // number of frames that the camera generated
+    uint64_t delivered{0};          // number of frames delivered to the host
+    uint64_t dropped{0};            // lost on the way to the host (based on the drop rate)
+    uint64_t incomplete{0};         // delivered with some of the packets missing (based on the incomplete rate)
+    uint64_t starved{0};            // lost since the host did not queue a buffer for the camera
+};
+
+auto operator << (std::ostream& os, const Statistics& s) -> std::ostream&;
+
+struct Device : std::enable_shared_from_this<Device> {
+    Device(DeviceInfo info, const Settings& settings, uint32_t index, clock_type::time_point epoch);
+    ~Device();
+
+    auto id() const -> const std::string& {
+        return info.id;
+    }
+
+    auto device_info() const -> const DeviceInfo& {
+        return info;
+    }
+
+    auto open() -> bool;
+    auto close() -> void;
+
+    auto feature_by_name(const char* name, FeaturePtr& feature) -> bool;
+
+    // Buffers management, this is the same flow as in GenICam based SDK:
+    // announce the frames, start the capture, queue the frames, and then start the acquisition.
+    auto announce_frame(const FramePtr& frame) -> bool;
+    auto revoke_all_frames() -> bool;
+    auto start_capture() -> bool;
+    auto end_capture() -> bool;
+    auto queue_frame(const FramePtr& frame) -> bool;
+    auto flush_queue() -> void;
+
+    // This is doing all the above for us, in this case the frames are allocated internally
+    auto start_continuous_acquisition(int queue_size, FrameObserverPtr observer) -> bool;
+    auto stop_continuous_acquisition() -> bool;
+
+    // Read a single image, this is blocking for no more than the timeout in milliseconds
+    auto acquire_single_image(FramePtr& frame, uint32_t timeout) -> bool;
+
+    auto statistics() const -> Statistics;
+
+private:
+    friend struct Feature;
+
+    auto add_feature(std::string name, Feature::Kind kind, feature_value_t v, std::vector<std::string> entries = {}) -> void;
+    auto write(Feature& feature, feature_value_t v) -> bool;
+    auto execute(Feature& feature) -> bool;
+    auto text_value(const char* name) const -> const std::string&;
+    auto number_value(const char* name) const -> double;
+    auto payload_size() const -> int64_t;
+    auto frame_period() const -> clock_type::duration;
+    auto software_triggered() const -> bool;
+    auto line_triggered() const -> bool;
+    auto next_exposure_time(clock_type::time_point from) const -> clock_type::time_point;
+    auto lost_frame() -> bool;
+    auto incomplete_frame() -> bool;
+    auto delivery_jitter() -> clock_type::duration;
+    auto expose(clock_type::time_point at) -> void;
+    auto prepare_pattern() -> void;
+    auto fill(Frame& frame, uint64_t frame_id, clock_type::time_point exposure, PixelFormat format) const -> void;
+    auto stop_worker(std::unique_lock<std::mutex>& lock) -> void;
+    auto generate(uint64_t session) -> void;
+
+    // A frame that the camera already exposed, and is waiting to be delivered to the host
+    struct Exposure {
+        FramePtr frame;
+        uint64_t id{0};
+        clock_type::time_point at;
+        PixelFormat format{PixelFormat::RawRGGB8};
+        bool incomplete{false};
+    };
+
+    DeviceInfo info;
+    const Settings settings;
+    const uint32_t index{0};
+    const clock_type::time_point epoch;
+    mutable std::mutex guard;
+    std::condition_variable notify;
+    std::map<std::string, FeaturePtr, std::less<>> features;
+    std::vector<FramePtr> announced;
+    std::deque<FramePtr> queued;
+    std::deque<Exposure> ready;
+    std::shared_ptr<const std::vector<uint8_t>> pattern;
+    std::mt19937_64 random;
+    bool is_open{false};
+    bool capturing{false};
+    bool acquiring{false};
+    int pending_triggers{0};
+    uint64_t session{0};                    // each start_capture is a new session for the worker thread
+    uint64_t next_frame_id{0};
+    clock_type::time_point next_exposure{};
+    Statistics stats;
+    std::thread worker;
+};
+
+// This is the entry point to the simulated cameras
+struct System {
+    static auto instance() -> System&;
+
+    auto startup(const Settings& settings) -> bool;
+    auto shutdown() -> bool;
+
+    auto cameras() const -> std::vector<CameraPtr>;
+    auto camera_by_id(const std::string& id) const -> CameraPtr;
+    auto open_camera_by_id(const std::string& id) -> CameraPtr;
+
+private:
+    mutable std::mutex guard;
+    std::vector<CameraPtr> devices;
+};
+
+}   // end of namespace simulator
+}   // end of namespace camera
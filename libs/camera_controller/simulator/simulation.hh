@@ -0,0 +1,38 @@
+#pragma once
+#include "cameras_context.hh"
+#include "image.hh"
+#include <stdint.h>
+#include <iosfwd>
+
+namespace camera {
+namespace simulator {
+
+// The settings for the simulated cameras. All the cameras in the context are using the same settings,
+// each camera is using its own seed (derived from the seed here) so the cameras are not producing the
+// same timing, but running the same settings twice will always produce the same frames (content, numbers and drops).
+struct Settings {
+    uint32_t cameras{2};                        // number of cameras that enumerate will report
+    uint32_t width{4096};
+    uint32_t height{3000};
+    double fps{30.0};                           // default value for AcquisitionFrameRate
+    uint32_t jitter_us{0};                      // each frame is delivered with a random delay of up to this value after its exposure
+    double drop_rate{0.0};                      // the probability [0, 1] that a frame will be lost on the way to the host
+    double incomplete_rate{0.0};                // the probability [0, 1] that a frame will arrive with some of its packets missing
+    uint64_t seed{1};
+    PixelFormat format{PixelFormat::RawRGGB8};  // the initial value of PixelFormat
+
+    // Read the settings from the environment, any value that is not set is using the default from above:
+    // SIMCAM_CAMERAS, SIMCAM_WIDTH, SIMCAM_HEIGHT, SIMCAM_FPS, SIMCAM_JITTER_US, SIMCAM_DROP_RATE, SIMCAM_INCOMPLETE_RATE, SIMCAM_SEED and
+    // SIMCAM_FORMAT (using the GenICam name, for example BayerRG8 or Mono8).
+    static auto from_environment() -> Settings;
+};
+
+auto operator << (std::ostream& os, const Settings& s) -> std::ostream&;
+
+}   // end of namespace simulator
+
+// Create a context with simulated cameras, note that in simulation build, make_context is using
+// the settings from the environment (see Settings::from_environment).
+[[nodiscard]] auto make_simulated_context(const simulator::Settings& settings) -> std::variant<context_type, error_type>;
+
+}   // end of namespace camera
@@ -2,6 +2,9 @@
 #include "cameras_context.hh"
 #include "cameras_fwd.hh"
 #include "image.hh"
+#include "frame_lease.hh"
+#include "frame_dispatcher.hh"
+#include "frame_buffer_pool.hh"
 #include "vimba/internal_settings.hpp"
 #include "log/logging.h"
 
@@ -16,10 +19,10 @@ using AVT::VmbAPI::CameraPtr;
 namespace vimba_sdk {
     struct CaptureModeCamera;
     auto register_buffers(CameraPtr& camera, std::vector<FramePtr>& frames, IFrameObserverPtr fop) -> bool;
-    auto do_software_trigger(CameraPtr& camera) -> bool;
-    auto start_acquisition(CameraPtr& camera) -> bool;
-    auto stop_acquisition(CameraPtr& camera) -> bool;
-    auto do_software_trigger_once(CameraPtr& camera) -> bool;
+    auto do_software_trigger(feature_cache_t& features) -> bool;
+    auto start_acquisition(feature_cache_t& features) -> bool;
+    auto stop_acquisition(feature_cache_t& features) -> bool;
+    auto do_software_trigger_once(feature_cache_t& features) -> bool;
 }
 
 struct CaptureContext : std::enable_shared_from_this<CaptureContext> {
@@ -32,13 +35,34 @@ auto make_capture_context_impl() -> std::shared_ptr<CaptureContext>;
 
 struct AsyncCaptureContxt : std::enable_shared_from_this<AsyncCaptureContxt> {
     AsyncCaptureContxt(CameraPtr cp, frame_processing_f&& pf, std::stop_token sp) : 
-            source{new FrameGrabber(cp, this)},
+            source{new FrameGrabber(cp, this)}, camera{cp},
             processing_op{std::move(pf)}, cancellation{std::move(sp)} {
 
     }
 
+    // In this mode the frames are passed to the application as a lease, and not returned to the camera on return
+    AsyncCaptureContxt(CameraPtr cp, frame_lease_f&& lf, std::stop_token sp) : 
+            source{new FrameGrabber(cp, this)}, camera{cp},
+            lease_op{std::move(lf)}, cancellation{std::move(sp)} {
+
+    }
+
+    // In this mode the frames are passed to a pool of workers, the camera thread is only pushing the lease to the pool
+    AsyncCaptureContxt(CameraPtr cp, std::shared_ptr<FrameDispatcher> fd, std::stop_token sp) : 
+            source{new FrameGrabber(cp, this)}, camera{cp},
+            lease_op{[fd](FrameLease fl) { return fd->push(std::move(fl)); }},
+            dispatcher{fd}, cancellation{std::move(sp)} {
+
+    }
+
     ~AsyncCaptureContxt() {
         stop();
+        if (dispatcher) {
+            dispatcher->stop();
+        }
+        if (lease_op) {
+            LOG(INFO) << "frames lease statistics: " << leases->statistics() << ENDL;
+        }
     }
 
     auto get_observer() -> IFrameObserverPtr {
@@ -49,13 +73,54 @@ struct AsyncCaptureContxt : std::enable_shared_from_this<AsyncCaptureContxt> {
         dynamic_cast<FrameGrabber*>(source.get())->stop();  // note that this is safe, as we know what we allocated
     }
 
-    auto process(const FramePtr f) {
+    auto set_buffers(int queue_size) -> void {
+        leases->set_buffers(queue_size);
+    }
+
+    auto lease_statistics() const -> LeaseStatistics {
+        return leases->statistics();
+    }
+
+    auto dispatch_statistics() const -> DispatchStatistics {
+        return dispatcher ? dispatcher->statistics() : DispatchStatistics{};
+    }
+
+    // Allocate the frames from a single memory pool, and register them with the camera
+    auto allocate_frames(int count, int64_t size) -> bool {
+        pool = FrameBufferPool::make(count, size);
+        if (!pool) {
+            return false;
+        }
+        frames.resize(count);
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            frames[i] = FramePtr(new AVT::VmbAPI::Frame(pool->buffer(i), size));
+        }
+        set_buffers(count);
+        return vimba_sdk::register_buffers(camera, frames, get_observer());
+    }
+
+    auto pool_statistics() const -> PoolStatistics {
+        return pool ? pool->statistics() : PoolStatistics{};
+    }
+
+    // Cameras without the chunk data don't have ChunkModeActive, and then there is nothing to read with the frames.
+    // This must be called before the acquisition starts, so it is set before the first frame arrives
+    auto read_chunk_mode(vimba_sdk::feature_cache_t& cache) -> void {
+        chunks = vimba_sdk::get_value_impl<bool>(cache, features::ChunkModeActive::index, features::ChunkModeActive::name).value_or(false);
+    }
+
+    // Return true if the frame was passed to the application as a lease, in which case
+    // the lease is responsible for returning the frame to the camera.
+    auto process(const FramePtr f) -> bool {
         if (cancellation.stop_requested()) {
             LOG(INFO) << "got stop request from the application, will cancel capture" << ENDL;
             stop();
-            return;
+            return false;
         }
-        if (auto frame{vimba_sdk::TryInto(f)}; frame) {
+        if (auto frame{vimba_sdk::TryInto(f, chunks)}; frame) {
+            if (lease_op) {
+                return lease(f, frame.value());
+            }
             if (!processing_op(frame.value())) {    // we were told stop
                 LOG(INFO) << "processing function notify to stop the processing for frame number " << frame->number << ENDL;
                 stop();
@@ -63,9 +128,21 @@ struct AsyncCaptureContxt : std::enable_shared_from_this<AsyncCaptureContxt> {
         } else {
             LOG(WARNING) << "something is wrong the frame, dropping" << ENDL;
         }
+        return false;
     }
 
 private:
+    auto lease(const FramePtr& f, const ImageView& image) -> bool {
+        auto fl{FrameLease::make(image, leases, [cp = camera, f, p = pool] () mutable {
+            cp->QueueFrame(f);
+        })};
+        if (!lease_op(std::move(fl))) {    // we were told stop
+            LOG(INFO) << "processing function notify to stop the processing for frame number " << image.number << ENDL;
+            stop();
+        }
+        return true;
+    }
+
     struct FrameGrabber : IFrameObserver {
         FrameGrabber(CameraPtr cp, AsyncCaptureContxt* self) : IFrameObserver{cp}, patent{self} {
 
@@ -83,40 +160,40 @@ private:
         }
 
         void FrameReceived(const FramePtr f) override {
-            patent->process(f);
-            m_pCamera->QueueFrame(f);
+            if (!patent->process(f)) {
+                m_pCamera->QueueFrame(f);
+            }
         }
 
         AsyncCaptureContxt* patent{nullptr};
     };
 
     IFrameObserverPtr                   source;
+    CameraPtr                           camera;
     frame_processing_f                  processing_op;
+    frame_lease_f                       lease_op;
+    std::shared_ptr<LeaseTracker>       leases{std::make_shared<LeaseTracker>()};
+    std::shared_ptr<FrameDispatcher>    dispatcher;
+    std::shared_ptr<FrameBufferPool>    pool;       // this must outlive the frames
+    std::vector<FramePtr>               frames;
     std::stop_token                     cancellation;
+    bool                                chunks{false};  // ChunkModeActive, read once when the capture starts
 };
 
 struct SoftwareCaptureContxt : AsyncCaptureContxt {
     SoftwareCaptureContxt(CameraPtr cp, frame_processing_f&& pf, std::stop_token sp, int queue_size, int64_t image_size) : 
-                AsyncCaptureContxt(std::move(cp), std::move(pf), std::move(sp)), frames(queue_size) {
-        for (auto&& f: frames) {
-            f = FramePtr(new AVT::VmbAPI::Frame(image_size, AVT::VmbAPI::FrameAllocation_AllocAndAnnounceFrame));
-        }
-        if (!vimba_sdk::register_buffers(cp, frames, get_observer())) {
+                AsyncCaptureContxt(std::move(cp), std::move(pf), std::move(sp)) {
+        if (!allocate_frames(queue_size, image_size)) {
             throw std::runtime_error("failed to register the frames to the device, this will result in critical error");
         }
-
     }
-
-private:
-    std::vector<FramePtr> frames;
 };
 
 namespace vimba_sdk {
 
-auto run_command(CameraPtr& camera, const char* name) -> bool {
-    FeaturePtr feature;
-    if (auto e = camera->GetFeatureByName(name, feature); e != VmbErrorSuccess) {
-        LOG(WARNING) << "failed to get feature " << name << ": " << ErrorCodeToMessage(e) << ENDL;
+auto run_command(feature_cache_t& features, std::size_t index, const char* name) -> bool {
+    auto feature{features.get(index, name)};
+    if (!feature) {
         return false;
     }
     if (auto e = feature->RunCommand(); e != VmbErrorSuccess) {
@@ -126,36 +203,28 @@ auto run_command(CameraPtr& camera, const char* name) -> bool {
     return true;
 }
 
-auto do_software_trigger_once(CameraPtr& camera) -> bool {
-
-    FeaturePtr feature;
-    const auto run_one_command = [&camera, &feature] (const char* name) -> bool {
-        if (auto e = camera->GetFeatureByName(name, feature); e != VmbErrorSuccess) {
-            LOG(WARNING) << "failed to get feature " << name << ": " << ErrorCodeToMessage(e) << ENDL;
-            return false;
-        }
-        if (auto e = feature->RunCommand(); e != VmbErrorSuccess) {
-            LOG(WARNING) << "failed to run feature " << name << ": " << ErrorCodeToMessage(e) << ENDL;
-            return false;
-        }
-        return true;
-    };
-    return run_one_command("AcquisitionStart") &&
-        run_one_command("TriggerSoftware") &&
-        run_one_command("AcquisitionStop");
+template<typename Command>
+auto run_command(feature_cache_t& cache) -> bool {
+    return run_command(cache, Command::index, Command::name);
+}
 
+// We are waiting for the acquisition start and stop, but not for the trigger, since we don't want to add latency to it
+auto do_software_trigger_once(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStart>(features) &&
+        run_command<features::TriggerSoftware>(features) &&
+        execute_and_wait<features::AcquisitionStop>(features);
 }
 
-auto do_software_trigger(CameraPtr& camera) -> bool {
-    return run_command(camera, "TriggerSoftware");
+auto do_software_trigger(feature_cache_t& features) -> bool {
+    return run_command<features::TriggerSoftware>(features);
 }
 
-auto start_acquisition(CameraPtr& camera) -> bool {
-    return run_command(camera, "AcquisitionStart");
+auto start_acquisition(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStart>(features);
 }
 
-auto stop_acquisition(CameraPtr& camera) -> bool {
-    return run_command(camera, "AcquisitionStop");
+auto stop_acquisition(feature_cache_t& features) -> bool {
+    return execute_and_wait<features::AcquisitionStop>(features);
 }
 
 auto register_buffers(CameraPtr& camera, std::vector<FramePtr>& frames, IFrameObserverPtr fop) -> bool {
@@ -187,7 +256,8 @@ auto register_buffers(CameraPtr& camera, std::vector<FramePtr>& frames, IFrameOb
 struct IdleModeCamera : std::enable_shared_from_this<IdleModeCamera> {
     using Self = IdleModeCamera;
 
-    explicit IdleModeCamera(CameraPtr c) : camera{std::move(c)} {
+    explicit IdleModeCamera(CameraPtr c, std::shared_ptr<feature_cache_t> f = {}) :
+            camera{std::move(c)}, features{f ? std::move(f) : make_feature_cache(camera)} {
 
     }
 
@@ -203,57 +273,59 @@ struct IdleModeCamera : std::enable_shared_from_this<IdleModeCamera> {
             LOG(ERROR) << "Failed to open camera! " << ErrorCodeToMessage(e) << ENDL;
             return {};
         }
-        if (set_comm_speed(camera)) {
-            return std::make_unique<IdleModeCamera>(camera);
+        if (auto idle{std::make_unique<IdleModeCamera>(camera)}; set_comm_speed(*idle->features)) {
+            return idle;
         }
         return {};
     }
 
     template<typename T>
     auto set_value(const char* name, T val) -> bool {
-        return set_value_impl(camera, name, val);
+        return set_value_impl(*features, name, val);
     }
 
     template<typename T>
     auto get_value(const char* name) -> std::optional<T> {
-        return get_value_impl<T>(camera, name);
+        return get_value_impl<T>(*features, name);
     }
 
     CameraPtr camera;
+    std::shared_ptr<feature_cache_t> features;
 };
 
 struct CaptureModeCamera : std::enable_shared_from_this<CaptureModeCamera> {
 
-    explicit CaptureModeCamera(IdleModeCamera&& from) : camera{std::move(from.camera)} {
+    explicit CaptureModeCamera(IdleModeCamera&& from) : camera{std::move(from.camera)}, features{std::move(from.features)} {
 
     }
 
     template<typename T>
     auto set_value(const char* name, T val) -> bool {
-        return set_value(camera, name, val);
+        return set_value_impl(*features, name, val);
     }
 
     auto start_acquisition() -> bool {
-        return vimba_sdk::start_acquisition(camera);
+        return vimba_sdk::start_acquisition(*features);
     }
 
     auto stop_acquisition() -> bool {
-        return vimba_sdk::stop_acquisition(camera);
+        return vimba_sdk::stop_acquisition(*features);
     }
 
     auto trigger() -> bool {
-        return vimba_sdk::do_software_trigger(camera);
+        return vimba_sdk::do_software_trigger(*features);
     }
 
     auto trigger_once() -> bool {
-        return vimba_sdk::do_software_trigger_once(camera);
+        return vimba_sdk::do_software_trigger_once(*features);
     }
 
     CameraPtr camera;
+    std::shared_ptr<feature_cache_t> features;
 };
 
 auto Into(CaptureModeCamera from) -> IdleModeCamera {
-    return IdleModeCamera{std::move(from.camera)};
+    return IdleModeCamera{std::move(from.camera), std::move(from.features)};
 }
 
 
@@ -266,8 +338,11 @@ auto do_capture_once(CaptureModeCamera& camera, uint32_t timeout) -> std::option
 }
 
 auto async_capture_impl(AsyncCaptureContxt& context, CaptureModeCamera& camera, int queue_size) -> bool {
-    if (auto e = camera.camera->StartContinuousImageAcquisition(queue_size, context.get_observer()); e != VmbErrorSuccess) {
-        LOG(ERROR) << "failed to register for capturing from the camera: " << ErrorCodeToMessage(e) << ENDL;
+    // we are not letting the SDK allocate the frames, so we would know where they are, and how much memory we are using
+    const auto image_size{get_value_impl<VmbInt64_t>(*camera.features, features::PayloadSize::index, features::PayloadSize::name)};
+    context.read_chunk_mode(*camera.features);
+    if (!(image_size && context.allocate_frames(queue_size, image_size.value()) && start_acquisition(*camera.features))) {
+        LOG(ERROR) << "failed to register for capturing from the camera" << ENDL;
         context.stop();
         return false;
     }
@@ -1,6 +1,9 @@
 #pragma once
 #include "log/logging.h"
 #include "vmb_common/ErrorCodeToMessage.h"
+#include "feature_cache.hh"
+#include "features.hh"
+#include "command_wait.hh"
 #include <VimbaCPP/Include/VimbaCPP.h>
 
 namespace camera {
@@ -8,14 +11,29 @@ namespace vimba_sdk {
 
 using namespace AVT::VmbAPI;
 
+// The type that we are using to read integer values from the camera
+using int_value_t = VmbInt64_t;
+
+// Negotiating the packet size with the device can take a few seconds
+constexpr auto PACKET_SIZE_TIMEOUT = std::chrono::milliseconds{5'000};
+
+// Resolve the feature by name only once for each camera (see feature_cache.hh)
+using feature_cache_t = FeatureCache<FeaturePtr>;
+
+auto make_feature_cache(CameraPtr camera) -> std::shared_ptr<feature_cache_t> {
+    return std::make_shared<feature_cache_t>([camera](const char* name) {
+        FeaturePtr feature;
+        if (auto e = camera->GetFeatureByName(name, feature); e != VmbErrorSuccess) {
+            LOG(ERROR) << "failed to get feature " << name << " from the camera: " << ErrorCodeToMessage(e) << ENDL;
+            return FeaturePtr{};
+        }
+        return feature;
+    }, features::COUNT);
+}
+
 template<typename Value>
-auto set_value_impl(CameraPtr& camera, const char* key, Value val) -> bool {
-    FeaturePtr features;
-    if (auto e = camera->GetFeatureByName(key, features); e != VmbErrorSuccess) {
-        LOG(ERROR) << "failed to get exposure mode feature from the camera: " << ErrorCodeToMessage(e) << ENDL;
-        return false;
-    }
-    if (auto e = features->SetValue(val); e != VmbErrorSuccess) {
+auto set_feature_value(FeaturePtr& feature, const char* key, Value val) -> bool {
+    if (auto e = feature->SetValue(val); e != VmbErrorSuccess) {
         LOG(ERROR) << "failed to set value " << val << " for " << key << ": " << ErrorCodeToMessage(e) << ENDL;
         return false;
     }
@@ -23,33 +41,67 @@ auto set_value_impl(CameraPtr& camera, const char* key, Value val) -> bool {
 }
 
 template<typename Value>
-auto get_value_impl(CameraPtr& camera, const char* key) -> std::optional<Value> {
-    FeaturePtr feature;
-    if (auto error = camera->GetFeatureByName(key, feature); error != VmbErrorSuccess) {
-        LOG(WARNING) << "failed to read payload size: " << ErrorCodeToMessage(error) << ENDL;
-        return {};
-    }
+auto get_feature_value(FeaturePtr& feature, const char* key) -> std::optional<Value> {
     Value pl;
     if (auto error = feature->GetValue(pl); error != VmbErrorSuccess) {
-        LOG(WARNING) << "failed to get payload size: " << ErrorCodeToMessage(error) << ENDL;
+        LOG(WARNING) << "failed to get value for " << key << ": " << ErrorCodeToMessage(error) << ENDL;
         return {};
     }
     return pl;
 }
 
-auto set_comm_speed(CameraPtr& camera) -> bool {
-    FeaturePtr features;
-    if (camera->GetFeatureByName("GVSPAdjustPacketSize", features) != VmbErrorSuccess) {
-        LOG(ERROR) << "failed to get packet size feature from the camera" << ENDL;
-        return false;
+template<typename Value>
+auto set_value_impl(feature_cache_t& cache, const char* key, Value val) -> bool {
+    auto feature{cache.get(key)};
+    return feature && set_feature_value(feature, key, val);
+}
+
+template<typename Value>
+auto get_value_impl(feature_cache_t& cache, const char* key) -> std::optional<Value> {
+    if (auto feature{cache.get(key)}; feature) {
+        return get_feature_value<Value>(feature, key);
     }
-    if (features->RunCommand() != VmbErrorSuccess) {
-        LOG(ERROR) << "failed to run feature command" << ENDL;
-        return false;
+    return {};
+}
+
+template<typename Value>
+auto set_value_impl(feature_cache_t& cache, std::size_t index, const char* key, Value val) -> bool {
+    auto feature{cache.get(index, key)};
+    return feature && set_feature_value(feature, key, val);
+}
+
+template<typename Value>
+auto get_value_impl(feature_cache_t& cache, std::size_t index, const char* key) -> std::optional<Value> {
+    if (auto feature{cache.get(index, key)}; feature) {
+        return get_feature_value<Value>(feature, key);
     }
-    bool done{false};
-    while (features->IsCommandDone(done) == VmbErrorSuccess && !done) {
+    return {};
+}
+
+// Run the command and wait for the device to finish it, without spinning (see command_wait.hh)
+auto execute_and_wait(FeaturePtr feature, const char* key, std::chrono::milliseconds timeout) -> CommandResult {
+    const auto result{run_and_wait(key, [&feature]() {
+        return feature && feature->RunCommand() == VmbErrorSuccess;
+    }, [&feature](bool& done) {
+        return feature->IsCommandDone(done) == VmbErrorSuccess;
+    }, timeout)};
+    if (result != CommandResult::Done) {
+        LOG(WARNING) << "command " << key << " is not done: " << result << " (timeout " << timeout.count() << "ms)" << ENDL;
     }
+    return result;
+}
+
+auto execute_and_wait(feature_cache_t& cache, std::size_t index, const char* key, std::chrono::milliseconds timeout) -> CommandResult {
+    return execute_and_wait(cache.get(index, key), key, timeout);
+}
+
+template<typename Command>
+auto execute_and_wait(feature_cache_t& cache, std::chrono::milliseconds timeout = DEFAULT_COMMAND_TIMEOUT) -> bool {
+    return execute_and_wait(cache, Command::index, Command::name, timeout) == CommandResult::Done;
+}
+
+auto set_comm_speed(feature_cache_t& cache) -> bool {
+    const auto done{execute_and_wait<features::GVSPAdjustPacketSize>(cache, PACKET_SIZE_TIMEOUT)};
     LOG(INFO) << "we have " << (done ? "successfully" : "failed") << " set the feature comm speed" << ENDL;
     return done;
 }
@@ -145,8 +197,90 @@ constexpr auto map_pixel_type(PixelFormat from) -> VmbPixelFormatType {
     }
 }
 
-auto TryInto(const FramePtr& from) -> std::optional<ImageView> {
+// Note that the SDK only accept VmbInt64_t for integers (int64_t is ambiguous here), and
+// the pixel format is an enumeration that is set by its integer value
+auto write_feature_value(feature_cache_t& cache, std::size_t index, const char* key, const features::value_t& val) -> bool {
+    return std::visit([&](auto&& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, PixelFormat>) {
+            return set_value_impl(cache, index, key, static_cast<VmbInt64_t>(map_pixel_type(v)));
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            return set_value_impl(cache, index, key, v.c_str());
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            return set_value_impl(cache, index, key, static_cast<VmbInt64_t>(v));
+        } else {
+            return set_value_impl(cache, index, key, v);
+        }
+    }, val);
+}
+
+auto read_feature_value(feature_cache_t& cache, std::size_t index, const char* key, features::FeatureKind kind) -> std::optional<features::value_t> {
+    switch (kind) {
+        case features::FeatureKind::Integer:
+            if (auto v = get_value_impl<VmbInt64_t>(cache, index, key); v) {
+                return static_cast<int64_t>(v.value());
+            }
+            return {};
+        case features::FeatureKind::Float:
+            if (auto v = get_value_impl<double>(cache, index, key); v) {
+                return v.value();
+            }
+            return {};
+        case features::FeatureKind::Boolean:
+            if (auto v = get_value_impl<bool>(cache, index, key); v) {
+                return v.value();
+            }
+            return {};
+        case features::FeatureKind::Enumeration:
+            if (auto v = get_value_impl<std::string>(cache, index, key); v) {
+                return v.value();
+            }
+            return {};
+        case features::FeatureKind::Format:
+            if (auto v = get_value_impl<VmbInt64_t>(cache, index, key); v) {
+                return type_map(static_cast<VmbPixelFormatType>(v.value()));
+            }
+            return {};
+        default:
+            return {};
+    }
+}
+
+auto receive_status(VmbFrameStatusType status) -> ReceiveStatus {
+    switch (status) {
+    case VmbFrameStatusComplete:
+        return ReceiveStatus::Complete;
+    case VmbFrameStatusIncomplete:
+        return ReceiveStatus::Incomplete;
+    case VmbFrameStatusTooSmall:
+        return ReceiveStatus::TooSmall;
+    default:
+        return ReceiveStatus::Invalid;
+    }
+}
+
+// The exposure and the gain are only sent with the frame when the chunk mode is active on the camera (ChunkModeActive),
+// so this is only called when it was on when the capture started. The chunk features belong to the frame, and are gone
+// once it is queued again, so they cannot be cached like the camera features, instead of looking up a FeaturePtr by name
+// on every frame, we are reading the values directly from the handle of the chunk data
+auto read_chunk(const FramePtr& from, ImageView& image) -> void {
+    AncillaryDataPtr chunk;
+    if (from->GetAncillaryData(chunk) != VmbErrorSuccess || !chunk || chunk->Open() != VmbErrorSuccess) {
+        return;
+    }
+    const auto handle{chunk->GetHandle()};
+    if (VmbFloat_t value{0}; VmbFeatureFloatGet(handle, "ChunkExposureTime", &value) == VmbErrorSuccess) {
+        image.exposure = static_cast<float>(value);
+    }
+    if (VmbFloat_t value{0}; VmbFeatureFloatGet(handle, "ChunkGain", &value) == VmbErrorSuccess) {
+        image.gain = static_cast<float>(value);
+    }
+    chunk->Close();
+}
+
+auto TryInto(const FramePtr& from, bool chunks) -> std::optional<ImageView> {
     ImageView image;
+    image.arrived = host_time();
     VmbPixelFormatType pixel_format;
     from->GetPixelFormat(pixel_format);
     from->GetFrameID(image.number);
@@ -164,6 +298,15 @@ auto TryInto(const FramePtr& from) -> std::optional<ImageView> {
         return {};
     }
     image.type = type_map(pixel_format);
+    if (VmbUint64_t ts{0}; from->GetTimestamp(ts) == VmbErrorSuccess) {
+        image.timestamp = ts;
+    }
+    if (VmbFrameStatusType status; from->GetReceiveStatus(status) == VmbErrorSuccess) {
+        image.status = receive_status(status);
+    }
+    if (chunks) {
+        read_chunk(from, image);
+    }
     return image;
 }
 
@@ -182,7 +325,7 @@ auto do_acquisition(CameraPtr& camera, uint32_t timeout, FramePtr& frame) -> std
         LOG(WARNING) << "we don't have the full image after " << timeout << ENDL;
         return {};
     }
-    return TryInto(frame);
+    return TryInto(frame, false);
 }
 
 }   // vimba_sdk
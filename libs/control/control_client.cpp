@@ -0,0 +1,99 @@
+#include "control_client.hh"
+#include "log/logging.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace control {
+
+struct ControlClient {
+    explicit ControlClient(int socket) : fd{socket} {
+    }
+
+    ~ControlClient() {
+        ::close(fd);
+    }
+
+    const int fd;
+    uint32_t next_id{1};
+    std::string output;         // reused for all the requests
+    std::string input;          // what was read after the last reply
+};
+
+auto connect(const std::string& address, uint16_t port) -> client_t {
+    sockaddr_in at{.sin_family = AF_INET, .sin_port = htons(port), .sin_addr = {}, .sin_zero = {}};
+    if (::inet_pton(AF_INET, address.c_str(), &at.sin_addr) != 1) {
+        LOG(ERROR) << "invalid address for the control server " << address << ", expecting an IPv4 address" << ENDL;
+        return {};
+    }
+    const auto fd{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (fd < 0) {
+        LOG(ERROR) << "failed to create the socket for the control client: " << std::strerror(errno) << ENDL;
+        return {};
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&at), sizeof(at)) != 0) {
+        LOG(ERROR) << "failed to connect to the control server at " << address << ":" << port << ": " << std::strerror(errno) << ENDL;
+        ::close(fd);
+        return {};
+    }
+    const int on{1};
+    (void)::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return std::make_shared<ControlClient>(fd);
+}
+
+auto send(ControlClient& client, Command command, uint16_t camera, std::string_view payload) -> uint32_t {
+    const auto id{client.next_id++};
+    client.output.clear();
+    append(client.output, id, command, camera, payload);
+    std::size_t sent{0};
+    while (sent < client.output.size()) {
+        const auto n{::send(client.fd, client.output.data() + sent, client.output.size() - sent, MSG_NOSIGNAL)};
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG(ERROR) << "failed to send " << command << " to the control server: " << std::strerror(errno) << ENDL;
+            return 0;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return id;
+}
+
+auto receive(ControlClient& client) -> std::optional<Reply> {
+    char buffer[4096];
+    while (true) {
+        const auto size{message_size(client.input)};
+        if (!size) {
+            LOG(ERROR) << "invalid reply from the control server" << ENDL;
+            return std::nullopt;
+        }
+        if (size.value() > 0) {
+            auto reply{parse_reply(std::string_view{client.input}.substr(0, size.value()))};
+            client.input.erase(0, size.value());
+            return reply;
+        }
+        const auto got{::recv(client.fd, buffer, sizeof(buffer), 0)};
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return std::nullopt;
+        }
+        client.input.append(buffer, static_cast<std::size_t>(got));
+    }
+}
+
+auto call(ControlClient& client, Command command, uint16_t camera, std::string_view payload) -> std::optional<Reply> {
+    if (send(client, command, camera, payload) == 0) {
+        return std::nullopt;
+    }
+    return receive(client);
+}
+
+}   // end of namespace control
@@ -0,0 +1,33 @@
+#pragma once
+#include "protocol.hh"
+#include <memory>
+#include <string>
+#include <optional>
+#include <stdint.h>
+
+// A simple blocking client for the control server (see control_server.hh), for tools and for measuring the round trip.
+// The requests can be pipelined: send a few requests, and then receive their replies.
+// For example:
+// auto client{control::connect("192.168.1.20", control::DEFAULT_CONTROL_PORT)};
+// if (auto reply = control::call(*client, control::Command::SetExposure, 0, control::encode(12000.0)); !reply || reply->status != control::Status::Ok) {
+//      std::cerr << "failed to set the exposure\n";
+// }
+
+namespace control {
+
+struct ControlClient;
+using client_t = std::shared_ptr<ControlClient>;
+
+// Return nullptr if we cannot connect
+[[nodiscard]] auto connect(const std::string& address, uint16_t port) -> client_t;
+
+// Send the request without waiting for the reply, return the id of the request, or 0 if it failed
+auto send(ControlClient& client, Command command, uint16_t camera, std::string_view payload = {}) -> uint32_t;
+
+// Wait for the next reply, return nullopt if the connection was closed
+[[nodiscard]] auto receive(ControlClient& client) -> std::optional<Reply>;
+
+// Send the request and wait for its reply, there should be no other requests that are waiting for their replies
+[[nodiscard]] auto call(ControlClient& client, Command command, uint16_t camera, std::string_view payload = {}) -> std::optional<Reply>;
+
+}   // end of namespace control
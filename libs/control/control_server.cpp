@@ -0,0 +1,471 @@
+#include "control_server.hh"
+#include "log/logging.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace control {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// the keys of the connections in epoll are starting after these, and are never reused
+constexpr uint64_t LISTENER = 0;
+constexpr uint64_t WAKEUP = 1;
+constexpr int MAX_EVENTS = 64;
+constexpr std::size_t READ_SIZE = 64 * 1024;
+// a client that is not reading its replies is not read from, until it takes them
+constexpr std::size_t MAX_OUTPUT = 256 * 1024;
+constexpr std::size_t MAX_QUEUED = 1024;
+
+struct Job {
+    uint64_t connection;
+    Request request;
+    clock_type::time_point received;
+    bool busy{false};           // rejected, it is only here so its reply is in order with the other replies of the camera
+};
+
+struct Done {
+    uint64_t connection;
+    Reply reply;
+    clock_type::time_point received;
+};
+
+// The commands of a camera are only running on its thread, one at a time
+struct Strand {
+    explicit Strand(Target&& t) : target{std::move(t)} {
+    }
+
+    Target target;
+    std::mutex guard;
+    std::condition_variable_any wakeup;
+    std::deque<Job> jobs;
+    std::size_t waiting{0};     // the jobs that are going to run, not counting the rejected ones
+    std::jthread thread;
+};
+
+struct Connection {
+    int fd{-1};
+    std::string input;          // what was read and is not a complete message yet
+    std::string output;         // the replies that the socket did not take yet
+    std::size_t queued{0};      // the requests that are waiting in the queues of the cameras
+    bool reading{true};         // we are waiting for the requests
+    bool writing{false};        // we are waiting for the socket to be writable
+};
+
+}       // end of local namespace
+
+struct ControlServer {
+    ControlServer(int listening, int poll, int event, uint16_t p, const ControlSettings& s, std::vector<Target>&& targets, std::stop_token cancellation) :
+            settings{s}, port{p}, listener{listening}, epoll{poll}, wakeup{event}, reading(READ_SIZE) {
+        for (auto&& t : targets) {
+            strands.push_back(std::make_unique<Strand>(std::move(t)));
+        }
+        for (auto&& strand : strands) {
+            strand->thread = std::jthread([this, s = strand.get()](std::stop_token st) {
+                serve(*s, std::move(st));
+            });
+        }
+        thread = std::jthread([this](std::stop_token st) {
+            run(std::move(st));
+        });
+        cancelled.emplace(std::move(cancellation), [this] {
+            thread.request_stop();
+            wake();
+        });
+    }
+
+    ~ControlServer() {
+        // the callback is waking the server with the eventfd, so it must be gone (or done running) before we close it
+        cancelled.reset();
+        stop();
+        ::close(wakeup);
+        ::close(epoll);
+        ::close(listener);
+    }
+
+    auto stop() -> void {
+        thread.request_stop();
+        wake();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        for (auto&& strand : strands) {
+            strand->thread.request_stop();
+            if (strand->thread.joinable()) {
+                strand->thread.join();
+            }
+        }
+    }
+
+    auto statistics() const -> ControlStatistics {
+        return ControlStatistics{
+            .connections = connections_count.load(), .requests = requests.load(), .replies = replies.load(), .busy = busy.load(),
+            .invalid = invalid.load(), .throttled = throttled.load(), .total = std::chrono::microseconds{total.load()}, .max = std::chrono::microseconds{max.load()}
+        };
+    }
+
+    const ControlSettings settings;
+    const uint16_t port;
+
+private:
+    auto run(std::stop_token st) -> void;
+    auto serve(Strand& strand, std::stop_token st) -> void;
+    auto accept_all() -> void;
+    // return false when the connection should be closed
+    auto receive(uint64_t key, Connection& connection) -> bool;
+    auto flush(uint64_t key, Connection& connection) -> bool;
+    auto handle(uint64_t key, Connection& connection, Request&& request, clock_type::time_point now) -> void;
+    auto reply(Connection& connection, const Reply& reply, clock_type::time_point received) -> void;
+    auto deliver() -> void;
+    auto close(uint64_t key) -> void;
+    auto wake() -> void {
+        const uint64_t one{1};
+        (void)!::write(wakeup, &one, sizeof(one));
+    }
+
+    const int listener;
+    const int epoll;
+    const int wakeup;                   // an eventfd, for the replies from the cameras and for stopping
+    std::vector<std::unique_ptr<Strand>> strands;
+    std::mutex finishing;               // for the replies from the cameras
+    std::vector<Done> done;
+    // these are only used by the server thread
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t next_key{WAKEUP + 1};
+    std::vector<char> reading;
+    std::atomic<uint64_t> connections_count{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> replies{0};
+    std::atomic<uint64_t> busy{0};
+    std::atomic<uint64_t> invalid{0};
+    std::atomic<uint64_t> throttled{0};
+    std::atomic<uint64_t> total{0};     // microseconds
+    std::atomic<uint64_t> max{0};
+    std::jthread thread;
+    std::optional<std::stop_callback<std::function<void()>>> cancelled;
+};
+
+auto ControlServer::run(std::stop_token st) -> void {
+    epoll_event events[MAX_EVENTS];
+    while (!st.stop_requested()) {
+        const auto count{::epoll_wait(epoll, events, MAX_EVENTS, -1)};
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(ERROR) << "failed to wait for the control connections: " << std::strerror(errno) << ENDL;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            const auto key{events[i].data.u64};
+            if (key == LISTENER) {
+                accept_all();
+                continue;
+            }
+            if (key == WAKEUP) {
+                uint64_t value{0};
+                (void)!::read(wakeup, &value, sizeof(value));
+                deliver();
+                continue;
+            }
+            auto at{connections.find(key)};
+            if (at == connections.end()) {
+                continue;       // it was closed while handling the events before it
+            }
+            const auto flags{events[i].events};
+            if (((flags & EPOLLIN) && !receive(key, at->second)) || ((flags & EPOLLOUT) && !flush(key, at->second)) ||
+                    ((flags & (EPOLLERR | EPOLLHUP)) && !(flags & EPOLLIN))) {
+                close(key);
+            }
+        }
+    }
+    while (!connections.empty()) {
+        close(connections.begin()->first);
+    }
+}
+
+auto ControlServer::serve(Strand& strand, std::stop_token st) -> void {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock{strand.guard};
+            if (!strand.wakeup.wait(lock, st, [&strand] { return !strand.jobs.empty(); })) {
+                return;
+            }
+            job = std::move(strand.jobs.front());
+            strand.jobs.pop_front();
+            if (!job.busy) {
+                --strand.waiting;
+            }
+        }
+        auto result{job.busy ? Reply{.status = Status::Busy, .payload = {}} : strand.target.handler(job.request)};
+        result.id = job.request.id;
+        result.camera = job.request.camera;
+        {
+            std::lock_guard lock{finishing};
+            done.push_back(Done{.connection = job.connection, .reply = std::move(result), .received = job.received});
+        }
+        wake();
+    }
+}
+
+auto ControlServer::accept_all() -> void {
+    while (true) {
+        const auto fd{::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG(WARNING) << "failed to accept a control connection: " << std::strerror(errno) << ENDL;
+            }
+            return;
+        }
+        if (connections.size() >= settings.max_clients) {
+            LOG(WARNING) << "rejecting a control connection, there are already " << connections.size() << " clients" << ENDL;
+            ::close(fd);
+            continue;
+        }
+        // the requests and the replies are small, and the clients are waiting for them
+        const int on{1};
+        (void)::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        const auto key{next_key++};
+        epoll_event event{.events = EPOLLIN, .data = {.u64 = key}};
+        if (::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            LOG(WARNING) << "failed to watch a control connection: " << std::strerror(errno) << ENDL;
+            ::close(fd);
+            continue;
+        }
+        connections.emplace(key, Connection{.fd = fd, .input = {}, .output = {}, .queued = 0, .reading = true, .writing = false});
+        ++connections_count;
+    }
+}
+
+auto ControlServer::receive(uint64_t key, Connection& connection) -> bool {
+    // epoll is level triggered, so what we did not read now is read the next time around, after the requests that we have
+    while (connection.input.size() < READ_SIZE) {
+        const auto got{::read(connection.fd, reading.data(), reading.size())};
+        if (got == 0) {
+            return false;       // the client closed the connection
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            break;
+        }
+        connection.input.append(reading.data(), static_cast<std::size_t>(got));
+    }
+    // all the requests that arrived, the client can send many of them without waiting for the replies
+    const auto now{clock_type::now()};
+    std::size_t offset{0};
+    while (true) {
+        const auto size{message_size(std::string_view{connection.input}.substr(offset))};
+        if (!size) {
+            ++invalid;
+            LOG(WARNING) << "closing a control connection with an invalid message" << ENDL;
+            return false;
+        }
+        if (size.value() == 0) {
+            break;
+        }
+        handle(key, connection, parse_request(std::string_view{connection.input}.substr(offset, size.value())), now);
+        offset += size.value();
+    }
+    connection.input.erase(0, offset);
+    return flush(key, connection);
+}
+
+auto ControlServer::handle(uint64_t key, Connection& connection, Request&& request, clock_type::time_point now) -> void {
+    ++requests;
+    Reply result{.id = request.id, .status = Status::Ok, .camera = request.camera, .payload = {}};
+    switch (request.command) {
+        case Command::Ping:
+            reply(connection, result, now);
+            return;
+        case Command::Cameras:
+            for (auto&& strand : strands) {
+                result.payload += strand->target.camera + "\n";
+            }
+            reply(connection, result, now);
+            return;
+        default:
+            break;
+    }
+    if (request.command > Command::Statistics) {
+        result.status = Status::UnknownCommand;
+    } else if (request.camera >= strands.size()) {
+        result.status = Status::UnknownCamera;
+    } else {
+        // when the queue is full, the request is rejected, but the reply is still passed through the queue,
+        // since the replies of a camera must be in the order of the requests
+        auto& strand{*strands[request.camera]};
+        std::lock_guard lock{strand.guard};
+        const auto rejected{strand.waiting >= settings.queue};
+        if (rejected) {
+            ++busy;
+            request.payload.clear();
+        } else {
+            ++strand.waiting;
+        }
+        strand.jobs.push_back(Job{.connection = key, .request = std::move(request), .received = now, .busy = rejected});
+        strand.wakeup.notify_one();
+        ++connection.queued;
+        return;
+    }
+    reply(connection, result, now);
+}
+
+auto ControlServer::reply(Connection& connection, const Reply& r, clock_type::time_point received) -> void {
+    append(connection.output, r);
+    const uint64_t took = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - received).count();
+    total += took;
+    if (took > max) {
+        max = took;
+    }
+    ++replies;
+}
+
+auto ControlServer::deliver() -> void {
+    std::vector<Done> finished;
+    {
+        std::lock_guard lock{finishing};
+        finished.swap(done);
+    }
+    std::vector<uint64_t> touched;
+    for (auto&& d : finished) {
+        if (auto at = connections.find(d.connection); at != connections.end()) {
+            --at->second.queued;
+            reply(at->second, d.reply, d.received);
+            touched.push_back(d.connection);
+        }
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (auto key : touched) {
+        if (!flush(key, connections.at(key))) {
+            close(key);
+        }
+    }
+}
+
+auto ControlServer::flush(uint64_t key, Connection& connection) -> bool {
+    std::size_t sent{0};
+    while (sent < connection.output.size()) {
+        const auto n{::send(connection.fd, connection.output.data() + sent, connection.output.size() - sent, MSG_NOSIGNAL)};
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            break;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    connection.output.erase(0, sent);
+    // only wait for the socket to be writable while there are replies that it did not take, and stop reading the
+    // requests of a client that has too many replies that it did not take, or that are still waiting for the cameras
+    const auto writing{!connection.output.empty()};
+    const auto reading{connection.output.size() < MAX_OUTPUT && connection.queued < MAX_QUEUED};
+    if (writing != connection.writing || reading != connection.reading) {
+        epoll_event event{.events = (reading ? EPOLLIN : 0u) | (writing ? EPOLLOUT : 0u), .data = {.u64 = key}};
+        if (::epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event) != 0) {
+            return false;
+        }
+        throttled += connection.reading && !reading ? 1 : 0;
+        connection.reading = reading;
+        connection.writing = writing;
+    }
+    return true;
+}
+
+auto ControlServer::close(uint64_t key) -> void {
+    if (auto at = connections.find(key); at != connections.end()) {
+        (void)::epoll_ctl(epoll, EPOLL_CTL_DEL, at->second.fd, nullptr);
+        ::close(at->second.fd);
+        connections.erase(at);
+    }
+}
+
+auto make_control_server(const ControlSettings& settings, std::vector<Target>&& targets, std::stop_token cancellation) -> control_server_t {
+    if (targets.size() > UINT16_MAX || std::any_of(targets.begin(), targets.end(), [](auto&& t) { return !t.handler; })) {
+        LOG(ERROR) << "cannot control " << targets.size() << " cameras, each camera needs a handler, and there can be up to " << UINT16_MAX << ENDL;
+        return {};
+    }
+    sockaddr_in at{.sin_family = AF_INET, .sin_port = htons(settings.port), .sin_addr = {}, .sin_zero = {}};
+    if (::inet_pton(AF_INET, settings.address.c_str(), &at.sin_addr) != 1) {
+        LOG(ERROR) << "invalid address for the control server " << settings.address << ", expecting an IPv4 address" << ENDL;
+        return {};
+    }
+    const auto listener{::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (listener < 0) {
+        LOG(ERROR) << "failed to create the socket for the control server: " << std::strerror(errno) << ENDL;
+        return {};
+    }
+    const int reuse{1};
+    (void)::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t length{sizeof(at)};
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&at), sizeof(at)) != 0 || ::listen(listener, 16) != 0 ||
+            ::getsockname(listener, reinterpret_cast<sockaddr*>(&at), &length) != 0) {
+        LOG(ERROR) << "failed to listen for control on " << settings.address << ":" << settings.port << ": " << std::strerror(errno) << ENDL;
+        ::close(listener);
+        return {};
+    }
+    const auto poll{::epoll_create1(EPOLL_CLOEXEC)};
+    const auto event{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+    epoll_event listening{.events = EPOLLIN, .data = {.u64 = LISTENER}};
+    epoll_event waking{.events = EPOLLIN, .data = {.u64 = WAKEUP}};
+    if (poll < 0 || event < 0 || ::epoll_ctl(poll, EPOLL_CTL_ADD, listener, &listening) != 0 || ::epoll_ctl(poll, EPOLL_CTL_ADD, event, &waking) != 0) {
+        LOG(ERROR) << "failed to create the control server events: " << std::strerror(errno) << ENDL;
+        for (auto fd : {poll, event, listener}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        return {};
+    }
+    const auto port{ntohs(at.sin_port)};
+    LOG(INFO) << "controlling " << targets.size() << " cameras on " << settings.address << ":" << port << ENDL;
+    return std::make_shared<ControlServer>(listener, poll, event, port, settings, std::move(targets), std::move(cancellation));
+}
+
+auto port(const ControlServer& server) -> uint16_t {
+    return server.port;
+}
+
+auto stop(ControlServer& server) -> void {
+    server.stop();
+}
+
+auto statistics(const ControlServer& server) -> ControlStatistics {
+    return server.statistics();
+}
+
+auto ControlStatistics::mean() const -> std::chrono::microseconds {
+    return replies ? total / static_cast<int64_t>(replies) : std::chrono::microseconds{0};
+}
+
+auto operator << (std::ostream& os, const ControlStatistics& cs) -> std::ostream& {
+    return os << "connections " << cs.connections << ", requests " << cs.requests << ", replies " << cs.replies << ", busy " << cs.busy
+        << ", invalid " << cs.invalid << ", throttled " << cs.throttled << ", mean " << cs.mean().count() << "us, max " << cs.max.count() << "us";
+}
+
+}   // end of namespace control
@@ -0,0 +1,73 @@
+#pragma once
+#include "protocol.hh"
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Control the cameras remotely over TCP (see protocol.hh for the messages).
+// A single thread is serving all the clients with epoll: the sockets are not blocking, each client can send
+// many requests without waiting (they are read and parsed as they arrive), and the replies are written as the
+// socket can take them. The server itself is never talking to the cameras: each camera has a thread that is the
+// only one running its commands, with a bounded queue of requests, so a slow camera is not delaying the other
+// cameras or the clients, and the commands of a camera are running one at a time, in the order that they arrived.
+// When the command is done, the reply is passed back to the server thread (that is woken with an eventfd) and written
+// to the client. A client that is not reading its replies is not read from until it takes them, so what is kept for
+// each client is bounded. Nothing here is on the path of the frames, the handler of each camera decides how to reach it
+// (for example with recording::with_camera). Ping and Cameras are answered by the server thread.
+// For example:
+// std::vector<control::Target> targets{{"DEV_1AB22C00A1B2", [&camera](const control::Request& request) {
+//      return control::Reply{.status = set_exposure(camera, request) ? control::Status::Ok : control::Status::Failed};
+// }}};
+// auto server{control::make_control_server(control::ControlSettings{.port = 5100}, std::move(targets), stop_source.get_token())};
+
+namespace control {
+
+struct ControlSettings {
+    std::string address{"0.0.0.0"};         // to listen on
+    uint16_t port{DEFAULT_CONTROL_PORT};    // 0 for any free port (see port())
+    std::size_t max_clients{16};
+    std::size_t queue{64};                  // requests that are waiting for each camera, after that the requests are rejected as busy
+};
+
+// Called on the thread of the camera, the id and the camera of the reply are set by the server
+using handler_f = std::function<Reply(const Request& request)>;
+
+struct Target {
+    std::string camera;
+    handler_f handler;
+};
+
+struct ControlStatistics {
+    uint64_t connections{0};
+    uint64_t requests{0};
+    uint64_t replies{0};
+    uint64_t busy{0};                       // requests that were rejected since the queue of the camera was full
+    uint64_t invalid{0};                    // clients that were disconnected for sending an invalid message
+    uint64_t throttled{0};                  // times that we stopped reading from a client, since it was not taking its replies
+    std::chrono::microseconds total{0};     // from reading the request until the reply is ready, for all the replies
+    std::chrono::microseconds max{0};
+
+    auto mean() const -> std::chrono::microseconds;
+};
+auto operator << (std::ostream& os, const ControlStatistics& cs) -> std::ostream&;
+
+struct ControlServer;
+using control_server_t = std::shared_ptr<ControlServer>;
+
+// Return nullptr if we cannot listen on the address
+[[nodiscard]] auto make_control_server(const ControlSettings& settings, std::vector<Target>&& targets, std::stop_token cancellation) -> control_server_t;
+
+// The port that the server is listening on, for when it was created with port 0
+[[nodiscard]] auto port(const ControlServer& server) -> uint16_t;
+
+// Close all the connections, and wait for the commands that are running
+auto stop(ControlServer& server) -> void;
+
+[[nodiscard]] auto statistics(const ControlServer& server) -> ControlStatistics;
+
+}   // end of namespace control
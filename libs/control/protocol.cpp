@@ -0,0 +1,148 @@
+#include "protocol.hh"
+#include <cstring>
+#include <iostream>
+
+namespace control {
+namespace {
+
+auto header_of(std::string_view message) -> MessageHeader {
+    MessageHeader header;
+    std::memcpy(&header, message.data(), sizeof(header));
+    return header;
+}
+
+template<typename T>
+auto encode_value(T value) -> std::string {
+    std::string output(sizeof(value), '\0');
+    std::memcpy(output.data(), &value, sizeof(value));
+    return output;
+}
+
+template<typename T>
+auto decode_value(std::string_view payload) -> std::optional<T> {
+    if (payload.size() != sizeof(T)) {
+        return std::nullopt;
+    }
+    T value;
+    std::memcpy(&value, payload.data(), sizeof(value));
+    return value;
+}
+
+}       // end of local namespace
+
+auto append(std::string& to, uint32_t id, uint16_t code, uint16_t camera, std::string_view payload) -> void {
+    const MessageHeader header{.size = static_cast<uint32_t>(sizeof(MessageHeader) + payload.size()), .id = id, .code = code, .camera = camera};
+    to.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    to.append(payload);
+}
+
+auto append(std::string& to, uint32_t id, Command command, uint16_t camera, std::string_view payload) -> void {
+    append(to, id, static_cast<uint16_t>(command), camera, payload);
+}
+
+auto append(std::string& to, const Reply& reply) -> void {
+    append(to, reply.id, static_cast<uint16_t>(reply.status), reply.camera, reply.payload);
+}
+
+auto message_size(std::string_view buffer) -> std::optional<std::size_t> {
+    if (buffer.size() < sizeof(MessageHeader)) {
+        return 0;
+    }
+    const auto size{header_of(buffer).size};
+    if (size < sizeof(MessageHeader) || size > MAX_MESSAGE) {
+        return std::nullopt;
+    }
+    return size <= buffer.size() ? size : 0;
+}
+
+auto parse_request(std::string_view message) -> Request {
+    const auto header{header_of(message)};
+    return Request{
+        .id = header.id, .command = static_cast<Command>(header.code), .camera = header.camera,
+        .payload = std::string{message.substr(sizeof(header), header.size - sizeof(header))}
+    };
+}
+
+auto parse_reply(std::string_view message) -> Reply {
+    const auto header{header_of(message)};
+    return Reply{
+        .id = header.id, .status = static_cast<Status>(header.code), .camera = header.camera,
+        .payload = std::string{message.substr(sizeof(header), header.size - sizeof(header))}
+    };
+}
+
+auto encode(double value) -> std::string {
+    return encode_value(value);
+}
+
+auto encode(int64_t value) -> std::string {
+    return encode_value(value);
+}
+
+auto decode_double(std::string_view payload) -> std::optional<double> {
+    return decode_value<double>(payload);
+}
+
+auto decode_integer(std::string_view payload) -> std::optional<int64_t> {
+    return decode_value<int64_t>(payload);
+}
+
+auto operator << (std::ostream& os, Command command) -> std::ostream& {
+    switch (command) {
+        case Command::Ping:
+            return os << "ping";
+        case Command::Cameras:
+            return os << "cameras";
+        case Command::SetExposure:
+            return os << "set exposure";
+        case Command::AutoExposure:
+            return os << "auto exposure";
+        case Command::WhiteBalance:
+            return os << "white balance";
+        case Command::SetGain:
+            return os << "set gain";
+        case Command::TriggerMode:
+            return os << "trigger mode";
+        case Command::StartAcquisition:
+            return os << "start acquisition";
+        case Command::StopAcquisition:
+            return os << "stop acquisition";
+        case Command::StartRecording:
+            return os << "start recording";
+        case Command::StopRecording:
+            return os << "stop recording";
+        case Command::Trigger:
+            return os << "trigger";
+        case Command::Statistics:
+            return os << "statistics";
+        default:
+            return os << "unknown command " << static_cast<uint16_t>(command);
+    }
+}
+
+auto operator << (std::ostream& os, Status status) -> std::ostream& {
+    switch (status) {
+        case Status::Ok:
+            return os << "ok";
+        case Status::Failed:
+            return os << "failed";
+        case Status::Invalid:
+            return os << "invalid";
+        case Status::UnknownCommand:
+            return os << "unknown command";
+        case Status::UnknownCamera:
+            return os << "unknown camera";
+        case Status::NotAllowed:
+            return os << "not allowed";
+        case Status::Busy:
+            return os << "busy";
+        default:
+            return os << "unknown status " << static_cast<uint16_t>(status);
+    }
+}
+
+auto operator << (std::ostream& os, const Reply& reply) -> std::ostream& {
+    return os << "reply " << reply.id << " for camera " << reply.camera << ": " << reply.status << ", " << reply.payload.size() << " bytes";
+}
+
+}   // end of namespace control
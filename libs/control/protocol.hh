@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <optional>
+#include <iosfwd>
+#include <stdint.h>
+
+// The remote control of the cameras is over TCP, with a small binary protocol. Each request and each reply is a message:
+// [MessageHeader][payload]
+// where the size in the header is of the whole message, so the messages can be read from the stream one after the other.
+// A client can send many requests without waiting for the replies (pipelining), and each reply has the id of its request.
+// The replies for the same camera are in the order of the requests, but the replies for different cameras can be in any
+// order, since each camera is running its commands on its own. The values in the payload (see encode) and in the header
+// are in the host byte order (the viewers and the recorder are on the same kind of hosts).
+// For example, set the exposure of the second camera to 12 milliseconds:
+// std::string message;
+// control::append(message, 1, control::Command::SetExposure, 1, control::encode(12000.0));
+
+namespace control {
+
+constexpr uint16_t DEFAULT_CONTROL_PORT = 5100;
+constexpr std::size_t MAX_MESSAGE = 64 * 1024;
+
+enum class Command : uint16_t {
+    Ping,               // answered by the server itself, to measure the round trip
+    Cameras,            // the ids of the cameras, one on each line, the camera in the other requests is the position here
+    SetExposure,        // double, microseconds
+    AutoExposure,       // int64, 0 for off, 1 for once and 2 for continuous
+    WhiteBalance,       // int64, 0 for off, 1 for once and 2 for continuous
+    SetGain,            // double, dB
+    TriggerMode,        // int64, -1 for free running, or the hardware trigger line, only when not recording
+    StartAcquisition,
+    StopAcquisition,
+    StartRecording,
+    StopRecording,
+    Trigger,            // a software trigger, or save an event in the events mode
+    Statistics          // the statistics of the recording, as text
+};
+auto operator << (std::ostream& os, Command command) -> std::ostream&;
+
+enum class Status : uint16_t {
+    Ok,
+    Failed,             // the camera failed to do it
+    Invalid,            // the payload is not what the command expects
+    UnknownCommand,
+    UnknownCamera,
+    NotAllowed,         // not in the current state of the camera, for example changing the trigger while recording
+    Busy                // too many requests are already waiting for this camera
+};
+auto operator << (std::ostream& os, Status status) -> std::ostream&;
+
+struct MessageHeader {
+    uint32_t size{0};           // of the whole message, including this header
+    uint32_t id{0};             // chosen by the client, the reply has the same id
+    uint16_t code{0};           // Command for the requests, and Status for the replies
+    uint16_t camera{0};
+};
+static_assert(sizeof(MessageHeader) == 12, "the message header is part of the protocol");
+
+struct Request {
+    uint32_t id{0};
+    Command command{Command::Ping};
+    uint16_t camera{0};
+    std::string payload;
+};
+
+struct Reply {
+    uint32_t id{0};
+    Status status{Status::Ok};
+    uint16_t camera{0};
+    std::string payload;
+};
+auto operator << (std::ostream& os, const Reply& reply) -> std::ostream&;
+
+// Add a message to the end of the buffer
+auto append(std::string& to, uint32_t id, uint16_t code, uint16_t camera, std::string_view payload) -> void;
+auto append(std::string& to, uint32_t id, Command command, uint16_t camera, std::string_view payload) -> void;
+auto append(std::string& to, const Reply& reply) -> void;
+
+// The size of the first message in the buffer, 0 if it did not arrive completely yet, and nullopt if it is not a valid message
+[[nodiscard]] auto message_size(std::string_view buffer) -> std::optional<std::size_t>;
+
+// These are for a message that is complete (see message_size)
+[[nodiscard]] auto parse_request(std::string_view message) -> Request;
+[[nodiscard]] auto parse_reply(std::string_view message) -> Reply;
+
+[[nodiscard]] auto encode(double value) -> std::string;
+[[nodiscard]] auto encode(int64_t value) -> std::string;
+[[nodiscard]] auto decode_double(std::string_view payload) -> std::optional<double>;
+[[nodiscard]] auto decode_integer(std::string_view payload) -> std::optional<int64_t>;
+
+}   // end of namespace control
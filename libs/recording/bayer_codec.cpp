@@ -0,0 +1,609 @@
+#include "bayer_codec.hh"
+#include "log/logging.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <atomic>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t BLOCK = 32;           // the number of pixels that are using the same Rice parameter
+constexpr unsigned MAX_K = 7;
+constexpr unsigned K_BITS = 3;
+constexpr unsigned ESCAPE = 24;             // this many zeros are followed by the value as is
+constexpr uint32_t STORED = 1u << 31;       // in the size of a tile, when it was stored as is
+
+struct Geometry {
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t tile_rows{0};
+    uint32_t tiles{0};
+
+    Geometry(uint32_t w, uint32_t h, uint32_t rows) : width{w}, height{h}, tile_rows{rows}, tiles{(h / 2 + rows - 1) / rows} {
+    }
+
+    // the rows of the planes, the tile is twice that in the frame
+    auto first_row(uint32_t tile) const -> uint32_t {
+        return tile * tile_rows;
+    }
+
+    auto last_row(uint32_t tile) const -> uint32_t {
+        return std::min(height / 2, (tile + 1) * tile_rows);
+    }
+
+    auto raw_size(uint32_t tile) const -> std::size_t {
+        return std::size_t{last_row(tile) - first_row(tile)} * 2 * width;
+    }
+
+    auto raw_offset(uint32_t tile) const -> std::size_t {
+        return std::size_t{first_row(tile)} * 2 * width;
+    }
+
+    auto plane_width() const -> uint32_t {
+        return width / 2;
+    }
+};
+
+auto zigzag(uint8_t difference) -> uint8_t {
+    const auto r{static_cast<int8_t>(difference)};
+    return static_cast<uint8_t>((r << 1) ^ (r >> 7));
+}
+
+auto unzigzag(uint8_t z) -> uint8_t {
+    return static_cast<uint8_t>((z >> 1) ^ -(z & 1));
+}
+
+// The median edge detector: the smaller of left and up if up-left is above both (an edge), the larger if it is below both,
+// and otherwise the plane through the 3 of them
+auto predict(uint8_t left, uint8_t up, uint8_t up_left) -> uint8_t {
+    const auto low{std::min(left, up)};
+    const auto high{std::max(left, up)};
+    const auto plane{static_cast<uint8_t>(left + up - up_left)};
+    return up_left >= high ? low : (up_left <= low ? high : plane);
+}
+
+// The row of the plane, from every other pixel of the row in the frame
+auto extract(const uint8_t* row, uint32_t parity, uint8_t* to, uint32_t count) -> void {
+    for (uint32_t x = 0; x < count; x++) {
+        to[x] = row[2 * x + parity];
+    }
+}
+
+auto insert(const uint8_t* from, uint8_t* row, uint32_t parity, uint32_t count) -> void {
+    for (uint32_t x = 0; x < count; x++) {
+        row[2 * x + parity] = from[x];
+    }
+}
+
+// All the pixels of the row are known, so this is a loop without dependencies between the pixels
+auto residuals(const uint8_t* current, const uint8_t* up, uint8_t* output, uint32_t count) -> void {
+    if (!up) {
+        output[0] = zigzag(current[0]);
+        for (uint32_t x = 1; x < count; x++) {
+            output[x] = zigzag(static_cast<uint8_t>(current[x] - current[x - 1]));
+        }
+        return;
+    }
+    output[0] = zigzag(static_cast<uint8_t>(current[0] - up[0]));
+    for (uint32_t x = 1; x < count; x++) {
+        output[x] = zigzag(static_cast<uint8_t>(current[x] - predict(current[x - 1], up[x], up[x - 1])));
+    }
+}
+
+// Here each pixel is depending on the one before it
+auto reconstruct(const uint8_t* values, const uint8_t* up, uint8_t* current, uint32_t count) -> void {
+    if (!up) {
+        current[0] = unzigzag(values[0]);
+        for (uint32_t x = 1; x < count; x++) {
+            current[x] = static_cast<uint8_t>(current[x - 1] + unzigzag(values[x]));
+        }
+        return;
+    }
+    current[0] = static_cast<uint8_t>(up[0] + unzigzag(values[0]));
+    for (uint32_t x = 1; x < count; x++) {
+        current[x] = static_cast<uint8_t>(predict(current[x - 1], up[x], up[x - 1]) + unzigzag(values[x]));
+    }
+}
+
+// MSB first, written 32 bits at a time
+struct BitWriter {
+    explicit BitWriter(uint8_t* to) : start{to}, output{to} {
+    }
+
+    // the count is at most 32
+    auto put(uint32_t value, unsigned count) -> void {
+        accumulator = (accumulator << count) | value;
+        pending += count;
+        if (pending >= 32) {
+            pending -= 32;
+            const auto word{static_cast<uint32_t>(accumulator >> pending)};
+            output[0] = static_cast<uint8_t>(word >> 24);
+            output[1] = static_cast<uint8_t>(word >> 16);
+            output[2] = static_cast<uint8_t>(word >> 8);
+            output[3] = static_cast<uint8_t>(word);
+            output += 4;
+        }
+    }
+
+    auto flush() -> void {
+        while (pending >= 8) {
+            pending -= 8;
+            *output++ = static_cast<uint8_t>(accumulator >> pending);
+        }
+        if (pending > 0) {
+            *output++ = static_cast<uint8_t>(accumulator << (8 - pending));
+            pending = 0;
+        }
+    }
+
+    auto size() const -> std::size_t {
+        return output - start;
+    }
+
+private:
+    uint8_t* start;
+    uint8_t* output;
+    uint64_t accumulator{0};
+    unsigned pending{0};
+};
+
+// The bits that were not read yet are at the top of the accumulator
+struct BitReader {
+    BitReader(const uint8_t* from, std::size_t size) : input{from}, end{from + size} {
+    }
+
+    auto get(unsigned count) -> uint32_t {
+        refill();
+        const auto value{static_cast<uint32_t>(accumulator >> (64 - count))};
+        skip(count);
+        return value;
+    }
+
+    // A single value is never more than 32 bits, so a single refill is enough for it
+    auto rice(unsigned k) -> uint8_t {
+        refill();
+        const auto q{static_cast<unsigned>(std::countl_zero(accumulator))};
+        if (q >= ESCAPE) {
+            const auto value{static_cast<uint8_t>(accumulator >> (64 - ESCAPE - 8))};
+            skip(ESCAPE + 8);
+            return value;
+        }
+        const auto low{k ? static_cast<uint32_t>((accumulator << (q + 1)) >> (64 - k)) : 0};
+        skip(q + 1 + k);
+        return static_cast<uint8_t>((q << k) | low);
+    }
+
+    // we are reading zeros after the end while reading ahead, using more than that means that the data is corrupted
+    auto valid() const -> bool {
+        return overrun * 8 <= available;
+    }
+
+private:
+    // at least 32 bits are available after this
+    auto refill() -> void {
+        if (available > 32) {
+            return;
+        }
+        uint32_t word{0};
+        if (end - input >= 4) {
+            word = uint32_t{input[0]} << 24 | uint32_t{input[1]} << 16 | uint32_t{input[2]} << 8 | input[3];
+            input += 4;
+        } else {
+            for (int i = 0; i < 4; i++) {
+                word <<= 8;
+                if (input < end) {
+                    word |= *input++;
+                } else {
+                    ++overrun;
+                }
+            }
+        }
+        accumulator |= uint64_t{word} << (32 - available);
+        available += 32;
+    }
+
+    auto skip(unsigned count) -> void {
+        accumulator <<= count;
+        available -= count;
+    }
+
+    const uint8_t* input;
+    const uint8_t* end;
+    uint64_t accumulator{0};
+    unsigned available{0};
+    std::size_t overrun{0};
+};
+
+auto encode_values(const uint8_t* values, uint32_t count, BitWriter& bits) -> void {
+    for (uint32_t at = 0; at < count; at += BLOCK) {
+        const auto n{std::min<uint32_t>(BLOCK, count - at)};
+        uint32_t sum{0};
+        for (uint32_t i = 0; i < n; i++) {
+            sum += values[at + i];
+        }
+        // 2^k is about the mean of the values in the block
+        unsigned k{0};
+        while (k < MAX_K && (n << k) < sum) {
+            ++k;
+        }
+        bits.put(k, K_BITS);
+        const auto mask{(1u << k) - 1};
+        for (uint32_t i = 0; i < n; i++) {
+            // q zeros, a one, and the k low bits of the value
+            const uint32_t value{values[at + i]};
+            const auto q{value >> k};
+            if (q < ESCAPE) {
+                bits.put((1u << k) | (value & mask), q + 1 + k);
+            } else {
+                bits.put(value, ESCAPE + 8);
+            }
+        }
+    }
+}
+
+auto decode_values(BitReader& bits, uint8_t* values, uint32_t count) -> void {
+    for (uint32_t at = 0; at < count; at += BLOCK) {
+        const auto n{std::min<uint32_t>(BLOCK, count - at)};
+        const auto k{bits.get(K_BITS)};
+        for (uint32_t i = 0; i < n; i++) {
+            values[at + i] = bits.rice(k);
+        }
+    }
+}
+
+struct Rows {
+    auto resize(uint32_t width) -> void {
+        current.resize(width);
+        previous.resize(width);
+        values.resize(width);
+    }
+
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> values;
+};
+
+// Return false if the tile did not get smaller, then the output is not valid
+auto encode_tile(const camera::ImageView& image, const Geometry& geometry, uint32_t tile, Rows& rows, std::vector<uint8_t>& output) -> bool {
+    const auto width{geometry.plane_width()};
+    const auto raw{geometry.raw_size(tile)};
+    // a row is never more than 5 bytes per pixel, so we stop once we are larger than the raw tile without checking every write
+    output.resize(raw + std::size_t{width} * 5 + 16);
+    rows.resize(width);
+    BitWriter bits{output.data()};
+    for (uint32_t plane = 0; plane < 4; plane++) {
+        const auto dy{plane >> 1};
+        const auto dx{plane & 1};
+        const uint8_t* up{nullptr};
+        for (auto y = geometry.first_row(tile); y < geometry.last_row(tile); y++) {
+            extract(image.data + std::size_t{2 * y + dy} * image.width, dx, rows.current.data(), width);
+            residuals(rows.current.data(), up, rows.values.data(), width);
+            encode_values(rows.values.data(), width, bits);
+            if (bits.size() >= raw) {
+                return false;
+            }
+            std::swap(rows.current, rows.previous);
+            up = rows.previous.data();
+        }
+    }
+    bits.flush();
+    output.resize(bits.size());
+    return output.size() < raw;
+}
+
+auto decode_tile(const uint8_t* data, std::size_t size, bool stored, const Geometry& geometry, uint32_t tile, Rows& rows, uint8_t* output) -> bool {
+    auto to{output + geometry.raw_offset(tile)};
+    if (stored) {
+        if (size != geometry.raw_size(tile)) {
+            return false;
+        }
+        std::memcpy(to, data, size);
+        return true;
+    }
+    const auto width{geometry.plane_width()};
+    rows.resize(width);
+    BitReader bits{data, size};
+    for (uint32_t plane = 0; plane < 4; plane++) {
+        const auto dy{plane >> 1};
+        const auto dx{plane & 1};
+        const uint8_t* up{nullptr};
+        for (auto y = geometry.first_row(tile); y < geometry.last_row(tile); y++) {
+            decode_values(bits, rows.values.data(), width);
+            reconstruct(rows.values.data(), up, rows.current.data(), width);
+            insert(rows.current.data(), output + std::size_t{2 * y + dy} * geometry.width, dx, width);
+            std::swap(rows.current, rows.previous);
+            up = rows.previous.data();
+        }
+    }
+    return bits.valid();
+}
+
+// The position of each tile in the compressed frame, nullopt if the frame is not valid
+struct Layout {
+    Geometry geometry;
+    std::vector<const uint8_t*> tiles;
+    std::vector<uint32_t> sizes;
+};
+
+auto read_layout(const uint8_t* data, std::size_t size, std::size_t output_size) -> std::optional<Layout> {
+    CompressedFrame header;
+    if (size < sizeof(header)) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != CODEC_MAGIC || header.width == 0 || header.height == 0 || header.width % 2 || header.height % 2 ||
+            header.tile_rows == 0 || output_size != std::size_t{header.width} * header.height) {
+        return std::nullopt;
+    }
+    Layout layout{.geometry = Geometry{header.width, header.height, header.tile_rows}, .tiles = {}, .sizes = {}};
+    if (header.tiles != layout.geometry.tiles || size < sizeof(header) + header.tiles * sizeof(uint32_t)) {
+        return std::nullopt;
+    }
+    layout.sizes.resize(header.tiles);
+    std::memcpy(layout.sizes.data(), data + sizeof(header), header.tiles * sizeof(uint32_t));
+    auto at{sizeof(header) + header.tiles * sizeof(uint32_t)};
+    for (auto s : layout.sizes) {
+        layout.tiles.push_back(data + at);
+        at += s & ~STORED;
+        if (at > size) {
+            return std::nullopt;
+        }
+    }
+    return layout;
+}
+
+auto micros(clock_type::duration d) -> std::chrono::microseconds {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d);
+}
+
+}       // end of local namespace
+
+// Run the same function on all the tiles, with the threads of the pool and the calling thread
+struct BayerCodec::Pool {
+    explicit Pool(std::size_t count) {
+        for (std::size_t i = 1; i < count; i++) {
+            threads.emplace_back([this](std::stop_token st) {
+                work(std::move(st));
+            });
+        }
+    }
+
+    ~Pool() {
+        for (auto&& t : threads) {
+            t.request_stop();
+        }
+        work_cv.notify_all();
+    }
+
+    auto run(std::size_t count, std::function<void(std::size_t)> f) -> void {
+        {
+            std::lock_guard lock{guard};
+            job = std::move(f);
+            tasks = count;
+            next = 0;
+            finished = 0;
+            ++generation;
+        }
+        work_cv.notify_all();
+        help(generation);
+        std::unique_lock lock{guard};
+        done_cv.wait(lock, [this] { return finished == tasks; });
+    }
+
+    auto size() const -> std::size_t {
+        return threads.size() + 1;
+    }
+
+private:
+    auto work(std::stop_token st) -> void {
+        uint64_t seen{0};
+        while (true) {
+            {
+                std::unique_lock lock{guard};
+                if (!work_cv.wait(lock, st, [this, seen] { return generation != seen; })) {
+                    return;
+                }
+                seen = generation;
+            }
+            help(seen);
+        }
+    }
+
+    // take the tasks of this run one at a time, until there are none left
+    auto help(uint64_t run) -> void {
+        std::unique_lock lock{guard};
+        while (generation == run && next < tasks) {
+            const auto task{next++};
+            lock.unlock();
+            job(task);
+            lock.lock();
+            if (++finished == tasks) {
+                done_cv.notify_all();
+            }
+        }
+    }
+
+    std::mutex guard;
+    std::condition_variable_any work_cv;
+    std::condition_variable done_cv;
+    std::function<void(std::size_t)> job;
+    std::size_t tasks{0};
+    std::size_t next{0};
+    std::size_t finished{0};
+    uint64_t generation{0};
+    std::vector<std::jthread> threads;
+};
+
+struct BayerCodec::Scratch {
+    std::vector<uint8_t> data;
+    bool stored{false};
+    clock_type::duration took{};
+    Rows rows;
+};
+
+auto bayer_codec_supported(const camera::ImageView& image) -> bool {
+    switch (image.type) {
+    case camera::PixelFormat::RawRGGB8:
+    case camera::PixelFormat::RawGR8:
+    case camera::PixelFormat::RawGB8:
+    case camera::PixelFormat::RawBG8:
+    case camera::PixelFormat::Mono8:
+        break;
+    default:
+        return false;
+    }
+    return image.data && image.width > 0 && image.height > 0 && image.width % 2 == 0 && image.height % 2 == 0 &&
+        image.size == std::size_t{image.width} * image.height;
+}
+
+auto decoded_size(const uint8_t* data, std::size_t size) -> std::optional<std::size_t> {
+    CompressedFrame header;
+    if (size < sizeof(header)) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != CODEC_MAGIC) {
+        return std::nullopt;
+    }
+    return std::size_t{header.width} * header.height;
+}
+
+auto bayer_decode(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t output_size) -> bool {
+    const auto layout{read_layout(data, size, output_size)};
+    if (!layout) {
+        LOG(ERROR) << "invalid compressed frame of " << size << " bytes" << ENDL;
+        return false;
+    }
+    Rows rows;
+    for (uint32_t t = 0; t < layout->geometry.tiles; t++) {
+        if (!decode_tile(layout->tiles[t], layout->sizes[t] & ~STORED, layout->sizes[t] & STORED, layout->geometry, t, rows, output)) {
+            LOG(ERROR) << "corrupted tile " << t << " in a compressed frame" << ENDL;
+            return false;
+        }
+    }
+    return true;
+}
+
+auto BayerCodec::make(const CodecSettings& settings) -> std::unique_ptr<BayerCodec> {
+    if (settings.tile_rows == 0) {
+        LOG(ERROR) << "the tiles of the codec must have at least one row" << ENDL;
+        return {};
+    }
+    return std::unique_ptr<BayerCodec>(new BayerCodec(settings));
+}
+
+BayerCodec::BayerCodec(const CodecSettings& s) : settings{s} {
+    const auto count{settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency())};
+    pool = std::make_unique<Pool>(count);
+    stats.threads = count;
+}
+
+BayerCodec::~BayerCodec() = default;
+
+auto BayerCodec::threads() const -> std::size_t {
+    return pool->size();
+}
+
+auto BayerCodec::encode(const camera::ImageView& image, std::vector<uint8_t>& output) -> bool {
+    if (!bayer_codec_supported(image)) {
+        return false;
+    }
+    const auto start{clock_type::now()};
+    const Geometry geometry{image.width, image.height, settings.tile_rows};
+    if (scratch.size() < geometry.tiles) {
+        scratch.resize(geometry.tiles);
+    }
+    pool->run(geometry.tiles, [&](std::size_t t) {
+        const auto begin{clock_type::now()};
+        auto& s{scratch[t]};
+        const auto tile{static_cast<uint32_t>(t)};
+        s.stored = !encode_tile(image, geometry, tile, s.rows, s.data);
+        if (s.stored) {
+            s.data.assign(image.data + geometry.raw_offset(tile), image.data + geometry.raw_offset(tile) + geometry.raw_size(tile));
+        }
+        s.took = clock_type::now() - begin;
+    });
+    const CompressedFrame header{.magic = CODEC_MAGIC, .width = image.width, .height = image.height,
+        .tile_rows = settings.tile_rows, .tiles = geometry.tiles, .reserved = 0};
+    std::size_t total{sizeof(header) + geometry.tiles * sizeof(uint32_t)};
+    for (uint32_t t = 0; t < geometry.tiles; t++) {
+        total += scratch[t].data.size();
+    }
+    output.resize(total);
+    std::memcpy(output.data(), &header, sizeof(header));
+    auto sizes{output.data() + sizeof(header)};
+    auto at{sizes + geometry.tiles * sizeof(uint32_t)};
+    clock_type::duration cpu{};
+    uint64_t stored{0};
+    for (uint32_t t = 0; t < geometry.tiles; t++) {
+        const auto& s{scratch[t]};
+        const uint32_t size = s.data.size() | (s.stored ? STORED : 0);
+        std::memcpy(sizes + t * sizeof(uint32_t), &size, sizeof(size));
+        std::memcpy(at, s.data.data(), s.data.size());
+        at += s.data.size();
+        cpu += s.took;
+        stored += s.stored;
+    }
+    std::lock_guard lock{stats_guard};
+    ++stats.frames;
+    stats.raw_bytes += image.size;
+    stats.compressed_bytes += total;
+    stats.stored_tiles += stored;
+    stats.cpu += micros(cpu);
+    stats.wall += micros(clock_type::now() - start);
+    return true;
+}
+
+auto BayerCodec::decode(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t output_size) -> bool {
+    const auto layout{read_layout(data, size, output_size)};
+    if (!layout) {
+        LOG(ERROR) << "invalid compressed frame of " << size << " bytes" << ENDL;
+        return false;
+    }
+    if (scratch.size() < layout->geometry.tiles) {
+        scratch.resize(layout->geometry.tiles);
+    }
+    std::atomic<bool> success{true};
+    pool->run(layout->geometry.tiles, [&](std::size_t t) {
+        const auto tile{static_cast<uint32_t>(t)};
+        if (!decode_tile(layout->tiles[t], layout->sizes[t] & ~STORED, layout->sizes[t] & STORED, layout->geometry, tile, scratch[t].rows, output)) {
+            success = false;
+        }
+    });
+    if (!success) {
+        LOG(ERROR) << "corrupted tiles in a compressed frame" << ENDL;
+    }
+    return success;
+}
+
+auto BayerCodec::statistics() const -> CodecStatistics {
+    std::lock_guard lock{stats_guard};
+    return stats;
+}
+
+auto CodecStatistics::ratio() const -> double {
+    return compressed_bytes ? static_cast<double>(raw_bytes) / compressed_bytes : 0;
+}
+
+auto CodecStatistics::per_core() const -> double {
+    return cpu.count() ? raw_bytes / (cpu.count() / 1e6) / (1024.0 * 1024.0) : 0;
+}
+
+auto CodecStatistics::throughput() const -> double {
+    return wall.count() ? raw_bytes / (wall.count() / 1e6) / (1024.0 * 1024.0) : 0;
+}
+
+auto operator << (std::ostream& os, const CodecStatistics& cs) -> std::ostream& {
+    return os << "compressed " << cs.frames << " frames, ratio " << cs.ratio() << ", " << cs.per_core() << " MB/s per core, "
+        << cs.throughput() << " MB/s with " << cs.threads << " threads, stored tiles: " << cs.stored_tiles;
+}
+
+}   // end of namespace recording
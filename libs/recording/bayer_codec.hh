@@ -0,0 +1,100 @@
+#pragma once
+#include "frame_file.hh"
+#include "camera_controller/image.hh"
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <mutex>
+#include <iosfwd>
+#include <stdint.h>
+
+// Lossless compression for the raw Bayer frames, so that we are writing less to the disk.
+// Neighbouring pixels in a Bayer mosaic are of different colors, so the frame is split into its 4 CFA planes
+// (every other pixel in every other row), and each pixel is predicted from its neighbours in the same plane
+// (the median edge detector from LOCO-I: left, up and up-left). The prediction for a whole row is computed at
+// once from the original pixels, so the compiler can vectorize it. The differences from the prediction are small
+// numbers that are coded with Rice codes, with the parameter chosen for every 32 pixels.
+// The frame is cut into tiles of rows that are coded independently of each other, on all the cores. A tile that is
+// not getting smaller is stored as is, so a frame is never more than a few bytes larger than the raw frame.
+// A compressed frame is:
+// [CompressedFrame][the size of each tile, uint32_t][the tiles]
+// For example:
+// auto codec{recording::BayerCodec::make(recording::CodecSettings{})};
+// std::vector<uint8_t> compressed;
+// if (codec->encode(image, compressed)) { write(compressed.data(), compressed.size()); }
+
+namespace recording {
+
+constexpr uint32_t CODEC_MAGIC = 0x5a524347;       // "GCRZ"
+
+struct CompressedFrame {
+    uint32_t magic{CODEC_MAGIC};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t tile_rows{0};      // the number of rows of each of the CFA planes in a tile, the last tile may be shorter
+    uint32_t tiles{0};
+    uint32_t reserved{0};
+};
+static_assert(sizeof(CompressedFrame) == 24, "the compressed frame header is part of the file format");
+
+struct CodecSettings {
+    std::size_t threads{0};     // the number of threads to encode with, 0 for all the cores
+    uint32_t tile_rows{32};     // of each of the CFA planes, so a tile is twice this in the frame
+};
+
+struct CodecStatistics {
+    uint64_t frames{0};
+    uint64_t raw_bytes{0};
+    uint64_t compressed_bytes{0};
+    uint64_t stored_tiles{0};                   // tiles that did not get smaller, so they were stored as is
+    std::chrono::microseconds cpu{0};           // the time of all the threads together
+    std::chrono::microseconds wall{0};
+    std::size_t threads{0};
+
+    auto ratio() const -> double;               // raw / compressed
+    auto per_core() const -> double;            // MB/s of raw data for each thread
+    auto throughput() const -> double;          // MB/s of raw data
+};
+auto operator << (std::ostream& os, const CodecStatistics& cs) -> std::ostream&;
+
+// The frames that we can compress: 8 bits Bayer or Mono, with an even width and height
+[[nodiscard]] auto bayer_codec_supported(const camera::ImageView& image) -> bool;
+// The size of the frame after decoding, nullopt if this is not a compressed frame
+[[nodiscard]] auto decoded_size(const uint8_t* data, std::size_t size) -> std::optional<std::size_t>;
+// Decode in the calling thread, the output must be of the decoded size
+[[nodiscard]] auto bayer_decode(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t output_size) -> bool;
+
+struct BayerCodec {
+    // Return nullptr if the settings are invalid
+    static auto make(const CodecSettings& settings) -> std::unique_ptr<BayerCodec>;
+
+    ~BayerCodec();
+
+    BayerCodec(const BayerCodec&) = delete;
+    auto operator = (const BayerCodec&) -> BayerCodec& = delete;
+
+    // Compress the frame into the output, that is reused between the calls (so there are no allocations once it is large enough).
+    // Return false if the frame is not supported.
+    [[nodiscard]] auto encode(const camera::ImageView& image, std::vector<uint8_t>& output) -> bool;
+    // The same as bayer_decode, with all the threads
+    [[nodiscard]] auto decode(const uint8_t* data, std::size_t size, uint8_t* output, std::size_t output_size) -> bool;
+
+    auto statistics() const -> CodecStatistics;
+
+    auto threads() const -> std::size_t;
+
+private:
+    struct Pool;
+    struct Scratch;
+
+    explicit BayerCodec(const CodecSettings& s);
+
+    const CodecSettings settings;
+    std::unique_ptr<Pool> pool;
+    std::vector<Scratch> scratch;       // for each tile
+    mutable std::mutex stats_guard;     // the statistics are read from other threads
+    CodecStatistics stats;
+};
+
+}   // end of namespace recording
@@ -0,0 +1,422 @@
+#include "direct_writer.hh"
+#include "log/logging.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+auto micros(std::chrono::steady_clock::duration d) -> std::chrono::microseconds {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d);
+}
+
+auto align_up(std::size_t size) -> std::size_t {
+    return (size + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+}
+
+// We are only writing the SQ tail and the CQ head, the kernel is writing the other side
+auto load(const uint32_t* at) -> uint32_t {
+    return std::atomic_ref<const uint32_t>{*at}.load(std::memory_order_acquire);
+}
+
+auto store(uint32_t* at, uint32_t value) -> void {
+    std::atomic_ref<uint32_t>{*at}.store(value, std::memory_order_release);
+}
+
+}       // end of local namespace
+
+// The minimum that we need from io_uring, without using liburing
+struct DirectWriter::Uring {
+    ~Uring() {
+        if (sqes) {
+            ::munmap(sqes, sqes_size);
+        }
+        if (cq_ring && cq_ring != sq_ring) {
+            ::munmap(cq_ring, cq_size);
+        }
+        if (sq_ring) {
+            ::munmap(sq_ring, sq_size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    auto setup(uint32_t entries) -> bool {
+        io_uring_params params{};
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const auto single{(params.features & IORING_FEAT_SINGLE_MMAP) != 0};
+        if (single) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+        cq_ring = single ? sq_ring : map(cq_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+        if (!sq_ring || !cq_ring || !sqes) {
+            return false;
+        }
+        auto sq{static_cast<uint8_t*>(sq_ring)};
+        sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        auto cq{static_cast<uint8_t*>(cq_ring)};
+        cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    auto register_buffers(const std::vector<iovec>& buffers) -> bool {
+        return ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    auto submit(int file, uint8_t* data, std::size_t size, uint64_t offset, uint16_t buffer, uint64_t user_data) -> bool {
+        const auto tail{*sq_tail};
+        const auto index{tail & sq_mask};
+        auto& sqe{sqes[index]};
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE_FIXED;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = static_cast<uint32_t>(size);
+        sqe.off = offset;
+        sqe.buf_index = buffer;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        store(sq_tail, tail + 1);
+        while (true) {
+            const auto n{::syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0)};
+            if (n == 1) {
+                return true;
+            }
+            if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                // the kernel did not take the entry, take it back, otherwise it would be submitted with the next
+                // one, and its completion would arrive for a write that we already completed as failed
+                if (n == 0) {
+                    errno = EIO;
+                }
+                store(sq_tail, tail);
+                return false;
+            }
+        }
+    }
+
+    // Return false if there was no completion, and we were not asked to wait for one
+    auto reap(bool wait, uint64_t& user_data, int64_t& result) -> bool {
+        while (true) {
+            const auto head{*cq_head};
+            if (head != load(cq_tail)) {
+                const auto& cqe{cqes[head & cq_mask]};
+                user_data = cqe.user_data;
+                result = cqe.res;
+                store(cq_head, head + 1);
+                return true;
+            }
+            if (!wait) {
+                return false;
+            }
+            if (::syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                LOG(ERROR) << "failed to wait for the io_uring completion: " << std::strerror(errno) << ENDL;
+                return false;
+            }
+        }
+    }
+
+    int fd{-1};
+
+private:
+    auto map(std::size_t size, off_t offset) -> void* {
+        auto at{::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset)};
+        return at == MAP_FAILED ? nullptr : at;
+    }
+
+    void* sq_ring{nullptr};
+    void* cq_ring{nullptr};
+    std::size_t sq_size{0};
+    std::size_t cq_size{0};
+    io_uring_sqe* sqes{nullptr};
+    std::size_t sqes_size{0};
+    uint32_t* sq_tail{nullptr};
+    uint32_t sq_mask{0};
+    uint32_t* sq_array{nullptr};
+    uint32_t* cq_head{nullptr};
+    uint32_t* cq_tail{nullptr};
+    uint32_t cq_mask{0};
+    io_uring_cqe* cqes{nullptr};
+};
+
+auto DirectWriter::make(const DirectSettings& settings) -> std::unique_ptr<DirectWriter> {
+    if (settings.chunk_size == 0 || settings.chunk_size % DIRECT_IO_ALIGNMENT != 0 || settings.queue_depth == 0) {
+        LOG(ERROR) << "invalid direct IO settings, the chunk size " << settings.chunk_size << " must be a multiple of " << DIRECT_IO_ALIGNMENT << ENDL;
+        return {};
+    }
+    std::unique_ptr<DirectWriter> writer{new DirectWriter{settings}};
+    writer->buffers = camera::FrameBufferPool::make(settings.queue_depth, settings.chunk_size,
+                        camera::PoolSettings{.huge_pages = true, .lock = true, .prefault = true, .alignment = DIRECT_IO_ALIGNMENT});
+    if (!writer->buffers) {
+        LOG(ERROR) << "failed to allocate " << settings.queue_depth << " buffers for direct IO" << ENDL;
+        return {};
+    }
+    writer->in_flight.resize(settings.queue_depth);
+    for (std::size_t i = settings.queue_depth; i > 0; i--) {
+        writer->free.push_back(i - 1);
+    }
+    if (settings.use_uring) {
+        auto uring{std::make_unique<Uring>()};
+        std::vector<iovec> registered;
+        for (std::size_t i = 0; i < settings.queue_depth; i++) {
+            registered.push_back(iovec{.iov_base = writer->buffers->buffer(i), .iov_len = settings.chunk_size});
+        }
+        if (uring->setup(static_cast<uint32_t>(settings.queue_depth)) && uring->register_buffers(registered)) {
+            writer->uring = std::move(uring);
+        } else {
+            LOG(WARNING) << "io_uring is not available (" << std::strerror(errno) << "), using a pool of " << settings.threads << " threads for the disk writes" << ENDL;
+        }
+    }
+    if (!writer->uring) {
+        for (std::size_t i = 0; i < std::max<std::size_t>(settings.threads, 1); i++) {
+            writer->pool.emplace_back([w = writer.get()](std::stop_token st) {
+                w->run_pool(st);
+            });
+        }
+    }
+    writer->stats.engine = writer->engine();
+    return writer;
+}
+
+DirectWriter::DirectWriter(const DirectSettings& s) : settings{s} {
+}
+
+DirectWriter::~DirectWriter() {
+    if (fd >= 0 && !finish()) {
+        LOG(WARNING) << "failed to complete the direct writes on shutdown" << ENDL;
+    }
+    for (auto&& t : pool) {
+        t.request_stop();
+    }
+    pending_cv.notify_all();
+    pool.clear();
+}
+
+auto DirectWriter::start(int file) -> void {
+    fd = file;
+    offset = 0;
+    fill = 0;
+    failed = false;
+}
+
+auto DirectWriter::append(const iovec* parts, int count) -> bool {
+    for (int i = 0; i < count && !failed; i++) {
+        auto from{static_cast<const uint8_t*>(parts[i].iov_base)};
+        auto left{parts[i].iov_len};
+        while (left > 0 && !failed) {
+            if (!current && !free_slot()) {
+                return false;
+            }
+            const auto n{std::min(left, settings.chunk_size - fill)};
+            std::memcpy(buffers->buffer(current.value()) + fill, from, n);
+            fill += n;
+            from += n;
+            left -= n;
+            if (fill == settings.chunk_size && !submit(fill)) {
+                return false;
+            }
+        }
+    }
+    return !failed;
+}
+
+auto DirectWriter::finish() -> bool {
+    if (current && fill > 0 && !failed) {
+        const auto size{align_up(fill)};
+        std::memset(buffers->buffer(current.value()) + fill, 0, size - fill);
+        submit(size);
+    }
+    if (current) {
+        free.push_back(current.value());
+        current.reset();
+    }
+    while (inflight_count > 0 && reap(true)) {
+    }
+    fd = -1;
+    return !failed && inflight_count == 0;
+}
+
+auto DirectWriter::free_slot() -> bool {
+    if (free.empty()) {
+        std::lock_guard lock{stats_guard};
+        ++stats.waits;
+    }
+    while (free.empty()) {
+        if (!reap(true)) {
+            failed = true;
+            return false;
+        }
+    }
+    current = free.back();
+    free.pop_back();
+    fill = 0;
+    return true;
+}
+
+auto DirectWriter::submit(std::size_t size) -> bool {
+    const auto slot{current.value()};
+    current.reset();
+    const auto now{clock_type::now()};
+    if (inflight_count++ == 0) {
+        busy_since = now;
+    }
+    auto& write{in_flight[slot]};
+    write = Write{.slot = slot, .offset = offset, .size = size, .written = 0, .submitted = now};
+    offset += size;
+    if (uring) {
+        if (!uring->submit(fd, buffers->buffer(slot), size, write.offset, static_cast<uint16_t>(slot), slot)) {
+            const auto err{errno};
+            LOG(ERROR) << "failed to submit a write of " << size << " bytes to io_uring: " << std::strerror(err) << ENDL;
+            completed(write, -err);
+            return false;
+        }
+    } else {
+        {
+            std::lock_guard lock{guard};
+            pending.push_back(write);
+        }
+        pending_cv.notify_one();
+    }
+    // don't let the completions pile up
+    while (reap(false)) {
+    }
+    return !failed;
+}
+
+auto DirectWriter::reap(bool wait) -> bool {
+    if (inflight_count == 0) {
+        return false;
+    }
+    if (uring) {
+        uint64_t slot{0};
+        int64_t result{0};
+        if (!uring->reap(wait, slot, result)) {
+            return false;
+        }
+        auto& write{in_flight[slot]};
+        if (result > 0 && write.written + result < write.size) {
+            // a short write, write the rest of the buffer
+            write.written += result;
+            const auto left{write.size - write.written};
+            if (uring->submit(fd, buffers->buffer(slot) + write.written, left, write.offset + write.written, static_cast<uint16_t>(slot), slot)) {
+                return true;
+            }
+            result = -errno;
+        }
+        completed(write, result < 0 ? result : static_cast<int64_t>(write.size));
+        return true;
+    }
+    std::unique_lock lock{guard};
+    if (wait) {
+        done_cv.wait(lock, [this]() { return !done.empty(); });
+    } else if (done.empty()) {
+        return false;
+    }
+    const auto [write, result] = done.front();
+    done.pop_front();
+    lock.unlock();
+    completed(write, result);
+    return true;
+}
+
+auto DirectWriter::completed(const Write& write, int64_t result) -> void {
+    const auto now{clock_type::now()};
+    free.push_back(write.slot);
+    std::lock_guard lock{stats_guard};
+    if (--inflight_count == 0) {
+        stats.busy += micros(now - busy_since);
+    }
+    if (result < 0 || static_cast<std::size_t>(result) < write.size) {
+        if (!failed) {
+            LOG(ERROR) << "failed to write " << write.size << " bytes at offset " << write.offset << ": " << std::strerror(static_cast<int>(-result)) << ENDL;
+        }
+        failed = true;
+        ++stats.failures;
+        return;
+    }
+    const auto latency{micros(now - write.submitted)};
+    ++stats.writes;
+    stats.bytes += write.size;
+    stats.max_latency = std::max(stats.max_latency, latency);
+    stats.total_latency += latency;
+}
+
+auto DirectWriter::run_pool(std::stop_token st) -> void {
+    while (true) {
+        Write write;
+        {
+            std::unique_lock lock{guard};
+            if (!pending_cv.wait(lock, st, [this]() { return !pending.empty(); })) {
+                return;
+            }
+            write = pending.front();
+            pending.pop_front();
+        }
+        int64_t result{0};
+        auto data{buffers->buffer(write.slot)};
+        while (static_cast<std::size_t>(result) < write.size) {
+            const auto n{::pwrite(fd, data + result, write.size - result, static_cast<off_t>(write.offset + result))};
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                result = n < 0 ? -errno : -EIO;
+                break;
+            }
+            result += n;
+        }
+        {
+            std::lock_guard lock{guard};
+            done.emplace_back(write, result);
+        }
+        done_cv.notify_one();
+    }
+}
+
+auto DirectWriter::statistics() const -> IoStatistics {
+    std::lock_guard lock{stats_guard};
+    return stats;
+}
+
+auto IoStatistics::throughput() const -> double {
+    return busy.count() > 0 ? static_cast<double>(bytes) / static_cast<double>(busy.count()) * 1e6 / (1024.0 * 1024.0) : 0.0;
+}
+
+auto operator << (std::ostream& os, IoEngine engine) -> std::ostream& {
+    switch (engine) {
+    case IoEngine::IoUring:
+        return os << "io_uring";
+    case IoEngine::ThreadPool:
+        return os << "thread pool";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const IoStatistics& is) -> std::ostream& {
+    return os << is.engine << ": writes " << is.writes << ", " << is.bytes / (1024 * 1024) << "MB, " << is.throughput() << " MB/s, failures "
+        << is.failures << ", waits " << is.waits << ", latency max " << is.max_latency.count() << "us, mean "
+        << (is.writes ? is.total_latency.count() / static_cast<int64_t>(is.writes) : 0) << "us";
+}
+
+}   // end of namespace recording
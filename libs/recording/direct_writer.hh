@@ -0,0 +1,122 @@
+#pragma once
+#include "camera_controller/frame_buffer_pool.hh"
+#include <sys/uio.h>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <iosfwd>
+#include <stdint.h>
+
+// Write to a file that was opened with O_DIRECT, so the data is not going through the page cache.
+// With the page cache, a long recording is filling the memory with dirty pages, and then the kernel is
+// stalling the writer while it is flushing them. With O_DIRECT the buffers, the sizes and the offsets must
+// be aligned, so the data is copied into a fixed set of aligned buffers (that are registered with the kernel),
+// and each buffer is written as soon as it is full, while the next one is being filled. The number of
+// buffers is the queue depth - the number of writes that are in flight at the same time.
+// The writes are submitted with io_uring, and when it is not available (old kernel, or it is disabled),
+// with a small pool of threads that are calling pwrite.
+
+namespace recording {
+
+constexpr std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+enum class IoEngine : uint32_t {
+    IoUring,
+    ThreadPool
+};
+auto operator << (std::ostream& os, IoEngine engine) -> std::ostream&;
+
+struct DirectSettings {
+    std::size_t queue_depth{8};                     // the number of buffers, and the most writes in flight
+    std::size_t chunk_size{4 * 1024 * 1024};        // the size of each write, must be a multiple of DIRECT_IO_ALIGNMENT
+    std::size_t threads{2};                         // for the thread pool
+    bool use_uring{true};                           // false to always use the thread pool
+};
+
+struct IoStatistics {
+    IoEngine engine{IoEngine::ThreadPool};
+    uint64_t writes{0};
+    uint64_t bytes{0};
+    uint64_t failures{0};
+    uint64_t waits{0};                              // number of times all the buffers were in flight, and we had to wait for one
+    std::chrono::microseconds max_latency{0};       // from the submission to the completion of a single write
+    std::chrono::microseconds total_latency{0};
+    std::chrono::microseconds busy{0};              // the time that there was at least one write in flight
+
+    auto throughput() const -> double;              // MB/s, while we were busy
+};
+auto operator << (std::ostream& os, const IoStatistics& is) -> std::ostream&;
+
+struct DirectWriter {
+    // Return nullptr if we cannot allocate the buffers
+    static auto make(const DirectSettings& settings) -> std::unique_ptr<DirectWriter>;
+
+    ~DirectWriter();
+
+    DirectWriter(const DirectWriter&) = delete;
+    auto operator = (const DirectWriter&) -> DirectWriter& = delete;
+
+    // Start writing to this file from offset 0, the writer is not the owner of the file descriptor
+    auto start(int fd) -> void;
+    // Copy the data into the buffers, and write the buffers that are full
+    [[nodiscard]] auto append(const iovec* parts, int count) -> bool;
+    // Write the last buffer (padded to the alignment) and wait for all the writes to complete.
+    // Note that the file is longer than the data that was appended, so it should be truncated after this.
+    [[nodiscard]] auto finish() -> bool;
+
+    auto statistics() const -> IoStatistics;
+
+    auto engine() const -> IoEngine {
+        return uring ? IoEngine::IoUring : IoEngine::ThreadPool;
+    }
+
+private:
+    using clock_type = std::chrono::steady_clock;
+
+    struct Uring;
+    struct Write {
+        std::size_t slot{0};
+        uint64_t offset{0};
+        std::size_t size{0};
+        std::size_t written{0};             // after a short write
+        clock_type::time_point submitted;
+    };
+
+    explicit DirectWriter(const DirectSettings& s);
+
+    auto submit(std::size_t size) -> bool;
+    auto reap(bool wait) -> bool;           // return true if a write completed
+    auto completed(const Write& write, int64_t result) -> void;
+    auto free_slot() -> bool;
+    auto run_pool(std::stop_token st) -> void;
+
+    const DirectSettings settings;
+    std::shared_ptr<camera::FrameBufferPool> buffers;
+    std::vector<std::size_t> free;
+    std::vector<Write> in_flight;           // by slot
+    std::size_t inflight_count{0};
+    std::optional<std::size_t> current;     // the buffer that we are filling now
+    std::size_t fill{0};
+    uint64_t offset{0};                     // of the next write in the file
+    int fd{-1};
+    bool failed{false};
+    std::unique_ptr<Uring> uring;
+    // for the thread pool
+    std::mutex guard;
+    std::condition_variable_any pending_cv;
+    std::condition_variable done_cv;
+    std::deque<Write> pending;
+    std::deque<std::pair<Write, int64_t>> done;
+    std::vector<std::jthread> pool;
+    // statistics, these are read from other threads
+    mutable std::mutex stats_guard;
+    IoStatistics stats;
+    clock_type::time_point busy_since;
+};
+
+}   // end of namespace recording
@@ -0,0 +1,257 @@
+#include "dng_writer.hh"
+#include "frame_file.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+// TIFF field types
+constexpr uint16_t BYTE = 1;
+constexpr uint16_t ASCII = 2;
+constexpr uint16_t SHORT = 3;
+constexpr uint16_t LONG = 4;
+constexpr uint16_t SRATIONAL = 10;
+
+// the colors in the CFA pattern
+constexpr uint8_t R = 0;
+constexpr uint8_t G = 1;
+constexpr uint8_t B = 2;
+
+// the monochrome frames are raw sensor data as well, that the DNG readers would only process as such with LinearRaw
+constexpr uint16_t PHOTOMETRIC_LINEAR_RAW = 34892;
+constexpr uint16_t PHOTOMETRIC_CFA = 32803;
+constexpr uint16_t ILLUMINANT_D65 = 21;
+
+constexpr char MAKE[] = "GroWings";
+constexpr char MODEL[] = "GroWings camera";
+constexpr char SOFTWARE[] = "growings-recorder";
+constexpr char UNIQUE_MODEL[] = "GRW-x1";
+
+struct Layout {
+    uint16_t bits{8};                       // of each sample in the file
+    uint32_t white{255};                    // the largest value that the sensor is producing
+    std::optional<std::array<uint8_t, 4>> cfa;     // for the Bayer formats, the colors of the top left 2x2 pixels
+};
+
+auto layout_of(camera::PixelFormat format) -> std::optional<Layout> {
+    switch (format) {
+    case camera::PixelFormat::RawRGGB8:
+        return Layout{.bits = 8, .white = 255, .cfa = std::array<uint8_t, 4>{R, G, G, B}};
+    case camera::PixelFormat::RawGR8:
+        return Layout{.bits = 8, .white = 255, .cfa = std::array<uint8_t, 4>{G, R, B, G}};
+    case camera::PixelFormat::RawGB8:
+        return Layout{.bits = 8, .white = 255, .cfa = std::array<uint8_t, 4>{G, B, R, G}};
+    case camera::PixelFormat::RawBG8:
+        return Layout{.bits = 8, .white = 255, .cfa = std::array<uint8_t, 4>{B, G, G, R}};
+    case camera::PixelFormat::Mono8:
+        return Layout{.bits = 8, .white = 255, .cfa = std::nullopt};
+    case camera::PixelFormat::Mono10:
+        return Layout{.bits = 16, .white = 1023, .cfa = std::nullopt};
+    case camera::PixelFormat::Mono12:
+        return Layout{.bits = 16, .white = 4095, .cfa = std::nullopt};
+    case camera::PixelFormat::Mono14:
+        return Layout{.bits = 16, .white = 16383, .cfa = std::nullopt};
+    case camera::PixelFormat::Mono16:
+        return Layout{.bits = 16, .white = 65535, .cfa = std::nullopt};
+    default:
+        return std::nullopt;
+    }
+}
+
+auto size_of(uint16_t type) -> std::size_t {
+    switch (type) {
+    case SHORT:
+        return 2;
+    case LONG:
+        return 4;
+    case SRATIONAL:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+// The IFD entries must be added in the order of the tags. The values that don't fit into the
+// entry itself are placed after the IFD.
+struct IfdBuilder {
+    auto add(uint16_t tag, uint16_t type, const void* values, uint32_t count) -> IfdBuilder& {
+        Entry entry{.tag = tag, .type = type, .count = count, .value = {}};
+        entry.value.resize(size_of(type) * count);
+        std::memcpy(entry.value.data(), values, entry.value.size());
+        entries.push_back(std::move(entry));
+        return *this;
+    }
+
+    auto add(uint16_t tag, uint16_t value) -> IfdBuilder& {
+        return add(tag, SHORT, &value, 1);
+    }
+
+    auto add(uint16_t tag, uint32_t value) -> IfdBuilder& {
+        return add(tag, LONG, &value, 1);
+    }
+
+    template<std::size_t N>
+    auto add(uint16_t tag, const char (&text)[N]) -> IfdBuilder& {
+        return add(tag, ASCII, text, N);        // with the terminating null
+    }
+
+    // The IFD starts right after the TIFF header, and the frame data starts right after the header that we return
+    auto build(uint16_t data_offset_tag) -> std::vector<uint8_t> {
+        constexpr uint32_t IFD_OFFSET = 8;
+        const uint32_t ifd_size = 2 + entries.size() * 12 + 4;
+        uint32_t extra{IFD_OFFSET + ifd_size};
+        for (auto&& e : entries) {
+            if (e.value.size() > 4) {
+                extra += (e.value.size() + 1) & ~std::size_t{1};      // the values must start at an even offset
+            }
+        }
+        const uint32_t data_offset{(extra + 15) & ~uint32_t{15}};
+        std::vector<uint8_t> output(data_offset, 0);
+        auto put = [&output](uint32_t at, const void* from, std::size_t size) {
+            std::memcpy(output.data() + at, from, size);
+        };
+        const uint8_t tiff[] = {'I', 'I', 42, 0};
+        put(0, tiff, sizeof(tiff));
+        put(4, &IFD_OFFSET, 4);
+        const uint16_t count = entries.size();
+        put(IFD_OFFSET, &count, 2);
+        uint32_t at{IFD_OFFSET + 2};
+        uint32_t values{IFD_OFFSET + ifd_size};
+        for (auto&& e : entries) {
+            if (e.tag == data_offset_tag) {
+                std::memcpy(e.value.data(), &data_offset, 4);
+            }
+            put(at, &e.tag, 2);
+            put(at + 2, &e.type, 2);
+            put(at + 4, &e.count, 4);
+            if (e.value.size() > 4) {
+                put(at + 8, &values, 4);
+                put(values, e.value.data(), e.value.size());
+                values += (e.value.size() + 1) & ~std::size_t{1};
+            } else {
+                put(at + 8, e.value.data(), e.value.size());
+            }
+            at += 12;
+        }
+        // the offset of the next IFD is 0, since there is only one
+        return output;
+    }
+
+private:
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        std::vector<uint8_t> value;
+    };
+
+    std::vector<Entry> entries;
+};
+
+}       // end of local namespace
+
+auto dng_supported(camera::PixelFormat format) -> bool {
+    return layout_of(format).has_value();
+}
+
+auto DngWriter::build(const camera::ImageView& image) -> bool {
+    const auto layout{layout_of(image.type)};
+    if (!layout) {
+        LOG(ERROR) << "cannot save an image in the format " << image.type << " as DNG" << ENDL;
+        return false;
+    }
+    const uint64_t expected{uint64_t{image.width} * image.height * (layout->bits / 8)};
+    if (image.width == 0 || image.height == 0 || image.size != expected) {
+        LOG(ERROR) << "cannot save the image [" << image.width << " X " << image.height << "] " << image.type
+            << " as DNG, its size " << image.size << " is not matching its geometry (expecting " << expected << ")" << ENDL;
+        return false;
+    }
+    const uint8_t dng_version[] = {1, 1, 0, 0};
+    const uint8_t dng_backward_version[] = {1, 0, 0, 0};
+    // we don't know the color calibration of the sensor, so the conversion from XYZ to the camera colors is identity
+    const int32_t color_matrix[] = {1, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 0, 1, 1, 1};
+    const uint16_t cfa_dim[] = {2, 2};
+    IfdBuilder ifd;
+    ifd.add(254, uint32_t{0})                               // NewSubFileType: the main image
+        .add(256, image.width)                              // ImageWidth
+        .add(257, image.height)                             // ImageLength
+        .add(258, layout->bits)                             // BitsPerSample
+        .add(259, uint16_t{1})                              // Compression: none
+        .add(262, layout->cfa ? PHOTOMETRIC_CFA : PHOTOMETRIC_LINEAR_RAW)
+        .add(271, MAKE)
+        .add(272, MODEL)
+        .add(273, uint32_t{0})                              // StripOffsets, this is set when we know the size of the header
+        .add(274, uint16_t{1})                              // Orientation: top left
+        .add(277, uint16_t{1})                              // SamplesPerPixel
+        .add(278, image.height)                             // RowsPerStrip: all the image is a single strip
+        .add(279, image.size)                               // StripByteCounts
+        .add(284, uint16_t{1})                              // PlanarConfiguration: chunky
+        .add(305, SOFTWARE);
+    if (layout->cfa) {
+        ifd.add(33421, SHORT, cfa_dim, 2)                   // CFARepeatPatternDim
+            .add(33422, BYTE, layout->cfa->data(), 4);      // CFAPattern
+    }
+    ifd.add(50706, BYTE, dng_version, 4)
+        .add(50707, BYTE, dng_backward_version, 4)
+        .add(50708, UNIQUE_MODEL);                          // UniqueCameraModel
+    if (layout->cfa) {
+        ifd.add(50711, uint16_t{1});                        // CFALayout: rectangular
+    }
+    ifd.add(50717, layout->white);                          // WhiteLevel
+    if (layout->cfa) {
+        ifd.add(50721, SRATIONAL, color_matrix, 9)          // ColorMatrix1
+            .add(50778, ILLUMINANT_D65);                    // CalibrationIlluminant1
+    }
+    cached = ifd.build(273);
+    width = image.width;
+    height = image.height;
+    format = image.type;
+    size = image.size;
+    return true;
+}
+
+auto DngWriter::header(const camera::ImageView& image) -> const std::vector<uint8_t>& {
+    static const std::vector<uint8_t> none;
+    if (cached.empty() || image.width != width || image.height != height || image.type != format) {
+        cached.clear();
+        if (!build(image)) {
+            return none;
+        }
+    }
+    if (image.size != size) {
+        LOG(ERROR) << "cannot save image number " << image.number << " as DNG, its size " << image.size << " is not matching its geometry" << ENDL;
+        return none;
+    }
+    return cached;
+}
+
+auto DngWriter::write(const std::filesystem::path& to, const camera::ImageView& image) -> bool {
+    if (!image.data) {
+        return false;
+    }
+    const auto& prefix{header(image)};
+    if (prefix.empty()) {
+        return false;
+    }
+    FrameFile file;
+    if (!file.open(to)) {
+        return false;
+    }
+    iovec parts[] = {
+        {.iov_base = const_cast<uint8_t*>(prefix.data()), .iov_len = prefix.size()},
+        {.iov_base = const_cast<uint8_t*>(image.data), .iov_len = image.size}
+    };
+    if (!file.write(parts, 2)) {
+        LOG(ERROR) << "failed to save image number " << image.number << " to " << to << ENDL;
+        return false;
+    }
+    file.close();
+    return true;
+}
+
+}   // end of namespace recording
@@ -0,0 +1,40 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include <filesystem>
+#include <vector>
+#include <stdint.h>
+
+// Save a frame as a DNG file (a TIFF file with a few more tags), that any raw converter can open.
+// The file is [TIFF header][IFD and the values of the tags][frame data], the frame data is written as is,
+// as a single strip without compression. The header is only depending on the size and the format of the
+// frame, so it is built once and then reused for all the frames with the same geometry, and each file is
+// written with a single writev of the header and the frame data.
+// Supported are the 8 bits Bayer formats (with their CFA pattern), and Mono8/10/12/14/16 (as LinearRaw) where anything above
+// 8 bits is expected in 16 bits per pixel (the packed formats are not supported).
+// For example:
+// recording::DngWriter dng;
+// if (!dng.write("/data/frame.dng", image)) {...}
+
+namespace recording {
+
+[[nodiscard]] auto dng_supported(camera::PixelFormat format) -> bool;
+
+struct DngWriter {
+    // Create (or truncate) the file, and write the image into it.
+    // Return false if the format is not supported, the size of the image is not matching its geometry, or we failed to write.
+    [[nodiscard]] auto write(const std::filesystem::path& to, const camera::ImageView& image) -> bool;
+
+    // The bytes that are written before the frame data, empty if we cannot write this image
+    [[nodiscard]] auto header(const camera::ImageView& image) -> const std::vector<uint8_t>&;
+
+private:
+    auto build(const camera::ImageView& image) -> bool;
+
+    uint32_t width{0};
+    uint32_t height{0};
+    camera::PixelFormat format{camera::PixelFormat::RawRGGB8};
+    uint32_t size{0};
+    std::vector<uint8_t> cached;
+};
+
+}   // end of namespace recording
@@ -0,0 +1,165 @@
+#include "frame_file.hh"
+#include "log/logging.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <iostream>
+
+namespace recording {
+
+FrameHeader::FrameHeader(const camera::ImageView& image) :
+        number{image.number}, timestamp{image.timestamp}, width{image.width}, height{image.height},
+        format{static_cast<uint32_t>(image.type)}, size{image.size} {
+}
+
+FrameFile::~FrameFile() {
+    close();
+}
+
+FrameFile::FrameFile(FrameFile&& other) noexcept :
+        fd{std::exchange(other.fd, -1)}, direct{std::exchange(other.direct, nullptr)}, written{std::exchange(other.written, 0)}, reserved{std::exchange(other.reserved, 0)} {
+}
+
+auto FrameFile::operator = (FrameFile&& other) noexcept -> FrameFile& {
+    if (this != &other) {
+        close();
+        fd = std::exchange(other.fd, -1);
+        direct = std::exchange(other.direct, nullptr);
+        written = std::exchange(other.written, 0);
+        reserved = std::exchange(other.reserved, 0);
+    }
+    return *this;
+}
+
+auto FrameFile::open(const std::filesystem::path& path, DirectWriter* writer) -> bool {
+    close();
+    constexpr int FLAGS = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (writer) {
+        fd = ::open(path.c_str(), FLAGS | O_DIRECT, 0644);
+        if (fd >= 0) {
+            direct = writer;
+            direct->start(fd);
+        } else if (errno == EINVAL) {
+            LOG(WARNING) << "the file system of " << path << " is not supporting direct IO, using buffered IO" << ENDL;
+        }
+    }
+    if (fd < 0) {
+        fd = ::open(path.c_str(), FLAGS, 0644);
+    }
+    if (fd < 0) {
+        LOG(ERROR) << "failed to open " << path << " for writing: " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    written = 0;
+    reserved = 0;
+    return true;
+}
+
+auto FrameFile::preallocate(uint64_t bytes) -> bool {
+    if (fd < 0) {
+        return false;
+    }
+    if (const auto err = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes)); err != 0) {
+        LOG(WARNING) << "failed to preallocate " << bytes << " bytes for the recording: " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    reserved = bytes;
+    return true;
+}
+
+auto FrameFile::write(const camera::ImageView& image) -> bool {
+    FrameHeader header{image};
+    iovec parts[] = {
+        {.iov_base = &header, .iov_len = sizeof(header)},
+        {.iov_base = const_cast<uint8_t*>(image.data), .iov_len = image.data ? image.size : 0}
+    };
+    if (!write(parts, image.data ? 2 : 1)) {
+        LOG(ERROR) << "failed to write frame number " << image.number << ENDL;
+        return false;
+    }
+    return true;
+}
+
+auto FrameFile::write(const void* data, std::size_t size) -> bool {
+    iovec part{.iov_base = const_cast<void*>(data), .iov_len = size};
+    return write(&part, 1);
+}
+
+auto FrameFile::write(iovec* next, int count) -> bool {
+    if (fd < 0) {
+        return false;
+    }
+    if (direct) {
+        if (!direct->append(next, count)) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            written += next[i].iov_len;
+        }
+        return true;
+    }
+    while (count > 0) {
+        const auto n{::writev(fd, next, count)};
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(ERROR) << "failed to write " << count << " buffers to the recording: " << std::strerror(errno) << ENDL;
+            return false;
+        }
+        written += n;
+        // a partial write, skip what was already written and try again
+        auto left{static_cast<std::size_t>(n)};
+        for (; count > 0 && left >= next->iov_len; --count, ++next) {
+            left -= next->iov_len;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<uint8_t*>(next->iov_base) + left;
+            next->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+auto FrameFile::close() -> void {
+    if (fd >= 0) {
+        // with direct IO the last write is padded to the alignment, so the file is always truncated
+        if (direct && !direct->finish()) {
+            LOG(ERROR) << "failed to complete the direct writes to the recording" << ENDL;
+        }
+        if ((direct || reserved > written) && ::ftruncate(fd, static_cast<off_t>(written)) != 0) {
+            LOG(WARNING) << "failed to release the unused space of the recording: " << std::strerror(errno) << ENDL;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    direct = nullptr;
+    written = 0;
+    reserved = 0;
+}
+
+auto operator << (std::ostream& os, Compression compression) -> std::ostream& {
+    switch (compression) {
+    case Compression::None:
+        return os << "none";
+    case Compression::Bayer:
+        return os << "bayer";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, DiskIo io) -> std::ostream& {
+    switch (io) {
+    case DiskIo::Buffered:
+        return os << "buffered";
+    case DiskIo::Direct:
+        return os << "direct";
+    default:
+        return os << "unknown";
+    }
+}
+
+}   // end of namespace recording
@@ -0,0 +1,130 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include "direct_writer.hh"
+#include <filesystem>
+#include <sys/uio.h>
+#include <stdint.h>
+
+// The recording is made of segment files, each one is laid out as:
+// [SegmentHeader][FrameHeader][frame data][FrameHeader][frame data]...[IndexEntry]...[IndexEntry][IndexTrailer]
+// The frames are appended as they arrive, and the index is only written when the segment is closed,
+// so reading a frame from a closed segment is reading the trailer from the end of the file, then the index.
+// A segment that was not closed (the process crashed for example) can still be read by following the frame headers.
+// All the values are in the host byte order.
+// The frame data may be compressed (see bayer_codec.hh), the compression is kept in the high byte of the format.
+
+namespace recording {
+
+constexpr uint32_t SEGMENT_MAGIC = 0x53524347;     // "GCRS"
+constexpr uint32_t FRAME_MAGIC = 0x46524347;       // "GCRF"
+constexpr uint32_t INDEX_MAGIC = 0x49524347;       // "GCRI"
+constexpr uint32_t SEGMENT_VERSION = 2;        // version 1 is the same, without compression
+constexpr uint32_t COMPRESSION_SHIFT = 24;
+
+enum class Compression : uint32_t {
+    None,
+    Bayer           // lossless, for 8 bits Bayer and Mono frames (see bayer_codec.hh)
+};
+auto operator << (std::ostream& os, Compression compression) -> std::ostream&;
+
+struct SegmentHeader {
+    uint32_t magic{SEGMENT_MAGIC};
+    uint32_t version{SEGMENT_VERSION};
+    uint32_t header_size{sizeof(SegmentHeader)};
+    uint32_t reserved{0};
+    uint64_t sequence{0};       // the number of this segment in the recording, starting from 0
+    uint64_t created{0};        // the host time in nanoseconds since the epoch
+    char name[32]{};            // the camera id, it may be truncated
+};
+static_assert(sizeof(SegmentHeader) == 64, "the segment header is part of the file format");
+
+struct FrameHeader {
+    uint32_t magic{FRAME_MAGIC};
+    uint32_t header_size{sizeof(FrameHeader)};
+    uint64_t number{0};
+    uint64_t timestamp{0};      // the device timestamp
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t format{0};         // camera::PixelFormat, and the Compression in the high byte
+    uint32_t size{0};           // the number of bytes of the frame data that follows the header
+
+    FrameHeader() = default;
+    explicit FrameHeader(const camera::ImageView& image);
+
+    auto pixel_format() const -> camera::PixelFormat {
+        return static_cast<camera::PixelFormat>(format & ((1u << COMPRESSION_SHIFT) - 1));
+    }
+
+    auto compression() const -> Compression {
+        return static_cast<Compression>(format >> COMPRESSION_SHIFT);
+    }
+};
+static_assert(sizeof(FrameHeader) == 40, "the frame header is part of the file format");
+
+struct IndexEntry {
+    uint64_t number{0};
+    uint64_t timestamp{0};
+    uint64_t offset{0};         // of the frame header, from the start of the segment
+    uint32_t size{0};           // of the frame data
+    uint32_t reserved{0};
+};
+static_assert(sizeof(IndexEntry) == 32, "the index entry is part of the file format");
+
+struct IndexTrailer {
+    uint32_t magic{INDEX_MAGIC};
+    uint32_t entry_size{sizeof(IndexEntry)};
+    uint64_t count{0};          // the number of entries in the index
+    uint64_t offset{0};         // of the first entry, from the start of the segment
+    uint64_t closed{0};         // the host time in nanoseconds since the epoch
+};
+static_assert(sizeof(IndexTrailer) == 32, "the index trailer is part of the file format");
+
+enum class DiskIo : uint32_t {
+    Buffered,       // through the page cache
+    Direct          // O_DIRECT, bypassing the page cache (see direct_writer.hh)
+};
+auto operator << (std::ostream& os, DiskIo io) -> std::ostream&;
+
+// Append only file. With buffered IO, the writes are done with a single system call where possible, without copying the data.
+// With direct IO the data is passed to the DirectWriter, that must outlive the file.
+struct FrameFile {
+    FrameFile() = default;
+    ~FrameFile();
+
+    FrameFile(FrameFile&& other) noexcept;
+    auto operator = (FrameFile&& other) noexcept -> FrameFile&;
+    FrameFile(const FrameFile&) = delete;
+    auto operator = (const FrameFile&) -> FrameFile& = delete;
+
+    // Create a new file (truncate it if it already exists). If the direct writer is passed, and the file system
+    // is supporting O_DIRECT, then the writes are done with it.
+    [[nodiscard]] auto open(const std::filesystem::path& path, DirectWriter* direct = nullptr) -> bool;
+    // Reserve the space on the disk in advance, the size of the file is not changed.
+    // This is only an optimization, so it is fine if this fails.
+    auto preallocate(uint64_t bytes) -> bool;
+    [[nodiscard]] auto write(const camera::ImageView& image) -> bool;
+    [[nodiscard]] auto write(const void* data, std::size_t size) -> bool;
+    [[nodiscard]] auto write(iovec* parts, int count) -> bool;
+    // Release the space that was reserved and not used, and close the file
+    auto close() -> void;
+
+    auto is_open() const -> bool {
+        return fd >= 0;
+    }
+
+    auto size() const -> uint64_t {
+        return written;
+    }
+
+    auto io() const -> DiskIo {
+        return direct ? DiskIo::Direct : DiskIo::Buffered;
+    }
+
+private:
+    int fd{-1};
+    DirectWriter* direct{nullptr};
+    uint64_t written{0};
+    uint64_t reserved{0};
+};
+
+}   // end of namespace recording
@@ -0,0 +1,106 @@
+#include "frame_ring.hh"
+#include "log/logging.h"
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+
+auto FrameRing::make(std::size_t count, std::size_t frame_size) -> std::unique_ptr<FrameRing> {
+    if (count == 0 || frame_size == 0) {
+        LOG(ERROR) << "invalid frames ring of " << count << " frames of " << frame_size << " bytes" << ENDL;
+        return {};
+    }
+    auto memory{camera::FrameBufferPool::make(count, frame_size)};
+    if (!memory) {
+        LOG(ERROR) << "failed to allocate the memory for a ring of " << count << " frames of " << frame_size << " bytes" << ENDL;
+        return {};
+    }
+    return std::unique_ptr<FrameRing>(new FrameRing(std::move(memory)));
+}
+
+FrameRing::FrameRing(std::shared_ptr<camera::FrameBufferPool> memory) : buffers{std::move(memory)}, slots(buffers->size()) {
+    stats.capacity = buffers->size();
+    stats.frame_size = buffers->buffer_size();
+}
+
+auto FrameRing::push(const camera::ImageView& image, clock_type::time_point arrived) -> bool {
+    uint64_t sequence{0};
+    {
+        std::lock_guard lock{guard};
+        if (image.size > stats.frame_size) {
+            ++stats.too_large;
+            return false;
+        }
+        if (reader && pushed - reader.value() >= slots.size()) {
+            ++stats.dropped;
+            return false;
+        }
+        sequence = pushed;
+        // the slot is about to be overwritten, so it cannot be pinned while we are copying into it
+        if (pushed - oldest >= slots.size()) {
+            ++oldest;
+            ++stats.overwritten;
+        }
+    }
+    // the reader is never reading this slot until it is pushed, so we don't need the lock for the copy
+    const auto index{sequence % slots.size()};
+    auto to{buffers->buffer(index)};
+    std::memcpy(to, image.data, image.size);
+    std::lock_guard lock{guard};
+    slots[index] = Slot{.image = image, .arrived = arrived};
+    slots[index].image.data = to;
+    ++pushed;
+    ++stats.pushed;
+    ready.notify_one();
+    return true;
+}
+
+auto FrameRing::pin(clock_type::time_point since) -> std::size_t {
+    std::lock_guard lock{guard};
+    auto from{oldest};
+    while (from < pushed && slot(from).arrived < since) {
+        ++from;
+    }
+    reader = from;
+    return pushed - from;
+}
+
+auto FrameRing::next() -> std::optional<RingFrame> {
+    std::lock_guard lock{guard};
+    if (!reader || reader.value() >= pushed) {
+        return std::nullopt;
+    }
+    const auto& s{slot(reader.value())};
+    return RingFrame{.image = s.image, .arrived = s.arrived};
+}
+
+auto FrameRing::release() -> void {
+    std::lock_guard lock{guard};
+    if (reader && reader.value() < pushed) {
+        reader = reader.value() + 1;
+    }
+}
+
+auto FrameRing::unpin() -> void {
+    std::lock_guard lock{guard};
+    reader.reset();
+}
+
+auto FrameRing::wait(std::chrono::milliseconds timeout) -> bool {
+    std::unique_lock lock{guard};
+    return ready.wait_for(lock, timeout, [this] {
+        return reader && reader.value() < pushed;
+    });
+}
+
+auto FrameRing::statistics() const -> RingStatistics {
+    std::lock_guard lock{guard};
+    return stats;
+}
+
+auto operator << (std::ostream& os, const RingStatistics& rs) -> std::ostream& {
+    return os << "ring of " << rs.capacity << " frames of " << rs.frame_size << " bytes, pushed: " << rs.pushed
+        << ", overwritten: " << rs.overwritten << ", dropped: " << rs.dropped << ", too large: " << rs.too_large;
+}
+
+}   // end of namespace recording
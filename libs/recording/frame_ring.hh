@@ -0,0 +1,87 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include "camera_controller/frame_buffer_pool.hh"
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <optional>
+#include <iosfwd>
+#include <stdint.h>
+
+// Keep the last frames of a camera in memory, so that when something happens we can still save
+// the frames from before it. The ring is a fixed number of slots that are allocated once (see
+// camera::FrameBufferPool), and each frame is copied into the oldest slot, so there is no allocation
+// per frame, and the camera buffers are returned to the camera right away.
+// Normally the oldest frame is simply overwritten. Once a reader is pinning the ring (from some point
+// in time), the frames that it did not read yet are kept, and when it is falling so far behind that the
+// ring is full, the new frames are dropped (and counted) until it is catching up.
+// There is a single writer (the thread that is getting the frames from the camera) and a single reader.
+
+namespace recording {
+
+struct RingFrame {
+    camera::ImageView image;                            // the data is in the ring, valid until release
+    std::chrono::steady_clock::time_point arrived;      // the host time that the frame was pushed
+};
+
+struct RingStatistics {
+    std::size_t capacity{0};
+    std::size_t frame_size{0};          // the largest frame that can be stored
+    uint64_t pushed{0};
+    uint64_t overwritten{0};            // old frames that no one wanted
+    uint64_t dropped{0};                // new frames that we had no space for, since the reader was behind
+    uint64_t too_large{0};
+};
+auto operator << (std::ostream& os, const RingStatistics& rs) -> std::ostream&;
+
+struct FrameRing {
+    using clock_type = std::chrono::steady_clock;
+
+    // Return nullptr if we cannot allocate the memory, this is count * frame_size bytes
+    static auto make(std::size_t count, std::size_t frame_size) -> std::unique_ptr<FrameRing>;
+
+    FrameRing(const FrameRing&) = delete;
+    auto operator = (const FrameRing&) -> FrameRing& = delete;
+
+    // Copy the frame into the ring, return false if it was dropped
+    auto push(const camera::ImageView& image, clock_type::time_point arrived = clock_type::now()) -> bool;
+
+    // Start reading from the oldest frame in the ring that arrived at or after this time.
+    // Return the number of frames that are waiting to be read.
+    auto pin(clock_type::time_point since) -> std::size_t;
+    // The frame that is next to read, this is nullopt when there is nothing to read, or the ring is not pinned
+    [[nodiscard]] auto next() -> std::optional<RingFrame>;
+    // Done with the frame that we got from next, its slot can be used again
+    auto release() -> void;
+    // Stop reading, from now on the oldest frames are overwritten again
+    auto unpin() -> void;
+    // Wait until there is a frame to read, return false on timeout
+    [[nodiscard]] auto wait(std::chrono::milliseconds timeout) -> bool;
+
+    auto statistics() const -> RingStatistics;
+
+private:
+    struct Slot {
+        camera::ImageView image;
+        clock_type::time_point arrived;
+    };
+
+    FrameRing(std::shared_ptr<camera::FrameBufferPool> memory);
+
+    auto slot(uint64_t sequence) -> Slot& {
+        return slots[sequence % slots.size()];
+    }
+
+    std::shared_ptr<camera::FrameBufferPool> buffers;
+    std::vector<Slot> slots;
+    mutable std::mutex guard;
+    std::condition_variable ready;
+    uint64_t oldest{0};                 // the sequence number of the oldest frame in the ring
+    uint64_t pushed{0};                 // the sequence number of the next frame
+    std::optional<uint64_t> reader;     // the sequence number of the next frame to read, when pinned
+    RingStatistics stats;
+};
+
+}   // end of namespace recording
@@ -0,0 +1,111 @@
+#include "governor.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <iostream>
+
+namespace recording {
+
+Governor::Governor(std::string n, const GovernorSettings& s) : name{std::move(n)}, settings{s} {
+}
+
+auto Governor::applied(Degradation d) const -> bool {
+    const auto at{std::find(settings.policy.begin(), settings.policy.end(), d)};
+    return at != settings.policy.end() && static_cast<std::size_t>(at - settings.policy.begin()) < step();
+}
+
+auto Governor::update(const Pressure& pressure, clock_type::time_point now) -> std::size_t {
+    if (!settings.enabled) {
+        return 0;
+    }
+    const auto queue{pressure.capacity ? static_cast<double>(pressure.depth) / pressure.capacity : 0.0};
+    const auto write{pressure.frame_time.count() ? static_cast<double>(pressure.write.count()) / pressure.frame_time.count() : 0.0};
+    const auto step{current.load(std::memory_order_relaxed)};
+    if (pressure.dropped > 0 || queue >= settings.high_queue || write >= settings.high_write) {
+        calm_since.reset();
+        if (step < settings.policy.size()) {
+            set(step + 1, pressure, pressure.dropped > 0 ? "frames were dropped" : (queue >= settings.high_queue ? "the queue is filling up" : "the writes are too slow"));
+        }
+        return current;
+    }
+    if (queue > settings.low_queue || write > settings.low_write) {
+        calm_since.reset();     // in between, stay where we are
+        return step;
+    }
+    if (!calm_since) {
+        calm_since = now;
+    }
+    if (step > 0 && now - calm_since.value() >= settings.recover) {
+        set(step - 1, pressure, "the writer is keeping up");
+        calm_since = now;       // wait again before the next step back
+    }
+    return current;
+}
+
+auto Governor::set(std::size_t to, const Pressure& pressure, const char* why) -> void {
+    const auto from{current.exchange(to)};
+    {
+        std::lock_guard lock{guard};
+        max_step = std::max(max_step, to);
+        ++(to > from ? raised : lowered);
+    }
+    const auto step_name = [this](std::size_t s) {
+        return s == 0 ? Degradation::None : settings.policy[s - 1];
+    };
+    LOG(WARNING) << name << ": " << why << " (queue " << pressure.depth << "/" << pressure.capacity << ", write " << pressure.write.count()
+        << "us for a frame every " << pressure.frame_time.count() << "us, dropped " << pressure.dropped << "), "
+        << (to > from ? "degrading to " : "back to ") << step_name(to) << " (step " << to << " of " << settings.policy.size() << ")" << ENDL;
+}
+
+auto Governor::keep_preview(uint64_t number) -> bool {
+    if (!applied(Degradation::DecimatePreview) || number % std::max(settings.preview_every, 1u) == 0) {
+        return true;
+    }
+    ++preview_skipped;
+    return false;
+}
+
+auto Governor::keep_recorded(uint64_t number) -> bool {
+    if (!applied(Degradation::DropFrames) || number % std::max(settings.drop_every, 1u) != 0) {
+        return true;
+    }
+    ++recorded_skipped;
+    return false;
+}
+
+auto Governor::compress() -> bool {
+    if (!applied(Degradation::Compress)) {
+        return false;
+    }
+    ++compressed;
+    return true;
+}
+
+auto Governor::statistics() const -> GovernorStatistics {
+    std::lock_guard lock{guard};
+    return GovernorStatistics{
+        .step = step(), .max_step = max_step, .raised = raised, .lowered = lowered,
+        .preview_skipped = preview_skipped.load(), .recorded_skipped = recorded_skipped.load(), .compressed = compressed.load()
+    };
+}
+
+auto operator << (std::ostream& os, Degradation step) -> std::ostream& {
+    switch (step) {
+    case Degradation::None:
+        return os << "none";
+    case Degradation::DecimatePreview:
+        return os << "decimate preview";
+    case Degradation::DropFrames:
+        return os << "drop frames";
+    case Degradation::Compress:
+        return os << "compress";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const GovernorStatistics& gs) -> std::ostream& {
+    return os << "governor step " << gs.step << " (max " << gs.max_step << "), raised: " << gs.raised << ", lowered: " << gs.lowered
+        << ", preview skipped: " << gs.preview_skipped << ", not recorded: " << gs.recorded_skipped << ", compressed: " << gs.compressed;
+}
+
+}   // end of namespace recording
@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <iosfwd>
+#include <stdint.h>
+
+// Decide how to degrade the recording when the disk is falling behind, before the queue of the writer is full
+// and the frames are lost in bursts. The recorder is passing the state of the writer (the queue depth, the time
+// it takes to write a frame, and the frames that were already dropped) a few times a second, and the governor
+// is stepping through the policy, one step at a time: when there is pressure it is moving to the next step, and
+// once the writer is keeping up for a while, it is moving back one step. Every step is logged and counted.
+// The steps are in the order of the policy, and each step is keeping the ones before it, for example with the
+// default policy, at the second step the preview is decimated and every Nth frame is not recorded.
+// For example:
+// recording::Governor governor{"DEV_1AB22C00A1B2", recording::GovernorSettings{.enabled = true}};
+// governor.update(recording::Pressure{.depth = 6, .capacity = 8, ...});
+// if (governor.keep_recorded(image.number)) { write(image); }
+
+namespace recording {
+
+enum class Degradation : uint32_t {
+    None,
+    DecimatePreview,        // only pass every Nth frame to the preview and the streaming
+    DropFrames,             // do not record every Nth frame
+    Compress                // compress the frames that are recorded (see bayer_codec.hh)
+};
+auto operator << (std::ostream& os, Degradation step) -> std::ostream&;
+
+struct GovernorSettings {
+    bool enabled{false};
+    std::vector<Degradation> policy{Degradation::DecimatePreview, Degradation::DropFrames, Degradation::Compress};
+    std::chrono::milliseconds interval{250};    // how often the pressure is checked
+    std::chrono::milliseconds recover{3000};    // how long the writer must keep up before we step back
+    double high_queue{0.5};                     // the part of the queue that is used when we are falling behind
+    double low_queue{0.125};                    // and when we are keeping up
+    double high_write{0.9};                     // the mean write time, as part of the time between the frames
+    double low_write{0.6};
+    uint32_t preview_every{4};                  // pass 1 of N frames to the preview
+    uint32_t drop_every{4};                     // do not record 1 of N frames
+};
+
+// The state of the writer since the last update
+struct Pressure {
+    std::size_t depth{0};                       // frames that are waiting for the writer now
+    std::size_t capacity{0};                    // of the queue
+    std::chrono::microseconds write{0};         // the mean time to write a frame
+    std::chrono::microseconds frame_time{0};    // the mean time between the frames that are arriving
+    uint64_t dropped{0};                        // frames that were lost since the last update
+};
+
+struct GovernorStatistics {
+    std::size_t step{0};                        // the number of steps of the policy that are applied now
+    std::size_t max_step{0};
+    uint64_t raised{0};                         // times that we moved to the next step
+    uint64_t lowered{0};
+    uint64_t preview_skipped{0};
+    uint64_t recorded_skipped{0};
+    uint64_t compressed{0};                     // frames that were compressed because of the governor
+};
+auto operator << (std::ostream& os, const GovernorStatistics& gs) -> std::ostream&;
+
+struct Governor {
+    using clock_type = std::chrono::steady_clock;
+
+    // The name is only for the log
+    Governor(std::string name, const GovernorSettings& settings);
+
+    Governor(const Governor&) = delete;
+    auto operator = (const Governor&) -> Governor& = delete;
+
+    // Return the step that is applied after the update
+    auto update(const Pressure& pressure, clock_type::time_point now = clock_type::now()) -> std::size_t;
+
+    // These are called for each frame, from the threads that are handling the frames, and are only reading the current step
+    [[nodiscard]] auto keep_preview(uint64_t number) -> bool;
+    [[nodiscard]] auto keep_recorded(uint64_t number) -> bool;
+    [[nodiscard]] auto compress() -> bool;
+
+    auto step() const -> std::size_t {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    auto statistics() const -> GovernorStatistics;
+
+private:
+    auto applied(Degradation d) const -> bool;
+    auto set(std::size_t to, const Pressure& pressure, const char* why) -> void;
+
+    const std::string name;
+    const GovernorSettings settings;
+    std::atomic<std::size_t> current{0};
+    std::optional<clock_type::time_point> calm_since;     // the writer is keeping up since
+    mutable std::mutex guard;
+    std::size_t max_step{0};
+    uint64_t raised{0};
+    uint64_t lowered{0};
+    std::atomic<uint64_t> preview_skipped{0};
+    std::atomic<uint64_t> recorded_skipped{0};
+    std::atomic<uint64_t> compressed{0};
+};
+
+}   // end of namespace recording
@@ -0,0 +1,253 @@
+#include "metadata.hh"
+#include "log/logging.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+constexpr std::array<std::size_t, static_cast<std::size_t>(Column::Count)> WIDTHS = {
+    sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t), sizeof(float), sizeof(float),
+    sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t)
+};
+
+constexpr auto record_size() -> std::size_t {
+    std::size_t size{0};
+    for (auto w : WIDTHS) {
+        size += w;
+    }
+    return size;
+}
+
+constexpr std::size_t BLOCK_SIZE = record_size() * METADATA_BLOCK;
+
+// where the column starts in each block
+auto column_offset(Column c) -> std::size_t {
+    std::size_t offset{0};
+    for (std::size_t i = 0; i < static_cast<std::size_t>(c); i++) {
+        offset += WIDTHS[i] * METADATA_BLOCK;
+    }
+    return offset;
+}
+
+auto block_offset(std::size_t block) -> std::size_t {
+    return METADATA_HEADER_SIZE + block * BLOCK_SIZE;
+}
+
+auto store(uint8_t* block, Column c, std::size_t i, const void* value) -> void {
+    const auto width{WIDTHS[static_cast<std::size_t>(c)]};
+    std::memcpy(block + column_offset(c) + i * width, value, width);
+}
+
+auto load(const uint8_t* block, Column c, std::size_t i, void* value) -> void {
+    const auto width{WIDTHS[static_cast<std::size_t>(c)]};
+    std::memcpy(value, block + column_offset(c) + i * width, width);
+}
+
+}       // end of local namespace
+
+auto column_width(Column column) -> std::size_t {
+    return column < Column::Count ? WIDTHS[static_cast<std::size_t>(column)] : 0;
+}
+
+auto metadata_name(const std::string& name) -> std::string {
+    return name + ".meta";
+}
+
+FrameMetadata::FrameMetadata(const camera::ImageView& image, uint32_t seg, uint64_t off, uint32_t s) :
+        number{image.number}, timestamp{image.timestamp}, arrived{image.arrived}, offset{off},
+        exposure{image.exposure}, gain{image.gain}, size{s}, status{image.status}, segment{seg} {
+}
+
+MetadataWriter::~MetadataWriter() {
+    close();
+}
+
+auto MetadataWriter::open(const std::filesystem::path& path, const std::string& name) -> bool {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG(ERROR) << "failed to create the metadata file " << path << ": " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    if (::ftruncate(fd, METADATA_HEADER_SIZE) != 0) {
+        LOG(ERROR) << "failed to write the header of the metadata file " << path << ": " << std::strerror(errno) << ENDL;
+        close();
+        return false;
+    }
+    auto mapping{::mmap(nullptr, METADATA_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+    if (mapping == MAP_FAILED) {
+        LOG(ERROR) << "failed to map the metadata file " << path << ": " << std::strerror(errno) << ENDL;
+        close();
+        return false;
+    }
+    base = static_cast<uint8_t*>(mapping);
+    mapped = METADATA_HEADER_SIZE;
+    MetadataHeader header{.record_size = static_cast<uint32_t>(record_size()), .created = camera::host_time()};
+    std::strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+    std::memcpy(base, &header, sizeof(header));
+    count = 0;
+    return true;
+}
+
+auto MetadataWriter::grow() -> bool {
+    const auto size{mapped + BLOCK_SIZE};
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        LOG(ERROR) << "failed to grow the metadata file to " << size << " bytes: " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    auto mapping{::mremap(base, mapped, size, MREMAP_MAYMOVE)};
+    if (mapping == MAP_FAILED) {
+        LOG(ERROR) << "failed to map " << size << " bytes of the metadata file: " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    base = static_cast<uint8_t*>(mapping);
+    mapped = size;
+    return true;
+}
+
+auto MetadataWriter::append(const FrameMetadata& frame) -> bool {
+    if (!is_open()) {
+        return false;
+    }
+    const auto block{count / METADATA_BLOCK};
+    const auto i{count % METADATA_BLOCK};
+    if (block_offset(block + 1) > mapped && !grow()) {
+        return false;
+    }
+    const auto status{static_cast<uint32_t>(frame.status)};
+    auto at{base + block_offset(block)};
+    store(at, Column::Number, i, &frame.number);
+    store(at, Column::Timestamp, i, &frame.timestamp);
+    store(at, Column::Arrived, i, &frame.arrived);
+    store(at, Column::Offset, i, &frame.offset);
+    store(at, Column::Exposure, i, &frame.exposure);
+    store(at, Column::Gain, i, &frame.gain);
+    store(at, Column::Size, i, &frame.size);
+    store(at, Column::Status, i, &status);
+    store(at, Column::Segment, i, &frame.segment);
+    // a reader that is mapping the file is seeing the new count only after the values
+    ++count;
+    std::atomic_ref<uint64_t>{reinterpret_cast<MetadataHeader*>(base)->count}.store(count, std::memory_order_release);
+    return true;
+}
+
+auto MetadataWriter::close() -> void {
+    if (base) {
+        ::munmap(base, mapped);
+        base = nullptr;
+        mapped = 0;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+MetadataReader::~MetadataReader() {
+    close();
+}
+
+auto MetadataReader::open(const std::filesystem::path& path) -> bool {
+    close();
+    const auto fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat file{};
+    if (fd < 0 || ::fstat(fd, &file) != 0) {
+        LOG(ERROR) << "failed to open the metadata file " << path << ": " << std::strerror(errno) << ENDL;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    const auto length{static_cast<std::size_t>(file.st_size)};
+    auto mapping{length >= sizeof(MetadataHeader) ? ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED};
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG(ERROR) << path << " is not a metadata file" << ENDL;
+        return false;
+    }
+    base = static_cast<const uint8_t*>(mapping);
+    mapped = length;
+    std::memcpy(&info, base, sizeof(info));
+    if (info.magic != METADATA_MAGIC || info.version != METADATA_VERSION || info.header_size != METADATA_HEADER_SIZE ||
+            info.block_frames != METADATA_BLOCK || info.columns != static_cast<uint32_t>(Column::Count) || info.record_size != record_size()) {
+        LOG(ERROR) << path << " is not a metadata file of version " << METADATA_VERSION << ENDL;
+        close();
+        return false;
+    }
+    // only the frames that are in the mapping, the writer may have added more since
+    const auto capacity{length > METADATA_HEADER_SIZE ? (length - METADATA_HEADER_SIZE) / BLOCK_SIZE * METADATA_BLOCK : 0};
+    const auto written{std::atomic_ref<uint64_t>{const_cast<MetadataHeader*>(reinterpret_cast<const MetadataHeader*>(base))->count}.load(std::memory_order_acquire)};
+    count = std::min<std::size_t>(written, capacity);
+    return true;
+}
+
+auto MetadataReader::close() -> void {
+    if (base) {
+        ::munmap(const_cast<uint8_t*>(base), mapped);
+        base = nullptr;
+        mapped = 0;
+    }
+    count = 0;
+}
+
+auto MetadataReader::column_at(Column c, std::size_t block) const -> const uint8_t* {
+    return base + block_offset(block) + column_offset(c);
+}
+
+auto MetadataReader::at(std::size_t i) const -> FrameMetadata {
+    const auto block{base + block_offset(i / METADATA_BLOCK)};
+    const auto in{i % METADATA_BLOCK};
+    FrameMetadata frame;
+    uint32_t status{0};
+    load(block, Column::Number, in, &frame.number);
+    load(block, Column::Timestamp, in, &frame.timestamp);
+    load(block, Column::Arrived, in, &frame.arrived);
+    load(block, Column::Offset, in, &frame.offset);
+    load(block, Column::Exposure, in, &frame.exposure);
+    load(block, Column::Gain, in, &frame.gain);
+    load(block, Column::Size, in, &frame.size);
+    load(block, Column::Status, in, &status);
+    load(block, Column::Segment, in, &frame.segment);
+    frame.status = static_cast<camera::ReceiveStatus>(status);
+    return frame;
+}
+
+auto operator << (std::ostream& os, Column column) -> std::ostream& {
+    switch (column) {
+    case Column::Number:
+        return os << "number";
+    case Column::Timestamp:
+        return os << "timestamp";
+    case Column::Arrived:
+        return os << "arrived";
+    case Column::Offset:
+        return os << "offset";
+    case Column::Exposure:
+        return os << "exposure";
+    case Column::Gain:
+        return os << "gain";
+    case Column::Size:
+        return os << "size";
+    case Column::Status:
+        return os << "status";
+    case Column::Segment:
+        return os << "segment";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const FrameMetadata& fm) -> std::ostream& {
+    return os << "frame " << fm.number << ", timestamp " << fm.timestamp << ", arrived " << fm.arrived << ", exposure " << fm.exposure
+        << "us, gain " << fm.gain << "dB, " << fm.status << ", segment " << fm.segment << " at " << fm.offset << ", " << fm.size << " bytes";
+}
+
+}   // end of namespace recording
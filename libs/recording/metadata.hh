@@ -0,0 +1,161 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include <filesystem>
+#include <span>
+#include <string>
+#include <algorithm>
+#include <iosfwd>
+#include <stdint.h>
+
+// Keep what we know about each frame (the timestamps, the exposure, the gain, how it was received, and where it
+// is in the segments) in a sidecar file next to the segments, so the analysis can go over millions of frames
+// without reading the frames themselves.
+// Every frame is the same number of bytes, and the frames are in blocks of METADATA_BLOCK frames. In each block
+// the values are by column, so reading one value (the exposure for example) of all the frames is reading only
+// that column, and each column is an array that can be used as is from the mapping of the file:
+// [MetadataHeader, padded to a page][block 0: number * N, timestamp * N, ..., segment * N][block 1]...
+// The file is growing a block at a time, and the writer is appending the values through a memory mapping, so
+// adding a frame is a few stores to memory. The number of frames in the header is updated after each frame, so
+// the file can be read while it is written, and after a crash it has all the frames that were written before it.
+// For example:
+// recording::MetadataReader meta;
+// if (meta.open("/data/run1/DEV_1AB22C00A1B2/DEV_1AB22C00A1B2.meta")) {
+//      for (std::size_t b = 0; b < meta.blocks(); b++) {
+//          for (auto exposure : meta.column<float>(recording::Column::Exposure, b)) {...}
+//      }
+// }
+
+namespace recording {
+
+constexpr uint32_t METADATA_MAGIC = 0x4d524347;     // "GCRM"
+constexpr uint32_t METADATA_VERSION = 1;
+constexpr uint32_t METADATA_BLOCK = 4096;           // frames, so every column in the block is a whole number of pages
+constexpr uint32_t METADATA_HEADER_SIZE = 4096;
+
+enum class Column : uint32_t {
+    Number,         // uint64_t
+    Timestamp,      // uint64_t, the device timestamp
+    Arrived,        // uint64_t, the host time in nanoseconds since the epoch
+    Offset,         // uint64_t, of the frame header in its segment
+    Exposure,       // float, microseconds
+    Gain,           // float, dB
+    Size,           // uint32_t, of the frame data in the segment (after the compression)
+    Status,         // uint32_t, camera::ReceiveStatus
+    Segment,        // uint32_t, the sequence number of the segment
+    Count
+};
+auto operator << (std::ostream& os, Column column) -> std::ostream&;
+
+// The width in bytes of the values in the column
+[[nodiscard]] auto column_width(Column column) -> std::size_t;
+
+struct MetadataHeader {
+    uint32_t magic{METADATA_MAGIC};
+    uint32_t version{METADATA_VERSION};
+    uint32_t header_size{METADATA_HEADER_SIZE};
+    uint32_t block_frames{METADATA_BLOCK};
+    uint32_t columns{static_cast<uint32_t>(Column::Count)};
+    uint32_t record_size{0};        // the bytes of a single frame, in all the columns
+    uint64_t count{0};              // the number of frames that were written
+    uint64_t created{0};            // the host time in nanoseconds since the epoch
+    char name[24]{};                // the camera id, it may be truncated
+};
+static_assert(sizeof(MetadataHeader) == 64, "the metadata header is part of the file format");
+
+// A single frame, from all the columns
+struct FrameMetadata {
+    uint64_t number{0};
+    uint64_t timestamp{0};
+    uint64_t arrived{0};
+    uint64_t offset{0};
+    float exposure{0};
+    float gain{0};
+    uint32_t size{0};
+    camera::ReceiveStatus status{camera::ReceiveStatus::Complete};
+    uint32_t segment{0};
+
+    FrameMetadata() = default;
+    // The location of the frame in the segments is not known to the image
+    FrameMetadata(const camera::ImageView& image, uint32_t segment, uint64_t offset, uint32_t size);
+};
+auto operator << (std::ostream& os, const FrameMetadata& fm) -> std::ostream&;
+
+struct MetadataWriter {
+    MetadataWriter() = default;
+    ~MetadataWriter();
+
+    MetadataWriter(const MetadataWriter&) = delete;
+    auto operator = (const MetadataWriter&) -> MetadataWriter& = delete;
+
+    // Create (or truncate) the file
+    [[nodiscard]] auto open(const std::filesystem::path& path, const std::string& name) -> bool;
+    [[nodiscard]] auto append(const FrameMetadata& frame) -> bool;
+    auto close() -> void;
+
+    auto is_open() const -> bool {
+        return fd >= 0;
+    }
+
+    auto size() const -> uint64_t {
+        return count;
+    }
+
+private:
+    auto grow() -> bool;
+
+    int fd{-1};
+    uint8_t* base{nullptr};
+    std::size_t mapped{0};
+    uint64_t count{0};
+};
+
+struct MetadataReader {
+    MetadataReader() = default;
+    ~MetadataReader();
+
+    MetadataReader(const MetadataReader&) = delete;
+    auto operator = (const MetadataReader&) -> MetadataReader& = delete;
+
+    // The frames that were written until now, open it again to see the frames that were added since
+    [[nodiscard]] auto open(const std::filesystem::path& path) -> bool;
+    auto close() -> void;
+
+    auto size() const -> std::size_t {
+        return count;
+    }
+
+    auto header() const -> const MetadataHeader& {
+        return info;
+    }
+
+    auto blocks() const -> std::size_t {
+        return (count + info.block_frames - 1) / info.block_frames;
+    }
+
+    // All the frames in the block (the last one may be partial) from a single column, the type must be of the width of the column.
+    // This is pointing into the mapping, so it is valid until the reader is closed.
+    template<typename T>
+    auto column(Column c, std::size_t block) const -> std::span<const T> {
+        if (sizeof(T) != column_width(c) || block >= blocks()) {
+            return {};
+        }
+        const auto frames{std::min<std::size_t>(info.block_frames, count - block * info.block_frames)};
+        return std::span<const T>{reinterpret_cast<const T*>(column_at(c, block)), frames};
+    }
+
+    // A single frame from all the columns, the position must be less than size
+    [[nodiscard]] auto at(std::size_t i) const -> FrameMetadata;
+
+private:
+    auto column_at(Column c, std::size_t block) const -> const uint8_t*;
+
+    const uint8_t* base{nullptr};
+    std::size_t mapped{0};
+    MetadataHeader info;
+    std::size_t count{0};
+};
+
+// The name of the metadata file of the camera, in the directory of its segments
+[[nodiscard]] auto metadata_name(const std::string& name) -> std::string;
+
+}   // end of namespace recording
@@ -0,0 +1,468 @@
+#include "recorder.hh"
+#include "log/logging.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+auto max_of(std::atomic<uint64_t>& to, uint64_t value) -> void {
+    auto current{to.load(std::memory_order_relaxed)};
+    while (value > current && !to.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+auto event_name(uint64_t number) -> std::string {
+    char name[32];
+    std::snprintf(name, sizeof(name), "event-%06llu", static_cast<unsigned long long>(number));
+    return name;
+}
+
+}       // end of local namespace
+
+struct CameraRecorder {
+    CameraRecorder(std::shared_ptr<camera::IdleCamera>&& cam, const std::string& i, std::filesystem::path p, const RecorderSettings& s) :
+            settings{s}, id{i}, path{std::move(p)}, idle{std::move(cam)}, governor{i, s.governor} {
+    }
+
+    ~CameraRecorder() {
+        stop();
+    }
+
+    auto open() -> bool;
+    auto start(std::stop_token cancellation) -> bool;
+    auto stop() -> void;
+    auto trigger() -> bool;
+    auto statistics() const -> RecorderStatistics;
+    auto keep_preview(uint64_t number) -> bool;
+    auto with_camera(const std::function<bool(camera::CapturingCamera&)>& f) -> bool;
+    auto release() -> std::shared_ptr<camera::IdleCamera>;
+
+private:
+    // This is running on its own thread, and is passing the state of the writer to the governor
+    auto watch(std::stop_token st) -> void;
+    auto governed() const -> bool {
+        return settings.governor.enabled && !ring;
+    }
+
+    // These are called from the writer thread
+    auto write(const camera::ImageView& image) -> bool;
+    auto save_events(std::stop_token st) -> void;
+    auto save_event(clock_type::time_point at, std::stop_token st) -> void;
+    auto taken(uint64_t number) -> void;
+
+public:
+    const RecorderSettings settings;
+    const std::string id;
+    const std::filesystem::path path;
+
+private:
+    mutable std::mutex guard;           // for the camera and the context
+    std::shared_ptr<camera::IdleCamera> idle;
+    std::shared_ptr<camera::CapturingCamera> capturing;
+    camera::async_context_t context;
+    camera::DispatchStatistics last_dispatch;       // once the context is gone
+    SegmentWriter writer;               // for the events mode
+    StripedWriter striped;              // for the continuous mode, this is a single volume unless settings.volumes are set
+    // for the events mode, the camera thread is pushing the frames into the ring, and the events thread is writing them
+    std::unique_ptr<FrameRing> ring;
+    std::mutex events_guard;
+    std::condition_variable_any event_cv;
+    std::optional<clock_type::time_point> requested;    // the last event that was triggered, and was not handled yet
+    std::jthread events_thread;
+    std::atomic<bool> accepting{false};                 // events are only triggered while we are recording
+    Governor governor;
+    std::jthread governor_thread;
+    // these are updated by the writer threads
+    std::mutex numbers_guard;
+    bool first{true};
+    uint64_t last_number{0};
+    uint64_t previous_segments{0};                      // of the events that were already saved
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> missing{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> segments{0};
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> max_write{0};
+    std::atomic<uint64_t> total_write{0};
+};
+
+auto CameraRecorder::open() -> bool {
+    if (settings.mode == RecordingMode::Continuous) {
+        auto segments{settings.segments};
+        const auto& policy{settings.governor.policy};
+        segments.prepare_codec = settings.governor.enabled && std::find(policy.begin(), policy.end(), Degradation::Compress) != policy.end();
+        std::vector<std::filesystem::path> volumes{settings.output};
+        if (!settings.volumes.empty()) {
+            volumes = settings.volumes;
+        }
+        return striped.open(volumes, path, id, segments, settings.striping);
+    }
+    const auto frame_size{camera::get_frame_size(*idle)};
+    if (!frame_size || frame_size.value() <= 0) {
+        LOG(ERROR) << "failed to get the frame size of " << id << ", cannot allocate the frames ring" << ENDL;
+        return false;
+    }
+    // the window before the event, and another second for the frames that arrive while we are writing it
+    const auto seconds{std::chrono::duration<double>(settings.events.pre).count() + 1.0};
+    const auto count{static_cast<std::size_t>(std::ceil(seconds * settings.events.frame_rate))};
+    ring = FrameRing::make(count, static_cast<std::size_t>(frame_size.value()));
+    if (!ring) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    if (ec) {
+        LOG(ERROR) << "failed to create the recording directory " << path << ": " << ec.message() << ENDL;
+        return false;
+    }
+    return true;
+}
+
+auto CameraRecorder::start(std::stop_token cancellation) -> bool {
+    std::lock_guard lock{guard};
+    if (context) {
+        LOG(WARNING) << "already recording to " << path << ENDL;
+        return false;
+    }
+    if (!idle) {
+        LOG(ERROR) << "no camera to record from to " << path << ENDL;
+        return false;
+    }
+    if (!striped.is_open() && !ring) {
+        LOG(ERROR) << "the recording to " << path << " was already closed" << ENDL;
+        return false;
+    }
+    capturing = camera::From(std::move(idle));
+    // a worker for each volume, with a single volume the frames are written in order
+    context = camera::make_async_pool_context(*capturing, [this](camera::FrameLease frame) {
+        const auto& image{frame.image()};
+        if (settings.tap && keep_preview(image.number)) {
+            settings.tap(frame);
+        }
+        if (ring) {
+            ring->push(image);      // the frames that are dropped are counted by the ring
+            return true;
+        }
+        return write(image);
+    }, std::move(cancellation), camera::DispatchSettings{
+        .workers = ring ? 1 : striped.size(), .ring_size = settings.queue_size, .overflow = camera::OverflowPolicy::DropNewest, .drain = true
+    });
+    if (!context || !camera::async_capture(*context, *capturing, settings.buffers)) {
+        LOG(ERROR) << "failed to start capturing for recording to " << path << ENDL;
+        context.reset();
+        idle = camera::Back(std::move(capturing));
+        return false;
+    }
+    if (ring) {
+        events_thread = std::jthread([this](std::stop_token st) {
+            save_events(std::move(st));
+        });
+        accepting = true;
+    }
+    if (governed()) {
+        governor_thread = std::jthread([this](std::stop_token st) {
+            watch(std::move(st));
+        });
+    }
+    LOG(INFO) << "recording to " << path << " with " << settings.buffers << " buffers and a queue of " << settings.queue_size << " frames, "
+        << settings.mode << " mode" << ENDL;
+    return true;
+}
+
+auto CameraRecorder::stop() -> void {
+    if (governor_thread.joinable()) {
+        governor_thread.request_stop();
+        governor_thread.join();     // before taking the lock, since it is using it
+    }
+    std::lock_guard lock{guard};
+    if (context) {
+        last_dispatch = camera::dispatch_statistics(*context);
+        context.reset();            // this is stopping the camera, and then the writer is done with the queue
+    }
+    if (capturing) {
+        idle = camera::Back(std::move(capturing));
+    }
+    // the camera is stopped, so this is only finishing the event that is being saved, with the frames that we already have
+    accepting = false;
+    if (events_thread.joinable()) {
+        events_thread.request_stop();
+        events_thread.join();
+    }
+    writer.close();
+    striped.close();
+}
+
+auto CameraRecorder::trigger() -> bool {
+    if (!accepting) {
+        return false;
+    }
+    std::lock_guard lock{events_guard};
+    requested = clock_type::now();
+    event_cv.notify_one();
+    return true;
+}
+
+auto CameraRecorder::save_events(std::stop_token st) -> void {
+    while (!st.stop_requested()) {
+        clock_type::time_point at;
+        {
+            std::unique_lock lock{events_guard};
+            if (!event_cv.wait(lock, st, [this] { return requested.has_value(); })) {
+                return;
+            }
+            at = requested.value();
+            requested.reset();
+        }
+        save_event(at, st);
+    }
+}
+
+auto CameraRecorder::save_event(clock_type::time_point at, std::stop_token st) -> void {
+    const auto number{events.load()};
+    if (!writer.open(path / event_name(number), id, settings.segments)) {
+        ++errors;
+        return;
+    }
+    auto end{at + settings.events.post};
+    const auto waiting{ring->pin(at - settings.events.pre)};
+    LOG(INFO) << "saving event " << number << " of " << id << ", " << waiting << " frames from before the event" << ENDL;
+    first = true;       // the frames between the events are missing on purpose
+    auto success{true};
+    while (success) {
+        {
+            std::lock_guard lock{events_guard};
+            if (requested) {
+                end = std::max(end, requested.value() + settings.events.post);
+                requested.reset();
+            }
+        }
+        if (const auto frame = ring->next(); frame) {
+            if (frame->arrived > end) {
+                break;
+            }
+            success = write(frame->image);
+            ring->release();
+        } else if (st.stop_requested() || clock_type::now() > end) {
+            break;      // when stopping, there are no more frames that are coming
+        } else {
+            (void)ring->wait(std::chrono::milliseconds{100});
+        }
+    }
+    ring->unpin();
+    if (!writer.close()) {
+        ++errors;
+    }
+    previous_segments += writer.segments();
+    ++events;
+}
+
+auto CameraRecorder::watch(std::stop_token st) -> void {
+    std::mutex sleeping;
+    std::condition_variable_any wakeup;
+    camera::DispatchStatistics before;
+    uint64_t frames_before{0}, write_before{0};
+    auto last{clock_type::now()};
+    while (!st.stop_requested()) {
+        {
+            std::unique_lock lock{sleeping};
+            wakeup.wait_for(lock, st, settings.governor.interval, [] { return false; });
+        }
+        camera::DispatchStatistics now;
+        {
+            std::lock_guard lock{guard};
+            if (!context) {
+                return;
+            }
+            now = camera::dispatch_statistics(*context);
+        }
+        const auto at{clock_type::now()};
+        const auto written{frames - frames_before};
+        const auto arrived{(now.pushed + now.dropped_newest) - (before.pushed + before.dropped_newest)};
+        const Pressure pressure{
+            .depth = static_cast<std::size_t>(now.pushed - now.processed), .capacity = settings.queue_size,
+            .write = std::chrono::microseconds{written ? (total_write - write_before) / written / striped.size() : 0},
+            .frame_time = std::chrono::duration_cast<std::chrono::microseconds>(at - last) / std::max<int64_t>(arrived, 1),
+            .dropped = now.dropped_newest - before.dropped_newest
+        };
+        governor.update(pressure, at);
+        before = now;
+        frames_before += written;
+        write_before = total_write;
+        last = at;
+    }
+}
+
+auto CameraRecorder::keep_preview(uint64_t number) -> bool {
+    return governor.keep_preview(number);
+}
+
+auto CameraRecorder::with_camera(const std::function<bool(camera::CapturingCamera&)>& f) -> bool {
+    std::lock_guard lock{guard};
+    return capturing && f(*capturing);
+}
+
+auto CameraRecorder::release() -> std::shared_ptr<camera::IdleCamera> {
+    stop();
+    std::lock_guard lock{guard};
+    return std::move(idle);
+}
+
+auto CameraRecorder::write(const camera::ImageView& image) -> bool {
+    if (governed()) {
+        if (!governor.keep_recorded(image.number)) {
+            taken(image.number);        // this is not a missing frame
+            return true;
+        }
+        striped.set_compression(governor.compress() ? Compression::Bayer : settings.segments.compression);
+    }
+    const auto start{clock_type::now()};
+    if (!(ring ? writer.write(image) : striped.write(image))) {
+        ++errors;
+        return false;       // the disk is not going to get better, so stop this camera
+    }
+    const uint64_t took = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+    max_of(max_write, took);
+    total_write += took;
+    taken(image.number);
+    bytes += sizeof(FrameHeader) + image.size;
+    segments = ring ? previous_segments + writer.segments() : striped.segments();
+    ++frames;
+    return true;
+}
+
+auto CameraRecorder::taken(uint64_t number) -> void {
+    // with a few volumes the frames are written at the same time, so a frame can come after the ones that
+    // arrived after it, and then it was already counted as missing
+    const uint64_t late{striped.size() > 1 ? settings.queue_size + striped.size() : 0};
+    std::lock_guard lock{numbers_guard};
+    if (first) {
+        first = false;
+    } else if (number > last_number) {
+        missing += number - last_number - 1;
+    } else if (number < last_number && last_number - number <= late) {
+        if (missing > 0) {
+            --missing;
+        }
+        return;
+    }
+    last_number = number;
+}
+
+auto CameraRecorder::statistics() const -> RecorderStatistics {
+    camera::DispatchStatistics dispatch;
+    {
+        std::lock_guard lock{guard};
+        dispatch = context ? camera::dispatch_statistics(*context) : last_dispatch;
+    }
+    const auto ring_stats{ring ? std::optional<RingStatistics>{ring->statistics()} : std::nullopt};
+    return RecorderStatistics{
+        .frames = frames.load(), .bytes = bytes.load(), .dropped = dispatch.dropped_newest + (ring_stats ? ring_stats->dropped : 0),
+        .missing = missing.load(), .errors = errors.load(), .segments = segments.load(), .max_queue = dispatch.max_depth,
+        .max_write = std::chrono::microseconds{max_write.load()}, .total_write = std::chrono::microseconds{total_write.load()},
+        .io = ring ? writer.io_statistics() : striped.io_statistics(), .codec = ring ? writer.codec_statistics() : striped.codec_statistics(), .events = events.load(), .ring = ring_stats,
+        .governor = governed() ? std::optional<GovernorStatistics>{governor.statistics()} : std::nullopt,
+        .volumes = striped.size() > 1 ? striped.statistics() : std::vector<VolumeStatistics>{}
+    };
+}
+
+auto make_recorder(std::shared_ptr<camera::IdleCamera>&& camera, const std::string& id, const RecorderSettings& settings) -> recorder_t {
+    if (!camera) {
+        LOG(ERROR) << "no camera to record from for " << id << ENDL;
+        return {};
+    }
+    if (settings.queue_size >= static_cast<std::size_t>(std::max(settings.buffers, 0))) {
+        LOG(WARNING) << "the recording queue size " << settings.queue_size << " is not less than the number of buffers " << settings.buffers
+            << ", the camera may run out of buffers while the writer is busy" << ENDL;
+    }
+    if (settings.mode == RecordingMode::Events && (settings.events.frame_rate <= 0 || settings.events.pre.count() < 0 || settings.events.post.count() < 0)) {
+        LOG(ERROR) << "invalid events settings for " << id << ", the frame rate must be positive and the windows cannot be negative" << ENDL;
+        return {};
+    }
+    if (settings.mode == RecordingMode::Events && settings.governor.enabled) {
+        LOG(WARNING) << "the governor is only used in the continuous mode, it is ignored for " << id << ENDL;
+    }
+    if (settings.mode == RecordingMode::Events && !settings.volumes.empty()) {
+        LOG(WARNING) << "the frames are only striped over the volumes in the continuous mode, the events of " << id << " are written to " << settings.output << ENDL;
+    }
+    auto recorder{std::make_shared<CameraRecorder>(std::move(camera), id, settings.output / id, settings)};
+    if (!recorder->open()) {
+        return {};
+    }
+    return recorder;
+}
+
+auto start(CameraRecorder& recorder, std::stop_token cancellation) -> bool {
+    return recorder.start(std::move(cancellation));
+}
+
+auto stop(CameraRecorder& recorder) -> void {
+    recorder.stop();
+}
+
+auto trigger(CameraRecorder& recorder) -> bool {
+    return recorder.trigger();
+}
+
+auto keep_preview(CameraRecorder& recorder, uint64_t number) -> bool {
+    return recorder.keep_preview(number);
+}
+
+auto with_camera(CameraRecorder& recorder, const std::function<bool(camera::CapturingCamera&)>& f) -> bool {
+    return recorder.with_camera(f);
+}
+
+auto release(CameraRecorder& recorder) -> std::shared_ptr<camera::IdleCamera> {
+    return recorder.release();
+}
+
+auto statistics(const CameraRecorder& recorder) -> RecorderStatistics {
+    return recorder.statistics();
+}
+
+auto output_path(const CameraRecorder& recorder) -> const std::filesystem::path& {
+    return recorder.path;
+}
+
+auto operator << (std::ostream& os, const RecorderStatistics& rs) -> std::ostream& {
+    os << "frames: " << rs.frames << ", bytes: " << rs.bytes << ", dropped: " << rs.dropped
+        << ", missing: " << rs.missing << ", errors: " << rs.errors << ", segments: " << rs.segments << ", max queue: " << rs.max_queue
+        << ", write max: " << rs.max_write.count() << "us, mean: " << (rs.frames ? rs.total_write.count() / rs.frames : 0) << "us";
+    if (rs.io) {
+        os << ", " << rs.io.value();
+    }
+    if (rs.codec) {
+        os << ", " << rs.codec.value();
+    }
+    if (rs.ring) {
+        os << ", events: " << rs.events << ", " << rs.ring.value();
+    }
+    if (rs.governor) {
+        os << ", " << rs.governor.value();
+    }
+    for (auto&& v : rs.volumes) {
+        os << "\n\t" << v;
+    }
+    return os;
+}
+
+auto operator << (std::ostream& os, RecordingMode mode) -> std::ostream& {
+    switch (mode) {
+        case RecordingMode::Continuous:
+            return os << "continuous";
+        case RecordingMode::Events:
+            return os << "events";
+    }
+    return os << "unknown recording mode";
+}
+
+}   // end of namespace recording
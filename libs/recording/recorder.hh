@@ -0,0 +1,129 @@
+#pragma once
+#include "camera_controller/camera.hh"
+#include "camera_controller/frame_lease.hh"
+#include "segment_writer.hh"
+#include "striped_writer.hh"
+#include "frame_ring.hh"
+#include "governor.hh"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Record the frames from a single camera to disk.
+// The camera thread is only passing the frame (as a lease) into a bounded queue, and a dedicated writer
+// thread is appending the frames from the queue into segment files (see segment_writer.hh). This way a slow
+// disk is never blocking the camera, when the writer cannot keep up, the new frames are dropped (and counted)
+// until there is space.
+// For example:
+// auto recorder{recording::make_recorder(std::move(camera), device.id, recording::RecorderSettings{.output = "/data"})};
+// if (!recorder || !recording::start(*recorder, stop_source.get_token())) {
+//      std::cerr << "failed to start recording\n"; exit(1);
+// }
+// ...
+// recording::stop(*recorder);
+// std::cout << recording::statistics(*recorder) << "\n";
+// In the events mode, the frames are only kept in memory (see frame_ring.hh), and nothing is written until
+// an event is triggered. Then the frames from a few seconds before the event, and until a few seconds after
+// it, are written into their own directory <output>/<camera id>/event-<N>/. This is using the host time that
+// the frames arrived at, so the same window is saved from all the cameras.
+// recording::trigger(*recorder);    // save the last settings.events.pre and the next settings.events.post
+// With settings.governor.enabled (in the continuous mode), the recorder is degrading the recording step by step when
+// the writer is falling behind (see governor.hh), the preview and the streaming should ask recording::keep_preview for each frame.
+// When a single disk cannot keep up, the frames can be striped over a few volumes (see striped_writer.hh), in the continuous
+// mode, with a writer thread for each volume:
+// recording::RecorderSettings{.output = "/data0/run1", .volumes = {"/data0/run1", "/data1/run1", "/data2/run1"}}
+
+namespace recording {
+
+enum class RecordingMode : uint32_t {
+    Continuous,             // write all the frames
+    Events                  // only write the frames around the events
+};
+auto operator << (std::ostream& os, RecordingMode mode) -> std::ostream&;
+
+struct EventSettings {
+    std::chrono::milliseconds pre{5000};    // how much to save from before the event
+    std::chrono::milliseconds post{5000};   // and after it
+    double frame_rate{30};                  // the expected rate, this is used to find how many frames to keep in memory
+};
+
+struct RecorderSettings {
+    std::filesystem::path output;       // the directory, the segments are written to <output>/<camera id>/
+    std::vector<std::filesystem::path> volumes;     // stripe the frames over <volume>/<camera id>/ instead (only for the continuous mode)
+    Striping striping{Striping::Load};
+    int buffers{static_cast<int>(camera::DEFAULT_NUMBER_OF_BUFFERS)};  // the number of buffers for the camera
+    std::size_t queue_size{8};          // frames that are waiting for the writer, this must be less than the number of buffers
+    SegmentSettings segments;
+    RecordingMode mode{RecordingMode::Continuous};
+    EventSettings events;               // only for the events mode
+    GovernorSettings governor;          // only for the continuous mode
+    // Called with each frame that is kept for the preview and the streaming (see keep_preview), from the capture callback
+    // before the frame is written, so it should only copy the frame or pass it on, and never wait. Keeping a copy of the lease
+    // is keeping the frame without copying it, but the camera has one less buffer until it is released, so the buffers should
+    // be more than the queue and the frames that the tap may hold.
+    std::function<void(const camera::FrameLease&)> tap;
+};
+
+struct RecorderStatistics {
+    uint64_t frames{0};                 // frames that were written to the file
+    uint64_t bytes{0};
+    uint64_t dropped{0};                // frames that we got from the camera, but the writer was too slow to take
+    uint64_t missing{0};                // gaps in the frame numbers, this includes the dropped frames, and the frames that the camera lost
+    uint64_t errors{0};
+    uint64_t segments{0};
+    uint64_t max_queue{0};              // the most frames that were waiting for the writer at the same time
+    std::chrono::microseconds max_write{0};
+    std::chrono::microseconds total_write{0};
+    std::optional<IoStatistics> io;     // only with direct IO
+    std::optional<CodecStatistics> codec;   // only with compression, the bytes above are before the compression
+    uint64_t events{0};                 // events that were saved
+    std::optional<RingStatistics> ring; // only in the events mode
+    std::optional<GovernorStatistics> governor;     // only when the governor is enabled
+    std::vector<VolumeStatistics> volumes;          // only when the frames are striped over a few volumes
+};
+auto operator << (std::ostream& os, const RecorderStatistics& rs) -> std::ostream&;
+
+struct CameraRecorder;
+using recorder_t = std::shared_ptr<CameraRecorder>;
+
+// The camera should already be configured (see camera::open_all). The id is used for the file name.
+// Return nullptr if we cannot create the first segment, or in the events mode, the frames ring.
+[[nodiscard]] auto make_recorder(std::shared_ptr<camera::IdleCamera>&& camera, const std::string& id, const RecorderSettings& settings) -> recorder_t;
+
+// Start capturing from the camera and writing the frames. The recording stops when the stop is requested,
+// when writing to the disk failed, or when calling stop.
+[[nodiscard]] auto start(CameraRecorder& recorder, std::stop_token cancellation) -> bool;
+
+// Stop the camera, wait for the writer to finish with the frames that are already in the queue, and close the last segment.
+// Note that a recorder cannot be started again after it was stopped.
+auto stop(CameraRecorder& recorder) -> void;
+
+[[nodiscard]] auto statistics(const CameraRecorder& recorder) -> RecorderStatistics;
+// Save an event, in the events mode: the frames from settings.events.pre before now, and until settings.events.post
+// after now. This is not waiting for the frames to be written. Triggering while an event is being saved is extending it.
+// Return false if the recorder is not recording in the events mode.
+auto trigger(CameraRecorder& recorder) -> bool;
+
+// False if the governor decided that this frame should not be passed to the preview or the streaming, to save the disk
+[[nodiscard]] auto keep_preview(CameraRecorder& recorder, uint64_t number) -> bool;
+
+// Run the function with the camera on the calling thread, while the recorder is capturing. This is for the features that can
+// be changed while capturing (see features.hh), the frames are not waiting for it, the camera is only guarded from being stopped
+// at the same time. Return false if the recorder is not capturing, or if the function failed.
+[[nodiscard]] auto with_camera(CameraRecorder& recorder, const std::function<bool(camera::CapturingCamera&)>& f) -> bool;
+
+// Stop the recorder, and take the camera back from it, so it can be configured, or recorded again with a new recorder.
+// Return nullptr if the camera was already taken.
+[[nodiscard]] auto release(CameraRecorder& recorder) -> std::shared_ptr<camera::IdleCamera>;
+
+// The directory with the segments of this camera, or with the list of the volumes when the frames are striped
+[[nodiscard]] auto output_path(const CameraRecorder& recorder) -> const std::filesystem::path&;
+
+}   // end of namespace recording
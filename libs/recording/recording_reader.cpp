@@ -0,0 +1,268 @@
+#include "recording_reader.hh"
+#include "segment_reader.hh"
+#include "striped_writer.hh"
+#include "bayer_codec.hh"
+#include "log/logging.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <limits>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+constexpr uint32_t NO_FRAME = std::numeric_limits<uint32_t>::max();
+// use the table for finding by number, as long as it is not much larger than the number of frames
+constexpr std::size_t MAX_GAPS_FACTOR = 4;
+
+}       // end of local namespace
+
+RecordingReader::~RecordingReader() {
+    close();
+}
+
+auto RecordingReader::open(const std::filesystem::path& directory) -> bool {
+    const auto volumes{read_stripes(directory)};
+    if (volumes.size() == 1) {
+        const auto segments{list_segments(directory)};
+        if (segments.empty()) {
+            LOG(ERROR) << "there are no recording segments in " << directory << ENDL;
+            return false;
+        }
+        return open(segments);
+    }
+    // the frames of each volume are in the order they were written, and are merged by their numbers
+    close();
+    std::vector<std::size_t> ends;
+    for (auto&& volume : volumes) {
+        const auto segments{list_segments(volume)};
+        if (segments.empty()) {
+            LOG(WARNING) << "there are no recording segments in the volume " << volume << " of " << directory << ENDL;
+        }
+        for (auto&& path : segments) {
+            if (!map(path)) {
+                close();
+                return false;
+            }
+        }
+        ends.push_back(frames.size());
+    }
+    if (frames.empty()) {
+        LOG(ERROR) << "there are no recording segments in the " << volumes.size() << " volumes of " << directory << ENDL;
+        return false;
+    }
+    merge(ends);
+    build_lookup();
+    return true;
+}
+
+auto RecordingReader::open(const std::vector<std::filesystem::path>& segments) -> bool {
+    close();
+    for (auto&& path : segments) {
+        if (!map(path)) {
+            close();
+            return false;
+        }
+    }
+    build_lookup();
+    return true;
+}
+
+auto RecordingReader::map(const std::filesystem::path& path) -> bool {
+    // the index is read (or rebuilt for a segment that was not closed) the same way as for a single segment
+    SegmentReader segment;
+    if (!segment.open(path)) {
+        return false;
+    }
+    const auto fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat info{};
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        LOG(ERROR) << "failed to open the segment " << path << ": " << std::strerror(errno) << ENDL;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    const auto length{static_cast<std::size_t>(info.st_size)};
+    auto base{::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0)};
+    ::close(fd);        // the mapping is keeping the file
+    if (base == MAP_FAILED) {
+        LOG(ERROR) << "failed to map the segment " << path << ": " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    mappings.push_back(Mapping{.base = static_cast<uint8_t*>(base), .length = length});
+    for (auto&& entry : segment.index()) {
+        if (entry.offset + sizeof(FrameHeader) + entry.size > length) {
+            LOG(WARNING) << "the index of " << path << " is pointing after the end of the file at frame number " << entry.number << ENDL;
+            break;
+        }
+        frames.push_back(Frame{.header = mappings.back().base + entry.offset, .number = entry.number, .timestamp = entry.timestamp, .size = entry.size});
+    }
+    return true;
+}
+
+auto RecordingReader::merge(const std::vector<std::size_t>& ends) -> void {
+    std::vector<std::size_t> heads(ends.size());
+    for (std::size_t v = 1; v < ends.size(); v++) {
+        heads[v] = ends[v - 1];
+    }
+    std::vector<Frame> merged;
+    merged.reserve(frames.size());
+    while (merged.size() < frames.size()) {
+        std::size_t from{ends.size()};
+        for (std::size_t v = 0; v < ends.size(); v++) {
+            if (heads[v] < ends[v] && (from == ends.size() || frames[heads[v]].number < frames[heads[from]].number)) {
+                from = v;
+            }
+        }
+        merged.push_back(frames[heads[from]++]);
+    }
+    frames = std::move(merged);
+}
+
+auto RecordingReader::build_lookup() -> void {
+    by_number.clear();
+    numbers.clear();
+    if (frames.empty()) {
+        return;
+    }
+    first_number = frames.front().number;
+    const auto growing{std::adjacent_find(frames.begin(), frames.end(), [](const Frame& a, const Frame& b) {
+        return b.number <= a.number;
+    }) == frames.end()};
+    const auto range{frames.back().number - first_number + 1};
+    if (growing && frames.size() < NO_FRAME && range <= frames.size() * MAX_GAPS_FACTOR) {
+        by_number.assign(range, NO_FRAME);
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            by_number[frames[i].number - first_number] = static_cast<uint32_t>(i);
+        }
+        return;
+    }
+    numbers.reserve(frames.size());
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        numbers.emplace(frames[i].number, i);       // the first frame with this number
+    }
+}
+
+auto RecordingReader::close() -> void {
+    for (auto&& m : mappings) {
+        ::munmap(m.base, m.length);
+    }
+    mappings.clear();
+    frames.clear();
+    by_number.clear();
+    numbers.clear();
+}
+
+auto RecordingReader::at(std::size_t i) const -> camera::ImageView {
+    const auto& f{frames[i]};
+    FrameHeader header;
+    std::memcpy(&header, f.header, sizeof(header));
+    return camera::ImageView{header.size, header.width, header.height, header.number,
+        f.header + header.header_size, header.pixel_format(), header.timestamp};
+}
+
+auto RecordingReader::frame(std::size_t i) const -> std::optional<camera::ImageView> {
+    if (i >= frames.size()) {
+        return std::nullopt;
+    }
+    FrameHeader header;
+    std::memcpy(&header, frames[i].header, sizeof(header));
+    if (header.magic != FRAME_MAGIC || header.number != frames[i].number || header.size != frames[i].size || header.header_size != sizeof(FrameHeader)) {
+        LOG(ERROR) << "invalid frame header for frame number " << frames[i].number << ENDL;
+        return std::nullopt;
+    }
+    return at(i);
+}
+
+auto RecordingReader::compression(std::size_t i) const -> Compression {
+    FrameHeader header;
+    std::memcpy(&header, frames[i].header, sizeof(header));
+    return header.compression();
+}
+
+auto RecordingReader::read(std::size_t i, camera::Image& image) const -> bool {
+    const auto view{frame(i)};
+    if (!view) {
+        return false;
+    }
+    image.width = view->width;
+    image.height = view->height;
+    image.number = view->number;
+    image.type = view->type;
+    image.timestamp = view->timestamp;
+    switch (compression(i)) {
+    case Compression::None:
+        image.data.assign(view->data, view->data + view->size);
+        return true;
+    case Compression::Bayer:
+        image.data.resize(std::size_t{view->width} * view->height);
+        return bayer_decode(view->data, view->size, image.data.data(), image.data.size());
+    default:
+        LOG(ERROR) << "unknown compression " << compression(i) << " for frame number " << view->number << ENDL;
+        return false;
+    }
+}
+
+auto RecordingReader::find(uint64_t number) const -> std::optional<std::size_t> {
+    if (!by_number.empty()) {
+        if (number < first_number || number - first_number >= by_number.size() || by_number[number - first_number] == NO_FRAME) {
+            return std::nullopt;
+        }
+        return by_number[number - first_number];
+    }
+    if (const auto i = numbers.find(number); i != numbers.end()) {
+        return i->second;
+    }
+    return std::nullopt;
+}
+
+auto RecordingReader::find_time(uint64_t timestamp) const -> std::optional<std::size_t> {
+    if (frames.empty() || timestamp > frames.back().timestamp) {
+        return std::nullopt;
+    }
+    const auto first{frames.front().timestamp};
+    if (timestamp <= first) {
+        return 0;
+    }
+    // where it would be at a fixed frame rate, and from there to the first frame that is not before it
+    const auto span{frames.back().timestamp - first};
+    auto i{static_cast<std::size_t>(static_cast<long double>(timestamp - first) / span * (frames.size() - 1))};
+    i = std::min(i, frames.size() - 1);
+    while (i > 0 && frames[i - 1].timestamp >= timestamp) {
+        --i;
+    }
+    while (frames[i].timestamp < timestamp) {
+        ++i;        // this must stop, since the last frame is not before the timestamp
+    }
+    return i;
+}
+
+auto RecordingReader::will_read(std::size_t from, std::size_t count) const -> void {
+    if (from >= frames.size() || count == 0) {
+        return;
+    }
+    const auto last{std::min(from + count, frames.size()) - 1};
+    // one call per segment, this is only a hint so we don't care if it fails
+    for (auto i = from; i <= last;) {
+        const auto& mapping{*std::find_if(mappings.begin(), mappings.end(), [&](const Mapping& m) {
+            return frames[i].header >= m.base && frames[i].header < m.base + m.length;
+        })};
+        auto j{i};
+        while (j < last && frames[j + 1].header >= mapping.base && frames[j + 1].header < mapping.base + mapping.length) {
+            ++j;
+        }
+        const auto page{static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))};
+        const auto start{reinterpret_cast<uintptr_t>(frames[i].header) / page * page};
+        const auto end{reinterpret_cast<uintptr_t>(frames[j].header) + sizeof(FrameHeader) + frames[j].size};
+        ::madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+        i = j + 1;
+    }
+}
+
+}   // end of namespace recording
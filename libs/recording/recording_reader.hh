@@ -0,0 +1,93 @@
+#pragma once
+#include "frame_file.hh"
+#include "camera_controller/image.hh"
+#include <filesystem>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <stdint.h>
+
+// Read a whole recording of a camera (all its segments) through memory mappings, so the frames are
+// returned as views into the files, without copying them, and the page cache is doing the reading.
+// Finding a frame by its number is a lookup in a table, and by its timestamp is a guess from the frame
+// rate that is then corrected by a few steps at most (as long as the frame rate is not changing much),
+// so seeking is not depending on the length of the recording.
+// For example:
+// recording::RecordingReader reader;
+// if (reader.open("/data/run1/DEV_1AB22C00A1B2")) {
+//      if (auto i = reader.find(1000); i) { std::cout << reader.at(i.value()) << "\n"; }
+// }
+// See replay.hh for feeding the frames to the same processing that is used with a camera.
+// A recording that was striped over a few volumes (see striped_writer.hh) is opened from its directory the same
+// way, the segments of all the volumes are mapped, and the frames are put back in the order of their numbers.
+
+namespace recording {
+
+struct RecordingReader {
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    auto operator = (const RecordingReader&) -> RecordingReader& = delete;
+
+    // All the segments in the directory (see list_segments), or in all the volumes when the recording was striped
+    [[nodiscard]] auto open(const std::filesystem::path& directory) -> bool;
+    // These segments, in this order
+    [[nodiscard]] auto open(const std::vector<std::filesystem::path>& segments) -> bool;
+    auto close() -> void;
+
+    // The number of frames in all the segments
+    auto size() const -> std::size_t {
+        return frames.size();
+    }
+
+    auto segments() const -> std::size_t {
+        return mappings.size();
+    }
+
+    // The frame at this position, the data is valid until the reader is closed. The position must be less than size.
+    // For a compressed frame this is the compressed data (the size of the view is the compressed size), see read.
+    [[nodiscard]] auto at(std::size_t i) const -> camera::ImageView;
+    // The same, but return nullopt if the position is out of range, or the frame header is corrupted
+    [[nodiscard]] auto frame(std::size_t i) const -> std::optional<camera::ImageView>;
+    // How the frame at this position was written, the position must be less than size
+    [[nodiscard]] auto compression(std::size_t i) const -> Compression;
+    // Copy the frame into the image, decoding it if it was compressed
+    [[nodiscard]] auto read(std::size_t i, camera::Image& image) const -> bool;
+
+    // The position of the frame with this number
+    [[nodiscard]] auto find(uint64_t number) const -> std::optional<std::size_t>;
+    // The position of the first frame that was taken at or after this device timestamp
+    [[nodiscard]] auto find_time(uint64_t timestamp) const -> std::optional<std::size_t>;
+
+    // Tell the kernel that we are about to read these frames, so it would read them ahead
+    auto will_read(std::size_t from, std::size_t count) const -> void;
+
+private:
+    struct Mapping {
+        uint8_t* base{nullptr};
+        std::size_t length{0};
+    };
+
+    struct Frame {
+        const uint8_t* header{nullptr};     // in the mapping, the frame data is right after it
+        uint64_t number{0};
+        uint64_t timestamp{0};
+        uint32_t size{0};
+    };
+
+    auto map(const std::filesystem::path& path) -> bool;
+    // the frames of each volume end at these positions
+    auto merge(const std::vector<std::size_t>& ends) -> void;
+    auto build_lookup() -> void;
+
+    std::vector<Mapping> mappings;
+    std::vector<Frame> frames;
+    // finding by number, when the numbers are growing without large gaps this is a table from the first number,
+    // otherwise (the camera was restarted in the middle of the recording for example) it is a hash map
+    uint64_t first_number{0};
+    std::vector<uint32_t> by_number;
+    std::unordered_map<uint64_t, std::size_t> numbers;
+};
+
+}   // end of namespace recording
@@ -0,0 +1,193 @@
+#include "replay.hh"
+#include "bayer_codec.hh"
+#include "log/logging.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// the frames that we are asking the kernel to read ahead of the one that we are playing
+constexpr std::size_t READ_AHEAD = 8;
+
+auto micros(clock_type::duration d) -> std::chrono::microseconds {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d);
+}
+
+}       // end of local namespace
+
+struct ReplayContext {
+    ReplayContext(std::shared_ptr<const RecordingReader> r, camera::frame_processing_f&& f, std::stop_token cancellation, const ReplaySettings& s, std::size_t c) :
+            reader{std::move(r)}, process{std::move(f)}, settings{s}, count{c} {
+        worker = std::jthread([this](std::stop_token st) {
+            play(std::move(st));
+        });
+        // stopping from the outside is stopping our thread
+        outside.emplace(std::move(cancellation), [this]() {
+            worker.request_stop();
+        });
+    }
+
+    ~ReplayContext() {
+        outside.reset();
+        worker.request_stop();
+    }
+
+    auto wait() -> void {
+        std::unique_lock lock{guard};
+        finished.wait(lock, [this] { return done; });
+    }
+
+    auto statistics() const -> ReplayStatistics {
+        std::lock_guard lock{guard};
+        auto output{stats};
+        output.done = done;
+        output.elapsed = micros((done ? ended : clock_type::now()) - started);
+        return output;
+    }
+
+private:
+    auto play(std::stop_token st) -> void;
+    // return false if we were stopped while waiting
+    auto wait_until(clock_type::time_point when, const std::stop_token& st) -> bool;
+    auto finish() -> void;
+    // the frame at this position, decoded if it was compressed
+    auto load(std::size_t i) -> std::optional<camera::ImageView>;
+
+    std::shared_ptr<const RecordingReader> reader;
+    camera::frame_processing_f process;
+    const ReplaySettings settings;
+    const std::size_t count;
+    mutable std::mutex guard;
+    std::condition_variable_any finished;
+    bool done{false};
+    clock_type::time_point started{clock_type::now()};
+    clock_type::time_point ended;
+    ReplayStatistics stats;
+    std::vector<uint8_t> decoded;       // reused for the compressed frames
+    std::jthread worker;
+    std::optional<std::stop_callback<std::function<void()>>> outside;
+};
+
+auto ReplayContext::wait_until(clock_type::time_point when, const std::stop_token& st) -> bool {
+    std::unique_lock lock{guard};
+    // this is only returning early when we are stopped
+    finished.wait_until(lock, st, when, [] { return false; });
+    return !st.stop_requested();
+}
+
+auto ReplayContext::load(std::size_t i) -> std::optional<camera::ImageView> {
+    auto image{reader->frame(i)};
+    if (!image || reader->compression(i) == Compression::None) {
+        return image;
+    }
+    decoded.resize(std::size_t{image->width} * image->height);
+    if (reader->compression(i) != Compression::Bayer || !bayer_decode(image->data, image->size, decoded.data(), decoded.size())) {
+        LOG(ERROR) << "failed to decode frame number " << image->number << ENDL;
+        return std::nullopt;
+    }
+    image->data = decoded.data();
+    image->size = static_cast<uint32_t>(decoded.size());
+    return image;
+}
+
+auto ReplayContext::play(std::stop_token st) -> void {
+    const auto last{settings.from + count};
+    do {
+        const auto first_timestamp{reader->at(settings.from).timestamp};
+        const auto start{clock_type::now()};
+        for (auto i = settings.from; i < last && !st.stop_requested(); i++) {
+            if ((i - settings.from) % READ_AHEAD == 0) {
+                reader->will_read(i, READ_AHEAD * 2);
+            }
+            const auto image{load(i)};
+            if (!image) {
+                continue;
+            }
+            if (settings.timing == ReplayTiming::Original) {
+                const auto ticks{image->timestamp > first_timestamp ? image->timestamp - first_timestamp : 0};
+                const std::chrono::nanoseconds since_first{static_cast<int64_t>(ticks / settings.speed)};
+                const auto due{start + std::chrono::duration_cast<clock_type::duration>(since_first)};
+                if (const auto now = clock_type::now(); now < due) {
+                    if (!wait_until(due, st)) {
+                        break;
+                    }
+                } else if (now - due > std::chrono::milliseconds{1}) {
+                    std::lock_guard lock{guard};
+                    ++stats.late;
+                    stats.max_lag = std::max(stats.max_lag, micros(now - due));
+                }
+            }
+            const auto more{process(image.value())};
+            {
+                std::lock_guard lock{guard};
+                ++stats.frames;
+                stats.bytes += image->size;
+            }
+            if (!more) {
+                finish();
+                return;
+            }
+        }
+    } while (settings.loop && !st.stop_requested());
+    finish();
+}
+
+auto ReplayContext::finish() -> void {
+    std::lock_guard lock{guard};
+    done = true;
+    ended = clock_type::now();
+    finished.notify_all();
+}
+
+auto make_replay(std::shared_ptr<const RecordingReader> reader, camera::frame_processing_f&& process_f,
+        std::stop_token cancellation, const ReplaySettings& settings) -> replay_context_t {
+    if (!reader || settings.from >= reader->size()) {
+        LOG(ERROR) << "there are no frames to replay from position " << settings.from << ENDL;
+        return {};
+    }
+    if (settings.speed <= 0) {
+        LOG(ERROR) << "invalid replay speed " << settings.speed << ENDL;
+        return {};
+    }
+    const auto available{reader->size() - settings.from};
+    const auto count{settings.count ? std::min(settings.count, available) : available};
+    LOG(INFO) << "replaying " << count << " frames from position " << settings.from << ", " << settings.timing << " timing" << ENDL;
+    return std::make_shared<ReplayContext>(std::move(reader), std::move(process_f), std::move(cancellation), settings, count);
+}
+
+auto wait(ReplayContext& context) -> void {
+    context.wait();
+}
+
+auto statistics(const ReplayContext& context) -> ReplayStatistics {
+    return context.statistics();
+}
+
+auto ReplayStatistics::throughput() const -> double {
+    return elapsed.count() ? bytes / (elapsed.count() / 1e6) / (1024.0 * 1024.0) : 0;
+}
+
+auto operator << (std::ostream& os, ReplayTiming timing) -> std::ostream& {
+    switch (timing) {
+    case ReplayTiming::Original:
+        return os << "original";
+    case ReplayTiming::MaxSpeed:
+        return os << "max speed";
+    default:
+        return os << "unknown";
+    }
+}
+
+auto operator << (std::ostream& os, const ReplayStatistics& rs) -> std::ostream& {
+    return os << "replayed " << rs.frames << " frames, " << rs.bytes << " bytes in " << rs.elapsed.count() << "us, "
+        << rs.throughput() << " MB/s, late: " << rs.late << ", max lag: " << rs.max_lag.count() << "us" << (rs.done ? ", done" : "");
+}
+
+}   // end of namespace recording
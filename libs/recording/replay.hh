@@ -0,0 +1,63 @@
+#pragma once
+#include "recording_reader.hh"
+#include "camera_controller/cameras_fwd.hh"
+#include <memory>
+#include <chrono>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Play a recording as if it was coming from a camera: the frames are passed one by one to the same function-like that
+// is used with camera::make_async_context, from a thread of the replay, either at the timing that they were taken
+// (according to their timestamps) or as fast as the function-like can take them. This way the processing of the frames
+// can be tested and benchmarked with the same frames every time, without a camera.
+// For example:
+// auto reader{std::make_shared<recording::RecordingReader>()};
+// if (!reader->open("/data/run1/DEV_1AB22C00A1B2")) {...}
+// auto replay{recording::make_replay(reader, [](camera::ImageView image) { process(image); return true; },
+//          stop_source.get_token(), recording::ReplaySettings{.timing = recording::ReplayTiming::MaxSpeed})};
+// recording::wait(*replay);
+// std::cout << recording::statistics(*replay) << "\n";
+
+namespace recording {
+
+enum class ReplayTiming : uint32_t {
+    Original,           // the same time between the frames as when they were recorded
+    MaxSpeed            // the next frame is passed as soon as the function-like returns
+};
+auto operator << (std::ostream& os, ReplayTiming timing) -> std::ostream&;
+
+struct ReplaySettings {
+    ReplayTiming timing{ReplayTiming::Original};
+    double speed{1.0};              // for the original timing, 2 is playing twice as fast
+    std::size_t from{0};            // the position of the first frame to play
+    std::size_t count{0};           // the number of frames to play, 0 for all the frames from the first
+    bool loop{false};               // start again from the first frame after the last one, until stopped
+};
+
+struct ReplayStatistics {
+    uint64_t frames{0};
+    uint64_t bytes{0};
+    uint64_t late{0};                           // frames that were passed after their time, since the function-like was too slow
+    std::chrono::microseconds max_lag{0};       // the most that a frame was late
+    std::chrono::microseconds elapsed{0};
+    bool done{false};                           // we passed all the frames, or we were stopped
+
+    auto throughput() const -> double;          // MB/s
+};
+auto operator << (std::ostream& os, const ReplayStatistics& rs) -> std::ostream&;
+
+struct ReplayContext;
+using replay_context_t = std::shared_ptr<ReplayContext>;
+
+// Start passing the frames to the function-like, that returns true to continue, and false to stop the replay.
+// The replay is stopped when the context is destroyed. Return nullptr if there is nothing to play.
+[[nodiscard]] auto make_replay(std::shared_ptr<const RecordingReader> reader, camera::frame_processing_f&& process_f,
+        std::stop_token cancellation, const ReplaySettings& settings) -> replay_context_t;
+
+// Wait until all the frames were played, or the replay was stopped
+auto wait(ReplayContext& context) -> void;
+
+[[nodiscard]] auto statistics(const ReplayContext& context) -> ReplayStatistics;
+
+}   // end of namespace recording
@@ -0,0 +1,164 @@
+#include "segment_reader.hh"
+#include "bayer_codec.hh"
+#include "log/logging.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace recording {
+
+SegmentReader::~SegmentReader() {
+    close();
+}
+
+auto SegmentReader::open(const std::filesystem::path& path) -> bool {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG(ERROR) << "failed to open the segment " << path << ": " << std::strerror(errno) << ENDL;
+        return false;
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || !read_at(0, &segment, sizeof(segment)) ||
+            segment.magic != SEGMENT_MAGIC || segment.header_size < sizeof(SegmentHeader)) {
+        LOG(ERROR) << path << " is not a recording segment" << ENDL;
+        close();
+        return false;
+    }
+    if (segment.version == 0 || segment.version > SEGMENT_VERSION) {
+        LOG(ERROR) << "unsupported version " << segment.version << " of the segment " << path << ENDL;
+        close();
+        return false;
+    }
+    const auto file_size{static_cast<uint64_t>(info.st_size)};
+    if (!read_index(file_size)) {
+        LOG(WARNING) << "the segment " << path << " was not closed, rebuilding its index" << ENDL;
+        scan(file_size);
+    }
+    return true;
+}
+
+auto SegmentReader::close() -> void {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    entries.clear();
+    rebuilt = false;
+}
+
+auto SegmentReader::read_at(uint64_t offset, void* to, std::size_t size) const -> bool {
+    auto at{static_cast<uint8_t*>(to)};
+    while (size > 0) {
+        const auto n{::pread(fd, at, size, static_cast<off_t>(offset))};
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+auto SegmentReader::read_index(uint64_t file_size) -> bool {
+    IndexTrailer trailer;
+    if (file_size < segment.header_size + sizeof(trailer) || !read_at(file_size - sizeof(trailer), &trailer, sizeof(trailer))) {
+        return false;
+    }
+    if (trailer.magic != INDEX_MAGIC || trailer.entry_size != sizeof(IndexEntry) ||
+            trailer.offset + trailer.count * sizeof(IndexEntry) + sizeof(trailer) != file_size) {
+        return false;
+    }
+    entries.resize(trailer.count);
+    return read_at(trailer.offset, entries.data(), entries.size() * sizeof(IndexEntry));
+}
+
+auto SegmentReader::scan(uint64_t file_size) -> void {
+    entries.clear();
+    rebuilt = true;
+    FrameHeader frame;
+    for (uint64_t offset = segment.header_size; offset + sizeof(frame) <= file_size; offset += frame.header_size + frame.size) {
+        if (!read_at(offset, &frame, sizeof(frame)) || frame.magic != FRAME_MAGIC ||
+                frame.header_size < sizeof(frame) || offset + frame.header_size + frame.size > file_size) {
+            break;      // this is where the writing stopped
+        }
+        entries.push_back(IndexEntry{.number = frame.number, .timestamp = frame.timestamp, .offset = offset, .size = frame.size});
+    }
+}
+
+auto SegmentReader::find(uint64_t number) const -> std::optional<std::size_t> {
+    // the frame numbers are only growing, but there may be gaps in them
+    auto i{std::lower_bound(entries.begin(), entries.end(), number, [](const IndexEntry& e, uint64_t n) {
+        return e.number < n;
+    })};
+    if (i == entries.end() || i->number != number) {
+        return std::nullopt;
+    }
+    return std::distance(entries.begin(), i);
+}
+
+auto SegmentReader::find_time(uint64_t timestamp) const -> std::optional<std::size_t> {
+    auto i{std::lower_bound(entries.begin(), entries.end(), timestamp, [](const IndexEntry& e, uint64_t t) {
+        return e.timestamp < t;
+    })};
+    if (i == entries.end()) {
+        return std::nullopt;
+    }
+    return std::distance(entries.begin(), i);
+}
+
+auto SegmentReader::read(std::size_t at, camera::Image& image) const -> bool {
+    if (at >= entries.size()) {
+        return false;
+    }
+    const auto& entry{entries[at]};
+    FrameHeader frame;
+    if (!read_at(entry.offset, &frame, sizeof(frame)) || frame.magic != FRAME_MAGIC || frame.size != entry.size) {
+        LOG(ERROR) << "invalid frame header at offset " << entry.offset << " for frame number " << entry.number << ENDL;
+        return false;
+    }
+    image.width = frame.width;
+    image.height = frame.height;
+    image.number = frame.number;
+    image.type = frame.pixel_format();
+    image.timestamp = frame.timestamp;
+    switch (frame.compression()) {
+    case Compression::None:
+        image.data.resize(frame.size);
+        return read_at(entry.offset + frame.header_size, image.data.data(), image.data.size());
+    case Compression::Bayer:
+        break;
+    default:
+        LOG(ERROR) << "unknown compression " << frame.compression() << " for frame number " << entry.number << ENDL;
+        return false;
+    }
+    std::vector<uint8_t> compressed(frame.size);
+    if (!read_at(entry.offset + frame.header_size, compressed.data(), compressed.size())) {
+        return false;
+    }
+    image.data.resize(std::size_t{frame.width} * frame.height);
+    return bayer_decode(compressed.data(), compressed.size(), image.data.data(), image.data.size());
+}
+
+auto list_segments(const std::filesystem::path& directory) -> std::vector<std::filesystem::path> {
+    std::vector<std::filesystem::path> segments;
+    std::error_code ec;
+    for (auto&& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".seg") {
+            segments.push_back(entry.path());
+        }
+    }
+    // the sequence number is padded with zeros, so the names are sorted by the sequence
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+}   // end of namespace recording
@@ -0,0 +1,71 @@
+#pragma once
+#include "frame_file.hh"
+#include "camera_controller/image.hh"
+#include <filesystem>
+#include <vector>
+#include <optional>
+#include <stdint.h>
+
+// Read back a segment that was written by the SegmentWriter.
+// For a segment that was closed, the index is read from the end of the file, so finding a frame by its number or
+// by its timestamp is not touching the frames at all. For a segment that was not closed, the index is rebuilt by
+// following the frame headers from the start of the file.
+// For example:
+// for (auto&& path : recording::list_segments("/data/run1/DEV_1AB22C00A1B2")) {
+//      recording::SegmentReader reader;
+//      if (reader.open(path)) {
+//          if (auto i = reader.find(1000); i) { camera::Image image; reader.read(i.value(), image); }
+//      }
+// }
+
+namespace recording {
+
+struct SegmentReader {
+    SegmentReader() = default;
+    ~SegmentReader();
+
+    SegmentReader(const SegmentReader&) = delete;
+    auto operator = (const SegmentReader&) -> SegmentReader& = delete;
+
+    [[nodiscard]] auto open(const std::filesystem::path& path) -> bool;
+    auto close() -> void;
+
+    auto header() const -> const SegmentHeader& {
+        return segment;
+    }
+
+    auto index() const -> const std::vector<IndexEntry>& {
+        return entries;
+    }
+
+    auto size() const -> std::size_t {
+        return entries.size();
+    }
+
+    // True if the segment was not closed, and the index was rebuilt by reading all the frame headers
+    auto recovered() const -> bool {
+        return rebuilt;
+    }
+
+    // The position in the index of the frame with this number
+    [[nodiscard]] auto find(uint64_t number) const -> std::optional<std::size_t>;
+    // The position in the index of the first frame that was taken at or after this device timestamp
+    [[nodiscard]] auto find_time(uint64_t timestamp) const -> std::optional<std::size_t>;
+    // Read the frame at this position in the index
+    [[nodiscard]] auto read(std::size_t at, camera::Image& image) const -> bool;
+
+private:
+    auto read_at(uint64_t offset, void* to, std::size_t size) const -> bool;
+    auto read_index(uint64_t file_size) -> bool;
+    auto scan(uint64_t file_size) -> void;
+
+    int fd{-1};
+    SegmentHeader segment;
+    std::vector<IndexEntry> entries;
+    bool rebuilt{false};
+};
+
+// All the segments in the directory, sorted by their sequence number
+[[nodiscard]] auto list_segments(const std::filesystem::path& directory) -> std::vector<std::filesystem::path>;
+
+}   // end of namespace recording
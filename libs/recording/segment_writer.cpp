@@ -0,0 +1,179 @@
+#include "segment_writer.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+
+namespace recording {
+namespace {
+
+auto now_ns() -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// the frames are arriving at a fixed rate, so the index is growing up to about the same size in each segment
+constexpr std::size_t INITIAL_INDEX_SIZE = 4096;
+
+}       // end of local namespace
+
+auto segment_name(const std::string& name, uint64_t sequence) -> std::string {
+    char number[32];
+    std::snprintf(number, sizeof(number), "-%06llu.seg", static_cast<unsigned long long>(sequence));
+    return name + number;
+}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+auto SegmentWriter::open(const std::filesystem::path& to, const std::string& n, const SegmentSettings& s) -> bool {
+    close();
+    std::error_code ec;
+    std::filesystem::create_directories(to, ec);
+    if (ec) {
+        LOG(ERROR) << "failed to create the recording directory " << to << ": " << ec.message() << ENDL;
+        return false;
+    }
+    settings = s;
+    if (settings.io == DiskIo::Direct && !direct) {
+        direct = DirectWriter::make(settings.direct);
+        if (!direct) {
+            LOG(WARNING) << "failed to create the direct IO writer for " << to << ", using buffered IO" << ENDL;
+        }
+    } else if (settings.io == DiskIo::Buffered) {
+        direct.reset();
+    }
+    if ((settings.compression == Compression::Bayer || settings.prepare_codec) && !codec) {
+        codec = BayerCodec::make(settings.codec);
+        if (!codec) {
+            return false;
+        }
+    } else if (settings.compression == Compression::None && !settings.prepare_codec) {
+        codec.reset();
+    }
+    if (settings.metadata && !meta.open(to / metadata_name(n), n)) {
+        LOG(WARNING) << "recording to " << to << " without the metadata of the frames" << ENDL;
+    }
+    directory = to;
+    name = n;
+    sequence = 0;
+    total = 0;
+    index.reserve(INITIAL_INDEX_SIZE);
+    return start_segment();
+}
+
+auto SegmentWriter::start_segment() -> bool {
+    current = directory / segment_name(name, sequence);
+    if (!file.open(current, direct.get())) {
+        return false;
+    }
+    if (settings.preallocate) {
+        file.preallocate(settings.max_size);
+    }
+    SegmentHeader header{.sequence = sequence, .created = now_ns()};
+    std::strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+    if (!file.write(&header, sizeof(header))) {
+        LOG(ERROR) << "failed to write the header of the segment " << current << ENDL;
+        file.close();
+        return false;
+    }
+    index.clear();
+    started = std::chrono::steady_clock::now();
+    ++sequence;
+    return true;
+}
+
+auto SegmentWriter::finish_segment() -> bool {
+    IndexTrailer trailer{.count = index.size(), .offset = file.size(), .closed = now_ns()};
+    iovec parts[] = {
+        {.iov_base = index.data(), .iov_len = index.size() * sizeof(IndexEntry)},
+        {.iov_base = &trailer, .iov_len = sizeof(trailer)}
+    };
+    const auto ok{file.write(parts, 2)};
+    if (!ok) {
+        LOG(ERROR) << "failed to write the index of the segment " << current << ", it can only be read by scanning it" << ENDL;
+    }
+    total += file.size();
+    file.close();
+    index.clear();
+    return ok;
+}
+
+auto SegmentWriter::rotate_before(const camera::ImageView& image) const -> bool {
+    if (index.empty()) {
+        return false;       // always write at least one frame into a segment
+    }
+    const auto after{file.size() + sizeof(FrameHeader) + image.size + (index.size() + 1) * sizeof(IndexEntry) + sizeof(IndexTrailer)};
+    return after > settings.max_size ||
+        (settings.max_duration.count() > 0 && std::chrono::steady_clock::now() - started >= settings.max_duration);
+}
+
+auto SegmentWriter::write(const camera::ImageView& image) -> bool {
+    if (!file.is_open()) {
+        return false;
+    }
+    if (rotate_before(image) && !(finish_segment() && start_segment())) {
+        return false;
+    }
+    const auto offset{file.size()};
+    if (settings.compression == Compression::Bayer && codec->encode(image, compressed)) {
+        FrameHeader header{image};
+        header.format |= static_cast<uint32_t>(Compression::Bayer) << COMPRESSION_SHIFT;
+        header.size = static_cast<uint32_t>(compressed.size());
+        iovec parts[] = {
+            {.iov_base = &header, .iov_len = sizeof(header)},
+            {.iov_base = compressed.data(), .iov_len = compressed.size()}
+        };
+        if (!file.write(parts, 2)) {
+            return false;
+        }
+        added(image, offset, header.size);
+        return true;
+    }
+    if (!file.write(image)) {
+        return false;
+    }
+    added(image, offset, image.size);
+    return true;
+}
+
+auto SegmentWriter::added(const camera::ImageView& image, uint64_t offset, uint32_t size) -> void {
+    index.push_back(IndexEntry{.number = image.number, .timestamp = image.timestamp, .offset = offset, .size = size});
+    if (meta.is_open() && !meta.append(FrameMetadata{image, static_cast<uint32_t>(sequence - 1), offset, size})) {
+        LOG(WARNING) << "stopped writing the metadata of the frames to " << directory << " at frame number " << image.number << ENDL;
+        meta.close();
+    }
+}
+
+auto SegmentWriter::io_statistics() const -> std::optional<IoStatistics> {
+    if (!direct) {
+        return std::nullopt;
+    }
+    return direct->statistics();
+}
+
+auto SegmentWriter::set_compression(Compression compression) -> bool {
+    if (compression != Compression::None && !codec) {
+        return false;
+    }
+    settings.compression = compression;
+    return true;
+}
+
+auto SegmentWriter::codec_statistics() const -> std::optional<CodecStatistics> {
+    if (!codec) {
+        return std::nullopt;
+    }
+    return codec->statistics();
+}
+
+auto SegmentWriter::close() -> bool {
+    meta.close();
+    if (!file.is_open()) {
+        return true;
+    }
+    return finish_segment();
+}
+
+}   // end of namespace recording
@@ -0,0 +1,106 @@
+#pragma once
+#include "frame_file.hh"
+#include "bayer_codec.hh"
+#include "metadata.hh"
+#include "camera_controller/image.hh"
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdint.h>
+
+// Append the frames of a single camera into segment files (see frame_file.hh for the layout).
+// Instead of a file per frame (that is a file system metadata operation, and an inode for each frame),
+// the frames are appended into a few large files, that are allocated on the disk in advance.
+// A new segment is started when the current one is full, or when it is open for too long.
+// The segments are named <directory>/<name>-<sequence>.seg, so sorting them by name is sorting them by time.
+// What we know about each frame is also kept in <directory>/<name>.meta (see metadata.hh).
+// For example:
+// recording::SegmentWriter writer;
+// if (!writer.open("/data/run1/DEV_1AB22C00A1B2", "DEV_1AB22C00A1B2", recording::SegmentSettings{})) {
+//      exit(1);
+// }
+// ... writer.write(image) for each frame
+// writer.close();
+
+namespace recording {
+
+constexpr uint64_t DEFAULT_SEGMENT_SIZE = uint64_t{4} * 1024 * 1024 * 1024;
+constexpr auto DEFAULT_SEGMENT_DURATION = std::chrono::seconds{60};
+
+struct SegmentSettings {
+    uint64_t max_size{DEFAULT_SEGMENT_SIZE};            // including the index, a single frame that is larger is still written
+    std::chrono::seconds max_duration{DEFAULT_SEGMENT_DURATION};   // 0 for no time limit
+    bool preallocate{true};                             // allocate max_size on the disk when the segment is created
+    DiskIo io{DiskIo::Buffered};
+    DirectSettings direct{};                            // only for direct IO
+    Compression compression{Compression::None};         // frames that the codec is not supporting are written as is
+    CodecSettings codec{};                              // only with compression
+    bool prepare_codec{false};                          // create the codec even without compression, to switch it on later
+    bool metadata{true};                                // write the metadata of the frames next to the segments
+};
+
+struct SegmentWriter {
+    SegmentWriter() = default;
+    ~SegmentWriter();
+
+    SegmentWriter(const SegmentWriter&) = delete;
+    auto operator = (const SegmentWriter&) -> SegmentWriter& = delete;
+
+    // Create the directory if needed, and start the first segment
+    [[nodiscard]] auto open(const std::filesystem::path& directory, const std::string& name, const SegmentSettings& settings) -> bool;
+    [[nodiscard]] auto write(const camera::ImageView& image) -> bool;
+    // Write the index of the current segment and close it
+    auto close() -> bool;
+    // From the next frame, return false if there is no codec (see SegmentSettings::prepare_codec)
+    auto set_compression(Compression compression) -> bool;
+
+    auto is_open() const -> bool {
+        return file.is_open();
+    }
+
+    auto segments() const -> uint64_t {
+        return sequence;
+    }
+
+    // All the bytes that were written, in all the segments
+    auto size() const -> uint64_t {
+        return total + file.size();
+    }
+
+    auto path() const -> const std::filesystem::path& {
+        return current;
+    }
+
+    // Only when we are writing with direct IO
+    auto io_statistics() const -> std::optional<IoStatistics>;
+    // Only when we are compressing
+    auto codec_statistics() const -> std::optional<CodecStatistics>;
+
+private:
+    auto added(const camera::ImageView& image, uint64_t offset, uint32_t size) -> void;
+    auto start_segment() -> bool;
+    auto finish_segment() -> bool;
+    auto rotate_before(const camera::ImageView& image) const -> bool;
+
+    SegmentSettings settings;
+    std::filesystem::path directory;
+    std::string name;
+    std::filesystem::path current;
+    std::unique_ptr<DirectWriter> direct;      // shared by all the segments
+    std::unique_ptr<BayerCodec> codec;
+    std::vector<uint8_t> compressed;            // reused for all the frames
+    FrameFile file;
+    MetadataWriter meta;
+    std::vector<IndexEntry> index;
+    std::chrono::steady_clock::time_point started;
+    uint64_t sequence{0};       // the number of segments that were started
+    uint64_t total{0};          // bytes in the segments that were already closed
+};
+
+// Name of the segment file, for the given camera and sequence number
+[[nodiscard]] auto segment_name(const std::string& name, uint64_t sequence) -> std::string;
+
+}   // end of namespace recording
@@ -0,0 +1,247 @@
+#include "striped_writer.hh"
+#include "log/logging.h"
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <iostream>
+
+namespace recording {
+
+StripedWriter::~StripedWriter() {
+    close();
+}
+
+auto StripedWriter::open(const std::vector<std::filesystem::path>& to, const std::filesystem::path& directory,
+        const std::string& name, const SegmentSettings& settings, Striping how) -> bool {
+    close();
+    volumes.clear();
+    if (to.empty()) {
+        LOG(ERROR) << "no volumes to record " << name << " to" << ENDL;
+        return false;
+    }
+    auto volume_settings{settings};
+    if (volume_settings.codec.threads == 0) {
+        // all the volumes are compressing at the same time, so they share the cores
+        volume_settings.codec.threads = std::max<std::size_t>(std::thread::hardware_concurrency() / to.size(), 1);
+    }
+    std::vector<std::filesystem::path> directories;
+    for (auto&& v : to) {
+        auto volume{std::make_unique<Volume>()};
+        volume->directory = to.size() > 1 ? v / name : directory;
+        if (!volume->writer.open(volume->directory, name, to.size() > 1 ? volume_settings : settings)) {
+            LOG(ERROR) << "failed to open the volume " << v << " for " << name << ENDL;
+            close();
+            volumes.clear();
+            return false;
+        }
+        volume->compression = settings.compression;
+        volume->segments = volume->writer.segments();
+        directories.push_back(volume->directory);
+        volumes.push_back(std::move(volume));
+    }
+    if (to.size() > 1 && !write_stripes(directory, directories)) {
+        close();
+        volumes.clear();
+        return false;
+    }
+    striping = how;
+    next = 0;
+    compression = settings.compression;
+    if (to.size() > 1) {
+        LOG(INFO) << "recording " << name << " to " << to.size() << " volumes, " << striping << ENDL;
+    }
+    return true;
+}
+
+auto StripedWriter::acquire() -> Volume& {
+    std::unique_lock lock{guard};
+    Volume* chosen{nullptr};
+    available.wait(lock, [this, &chosen] {
+        for (std::size_t i = 0; i < volumes.size(); i++) {
+            auto& v{*volumes[(next + i) % volumes.size()]};
+            if (v.busy) {
+                continue;
+            }
+            if (striping == Striping::RoundRobin) {
+                chosen = &v;
+                next = (next + i + 1) % volumes.size();
+                return true;
+            }
+            if (!chosen || v.busy_time < chosen->busy_time) {
+                chosen = &v;
+            }
+        }
+        return chosen != nullptr;
+    });
+    chosen->busy = true;
+    return *chosen;
+}
+
+auto StripedWriter::release(Volume& volume) -> void {
+    {
+        std::lock_guard lock{guard};
+        volume.busy = false;
+    }
+    available.notify_one();
+}
+
+auto StripedWriter::write(const camera::ImageView& image) -> bool {
+    if (volumes.empty()) {
+        return false;
+    }
+    auto& volume{acquire()};
+    if (const auto wanted = compression.load(std::memory_order_relaxed); wanted != volume.compression) {
+        (void)volume.writer.set_compression(wanted);
+        volume.compression = wanted;
+    }
+    const auto before{volume.writer.size()};
+    const auto start{std::chrono::steady_clock::now()};
+    const auto ok{volume.writer.write(image)};
+    volume.busy_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (ok) {
+        ++volume.frames;
+        volume.bytes += volume.writer.size() - before;
+        volume.segments = volume.writer.segments();
+    } else {
+        LOG(ERROR) << "failed to write frame number " << image.number << " to " << volume.directory << ENDL;
+    }
+    release(volume);
+    return ok;
+}
+
+auto StripedWriter::close() -> bool {
+    auto ok{true};
+    for (auto&& v : volumes) {
+        ok = v->writer.close() && ok;
+    }
+    return ok;
+}
+
+auto StripedWriter::set_compression(Compression to) -> void {
+    compression = to;
+}
+
+auto StripedWriter::segments() const -> uint64_t {
+    uint64_t count{0};
+    for (auto&& v : volumes) {
+        count += v->segments;
+    }
+    return count;
+}
+
+auto StripedWriter::statistics() const -> std::vector<VolumeStatistics> {
+    std::vector<VolumeStatistics> output;
+    for (auto&& v : volumes) {
+        VolumeStatistics stats{
+            .directory = v->directory, .frames = v->frames.load(), .bytes = v->bytes.load(), .segments = v->segments.load(),
+            .busy = std::chrono::microseconds{v->busy_time.load()}
+        };
+        std::error_code ec;
+        if (const auto space = std::filesystem::space(v->directory, ec); !ec) {
+            stats.capacity = space.capacity;
+            stats.available = space.available;
+        }
+        output.push_back(std::move(stats));
+    }
+    return output;
+}
+
+auto StripedWriter::io_statistics() const -> std::optional<IoStatistics> {
+    std::optional<IoStatistics> total;
+    for (auto&& v : volumes) {
+        const auto io{v->writer.io_statistics()};
+        if (!io) {
+            continue;
+        }
+        if (!total) {
+            total = io;
+            continue;
+        }
+        total->writes += io->writes;
+        total->bytes += io->bytes;
+        total->failures += io->failures;
+        total->waits += io->waits;
+        total->max_latency = std::max(total->max_latency, io->max_latency);
+        total->total_latency += io->total_latency;
+        total->busy = std::max(total->busy, io->busy);      // the volumes are busy at the same time
+    }
+    return total;
+}
+
+auto StripedWriter::codec_statistics() const -> std::optional<CodecStatistics> {
+    std::optional<CodecStatistics> total;
+    for (auto&& v : volumes) {
+        const auto codec{v->writer.codec_statistics()};
+        if (!codec) {
+            continue;
+        }
+        if (!total) {
+            total = codec;
+            continue;
+        }
+        total->frames += codec->frames;
+        total->raw_bytes += codec->raw_bytes;
+        total->compressed_bytes += codec->compressed_bytes;
+        total->stored_tiles += codec->stored_tiles;
+        total->cpu += codec->cpu;
+        total->wall = std::max(total->wall, codec->wall);
+        total->threads += codec->threads;
+    }
+    return total;
+}
+
+auto write_stripes(const std::filesystem::path& directory, const std::vector<std::filesystem::path>& volumes) -> bool {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    const auto path{directory / STRIPES_NAME};
+    std::ofstream output{path, std::ios::trunc};
+    for (auto&& v : volumes) {
+        output << std::filesystem::absolute(v, ec).string() << "\n";
+    }
+    output.flush();
+    if (!output) {
+        LOG(ERROR) << "failed to write the list of the volumes to " << path << ENDL;
+        return false;
+    }
+    return true;
+}
+
+auto read_stripes(const std::filesystem::path& directory) -> std::vector<std::filesystem::path> {
+    std::ifstream input{directory / STRIPES_NAME};
+    if (!input) {
+        return {directory};
+    }
+    std::vector<std::filesystem::path> volumes;
+    for (std::string line; std::getline(input, line);) {
+        if (!line.empty()) {
+            volumes.push_back(directory / line);        // only relative paths are relative to the directory
+        }
+    }
+    return volumes;
+}
+
+auto VolumeStatistics::throughput() const -> double {
+    return busy.count() > 0 ? static_cast<double>(bytes) / static_cast<double>(busy.count()) * 1e6 / (1024.0 * 1024.0) : 0.0;
+}
+
+auto VolumeStatistics::fill() const -> double {
+    return capacity > 0 ? 1.0 - static_cast<double>(available) / static_cast<double>(capacity) : 0.0;
+}
+
+auto operator << (std::ostream& os, const VolumeStatistics& vs) -> std::ostream& {
+    return os << vs.directory << ": frames " << vs.frames << ", " << vs.bytes / (1024 * 1024) << "MB in " << vs.segments << " segments, "
+        << vs.throughput() << " MB/s, " << static_cast<int>(vs.fill() * 100) << "% full (" << vs.available / (1024 * 1024 * 1024) << "GB free)";
+}
+
+auto operator << (std::ostream& os, Striping striping) -> std::ostream& {
+    switch (striping) {
+    case Striping::RoundRobin:
+        return os << "round robin";
+    case Striping::Load:
+        return os << "by load";
+    default:
+        return os << "unknown";
+    }
+}
+
+}   // end of namespace recording
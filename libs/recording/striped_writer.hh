@@ -0,0 +1,117 @@
+#pragma once
+#include "segment_writer.hh"
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <iosfwd>
+#include <stdint.h>
+
+// Spread the frames of a single camera over a few volumes (each one a directory on its own disk), when a single
+// disk cannot keep up with the cameras. Every volume has its own segment writer, in <volume>/<name>/, and the
+// frames are written to the volumes at the same time: write is called from a few threads (one for each volume,
+// see DispatchSettings::workers), and each call is taking a volume that is not busy, writing the frame to it,
+// and giving it back. So each volume has its own segments, and its own metadata of the frames (see metadata.hh).
+// The list of the volumes is written into the directory of the recording (see write_stripes), and the recording
+// reader is using it to put the frames from all the volumes back in order (see recording_reader.hh).
+// For example:
+// recording::StripedWriter writer;
+// if (!writer.open({"/data0/run1", "/data1/run1"}, "/data0/run1/DEV_1AB22C00A1B2", "DEV_1AB22C00A1B2", recording::SegmentSettings{}, recording::Striping::Load)) {
+//      exit(1);
+// }
+// ... writer.write(image) for each frame, from a thread for each volume
+// writer.close();
+// for (auto&& volume : writer.statistics()) { std::cout << volume << "\n"; }
+
+namespace recording {
+
+enum class Striping : uint32_t {
+    RoundRobin,         // the next volume that is not busy
+    Load                // the volume that spent the least time writing, so a slower disk is getting less frames
+};
+auto operator << (std::ostream& os, Striping striping) -> std::ostream&;
+
+struct VolumeStatistics {
+    std::filesystem::path directory;
+    uint64_t frames{0};
+    uint64_t bytes{0};
+    uint64_t segments{0};
+    std::chrono::microseconds busy{0};      // the time spent writing to this volume
+    uint64_t capacity{0};                   // of the file system, in bytes
+    uint64_t available{0};
+
+    auto throughput() const -> double;      // MB/s, while we were writing
+    auto fill() const -> double;            // the part of the file system that is used
+};
+auto operator << (std::ostream& os, const VolumeStatistics& vs) -> std::ostream&;
+
+struct StripedWriter {
+    StripedWriter() = default;
+    ~StripedWriter();
+
+    StripedWriter(const StripedWriter&) = delete;
+    auto operator = (const StripedWriter&) -> StripedWriter& = delete;
+
+    // Open a segment writer in <volume>/<name>/ for each volume. With more than a single volume, the list of the
+    // volumes is written into the directory (that can also be one of the volumes directories).
+    [[nodiscard]] auto open(const std::vector<std::filesystem::path>& volumes, const std::filesystem::path& directory,
+            const std::string& name, const SegmentSettings& settings, Striping striping) -> bool;
+    // This can be called from as many threads as there are volumes at the same time, more threads are waiting for a volume
+    [[nodiscard]] auto write(const camera::ImageView& image) -> bool;
+    // The statistics of the volumes are kept until it is opened again
+    auto close() -> bool;
+    // From the next frame on each volume (see SegmentWriter::set_compression)
+    auto set_compression(Compression compression) -> void;
+
+    auto is_open() const -> bool {
+        return !volumes.empty() && volumes.front()->writer.is_open();
+    }
+
+    auto size() const -> std::size_t {
+        return volumes.size();
+    }
+
+    // The segments that were started on all the volumes
+    auto segments() const -> uint64_t;
+    auto statistics() const -> std::vector<VolumeStatistics>;
+    // Of all the volumes together
+    auto io_statistics() const -> std::optional<IoStatistics>;
+    auto codec_statistics() const -> std::optional<CodecStatistics>;
+
+private:
+    struct Volume {
+        std::filesystem::path directory;
+        SegmentWriter writer;
+        bool busy{false};
+        Compression compression{Compression::None};     // that is set on the writer
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> segments{0};
+        std::atomic<uint64_t> busy_time{0};            // microseconds
+    };
+
+    auto acquire() -> Volume&;
+    auto release(Volume& volume) -> void;
+
+    std::vector<std::unique_ptr<Volume>> volumes;
+    Striping striping{Striping::Load};
+    std::mutex guard;                           // for choosing the volumes
+    std::condition_variable available;
+    std::size_t next{0};                        // for the round robin
+    std::atomic<Compression> compression{Compression::None};
+};
+
+// The name of the file with the list of the volumes, in the directory of the recording
+constexpr const char* STRIPES_NAME = "stripes";
+
+// Write the directories of the volumes of the recording into the directory, one in each line
+[[nodiscard]] auto write_stripes(const std::filesystem::path& directory, const std::vector<std::filesystem::path>& volumes) -> bool;
+// The directories with the segments of the recording in this directory, this is only the directory itself when it is not striped
+[[nodiscard]] auto read_stripes(const std::filesystem::path& directory) -> std::vector<std::filesystem::path>;
+
+}   // end of namespace recording
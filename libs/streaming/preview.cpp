@@ -0,0 +1,376 @@
+#include "preview.hh"
+#include "log/logging.h"
+#include <time.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+
+namespace streaming {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// The position of the red and the blue pixels in each 2 X 2 block of the Bayer pattern (row * 2 + column), the other two are green
+struct Pattern {
+    unsigned red;
+    unsigned blue;
+
+    constexpr auto channel(unsigned position) const -> unsigned {
+        return position == red ? 0 : (position == blue ? 2 : 1);
+    }
+};
+
+constexpr auto pattern_of(camera::PixelFormat format) -> std::optional<Pattern> {
+    switch (format) {
+        case camera::PixelFormat::RawRGGB8:
+            return Pattern{.red = 0, .blue = 3};
+        case camera::PixelFormat::RawGR8:
+            return Pattern{.red = 1, .blue = 2};
+        case camera::PixelFormat::RawGB8:
+            return Pattern{.red = 2, .blue = 1};
+        case camera::PixelFormat::RawBG8:
+            return Pattern{.red = 3, .blue = 0};
+        default:
+            return std::nullopt;
+    }
+}
+
+auto thread_cpu_time() -> std::chrono::nanoseconds {
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+auto since_epoch(clock_type::time_point at) -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+}
+
+struct Slot {
+    std::vector<uint8_t> data;      // the frame is copied here, so it is allocated once for the frame size
+    camera::ImageView image;
+};
+
+struct Mailbox {
+    explicit Mailbox(std::string name) : camera{std::move(name)} {
+        for (auto&& slot : slots) {
+            free.push_back(&slot);
+        }
+    }
+
+    const std::string camera;
+    std::array<Slot, 2> slots;          // one for the preview thread, and one for the latest frame
+    std::mutex guard;                   // for the free and the pending slots
+    std::vector<Slot*> free;
+    Slot* pending{nullptr};             // the latest frame that was taken
+    // only used from the capture thread
+    clock_type::time_point due{};
+    // only used from the preview thread
+    std::vector<uint8_t> rgb;
+    bool reported{false};               // that the pixel format is not supported
+    std::atomic<int64_t> throttled_until{0};    // nanoseconds of the steady clock, set by the preview thread
+    std::atomic<int64_t> first{0};
+    std::atomic<int64_t> last{0};
+    std::atomic<uint64_t> offered{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> throttled{0};
+    std::atomic<uint64_t> replaced{0};
+    std::atomic<uint64_t> unsupported{0};
+    std::atomic<uint64_t> previews{0};
+    std::atomic<int64_t> copy{0};       // nanoseconds
+    std::atomic<int64_t> cpu{0};        // nanoseconds
+};
+
+}       // end of local namespace
+
+struct Preview {
+    Preview(const PreviewSettings& s, const std::vector<std::string>& cameras, preview_f&& f, std::stop_token cancellation) :
+            settings{s}, on_preview{std::move(f)},
+            interval{std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(s.fps > 0 ? 1.0 / s.fps : 0.0))} {
+        for (auto&& c : cameras) {
+            mailboxes.push_back(std::make_unique<Mailbox>(c));
+        }
+        thread = std::jthread([this](std::stop_token st) {
+            run(std::move(st));
+        });
+        cancelled.emplace(std::move(cancellation), [this] {
+            thread.request_stop();
+        });
+    }
+
+    ~Preview() {
+        stop();
+    }
+
+    auto offer(std::size_t camera, const camera::ImageView& image) -> bool;
+
+    auto stop() -> void {
+        thread.request_stop();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    auto statistics() const -> std::vector<PreviewStatistics>;
+
+private:
+    auto run(std::stop_token st) -> void;
+    // the next camera, after the last one, that has a frame waiting, and take its frame
+    auto next_frame() -> std::pair<std::size_t, Slot*>;
+    auto make(std::size_t camera, Slot& slot) -> void;
+
+    const PreviewSettings settings;
+    preview_f on_preview;
+    const clock_type::duration interval;
+    std::vector<std::unique_ptr<Mailbox>> mailboxes;
+    std::mutex waiting;
+    std::condition_variable_any wakeup;
+    uint64_t published{0};          // frames that were taken, to wake the preview thread
+    std::size_t turn{0};            // only used by the preview thread
+    std::jthread thread;
+    std::optional<std::stop_callback<std::function<void()>>> cancelled;
+};
+
+auto Preview::offer(std::size_t index, const camera::ImageView& image) -> bool {
+    if (index >= mailboxes.size() || !thread.joinable()) {
+        return false;
+    }
+    auto& mailbox{*mailboxes[index]};
+    const auto now{clock_type::now()};
+    ++mailbox.offered;
+    if (mailbox.first == 0) {
+        mailbox.first = since_epoch(now);
+    }
+    mailbox.last = since_epoch(now);
+    if (settings.every ? image.number % settings.every != 0 : now < mailbox.due) {
+        ++mailbox.skipped;
+        return false;
+    }
+    if (since_epoch(now) < mailbox.throttled_until) {
+        ++mailbox.throttled;
+        return false;
+    }
+    // keep the cadence of the frame rate, unless we are already behind it
+    mailbox.due = mailbox.due + interval < now ? now + interval : mailbox.due + interval;
+    Slot* slot{nullptr};
+    {
+        std::lock_guard lock{mailbox.guard};
+        if (!mailbox.free.empty()) {
+            slot = mailbox.free.back();
+            mailbox.free.pop_back();
+        } else if (mailbox.pending) {
+            ++mailbox.replaced;
+            slot = std::exchange(mailbox.pending, nullptr);
+        } else {
+            return false;       // only when the frames of this camera are passed from more than one thread
+        }
+    }
+    slot->data.assign(image.data, image.data + image.size);
+    slot->image = image;
+    slot->image.data = slot->data.data();
+    mailbox.copy += std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - now).count();
+    {
+        std::lock_guard lock{mailbox.guard};
+        if (mailbox.pending) {
+            ++mailbox.replaced;
+            mailbox.free.push_back(mailbox.pending);
+        }
+        mailbox.pending = slot;
+    }
+    {
+        std::lock_guard lock{waiting};
+        ++published;
+    }
+    wakeup.notify_one();
+    return true;
+}
+
+auto Preview::run(std::stop_token st) -> void {
+    uint64_t seen{0};
+    while (!st.stop_requested()) {
+        if (const auto [camera, slot] = next_frame(); slot) {
+            make(camera, *slot);
+            continue;
+        }
+        std::unique_lock lock{waiting};
+        if (!wakeup.wait(lock, st, [this, seen] { return published != seen; })) {
+            return;
+        }
+        seen = published;
+    }
+}
+
+auto Preview::next_frame() -> std::pair<std::size_t, Slot*> {
+    for (std::size_t i = 0; i < mailboxes.size(); i++) {
+        const auto camera{(turn + i) % mailboxes.size()};
+        auto& mailbox{*mailboxes[camera]};
+        std::lock_guard lock{mailbox.guard};
+        if (mailbox.pending) {
+            turn = camera + 1;
+            return {camera, std::exchange(mailbox.pending, nullptr)};
+        }
+    }
+    return {0, nullptr};
+}
+
+auto Preview::make(std::size_t camera, Slot& slot) -> void {
+    auto& mailbox{*mailboxes[camera]};
+    const auto started{thread_cpu_time()};
+    const auto scale{pattern_of(slot.image.type) && settings.scale % 2 ? settings.scale + 1 : settings.scale};
+    const auto preview{downscale(slot.image, scale, mailbox.rgb)};
+    if (!preview && !std::exchange(mailbox.reported, true)) {
+        LOG(WARNING) << "cannot make a preview of " << mailbox.camera << " from " << slot.image << ENDL;
+    }
+    {
+        std::lock_guard lock{mailbox.guard};
+        mailbox.free.push_back(&slot);
+    }
+    if (preview) {
+        on_preview(camera, preview.value());
+        ++mailbox.previews;
+    } else {
+        ++mailbox.unsupported;
+    }
+    const auto cost{thread_cpu_time() - started};
+    mailbox.cpu += cost.count();
+    if (settings.budget > 0) {
+        // with this cost, taking the next frame before this time is using more than the budget
+        mailbox.throttled_until = since_epoch(clock_type::now()) + static_cast<int64_t>(cost.count() / settings.budget);
+    }
+}
+
+auto Preview::statistics() const -> std::vector<PreviewStatistics> {
+    std::vector<PreviewStatistics> output;
+    for (auto&& m : mailboxes) {
+        output.push_back(PreviewStatistics{
+            .camera = m->camera, .offered = m->offered.load(), .skipped = m->skipped.load(), .throttled = m->throttled.load(),
+            .replaced = m->replaced.load(), .unsupported = m->unsupported.load(), .previews = m->previews.load(),
+            .copy = std::chrono::nanoseconds{m->copy.load()}, .cpu = std::chrono::nanoseconds{m->cpu.load()},
+            .elapsed = std::chrono::nanoseconds{m->last.load() - m->first.load()}
+        });
+    }
+    return output;
+}
+
+auto make_preview(const PreviewSettings& settings, const std::vector<std::string>& cameras, preview_f&& on_preview, std::stop_token cancellation) -> preview_t {
+    if (!on_preview) {
+        LOG(ERROR) << "cannot make a preview without a callback" << ENDL;
+        return {};
+    }
+    auto s{settings};
+    s.scale = std::max(s.scale, 1u);
+    LOG(INFO) << "preview of " << cameras.size() << " cameras at 1/" << s.scale << " of the size, " << (s.every ? "every " : "at ")
+        << (s.every ? static_cast<double>(s.every) : s.fps) << (s.every ? " frames" : " FPS") << ", with a budget of "
+        << s.budget * 100 << "% of a core for each camera (0 for no limit)" << ENDL;
+    return std::make_shared<Preview>(s, cameras, std::move(on_preview), std::move(cancellation));
+}
+
+auto offer(Preview& preview, std::size_t camera, const camera::ImageView& image) -> bool {
+    return preview.offer(camera, image);
+}
+
+auto stop(Preview& preview) -> void {
+    preview.stop();
+}
+
+auto statistics(const Preview& preview) -> std::vector<PreviewStatistics> {
+    return preview.statistics();
+}
+
+auto downscale(const camera::ImageView& image, uint32_t scale, std::vector<uint8_t>& output) -> std::optional<camera::ImageView> {
+    const auto pattern{pattern_of(image.type)};
+    const auto rgb{image.type == camera::PixelFormat::RGB8 || image.type == camera::PixelFormat::BGR8};
+    if (!(pattern || rgb || image.type == camera::PixelFormat::Mono8) || scale == 0 || (pattern && scale % 2)) {
+        return std::nullopt;
+    }
+    const std::size_t depth{rgb ? 3u : 1u};     // bytes for each pixel of the image
+    const uint32_t width{image.width / scale};
+    const uint32_t height{image.height / scale};
+    if (width == 0 || height == 0 || image.data == nullptr || image.size < std::size_t{image.width} * image.height * depth) {
+        return std::nullopt;
+    }
+    output.resize(std::size_t{width} * height * 3);
+    // the sums of the red, green and blue of each pixel of the preview, for the rows of the image that are making one row of the preview
+    thread_local std::vector<uint32_t> sums;
+    sums.resize(std::size_t{width} * 3);
+    const std::size_t stride{std::size_t{image.width} * depth};
+    // the number of pixels of each color that are making a pixel of the preview
+    const auto area{scale * scale};
+    const std::array<uint32_t, 3> counts{pattern ? std::array<uint32_t, 3>{area / 4, area / 2, area / 4} : std::array<uint32_t, 3>{area, area, area}};
+    const auto swap{image.type == camera::PixelFormat::BGR8};
+    for (uint32_t y = 0; y < height; y++) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (uint32_t r = 0; r < scale; r++) {
+            const auto row{image.data + (std::size_t{y} * scale + r) * stride};
+            if (pattern) {
+                // along a row of the Bayer pattern the pixels are of two colors, one after the other
+                const auto even{pattern->channel((r % 2) * 2)};
+                const auto odd{pattern->channel((r % 2) * 2 + 1)};
+                for (uint32_t x = 0; x < width; x++) {
+                    const auto from{row + std::size_t{x} * scale};
+                    uint32_t first{0}, second{0};
+                    for (uint32_t k = 0; k < scale; k += 2) {
+                        first += from[k];
+                        second += from[k + 1];
+                    }
+                    sums[x * 3 + even] += first;
+                    sums[x * 3 + odd] += second;
+                }
+            } else if (rgb) {
+                for (uint32_t x = 0; x < width; x++) {
+                    const auto from{row + std::size_t{x} * scale * 3};
+                    for (uint32_t k = 0; k < scale * 3; k += 3) {
+                        sums[x * 3] += from[k];
+                        sums[x * 3 + 1] += from[k + 1];
+                        sums[x * 3 + 2] += from[k + 2];
+                    }
+                }
+            } else {
+                for (uint32_t x = 0; x < width; x++) {
+                    const auto from{row + std::size_t{x} * scale};
+                    uint32_t gray{0};
+                    for (uint32_t k = 0; k < scale; k++) {
+                        gray += from[k];
+                    }
+                    sums[x * 3] += gray;
+                }
+            }
+        }
+        auto to{output.data() + std::size_t{y} * width * 3};
+        for (uint32_t x = 0; x < width; x++, to += 3) {
+            if (!(pattern || rgb)) {
+                to[0] = to[1] = to[2] = static_cast<uint8_t>(sums[x * 3] / area);
+                continue;
+            }
+            to[0] = static_cast<uint8_t>(sums[x * 3 + (swap ? 2 : 0)] / counts[0]);
+            to[1] = static_cast<uint8_t>(sums[x * 3 + 1] / counts[1]);
+            to[2] = static_cast<uint8_t>(sums[x * 3 + (swap ? 0 : 2)] / counts[2]);
+        }
+    }
+    camera::ImageView preview{static_cast<uint32_t>(output.size()), width, height, image.number, output.data(), camera::PixelFormat::RGB8, image.timestamp};
+    preview.arrived = image.arrived;
+    preview.exposure = image.exposure;
+    preview.gain = image.gain;
+    preview.status = image.status;
+    return preview;
+}
+
+auto PreviewStatistics::load() const -> double {
+    return elapsed.count() > 0 ? static_cast<double>(cpu.count()) / elapsed.count() : 0.0;
+}
+
+auto PreviewStatistics::cost() const -> double {
+    return previews ? std::chrono::duration<double, std::milli>(cpu).count() / previews : 0.0;
+}
+
+auto operator << (std::ostream& os, const PreviewStatistics& ps) -> std::ostream& {
+    return os << ps.camera << ": previews " << ps.previews << " of " << ps.offered << " frames, skipped " << ps.skipped << ", throttled " << ps.throttled
+        << ", replaced " << ps.replaced << ", unsupported " << ps.unsupported << ", " << ps.cost() << "ms of CPU for each, " << ps.load() * 100
+        << "% of a core, " << std::chrono::duration<double, std::milli>(ps.copy).count() << "ms copying in the capture callback";
+}
+
+}   // end of namespace streaming
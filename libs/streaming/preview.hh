@@ -0,0 +1,79 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// A small RGB preview of the frames of a few cameras, for a viewer, that is made away from the recording path.
+// Passing a frame to the preview (from the capture callback for example) is first deciding if the frame is needed at all:
+// only every Nth frame is taken, or the latest frame at the frame rate of the preview, so most of the frames are not even copied.
+// A frame that is taken is copied into the mailbox of its camera, replacing the frame that is waiting there if the preview did not
+// get to it yet, so the viewer is always getting the latest frame, and the capture callback is never waiting for the preview.
+// A single thread is making the previews of all the cameras: the frame is reduced by the scale in each direction, where each
+// pixel of the preview is the average of the pixels that it covers (so the Bayer frames are debayered by the same step), and the
+// RGB preview is passed to the callback on this thread. The CPU time that each preview takes (including the callback) is
+// measured, and when a camera is using more than its budget of a core, the next frame of this camera is taken only after it
+// is back within the budget, so a large frame or a slow viewer is lowering the frame rate of the preview and not taking more CPU.
+// For example:
+// auto preview{streaming::make_preview(streaming::PreviewSettings{.fps = 10, .scale = 4}, {"DEV_1AB22C00A1B2"}, [](std::size_t, const camera::ImageView& rgb) {
+//      show(rgb);
+// }, stop_source.get_token())};
+// ... from the capture callback
+// streaming::offer(*preview, 0, image);
+// ...
+// for (auto&& s : streaming::statistics(*preview)) { std::cout << s << "\n"; }
+
+namespace streaming {
+
+struct PreviewSettings {
+    std::size_t every{0};               // take every Nth frame, 0 to take the latest frame at the frame rate
+    double fps{10};                     // for each camera, when every is 0
+    uint32_t scale{4};                  // the preview is 1/scale of the frame in each direction, this is made even for Bayer frames
+    double budget{0.1};                 // the most of a core for the preview of each camera, 0 for no limit
+};
+
+struct PreviewStatistics {
+    std::string camera;
+    uint64_t offered{0};                // frames that were passed to the preview
+    uint64_t skipped{0};                // not needed for the frame rate of the preview
+    uint64_t throttled{0};              // needed, but the camera was over its CPU budget
+    uint64_t replaced{0};               // taken, but a newer frame was taken before the preview got to it
+    uint64_t unsupported{0};            // frames in a pixel format that we cannot make a preview from
+    uint64_t previews{0};               // that were passed to the callback
+    std::chrono::nanoseconds copy{0};   // the time that the capture callback was copying the frames that were taken
+    std::chrono::nanoseconds cpu{0};    // the CPU time of making the previews and of the callback
+    std::chrono::nanoseconds elapsed{0};    // from the first frame that was passed to the last one
+
+    auto load() const -> double;        // the part of a core that the preview was using
+    auto cost() const -> double;        // milliseconds of CPU for each preview
+};
+auto operator << (std::ostream& os, const PreviewStatistics& ps) -> std::ostream&;
+
+// The camera is the position of the camera in make_preview, and the preview is RGB8, valid only during the call
+using preview_f = std::function<void(std::size_t camera, const camera::ImageView& preview)>;
+
+struct Preview;
+using preview_t = std::shared_ptr<Preview>;
+
+// Return nullptr without a callback
+[[nodiscard]] auto make_preview(const PreviewSettings& settings, const std::vector<std::string>& cameras, preview_f&& on_preview, std::stop_token cancellation) -> preview_t;
+
+// Return true if the frame was taken for the preview. This can be called from any thread, but the frames of
+// each camera should be passed from a single thread.
+auto offer(Preview& preview, std::size_t camera, const camera::ImageView& image) -> bool;
+
+auto stop(Preview& preview) -> void;
+
+[[nodiscard]] auto statistics(const Preview& preview) -> std::vector<PreviewStatistics>;
+
+// Reduce the image by the scale in each direction into RGB8, the output is resized for it. This supports Mono8,
+// the 8 bits Bayer formats (with an even scale), RGB8 and BGR8, and return nullopt for the other formats.
+[[nodiscard]] auto downscale(const camera::ImageView& image, uint32_t scale, std::vector<uint8_t>& output) -> std::optional<camera::ImageView>;
+
+}   // end of namespace streaming
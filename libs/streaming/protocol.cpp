@@ -0,0 +1,25 @@
+#include "protocol.hh"
+#include <iostream>
+
+namespace streaming {
+
+DatagramHeader::DatagramHeader(const camera::ImageView& image, uint32_t c, uint32_t p) :
+        camera{c}, format{static_cast<uint32_t>(image.type)}, number{image.number}, timestamp{image.timestamp},
+        width{image.width}, height{image.height}, size{image.size}, payload{p}, fragments{fragments_of(image.size, p)} {
+}
+
+auto camera_key(std::string_view id) -> uint32_t {
+    // FNV-1a
+    uint32_t hash{2166136261u};
+    for (auto c : id) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+auto operator << (std::ostream& os, const DatagramHeader& dh) -> std::ostream& {
+    return os << "camera " << dh.camera << ", frame " << dh.number << " [" << dh.width << " X " << dh.height << "] " << dh.pixel_format()
+        << ", fragment " << dh.fragment << " of " << dh.fragments << " (" << dh.payload << " bytes each, " << dh.size << " in the frame)";
+}
+
+}   // end of namespace streaming
@@ -0,0 +1,58 @@
+#pragma once
+#include "camera_controller/image.hh"
+#include <string_view>
+#include <iosfwd>
+#include <stdint.h>
+
+// The frames are streamed over UDP, each frame is split into datagrams that are small enough to not be
+// fragmented by IP (see payload_size), and each datagram is carrying a header with everything that is needed
+// to put it in its place in the frame, so the datagrams can arrive in any order, and a lost datagram is only
+// losing its part of the frame:
+// [DatagramHeader][payload: frame data from fragment * DatagramHeader::payload]
+// All the values are in the host byte order (the cameras and the viewers are on the same kind of hosts).
+
+namespace streaming {
+
+constexpr uint32_t STREAM_MAGIC = 0x53534347;      // "GCSS"
+constexpr uint16_t STREAM_VERSION = 1;
+constexpr std::size_t DEFAULT_MTU = 1500;
+constexpr std::size_t UDP_OVERHEAD = 28;            // the IPv4 and the UDP headers
+
+struct DatagramHeader {
+    uint32_t magic{STREAM_MAGIC};
+    uint16_t version{STREAM_VERSION};
+    uint16_t header_size{sizeof(DatagramHeader)};
+    uint32_t camera{0};         // see camera_key
+    uint32_t format{0};         // camera::PixelFormat
+    uint64_t number{0};
+    uint64_t timestamp{0};      // the device timestamp
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t size{0};           // of the whole frame
+    uint32_t payload{0};        // the size of the payload of all the fragments but the last one
+    uint32_t fragment{0};       // the position of this datagram in the frame
+    uint32_t fragments{0};      // the number of datagrams of the frame
+
+    DatagramHeader() = default;
+    DatagramHeader(const camera::ImageView& image, uint32_t camera, uint32_t payload);
+
+    auto pixel_format() const -> camera::PixelFormat {
+        return static_cast<camera::PixelFormat>(format);
+    }
+};
+static_assert(sizeof(DatagramHeader) == 56, "the datagram header is part of the protocol");
+auto operator << (std::ostream& os, const DatagramHeader& dh) -> std::ostream&;
+
+// A number for the camera id, that is small enough to be in each datagram, the receiver can find the camera with the same function
+[[nodiscard]] auto camera_key(std::string_view id) -> uint32_t;
+
+// The frame data in each datagram, so that a datagram with its header fits in the MTU
+[[nodiscard]] constexpr auto payload_size(std::size_t mtu) -> uint32_t {
+    return mtu > UDP_OVERHEAD + sizeof(DatagramHeader) ? static_cast<uint32_t>(mtu - UDP_OVERHEAD - sizeof(DatagramHeader)) : 0;
+}
+
+[[nodiscard]] constexpr auto fragments_of(std::size_t size, uint32_t payload) -> uint32_t {
+    return payload > 0 ? static_cast<uint32_t>((size + payload - 1) / payload) : 0;
+}
+
+}   // end of namespace streaming
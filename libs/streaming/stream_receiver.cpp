@@ -0,0 +1,296 @@
+#include "stream_receiver.hh"
+#include "log/logging.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace streaming {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// how often we are checking for the deadlines (and for stopping) when nothing is arriving
+constexpr auto RECEIVE_TIMEOUT = std::chrono::milliseconds{20};
+// a frame number that is this much before the last one of its camera is not late, the camera was restarted
+constexpr uint64_t RESTART_GAP = 1000;
+
+// a frame that is being put together
+struct Assembly {
+    bool used{false};
+    DatagramHeader header;              // of the first datagram that arrived, without the fragment
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> received;     // a bit for each fragment
+    uint32_t count{0};
+    clock_type::time_point started;
+};
+
+// the last frame of each camera that was passed to the callback or dropped
+struct Last {
+    uint32_t camera{0};
+    uint64_t number{0};
+};
+
+}       // end of local namespace
+
+struct StreamReceiver {
+    StreamReceiver(int socket, const ReceiverSettings& s, frame_received_f&& f, std::stop_token cancellation) :
+            settings{s}, on_frame{std::move(f)}, fd{socket}, slots(std::max<std::size_t>(s.slots, 1)),
+            buffers(std::max<std::size_t>(s.batch, 1) * s.mtu), parts(std::max<std::size_t>(s.batch, 1)), messages(parts.size()) {
+        for (auto&& slot : slots) {
+            slot.data.reserve(settings.frame_size);
+            slot.received.reserve((fragments_of(settings.frame_size, payload_size(settings.mtu)) + 63) / 64);
+        }
+        for (std::size_t i = 0; i < parts.size(); i++) {
+            parts[i] = iovec{.iov_base = buffers.data() + i * settings.mtu, .iov_len = settings.mtu};
+        }
+        thread = std::jthread([this](std::stop_token st) {
+            run(std::move(st));
+        });
+        cancelled.emplace(std::move(cancellation), [this] {
+            thread.request_stop();
+        });
+    }
+
+    ~StreamReceiver() {
+        stop();
+        ::close(fd);
+    }
+
+    auto stop() -> void {
+        thread.request_stop();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    auto statistics() const -> ReceiverStatistics {
+        return ReceiverStatistics{
+            .frames = frames.load(), .expired = expired.load(), .evicted = evicted.load(), .datagrams = datagrams.load(),
+            .bytes = bytes.load(), .batches = batches.load(), .duplicates = duplicates.load(), .late = late.load(), .invalid = invalid.load()
+        };
+    }
+
+private:
+    auto run(std::stop_token st) -> void;
+    // return false when the callback asked to stop
+    auto handle(const uint8_t* datagram, std::size_t length, clock_type::time_point now) -> bool;
+    auto slot_for(const DatagramHeader& header, clock_type::time_point now) -> Assembly&;
+    auto is_late(const DatagramHeader& header) const -> bool;
+    static auto same_frame(const DatagramHeader& frame, const DatagramHeader& header) -> bool;
+    auto release(Assembly& slot) -> void;
+    auto expire(clock_type::time_point now) -> void;
+
+    const ReceiverSettings settings;
+    frame_received_f on_frame;
+    const int fd;
+    // these are only used by the receiving thread
+    std::vector<Assembly> slots;
+    std::vector<Last> last;
+    std::vector<uint8_t> buffers;       // a datagram for each message of the batch
+    std::vector<iovec> parts;
+    std::vector<mmsghdr> messages;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> expired{0};
+    std::atomic<uint64_t> evicted{0};
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> late{0};
+    std::atomic<uint64_t> invalid{0};
+    std::jthread thread;
+    std::optional<std::stop_callback<std::function<void()>>> cancelled;
+};
+
+auto StreamReceiver::run(std::stop_token st) -> void {
+    while (!st.stop_requested()) {
+        for (std::size_t i = 0; i < messages.size(); i++) {
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_iov = &parts[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        // wait for the first datagram (up to the receive timeout), and take the ones that are already waiting after it
+        const auto got{::recvmmsg(fd, messages.data(), static_cast<unsigned int>(messages.size()), MSG_WAITFORONE, nullptr)};
+        const auto now{clock_type::now()};
+        if (got < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG(ERROR) << "failed to receive the stream on port " << settings.port << ": " << std::strerror(errno) << ENDL;
+                return;
+            }
+            expire(now);
+            continue;
+        }
+        ++batches;
+        for (int i = 0; i < got; i++) {
+            if (!handle(static_cast<const uint8_t*>(parts[i].iov_base), messages[i].msg_len, now)) {
+                LOG(INFO) << "the frames callback asked to stop receiving on port " << settings.port << ENDL;
+                return;
+            }
+        }
+        expire(now);
+    }
+}
+
+auto StreamReceiver::handle(const uint8_t* datagram, std::size_t length, clock_type::time_point now) -> bool {
+    DatagramHeader header;
+    if (length < sizeof(header)) {
+        ++invalid;
+        return true;
+    }
+    std::memcpy(&header, datagram, sizeof(header));
+    const std::size_t offset{std::size_t{header.fragment} * header.payload};
+    const auto size{length - std::min<std::size_t>(header.header_size, length)};
+    if (header.magic != STREAM_MAGIC || header.version != STREAM_VERSION || header.header_size < sizeof(header) || header.payload == 0 ||
+            header.size > settings.max_frame_size ||
+            header.fragments != fragments_of(header.size, header.payload) || header.fragment >= header.fragments ||
+            size != std::min<std::size_t>(header.payload, header.size - offset)) {
+        ++invalid;
+        return true;
+    }
+    if (is_late(header)) {
+        ++datagrams;
+        bytes += length;
+        ++late;
+        return true;
+    }
+    auto& slot{slot_for(header, now)};
+    // the slot was allocated for the frame from its first datagram, a datagram of the same frame that does not agree
+    // with it (corrupted, or from a camera that was restarted with another geometry) would be written outside of it
+    if (!same_frame(slot.header, header)) {
+        ++invalid;
+        return true;
+    }
+    ++datagrams;
+    bytes += length;
+    auto& word{slot.received[header.fragment / 64]};
+    const auto bit{uint64_t{1} << (header.fragment % 64)};
+    if (word & bit) {
+        ++duplicates;
+        return true;
+    }
+    word |= bit;
+    std::memcpy(slot.data.data() + offset, datagram + header.header_size, size);
+    if (++slot.count < header.fragments) {
+        return true;
+    }
+    camera::ImageView image{slot.header.size, slot.header.width, slot.header.height, slot.header.number, slot.data.data(),
+        slot.header.pixel_format(), slot.header.timestamp};
+    image.arrived = camera::host_time();
+    ++frames;
+    const auto more{on_frame(slot.header.camera, image)};
+    release(slot);
+    return more;
+}
+
+auto StreamReceiver::same_frame(const DatagramHeader& frame, const DatagramHeader& header) -> bool {
+    return frame.size == header.size && frame.payload == header.payload && frame.fragments == header.fragments &&
+        frame.width == header.width && frame.height == header.height && frame.format == header.format;
+}
+
+auto StreamReceiver::is_late(const DatagramHeader& header) const -> bool {
+    const auto at{std::find_if(last.begin(), last.end(), [&header](const Last& l) { return l.camera == header.camera; })};
+    return at != last.end() && header.number <= at->number && at->number - header.number < RESTART_GAP;
+}
+
+auto StreamReceiver::slot_for(const DatagramHeader& header, clock_type::time_point now) -> Assembly& {
+    Assembly* free{nullptr};
+    Assembly* oldest{nullptr};
+    for (auto&& slot : slots) {
+        if (!slot.used) {
+            free = free ? free : &slot;
+        } else if (slot.header.camera == header.camera && slot.header.number == header.number) {
+            return slot;
+        } else if (!oldest || slot.started < oldest->started) {
+            oldest = &slot;
+        }
+    }
+    if (!free) {
+        ++evicted;
+        release(*oldest);
+        free = oldest;
+    }
+    free->used = true;
+    free->header = header;
+    free->header.fragment = 0;
+    free->data.resize(header.size);         // this is only allocating when the frame is larger than the ones before it
+    free->received.assign((header.fragments + 63) / 64, 0);
+    free->count = 0;
+    free->started = now;
+    return *free;
+}
+
+auto StreamReceiver::release(Assembly& slot) -> void {
+    slot.used = false;
+    auto at{std::find_if(last.begin(), last.end(), [&slot](const Last& l) { return l.camera == slot.header.camera; })};
+    if (at == last.end()) {
+        last.push_back(Last{.camera = slot.header.camera, .number = slot.header.number});
+    } else if (slot.header.number > at->number || at->number - slot.header.number >= RESTART_GAP) {
+        at->number = slot.header.number;
+    }
+}
+
+auto StreamReceiver::expire(clock_type::time_point now) -> void {
+    for (auto&& slot : slots) {
+        if (slot.used && now - slot.started > settings.deadline) {
+            ++expired;
+            release(slot);
+        }
+    }
+}
+
+auto make_receiver(const ReceiverSettings& settings, frame_received_f&& on_frame, std::stop_token cancellation) -> receiver_t {
+    if (payload_size(settings.mtu) == 0 || !on_frame) {
+        LOG(ERROR) << "cannot receive the stream with the MTU " << settings.mtu << (on_frame ? "" : " and without a callback") << ENDL;
+        return {};
+    }
+    sockaddr_in at{.sin_family = AF_INET, .sin_port = htons(settings.port), .sin_addr = {}, .sin_zero = {}};
+    if (::inet_pton(AF_INET, settings.address.c_str(), &at.sin_addr) != 1) {
+        LOG(ERROR) << "invalid address to receive the stream on " << settings.address << ", expecting an IPv4 address" << ENDL;
+        return {};
+    }
+    const auto fd{::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+    if (fd < 0) {
+        LOG(ERROR) << "failed to create the socket for receiving the stream: " << std::strerror(errno) << ENDL;
+        return {};
+    }
+    const int reuse{1};
+    (void)::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &settings.receive_buffer, sizeof(settings.receive_buffer)) != 0) {
+        LOG(WARNING) << "failed to set the receive buffer for the stream to " << settings.receive_buffer << ": " << std::strerror(errno) << ENDL;
+    }
+    const timeval timeout{.tv_sec = 0, .tv_usec = std::chrono::duration_cast<std::chrono::microseconds>(RECEIVE_TIMEOUT).count()};
+    (void)::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&at), sizeof(at)) != 0) {
+        LOG(ERROR) << "failed to receive the stream on " << settings.address << ":" << settings.port << ": " << std::strerror(errno) << ENDL;
+        ::close(fd);
+        return {};
+    }
+    LOG(INFO) << "receiving the stream on " << settings.address << ":" << settings.port << " into " << settings.slots << " frame slots" << ENDL;
+    return std::make_shared<StreamReceiver>(fd, settings, std::move(on_frame), std::move(cancellation));
+}
+
+auto stop(StreamReceiver& receiver) -> void {
+    receiver.stop();
+}
+
+auto statistics(const StreamReceiver& receiver) -> ReceiverStatistics {
+    return receiver.statistics();
+}
+
+auto operator << (std::ostream& os, const ReceiverStatistics& rs) -> std::ostream& {
+    return os << "frames " << rs.frames << ", expired " << rs.expired << ", evicted " << rs.evicted << ", datagrams " << rs.datagrams
+        << ", " << rs.bytes / (1024 * 1024) << "MB, " << (rs.batches ? rs.datagrams / rs.batches : 0) << " datagrams for each batch, duplicates "
+        << rs.duplicates << ", late " << rs.late << ", invalid " << rs.invalid;
+}
+
+}   // end of namespace streaming
@@ -0,0 +1,67 @@
+#pragma once
+#include "protocol.hh"
+#include "camera_controller/image.hh"
+#include <memory>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Receive the frames that are streamed by the stream server (see stream_server.hh), and put them back together.
+// A dedicated thread is reading the datagrams in batches with recvmmsg, into buffers that are allocated once,
+// and is copying the payload of each datagram into its place in the frame, in one of a few frame slots that
+// are also allocated once (and only grow when a larger frame is arriving), so nothing is allocated for each datagram.
+// Once all the datagrams of a frame arrived, the frame is passed to the callback, on the receiving thread, and
+// the slot is reused once the callback returns. A frame that is not complete after the deadline is dropped (and
+// counted), and so is the oldest frame when a new frame is arriving and all the slots are in use.
+// For example:
+// auto receiver{streaming::make_receiver(streaming::ReceiverSettings{.port = 5000}, [](uint32_t camera, const camera::ImageView& image) {
+//      std::cout << camera << ": " << image << "\n"; return true;
+// }, stop_source.get_token())};
+// ...
+// std::cout << streaming::statistics(*receiver) << "\n";
+
+namespace streaming {
+
+struct ReceiverSettings {
+    std::string address{"0.0.0.0"};         // to listen on
+    uint16_t port{5000};
+    std::size_t mtu{DEFAULT_MTU};           // the largest datagram that we expect
+    std::size_t batch{64};                  // the most datagrams for each call to recvmmsg
+    std::size_t slots{8};                   // frames that are put together at the same time, from all the cameras
+    std::size_t frame_size{0};              // to allocate the slots in advance, 0 to allocate them with the first frames
+    std::size_t max_frame_size{64 * 1024 * 1024};  // the datagrams of larger frames are rejected, the slots are allocated by the size in the datagram
+    std::chrono::milliseconds deadline{200};    // for all the datagrams of a frame to arrive
+    int receive_buffer{32 * 1024 * 1024};   // SO_RCVBUF, the kernel may limit it
+};
+
+struct ReceiverStatistics {
+    uint64_t frames{0};                     // that were complete and passed to the callback
+    uint64_t expired{0};                    // frames that were not complete by the deadline
+    uint64_t evicted{0};                    // frames that were dropped for a new frame, when all the slots were in use
+    uint64_t datagrams{0};
+    uint64_t bytes{0};
+    uint64_t batches{0};                    // calls to recvmmsg that returned datagrams
+    uint64_t duplicates{0};
+    uint64_t late{0};                       // datagrams of frames that were already passed or dropped
+    uint64_t invalid{0};                    // datagrams that are not of our protocol, of a frame above max_frame_size, or that do not agree with the frame they are part of
+};
+auto operator << (std::ostream& os, const ReceiverStatistics& rs) -> std::ostream&;
+
+// The camera is the key of the camera id (see camera_key), and the image is valid only during the call.
+// Return false to stop receiving.
+using frame_received_f = std::function<bool(uint32_t camera, const camera::ImageView& image)>;
+
+struct StreamReceiver;
+using receiver_t = std::shared_ptr<StreamReceiver>;
+
+// Return nullptr if we cannot listen on the address
+[[nodiscard]] auto make_receiver(const ReceiverSettings& settings, frame_received_f&& on_frame, std::stop_token cancellation) -> receiver_t;
+
+auto stop(StreamReceiver& receiver) -> void;
+
+[[nodiscard]] auto statistics(const StreamReceiver& receiver) -> ReceiverStatistics;
+
+}   // end of namespace streaming
@@ -0,0 +1,583 @@
+#include "stream_server.hh"
+#include "log/logging.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <utility>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace streaming {
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// How often to check if the kernel is done with the frames that were sent with MSG_ZEROCOPY, and when to warn that it is taking long
+constexpr auto COMPLETION_POLL = std::chrono::milliseconds{1};
+constexpr auto COMPLETION_LIMIT = std::chrono::seconds{1};
+constexpr int NO_BUFFERS_RETRIES = 8;
+
+auto thread_cpu_time() -> std::chrono::nanoseconds {
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+// the ids of the MSG_ZEROCOPY sends are counting up from 0 for the socket, and may wrap around
+constexpr auto before(uint32_t a, uint32_t b) -> bool {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+struct Slot {
+    std::vector<uint8_t> data;      // the frame is copied here, so it is allocated once for the frame size
+    camera::FrameLease lease;       // or the frame is sent from the buffer of the camera
+    camera::ImageView image;
+    // with MSG_ZEROCOPY the kernel is reading the headers after sendmmsg returned as well, so the frame has its own
+    std::vector<DatagramHeader> headers;
+    bool zerocopy{false};
+    bool copied{false};             // the kernel notified that it copied some of the datagrams
+    uint32_t start{0};              // the ids of the zero copy sends of the frame, from start until end
+    uint32_t end{0};
+};
+
+struct Stream {
+    Stream(std::string name, const StreamSettings& s, std::size_t datagram) :
+            camera{std::move(name)}, key{camera_key(camera)}, settings{s},
+            burst{static_cast<double>(std::max(s.burst, datagram))}, tokens{burst}, refilled{clock_type::now()} {
+        for (std::size_t i = 0; i < std::max<std::size_t>(s.slots, 1); i++) {
+            slots.push_back(std::make_unique<Slot>());
+            free.push_back(slots.back().get());
+        }
+    }
+
+    // the tokens are the bytes that can be sent now, and are added at the rate of the stream
+    auto refill(clock_type::time_point now) -> void {
+        const auto seconds{std::chrono::duration<double>(now - refilled).count()};
+        tokens = std::min(burst, tokens + seconds * bytes_per_second());
+        refilled = now;
+    }
+
+    auto bytes_per_second() const -> double {
+        return settings.rate * 1e6 / 8;
+    }
+
+    const std::string camera;
+    const uint32_t key;
+    const StreamSettings settings;
+    std::mutex guard;                   // for the free and ready slots
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<Slot*> free;
+    std::deque<Slot*> ready;            // waiting to be sent, in order
+    // these are only used by the sending thread
+    Slot* current{nullptr};
+    DatagramHeader header;              // of the current frame, with the next fragment to send
+    const double burst;
+    double tokens;
+    clock_type::time_point refilled;
+    std::atomic<int64_t> first{0};      // nanoseconds of the steady clock, when we started sending
+    std::atomic<int64_t> last{0};       // and when we sent the last batch
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> paced{0};
+    std::atomic<uint64_t> leased{0};
+    std::atomic<uint64_t> zerocopy{0};
+    std::atomic<uint64_t> copied{0};
+    std::atomic<int64_t> copy{0};       // nanoseconds
+    std::atomic<int64_t> cpu{0};
+};
+
+// A frame that was sent with MSG_ZEROCOPY, and is waiting for the kernel to be done with it
+struct InFlight {
+    Stream* stream;
+    Slot* slot;
+};
+
+}       // end of local namespace
+
+struct StreamServer {
+    StreamServer(int socket, const ServerSettings& s, const std::vector<std::string>& cameras, std::stop_token cancellation) :
+            settings{s}, payload{payload_size(s.mtu)}, fd{socket},
+            messages(std::max<std::size_t>(s.batch, 1)), parts(messages.size() * 2), headers(messages.size()) {
+        for (auto&& c : cameras) {
+            streams.push_back(std::make_unique<Stream>(c, s.stream, payload + sizeof(DatagramHeader) + UDP_OVERHEAD));
+        }
+        thread = std::jthread([this](std::stop_token st) {
+            run(std::move(st));
+        });
+        cancelled.emplace(std::move(cancellation), [this] {
+            thread.request_stop();
+        });
+    }
+
+    ~StreamServer() {
+        stop();
+        ::close(fd);
+    }
+
+    auto send(std::size_t stream, const camera::ImageView& image) -> bool;
+    auto send(std::size_t stream, camera::FrameLease frame) -> bool;
+    auto stop() -> void;
+    auto statistics() const -> std::vector<StreamStatistics>;
+
+private:
+    auto run(std::stop_token st) -> void;
+    auto send_frames(std::stop_token st) -> void;
+    auto wait_for_kernel() -> void;
+    auto take(Stream& stream) -> Slot*;
+    auto queue(Stream& stream, Slot* slot) -> void;
+    auto recycle(Stream& stream, Slot* slot) -> void;
+    auto next_frame(Stream& stream) -> bool;
+    auto send_batch(Stream& stream, std::size_t count) -> void;
+    auto reap() -> void;
+    auto completed(uint32_t first, uint32_t last, bool copied) -> void;
+
+    const ServerSettings settings;
+    const uint32_t payload;
+    const int fd;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::mutex waiting;
+    std::condition_variable_any wakeup;
+    uint64_t queued{0};             // frames that were passed, to wake the sending thread
+    bool draining{false};
+    // these are only used by the sending thread, and are reused for all the batches
+    std::vector<mmsghdr> messages;
+    std::vector<iovec> parts;
+    std::vector<DatagramHeader> headers;
+    // the frames that were sent with MSG_ZEROCOPY, in the order of their ids, and the ids that the kernel is done with
+    std::deque<InFlight> inflight;
+    uint32_t next_id{0};
+    uint32_t done_id{0};                                // all the ids before this one are done
+    std::vector<std::pair<uint32_t, uint32_t>> early;   // ranges that were done out of order
+    Stream* zerocopy_stream{nullptr};                   // that the last zero copy send was for
+    std::jthread thread;
+    std::optional<std::stop_callback<std::function<void()>>> cancelled;
+};
+
+auto StreamServer::take(Stream& stream) -> Slot* {
+    std::lock_guard lock{stream.guard};
+    if (stream.free.empty()) {
+        ++stream.dropped;
+        return nullptr;
+    }
+    auto slot{stream.free.back()};
+    stream.free.pop_back();
+    return slot;
+}
+
+auto StreamServer::queue(Stream& stream, Slot* slot) -> void {
+    {
+        std::lock_guard lock{stream.guard};
+        stream.ready.push_back(slot);
+    }
+    {
+        std::lock_guard lock{waiting};
+        ++queued;
+    }
+    wakeup.notify_one();
+}
+
+auto StreamServer::recycle(Stream& stream, Slot* slot) -> void {
+    slot->lease.release();      // the buffer goes back to the camera
+    std::lock_guard lock{stream.guard};
+    stream.free.push_back(slot);
+}
+
+auto StreamServer::send(std::size_t index, const camera::ImageView& image) -> bool {
+    if (index >= streams.size() || !thread.joinable()) {
+        return false;
+    }
+    auto& stream{*streams[index]};
+    auto slot{take(stream)};
+    if (!slot) {
+        return false;
+    }
+    const auto started{thread_cpu_time()};
+    slot->data.assign(image.data, image.data + image.size);
+    stream.copy += (thread_cpu_time() - started).count();
+    slot->image = image;
+    slot->image.data = slot->data.data();
+    queue(stream, slot);
+    return true;
+}
+
+auto StreamServer::send(std::size_t index, camera::FrameLease frame) -> bool {
+    if (index >= streams.size() || !thread.joinable() || frame.empty()) {
+        return false;
+    }
+    auto& stream{*streams[index]};
+    auto slot{take(stream)};
+    if (!slot) {
+        return false;       // the lease is released here
+    }
+    slot->image = frame.image();
+    slot->lease = std::move(frame);
+    queue(stream, slot);
+    return true;
+}
+
+auto StreamServer::next_frame(Stream& stream) -> bool {
+    while (!stream.current) {
+        {
+            std::lock_guard lock{stream.guard};
+            if (stream.ready.empty()) {
+                return false;
+            }
+            stream.current = stream.ready.front();
+            stream.ready.pop_front();
+        }
+        stream.header = DatagramHeader{stream.current->image, stream.key, payload};
+        if (stream.header.fragments == 0) {
+            recycle(stream, std::exchange(stream.current, nullptr));
+            continue;
+        }
+        auto& slot{*stream.current};
+        slot.zerocopy = settings.zerocopy && !slot.lease.empty();
+        slot.copied = false;
+        slot.start = slot.end = next_id;
+        if (slot.zerocopy) {
+            slot.headers.resize(stream.header.fragments);
+        }
+    }
+    if (stream.first == 0) {
+        stream.first = clock_type::now().time_since_epoch().count();
+    }
+    return true;
+}
+
+auto StreamServer::send_batch(Stream& stream, std::size_t count) -> void {
+    const auto started{thread_cpu_time()};
+    auto& slot{*stream.current};
+    const auto& image{slot.image};
+    // the headers of a zero copy frame must stay until the kernel is done with them
+    auto batch_headers{slot.zerocopy ? slot.headers.data() + stream.header.fragment : headers.data()};
+    for (std::size_t i = 0; i < count; i++) {
+        batch_headers[i] = stream.header;
+        batch_headers[i].fragment = stream.header.fragment + static_cast<uint32_t>(i);
+        const std::size_t offset{std::size_t{batch_headers[i].fragment} * payload};
+        parts[i * 2] = iovec{.iov_base = &batch_headers[i], .iov_len = sizeof(DatagramHeader)};
+        parts[i * 2 + 1] = iovec{.iov_base = const_cast<uint8_t*>(image.data) + offset, .iov_len = std::min<std::size_t>(payload, image.size - offset)};
+        messages[i] = mmsghdr{};
+        messages[i].msg_hdr.msg_iov = &parts[i * 2];
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+    const int flags{slot.zerocopy ? MSG_ZEROCOPY : 0};
+    std::size_t done{0};
+    int retries{0};
+    while (done < count) {
+        const auto sent{::sendmmsg(fd, &messages[done], static_cast<unsigned int>(count - done), flags)};
+        ++stream.batches;
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // the kernel is limiting the memory for the notifications, so wait for it to be done with the frames that were sent
+            if (errno == ENOBUFS && slot.zerocopy && retries++ < NO_BUFFERS_RETRIES) {
+                pollfd notified{.fd = fd, .events = 0, .revents = 0};
+                (void)::poll(&notified, 1, static_cast<int>(COMPLETION_POLL.count()));
+                reap();
+                continue;
+            }
+            // this datagram is lost (no receiver, or no buffers in the kernel), go on with the next one
+            if (stream.failed++ == 0) {
+                LOG(WARNING) << "failed to send the frame number " << image.number << " of " << stream.camera << " to "
+                    << settings.address << ":" << settings.port << ": " << std::strerror(errno) << ENDL;
+            }
+            ++done;
+            continue;
+        }
+        for (auto i = done; i < done + static_cast<std::size_t>(sent); i++) {
+            stream.bytes += messages[i].msg_len;
+        }
+        stream.datagrams += sent;
+        done += sent;
+        if (slot.zerocopy) {
+            next_id += static_cast<uint32_t>(sent);     // each datagram is a send of its own, with its own id
+            slot.end = next_id;
+            zerocopy_stream = &stream;
+        }
+    }
+    stream.last = clock_type::now().time_since_epoch().count();
+    stream.header.fragment += static_cast<uint32_t>(count);
+    if (stream.header.fragment >= stream.header.fragments) {
+        ++stream.frames;
+        stream.leased += slot.lease.empty() ? 0 : 1;
+        stream.current = nullptr;
+        if (slot.zerocopy && slot.start != slot.end) {
+            ++stream.zerocopy;
+            inflight.push_back(InFlight{&stream, &slot});
+        } else {
+            recycle(stream, &slot);
+        }
+    }
+    stream.cpu += (thread_cpu_time() - started).count();
+}
+
+// Read the notifications of the kernel, for the sends with MSG_ZEROCOPY that it is done with, and release the frames that are done
+auto StreamServer::reap() -> void {
+    if (next_id == done_id) {
+        return;
+    }
+    auto charged{inflight.empty() ? zerocopy_stream : inflight.front().stream};
+    const auto started{thread_cpu_time()};
+    while (true) {
+        char control[128];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+        for (auto header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_IP || header->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+            if (error.ee_errno == 0 && error.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                completed(error.ee_info, error.ee_data, (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+            }
+        }
+    }
+    while (!inflight.empty() && !before(done_id, inflight.front().slot->end)) {
+        auto [stream, slot]{inflight.front()};
+        inflight.pop_front();
+        stream->copied += slot->copied ? 1 : 0;
+        recycle(*stream, slot);
+    }
+    charged->cpu += (thread_cpu_time() - started).count();
+}
+
+// The kernel is done with the sends from first to last (including), this is almost always in order
+auto StreamServer::completed(uint32_t first, uint32_t last, bool copied) -> void {
+    if (copied) {
+        const auto mark = [first, last](Slot& slot) {
+            if (slot.zerocopy && before(slot.start, last + 1) && before(first, slot.end)) {
+                slot.copied = true;
+            }
+        };
+        for (auto&& f : inflight) {
+            mark(*f.slot);
+        }
+        for (auto&& s : streams) {
+            if (s->current) {
+                mark(*s->current);      // the frames that are still being sent
+            }
+        }
+    }
+    if (first != done_id) {
+        early.emplace_back(first, last);
+        return;
+    }
+    done_id = last + 1;
+    for (auto found = true; found;) {
+        found = false;
+        for (auto i = early.begin(); i != early.end(); ++i) {
+            if (i->first == done_id) {
+                done_id = i->second + 1;
+                early.erase(i);
+                found = true;
+                break;
+            }
+        }
+    }
+}
+
+auto StreamServer::run(std::stop_token st) -> void {
+    send_frames(st);
+    wait_for_kernel();
+}
+
+auto StreamServer::send_frames(std::stop_token st) -> void {
+    const double datagram{static_cast<double>(payload + sizeof(DatagramHeader) + UDP_OVERHEAD)};
+    std::size_t first{0};       // the streams are taking turns to be the first one
+    while (!st.stop_requested() && !streams.empty()) {
+        uint64_t seen{0};
+        {
+            std::lock_guard lock{waiting};
+            seen = queued;
+        }
+        reap();
+        const auto now{clock_type::now()};
+        // the notifications of the kernel are not waking this thread, so check for them while there are frames in flight
+        std::optional<clock_type::time_point> wake;
+        if (next_id != done_id) {
+            wake = now + COMPLETION_POLL;
+        }
+        auto sent{false}, pending{false};
+        for (std::size_t i = 0; i < streams.size(); i++) {
+            auto& stream{*streams[(first + i) % streams.size()]};
+            if (!next_frame(stream)) {
+                continue;
+            }
+            pending = true;
+            auto count{std::min<std::size_t>(messages.size(), stream.header.fragments - stream.header.fragment)};
+            if (stream.settings.rate > 0) {
+                // wait for a whole batch (or burst), so the rate is not costing more system calls
+                stream.refill(now);
+                count = std::min(count, std::max<std::size_t>(static_cast<std::size_t>(stream.burst / datagram), 1));
+                if (stream.tokens < count * datagram) {
+                    ++stream.paced;
+                    const auto until{now + std::chrono::duration_cast<clock_type::duration>(
+                        std::chrono::duration<double>((count * datagram - stream.tokens) / stream.bytes_per_second()))};
+                    wake = wake ? std::min(wake.value(), until) : until;
+                    continue;
+                }
+                stream.tokens -= count * datagram;
+            }
+            send_batch(stream, count);
+            sent = true;
+        }
+        first = (first + 1) % streams.size();
+        if (sent) {
+            continue;
+        }
+        std::unique_lock lock{waiting};
+        if (!pending && draining) {
+            return;
+        }
+        if (wake) {
+            wakeup.wait_until(lock, st, wake.value(), [this, seen] { return queued != seen; });
+        } else {
+            wakeup.wait(lock, st, [this, seen] { return queued != seen || draining; });
+        }
+    }
+}
+
+// The kernel may still be reading the frames that were sent with MSG_ZEROCOPY (including a frame that was only sent in part
+// when the sending was cancelled), so their leases are kept until it notified that it is done with all of them. The kernel is
+// always notifying in the end, even for the datagrams that it drops, so this is only waiting for the card.
+auto StreamServer::wait_for_kernel() -> void {
+    const auto started{clock_type::now()};
+    auto warned{false};
+    while (next_id != done_id) {
+        pollfd notified{.fd = fd, .events = 0, .revents = 0};
+        (void)::poll(&notified, 1, static_cast<int>(COMPLETION_POLL.count()));
+        reap();
+        if (!warned && clock_type::now() - started > COMPLETION_LIMIT) {
+            LOG(WARNING) << "still waiting for the kernel to be done with " << next_id - done_id << " datagrams that were sent with zero copy to "
+                << settings.address << ":" << settings.port << ", the frames are held until then" << ENDL;
+            warned = true;
+        }
+    }
+}
+
+auto StreamServer::stop() -> void {
+    {
+        std::lock_guard lock{waiting};
+        draining = true;
+    }
+    wakeup.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    // the kernel is done with all the frames (see wait_for_kernel), give the frames that were still waiting back to the cameras
+    for (auto&& s : streams) {
+        for (auto&& slot : s->slots) {
+            slot->lease.release();
+        }
+    }
+}
+
+auto StreamServer::statistics() const -> std::vector<StreamStatistics> {
+    std::vector<StreamStatistics> output;
+    for (auto&& s : streams) {
+        const auto first{s->first.load()};
+        const auto last{s->last.load()};
+        output.push_back(StreamStatistics{
+            .camera = s->camera, .frames = s->frames.load(), .dropped = s->dropped.load(), .datagrams = s->datagrams.load(),
+            .failed = s->failed.load(), .bytes = s->bytes.load(), .batches = s->batches.load(), .paced = s->paced.load(),
+            .elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::duration{std::max(last - first, int64_t{0})}),
+            .leased = s->leased.load(), .zerocopy = s->zerocopy.load(), .copied = s->copied.load(),
+            .copy = std::chrono::nanoseconds{s->copy.load()}, .cpu = std::chrono::nanoseconds{s->cpu.load()}
+        });
+    }
+    return output;
+}
+
+auto make_server(const ServerSettings& settings, const std::vector<std::string>& cameras, std::stop_token cancellation) -> server_t {
+    if (payload_size(settings.mtu) == 0) {
+        LOG(ERROR) << "the MTU " << settings.mtu << " is too small for streaming the frames" << ENDL;
+        return {};
+    }
+    sockaddr_in to{.sin_family = AF_INET, .sin_port = htons(settings.port), .sin_addr = {}, .sin_zero = {}};
+    if (::inet_pton(AF_INET, settings.address.c_str(), &to.sin_addr) != 1) {
+        LOG(ERROR) << "invalid address to stream to " << settings.address << ", expecting an IPv4 address" << ENDL;
+        return {};
+    }
+    const auto fd{::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+    if (fd < 0) {
+        LOG(ERROR) << "failed to create the streaming socket: " << std::strerror(errno) << ENDL;
+        return {};
+    }
+    if (::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &settings.send_buffer, sizeof(settings.send_buffer)) != 0) {
+        LOG(WARNING) << "failed to set the send buffer of the streaming socket to " << settings.send_buffer << ": " << std::strerror(errno) << ENDL;
+    }
+    auto effective{settings};
+    if (settings.zerocopy) {
+        const int on{1};
+        if (::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+            LOG(WARNING) << "failed to enable zero copy on the streaming socket, the frames are copied by the kernel: " << std::strerror(errno) << ENDL;
+            effective.zerocopy = false;
+        }
+    }
+    // connected, so the route is only looked up once, and the datagrams are not carrying the address
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) != 0) {
+        LOG(ERROR) << "failed to stream to " << settings.address << ":" << settings.port << ": " << std::strerror(errno) << ENDL;
+        ::close(fd);
+        return {};
+    }
+    LOG(INFO) << "streaming " << cameras.size() << " cameras to " << settings.address << ":" << settings.port << ", "
+        << payload_size(settings.mtu) << " bytes in each datagram, " << (settings.stream.rate > 0 ? std::to_string(settings.stream.rate) + " Mbit/s" : std::string{"not paced"})
+        << " for each camera" << (effective.zerocopy ? ", with zero copy" : "") << ENDL;
+    return std::make_shared<StreamServer>(fd, effective, cameras, std::move(cancellation));
+}
+
+auto send(StreamServer& server, std::size_t stream, const camera::ImageView& image) -> bool {
+    return server.send(stream, image);
+}
+
+auto send(StreamServer& server, std::size_t stream, camera::FrameLease frame) -> bool {
+    return server.send(stream, std::move(frame));
+}
+
+auto stop(StreamServer& server) -> void {
+    server.stop();
+}
+
+auto statistics(const StreamServer& server) -> std::vector<StreamStatistics> {
+    return server.statistics();
+}
+
+auto StreamStatistics::throughput() const -> double {
+    return elapsed.count() > 0 ? static_cast<double>(bytes) * 8 / static_cast<double>(elapsed.count()) : 0.0;
+}
+
+auto StreamStatistics::cpu_per_gigabit() const -> double {
+    return bytes > 0 ? std::chrono::duration<double, std::milli>(copy + cpu).count() / (static_cast<double>(bytes) * 8 / 1e9) : 0.0;
+}
+
+auto operator << (std::ostream& os, const StreamStatistics& ss) -> std::ostream& {
+    return os << ss.camera << ": frames " << ss.frames << ", dropped " << ss.dropped << ", datagrams " << ss.datagrams << ", failed " << ss.failed
+        << ", " << ss.bytes / (1024 * 1024) << "MB, " << ss.throughput() << " Mbit/s, " << (ss.batches ? ss.datagrams / ss.batches : 0)
+        << " datagrams for each batch, paced " << ss.paced << " times, leased " << ss.leased << " frames, zero copy " << ss.zerocopy
+        << " (copied by the kernel " << ss.copied << "), CPU " << ss.cpu_per_gigabit() << " ms for each Gbit";
+}
+
+}   // end of namespace streaming
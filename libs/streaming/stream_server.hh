@@ -0,0 +1,99 @@
+#pragma once
+#include "protocol.hh"
+#include "camera_controller/image.hh"
+#include "camera_controller/frame_lease.hh"
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stop_token>
+#include <iosfwd>
+#include <stdint.h>
+
+// Stream the frames of a few cameras over UDP to a single destination (a viewer, or a multicast group).
+// Passing a frame to the server (from the capture callback for example) is only copying it into a free slot
+// of its stream, and a dedicated thread is splitting the frames into datagrams (see protocol.hh), and sending
+// them in batches with sendmmsg, so it is a single system call for many datagrams.
+// Each stream is paced on its own: a 12 MB frame is more than 8000 datagrams, and sending them as fast as
+// the host can is overflowing the buffers of the switch (that is shared with the cameras), so the datagrams of
+// each stream are sent at the given rate, in bursts that are not larger than the given burst, and the streams
+// are taking turns. When a frame is passed while all the slots of its stream are still waiting to be sent, it is
+// dropped (and counted), so a slow network is never blocking the camera.
+// A frame can also be passed as a lease (see camera::FrameLease), and then it is not copied at all: the datagrams are pointing into
+// the buffer of the camera, and the lease is released once the frame was sent. With settings.zerocopy the kernel is not copying
+// it either (MSG_ZEROCOPY), it is sending from the pages of the frame after sendmmsg returned, so the lease is only released when
+// the kernel notified that it is done with all the datagrams of the frame. This is saving the copy of the frame twice, but pinning
+// the pages and the notifications are not free, so it is only paying off for large frames, over a card that can send from a list
+// of buffers (over the loopback the kernel is copying anyway, and this is counted). Note that the slots of the stream are taken until
+// the frames are sent, and the camera has one less buffer for each frame that is waiting.
+// For example:
+// auto server{streaming::make_server(streaming::ServerSettings{.address = "192.168.1.10", .port = 5000}, {"DEV_1AB22C00A1B2"}, stop_source.get_token())};
+// if (!server) { exit(1); }
+// ... from the capture callback
+// streaming::send(*server, 0, image);
+// ... or from a callback that is getting the lease (see camera::make_async_lease_context)
+// streaming::send(*server, 0, frame);
+// ...
+// for (auto&& s : streaming::statistics(*server)) { std::cout << s << "\n"; }
+
+namespace streaming {
+
+struct StreamSettings {
+    double rate{0};                         // Mbit/s for each stream, 0 to send as fast as we can
+    std::size_t burst{256 * 1024};          // the most bytes that are sent at once with pacing
+    std::size_t slots{2};                   // frames that can wait to be sent, for each stream
+};
+
+struct ServerSettings {
+    std::string address{"127.0.0.1"};       // of the viewer
+    uint16_t port{5000};
+    std::size_t mtu{DEFAULT_MTU};
+    std::size_t batch{64};                  // the most datagrams for each call to sendmmsg
+    int send_buffer{4 * 1024 * 1024};       // SO_SNDBUF, the kernel may limit it
+    bool zerocopy{false};                   // send the frames that are passed as leases with MSG_ZEROCOPY
+    StreamSettings stream;
+};
+
+struct StreamStatistics {
+    std::string camera;
+    uint64_t frames{0};                     // that were sent completely
+    uint64_t dropped{0};                    // frames that were passed when all the slots were full
+    uint64_t datagrams{0};
+    uint64_t failed{0};                     // datagrams that the kernel did not accept
+    uint64_t bytes{0};                      // including the headers
+    uint64_t batches{0};                    // calls to sendmmsg
+    uint64_t paced{0};                      // times that the stream had to wait for its rate
+    std::chrono::microseconds elapsed{0};   // from the first datagram to the last one
+    uint64_t leased{0};                     // frames that were sent from the buffer of the camera
+    uint64_t zerocopy{0};                   // of these, frames that were sent with MSG_ZEROCOPY
+    uint64_t copied{0};                     // and of these, frames that the kernel had to copy anyway
+    std::chrono::nanoseconds copy{0};       // CPU time for copying the frames that were not passed as leases
+    std::chrono::nanoseconds cpu{0};        // CPU time of the sending thread for this stream, with the system calls
+
+    auto throughput() const -> double;      // Mbit/s
+    auto cpu_per_gigabit() const -> double; // milliseconds of CPU (copy and cpu) for each Gbit that was sent
+};
+auto operator << (std::ostream& os, const StreamStatistics& ss) -> std::ostream&;
+
+struct StreamServer;
+using server_t = std::shared_ptr<StreamServer>;
+
+// A stream for each camera, the streams are passed to send by their position here.
+// Return nullptr if we cannot create the socket, or the address is invalid.
+[[nodiscard]] auto make_server(const ServerSettings& settings, const std::vector<std::string>& cameras, std::stop_token cancellation) -> server_t;
+
+// Copy the frame into a free slot of the stream, return false if the frame was dropped. This can be called from
+// any thread, but the frames of each stream should be passed from a single thread, so they are sent in order.
+auto send(StreamServer& server, std::size_t stream, const camera::ImageView& image) -> bool;
+
+// Keep the lease in a free slot of the stream instead of copying the frame, the lease is released once the frame was sent
+// (or when it is dropped), return false if the frame was dropped.
+auto send(StreamServer& server, std::size_t stream, camera::FrameLease frame) -> bool;
+
+// Send the frames that are already waiting, and stop the sending thread, the frames that were sent with zero copy are held
+// until the kernel is done with them, also when the sending was cancelled
+auto stop(StreamServer& server) -> void;
+
+[[nodiscard]] auto statistics(const StreamServer& server) -> std::vector<StreamStatistics>;
+
+}   // end of namespace streaming
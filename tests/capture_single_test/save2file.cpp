@@ -1,10 +1,10 @@
 #include "save2file.h"
+#include "recording/dng_writer.hh"
 #include <opencv2/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <filesystem>
-#include <fstream>
 
 inline auto colorize(cv::InputArray input, cv::OutputArray rgb) -> void {
     cv::cvtColor(input, rgb, cv::COLOR_BayerRG2RGB);
@@ -39,39 +39,12 @@ auto show_images(const ImageBase frames) -> void {
     // }
 }
 
-auto dump_image(std::ofstream& out_file, ImageBase frame) -> void {
-    // Hard coded TIFF header (and pointer)
-	static const unsigned char HEADER[] = {0x49, 0x49, 0x2A, 0x00, 0x08, 0x80, 0xBB, 0x00};
-	// Hard coded TIFF tags and IFD
-	// Without ColorMatrix1 (from LibTIFF program)
-	static const unsigned char FOOTER[] = {
-		0x15, 0x00, 0xFE, 0x00, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
-		0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x01, 0x01, 0x03, 0x00, 0x01, 0x00,
-		0x00, 0x00, 0xB8, 0x0B, 0x00, 0x00, 0x02, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00,
-		0x00, 0x00, 0x03, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01,
-		0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x23, 0x80, 0x00, 0x00, 0x0F, 0x01, 0x02, 0x00, 0x09, 0x00,
-		0x00, 0x00, 0x0A, 0x81, 0xBB, 0x00, 0x10, 0x01, 0x02, 0x00, 0x10, 0x00, 0x00, 0x00, 0x14, 0x81,
-		0xBB, 0x00, 0x11, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x12, 0x01,
-		0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x15, 0x01, 0x03, 0x00, 0x01, 0x00,
-		0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x17, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x80,
-		0xBB, 0x00, 0x1C, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x31, 0x01,
-		0x02, 0x00, 0x12, 0x00, 0x00, 0x00, 0x24, 0x81, 0xBB, 0x00, 0x8D, 0x82, 0x03, 0x00, 0x02, 0x00,
-		0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x8E, 0x82, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x01,
-		0x01, 0x02, 0x12, 0xC6, 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x13, 0xC6,
-		0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x14, 0xC6, 0x02, 0x00, 0x07, 0x00,
-		0x00, 0x00, 0x36, 0x81, 0xBB, 0x00, 0x1D, 0xC6, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0xFF, 0x00,
-		0x00, 0x00, 0x5A, 0xC6, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x47, 0x72, 0x6F, 0x57, 0x69, 0x6E, 0x67, 0x73, 0x00, 0x00, 0x47, 0x72, 0x6F, 0x57,
-		0x69, 0x6E, 0x67, 0x73, 0x20, 0x63, 0x61, 0x6D, 0x65, 0x72, 0x61, 0x00, 0x67, 0x72, 0x6F, 0x77,
-		0x69, 0x6E, 0x67, 0x73, 0x2D, 0x72, 0x65, 0x63, 0x6F, 0x72, 0x64, 0x65, 0x72, 0x00, 0x47, 0x52,
-		0x57, 0x2D, 0x78, 0x31, 0x00 
-	};
-
-    if (out_file.write((const char*)HEADER, sizeof(HEADER)) &&
-        out_file.write((const char*)frame.data, frame.size) &&
-	    out_file.write((const char*)FOOTER, sizeof(FOOTER))) {
+auto dump_image(const std::filesystem::path& to, ImageBase frame) -> void {
+    // the header is built from the size of the frame, and only once for all the frames with the same size
+    static recording::DngWriter dng;
+    const camera::ImageView view{frame.size, frame.width, frame.height, frame.number, frame.data, camera::PixelFormat::RawRGGB8};
+    if (dng.write(to, view)) {
         std::cout << "successfully saved image of size " << frame.size << "[" << frame.width << " x " << frame.height << std::endl;
-        //LOG(INFO) << "successfully saved image to [" << to << "]" << ENDL;
     } else {
         std::cerr << "failed to save image\n";
     }
@@ -86,7 +59,6 @@ auto do_save(ImageBase image) -> void {
 
     if (image.data) {
         auto base = make_path / std::string{"image_number_" + std::to_string(image.number) + ".dng"};
-        std::ofstream output(base);
-        dump_image(output, image);
+        dump_image(base, image);
     }
 }
\ No newline at end of file
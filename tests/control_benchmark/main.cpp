@@ -0,0 +1,223 @@
+// Measure the round trip of the remote control commands (see control/control_server.hh).
+// Without an address, this is running its own control server, with a camera that is doing nothing, to measure the protocol and
+// passing the command to the thread of the camera, and with the first camera that we can open (real or simulated), to measure
+// setting the exposure through the server. With an address, this is measuring a running recorder (./recorder --control 5100),
+// with commands that are not changing anything. The requests are sent one at a time, and then pipelined, a few at a time. Without an
+// address, this is also checking that the requests that a slow camera rejected are answered in order with its other replies, and that
+// the server stops reading from a client that is not reading its replies, and then serves it when it does, for example:
+// SIMCAM_CAMERAS=1 ./control_benchmark 2000
+// ./control_benchmark 2000 192.168.1.20:5100
+// The numbers are in micro seconds per request.
+#include "control/control_server.hh"
+#include "control/control_client.hh"
+#include "camera_controller/camera.hh"
+#include "camera_controller/cameras_context.hh"
+#include <chrono>
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct Samples {
+    explicit Samples(std::string n) : name{std::move(n)} {
+    }
+
+    auto report() -> void {
+        if (values.empty()) {
+            std::cout << std::setw(36) << name << ": no samples" << std::endl;
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        const auto at = [this](double p) {
+            return values[std::min(values.size() - 1, static_cast<std::size_t>(p * values.size()))];
+        };
+        std::cout << std::fixed << std::setprecision(2) << std::setw(36) << name << ": requests " << values.size()
+            << ", mean " << std::accumulate(values.begin(), values.end(), 0.0) / values.size()
+            << ", p50 " << at(0.5) << ", p99 " << at(0.99) << ", max " << values.back() << std::endl;
+    }
+
+    std::string name;
+    std::vector<double> values;
+};
+
+// Send the requests in groups of depth, and wait for all the replies of the group, the time of each request is
+// from sending its group until its reply arrived
+auto measure(control::ControlClient& client, control::Command command, uint16_t camera, const std::string& payload, int count, int depth) -> bool {
+    std::ostringstream name;
+    name << command << " (camera " << camera << ", depth " << depth << ")";
+    Samples samples{name.str()};
+    const auto start{clock_type::now()};
+    for (int sent = 0; sent < count; sent += depth) {
+        const auto group{std::min(depth, count - sent)};
+        const auto at{clock_type::now()};
+        for (int i = 0; i < group; i++) {
+            if (control::send(client, command, camera, payload) == 0) {
+                return false;
+            }
+        }
+        for (int i = 0; i < group; i++) {
+            const auto reply{control::receive(client)};
+            if (!reply || reply->status != control::Status::Ok) {
+                std::cerr << "failed " << command << ": " << (reply ? reply->status : control::Status::Failed) << "\n";
+                return false;
+            }
+            samples.values.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - at).count());
+        }
+    }
+    const std::chrono::duration<double> elapsed{clock_type::now() - start};
+    samples.report();
+    std::cout << std::setw(36) << "" << "  " << static_cast<uint64_t>(count / elapsed.count()) << " requests per second" << std::endl;
+    return true;
+}
+
+auto benchmark(const std::string& address, uint16_t port, int count, const std::vector<std::pair<control::Command, std::string>>& commands, uint16_t cameras) -> bool {
+    auto client{control::connect(address, port)};
+    if (!client) {
+        return false;
+    }
+    const auto listed{control::call(*client, control::Command::Cameras, 0)};
+    if (!listed || listed->status != control::Status::Ok) {
+        std::cerr << "failed to list the cameras of the control server\n";
+        return false;
+    }
+    std::cout << "cameras:\n" << listed->payload << std::flush;
+    if (!measure(*client, control::Command::Ping, 0, {}, count, 1)) {
+        return false;
+    }
+    for (uint16_t camera = 0; camera < cameras; camera++) {
+        for (auto&& [command, payload] : commands) {
+            for (auto depth : {1, 8, 32}) {
+                if (!measure(*client, command, camera, payload, count, depth)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// A camera that is slower than the client, with a short queue, the requests that don't fit are rejected as busy,
+// and all the replies must still arrive in the order of the requests
+auto check_busy_order() -> bool {
+    constexpr int COUNT = 20;
+    std::vector<control::Target> targets{{"slow", [](const control::Request&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        return control::Reply{};
+    }}};
+    auto server{control::make_control_server(control::ControlSettings{.address = "127.0.0.1", .port = 0, .queue = 2}, std::move(targets), std::stop_token{})};
+    auto client{server ? control::connect("127.0.0.1", control::port(*server)) : nullptr};
+    if (!client) {
+        return false;
+    }
+    std::vector<uint32_t> sent;
+    for (int i = 0; i < COUNT; i++) {
+        sent.push_back(control::send(*client, control::Command::SetExposure, 0, control::encode(10000.0)));
+    }
+    int busy{0};
+    for (auto id : sent) {
+        const auto reply{control::receive(*client)};
+        if (!reply || reply->id != id) {
+            std::cerr << "expecting the reply to request " << id << ", got " << (reply ? reply->id : 0) << "\n";
+            return false;
+        }
+        busy += reply->status == control::Status::Busy ? 1 : 0;
+    }
+    control::stop(*server);
+    std::cout << "slow camera: " << busy << " of " << COUNT << " requests were busy, all the replies in order" << std::endl;
+    return busy > 0 && busy < COUNT;
+}
+
+// The replies to Cameras are large, so a client that is sending them without reading the replies is filling the socket
+// buffers and then the output of the server, that should stop reading from it until the replies are read
+auto check_slow_reader() -> bool {
+    constexpr int COUNT = 20000;
+    std::vector<control::Target> targets{{std::string(1000, 'c'), [](const control::Request&) { return control::Reply{}; }}};
+    auto server{control::make_control_server(control::ControlSettings{.address = "127.0.0.1", .port = 0}, std::move(targets), std::stop_token{})};
+    auto client{server ? control::connect("127.0.0.1", control::port(*server)) : nullptr};
+    if (!client) {
+        return false;
+    }
+    // this is blocking once the server stops reading, until we are reading the replies below
+    std::atomic<bool> sent{true};
+    std::jthread sender{[&] {
+        for (int i = 0; i < COUNT; i++) {
+            if (control::send(*client, control::Command::Cameras, 0) == 0) {
+                sent = false;
+                return;
+            }
+        }
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{500});
+    const auto throttled{control::statistics(*server).throttled};
+    for (int i = 0; i < COUNT; i++) {
+        if (const auto reply = control::receive(*client); !reply || reply->status != control::Status::Ok) {
+            std::cerr << "failed to read reply " << i << " of a client that was not reading its replies\n";
+            return false;
+        }
+    }
+    sender.join();
+    control::stop(*server);
+    std::cout << "slow reader: " << control::statistics(*server) << std::endl;
+    if (!sent || throttled == 0) {
+        std::cerr << "the server did not stop reading from a client that was not reading its replies\n";
+        return false;
+    }
+    return true;
+}
+
+}       // end of local namespace
+
+auto main(int argc, char** argv) -> int {
+    const auto count{std::max(1, argc > 1 ? std::atoi(argv[1]) : 1000)};
+    if (argc > 2) {
+        const std::string target{argv[2]};
+        const auto at{target.rfind(':')};
+        if (at == std::string::npos) {
+            std::cerr << "invalid address " << target << ", expecting <address>:<port>\n";
+            return -1;
+        }
+        // the statistics are passed to the thread of the camera, like any other command, but they are not changing the camera
+        const auto ok{benchmark(target.substr(0, at), static_cast<uint16_t>(std::atoi(target.c_str() + at + 1)), count,
+            {{control::Command::Statistics, {}}}, 1)};
+        return ok ? 0 : -1;
+    }
+
+    std::vector<control::Target> targets{{"nothing", [](const control::Request&) { return control::Reply{}; }}};
+    std::shared_ptr<camera::IdleCamera> camera;
+    auto devices_ctx{camera::make_context()};
+    if (std::holds_alternative<camera::context_type>(devices_ctx)) {
+        auto& ctx{std::get<camera::context_type>(devices_ctx)};
+        if (const auto devices = camera::enumerate(*ctx); !devices.empty() && (camera = camera::create(*ctx, devices.front()))) {
+            // only the thread of this camera in the server is using it
+            targets.push_back({devices.front().id, [&camera](const control::Request& request) {
+                const auto value{control::decode_double(request.payload)};
+                const auto ok{value && camera::set<camera::features::ExposureTime>(*camera, value.value())};
+                return control::Reply{.status = ok ? control::Status::Ok : control::Status::Failed, .payload = {}};
+            }});
+        }
+    }
+    if (!camera) {
+        std::cout << "no camera, only measuring the server" << std::endl;
+    }
+    const auto cameras{static_cast<uint16_t>(targets.size())};
+    auto server{control::make_control_server(control::ControlSettings{.address = "127.0.0.1", .port = 0}, std::move(targets), std::stop_token{})};
+    if (!server) {
+        return -1;
+    }
+    const auto ok{benchmark("127.0.0.1", control::port(*server), count, {{control::Command::SetExposure, control::encode(10000.0)}}, cameras) &&
+        check_busy_order() && check_slow_reader()};
+    control::stop(*server);
+    std::cout << "server: " << control::statistics(*server) << std::endl;
+    return ok ? 0 : -1;
+}
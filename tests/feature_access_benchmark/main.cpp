@@ -0,0 +1,195 @@
+// Measure how long it takes to change the camera settings, and to trigger the camera from software.
+// This is working with the first camera that we can open, and with either the real or the simulated cameras, for example:
+// SIMCAM_CAMERAS=1 ./feature_access_benchmark 2000
+// The numbers are in micro seconds per call. The same features are also accessed after dropping their cached handles, so they
+// are looked up by name as before they were cached, to compare the two.
+#include "camera_controller/camera.hh"
+#include "camera_controller/cameras_context.hh"
+#include "camera_controller/camera_profile.hh"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <cstdlib>
+
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+struct Samples {
+    explicit Samples(const char* n) : name{n} {
+
+    }
+
+    template<typename F>
+    auto measure(F&& f) -> bool {
+        const auto start{clock_type::now()};
+        const auto ok{f()};
+        values.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+        return ok;
+    }
+
+    auto report() -> void {
+        if (values.empty()) {
+            std::cout << std::setw(28) << name << ": no samples" << std::endl;
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        const auto at = [this](double p) {
+            return values[std::min(values.size() - 1, static_cast<std::size_t>(p * values.size()))];
+        };
+        std::cout << std::fixed << std::setprecision(2) << std::setw(28) << name << ": calls " << values.size()
+            << ", mean " << std::accumulate(values.begin(), values.end(), 0.0) / values.size()
+            << ", p50 " << at(0.5) << ", p99 " << at(0.99) << ", max " << values.back() << std::endl;
+    }
+
+    const char* name{nullptr};
+    std::vector<double> values;
+};
+
+auto settings_benchmark(camera::IdleCamera& camera, int count) -> bool {
+    Samples exposure{"manual exposure (3 writes)"};
+    Samples white_balance{"white balance (1 write)"};
+    Samples frame_size{"frame size (1 read)"};
+    Samples exposure_time{"exposure time (typed write)"};
+    for (int i = 0; i < count; i++) {
+        if (!(exposure.measure([&]() { return camera::manual_exposure(camera, 10000.0 + i % 100); }) &&
+                white_balance.measure([&]() { return camera::set_auto_whitebalance(camera, i % 2 == 0, false); }) &&
+                frame_size.measure([&]() { return camera::get_frame_size(camera).has_value(); }) &&
+                exposure_time.measure([&]() { return camera::set<camera::features::ExposureTime>(camera, 10000.0 + i % 100); }))) {
+            std::cerr << "failed to access the camera settings at iteration " << i << "\n";
+            return false;
+        }
+    }
+    exposure.report();
+    white_balance.report();
+    frame_size.report();
+    exposure_time.report();
+    return true;
+}
+
+// Each feature is looked up by name, and then accessed again with the handle that is now cached
+auto lookup_benchmark(camera::IdleCamera& camera, int count) -> bool {
+    Samples write_by_name{"exposure time (by name)"};
+    Samples write_cached{"exposure time (cached)"};
+    Samples read_by_name{"frame size (by name)"};
+    Samples read_cached{"frame size (cached)"};
+    for (int i = 0; i < count; i++) {
+        camera::forget_features(camera);
+        if (!(write_by_name.measure([&]() { return camera::set<camera::features::ExposureTime>(camera, 10000.0 + i % 100); }) &&
+                write_cached.measure([&]() { return camera::set<camera::features::ExposureTime>(camera, 10000.0 + i % 100); }) &&
+                read_by_name.measure([&]() { return camera::get_frame_size(camera).has_value(); }) &&
+                read_cached.measure([&]() { return camera::get_frame_size(camera).has_value(); }))) {
+            std::cerr << "failed to access the camera features at iteration " << i << "\n";
+            return false;
+        }
+    }
+    write_by_name.report();
+    write_cached.report();
+    read_by_name.report();
+    read_cached.report();
+    return true;
+}
+
+// Applying the same profile again should not write anything to the camera
+auto profile_benchmark(camera::IdleCamera& camera, int count) -> bool {
+    const auto target{camera::default_software_profile(camera::ActivationMode::RisingEdge)};
+    const auto first{camera::configure(camera, target)};
+    std::cout << "first profile apply: " << first << std::endl;
+    if (!first.ok) {
+        return false;
+    }
+    Samples again{"profile apply (no change)"};
+    std::size_t writes{0};
+    for (int i = 0; i < count; i++) {
+        if (!again.measure([&]() {
+                    const auto report{camera::configure(camera, target)};
+                    writes += report.writes;
+                    return report.ok;
+                })) {
+            std::cerr << "failed to apply the profile at iteration " << i << "\n";
+            return false;
+        }
+    }
+    again.report();
+    std::cout << "writes while applying the same profile " << count << " times: " << writes << std::endl;
+    return true;
+}
+
+auto trigger_benchmark(std::shared_ptr<camera::IdleCamera>& camera, int count) -> bool {
+    std::atomic<uint64_t> received{0};
+    std::stop_source stop_source;
+    auto ctx{camera::make_software_context(*camera, [&received](camera::ImageView) {
+        ++received;
+        received.notify_all();
+        return true;
+    }, stop_source.get_token(), camera::DEFAULT_NUMBER_OF_BUFFERS)};
+    if (!ctx) {
+        std::cerr << "failed to create software trigger context\n";
+        return false;
+    }
+    auto cc{camera::From(std::move(camera))};
+    Samples trigger{"software trigger call"};
+    Samples round_trip{"trigger to frame"};
+    for (int i = 0; i < count; i++) {
+        const auto before{received.load()};
+        const auto start{clock_type::now()};
+        if (!trigger.measure([&]() { return camera::async_software_capture_one(*ctx, *cc); })) {
+            std::cerr << "failed to trigger the camera at iteration " << i << "\n";
+            break;
+        }
+        const auto deadline{start + 1s};
+        while (received.load() == before && clock_type::now() < deadline) {
+            std::this_thread::yield();
+        }
+        if (received.load() == before) {
+            std::cerr << "no frame for the trigger at iteration " << i << "\n";
+            continue;
+        }
+        round_trip.values.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+    }
+    trigger.report();
+    round_trip.report();
+    if (!camera::stop_acquisition(*ctx, *cc)) {
+        std::cerr << "failed to stop the acquisition\n";
+    }
+    ctx.reset();
+    camera = camera::Back(std::move(cc));
+    return !trigger.values.empty();
+}
+
+auto main(int argc, char** argv) -> int {
+    const auto count{argc > 1 ? std::atoi(argv[1]) : 1000};
+    auto devices_ctx{camera::make_context()};
+    if (std::holds_alternative<camera::error_type>(devices_ctx)) {
+        std::cerr << "failed to create device context: " << std::get<camera::error_type>(devices_ctx) << "\n";
+        return -1;
+    }
+
+    auto& ctx{std::get<camera::context_type>(devices_ctx)};  // this is safe now
+
+    const auto devices{camera::enumerate(*ctx.get())};
+    if (devices.empty()) {
+        std::cerr << "no device was detected\n";
+        return -1;
+    }
+    auto camera{camera::create(*ctx, devices.front())};
+    if (!camera) {
+        std::cerr << "failed to open " << devices.front() << "\n";
+        return -1;
+    }
+    std::cout << "running " << count << " iterations on " << devices.front().id << std::endl;
+    if (!(settings_benchmark(*camera, count) && lookup_benchmark(*camera, count) && profile_benchmark(*camera, count))) {
+        return -1;
+    }
+    std::cout << camera::feature_statistics(*camera) << std::endl;
+    const auto ok{trigger_benchmark(camera, count / 10 + 1)};
+    for (auto&& cs : camera::command_statistics()) {
+        std::cout << cs << std::endl;
+    }
+    return ok ? 0 : -1;
+}
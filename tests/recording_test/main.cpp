@@ -0,0 +1,722 @@
+// Write frames into the recording segments and read them back, this is not using any camera.
+// The frames are generated here, so that the content of each frame that is read back can be verified.
+// The frames are written with each one of the disk IO modes, and the time it takes is compared with
+// writing the same frames as a file per frame. The Bayer codec is checked with frames that look like a real
+// sensor (smooth planes with noise), and with noise only, that cannot be compressed. In the simulation build, the receive status
+// in the metadata is also checked with frames from a simulated camera. The last argument is the frame size, use 4096x3000 to
+// size the disks for the real cameras, for example:
+// ./recording_test /data/recording_test 300 4096x3000
+#include "recording/segment_writer.hh"
+#include "recording/segment_reader.hh"
+#include "recording/frame_ring.hh"
+#include "recording/dng_writer.hh"
+#include "recording/replay.hh"
+#include "recording/bayer_codec.hh"
+#include "recording/governor.hh"
+#include "recording/metadata.hh"
+#include "recording/striped_writer.hh"
+#ifdef BUILD_WITH_SIMULATED_CAMERA
+#include "camera_controller/camera.hh"
+#include "camera_controller/simulator/simulation.hh"
+#endif
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr uint64_t FRAME_TIME = 33'333'333;        // nanoseconds, about 30 FPS
+
+struct Frames {
+    Frames(std::size_t c, uint32_t w, uint32_t h) : data(std::size_t{w} * h), count{c}, width{w}, height{h} {
+    }
+
+    // every frame is a bit different, so that we can tell them apart when reading back
+    auto at(std::size_t i) -> camera::ImageView {
+        for (std::size_t j = 0; j < data.size(); j += 4096) {
+            data[j] = static_cast<uint8_t>(i + j);
+        }
+        // skip a frame from time to time, as the camera would
+        const auto number{i + i / 100};
+        camera::ImageView image{static_cast<uint32_t>(data.size()), width, height, number, data.data(), camera::PixelFormat::RawRGGB8, number * FRAME_TIME};
+        image.arrived = number * FRAME_TIME + 1'000'000;
+        image.exposure = static_cast<float>(1000 + i % 10);
+        image.gain = static_cast<float>(i % 3);
+        image.status = i % 50 == 49 ? camera::ReceiveStatus::Incomplete : camera::ReceiveStatus::Complete;
+        return image;
+    }
+
+    std::vector<uint8_t> data;
+    std::size_t count;
+    uint32_t width;
+    uint32_t height;
+};
+
+auto same(const camera::Image& image, const camera::ImageView& expected) -> bool {
+    if (image.number != expected.number || image.timestamp != expected.timestamp || image.size() != expected.size ||
+            image.width != expected.width || image.height != expected.height || image.type != expected.type) {
+        return false;
+    }
+    return std::equal(image.data.begin(), image.data.end(), expected.data);
+}
+
+auto seconds_since(clock_type::time_point start) -> double {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+auto write_segments(const std::filesystem::path& to, Frames& frames, const recording::SegmentSettings& settings) -> bool {
+    recording::SegmentWriter writer;
+    if (!writer.open(to, "test", settings)) {
+        return false;
+    }
+    const auto start{clock_type::now()};
+    for (std::size_t i = 0; i < frames.count; i++) {
+        if (!writer.write(frames.at(i))) {
+            std::cerr << "failed to write frame " << i << "\n";
+            return false;
+        }
+    }
+    if (!writer.close()) {
+        return false;
+    }
+    ::sync();
+    const auto took{seconds_since(start)};
+    std::cout << settings.io << (settings.io == recording::DiskIo::Direct && !settings.direct.use_uring ? " (threads)" : "")
+        << " segments: " << frames.count << " frames into " << writer.segments() << " segments, "
+        << writer.size() / took / (1024.0 * 1024.0) << " MB/s, " << took * 1e6 / frames.count << "us per frame" << std::endl;
+    if (const auto io = writer.io_statistics(); io) {
+        std::cout << "\t" << io.value() << std::endl;
+    }
+    if (const auto codec = writer.codec_statistics(); codec) {
+        std::cout << "\t" << codec.value() << std::endl;
+    }
+    return true;
+}
+
+// This is how the frames were saved before, for comparison
+auto write_files(const std::filesystem::path& to, Frames& frames) -> void {
+    std::filesystem::create_directories(to);
+    const auto start{clock_type::now()};
+    for (std::size_t i = 0; i < frames.count; i++) {
+        const auto frame{frames.at(i)};
+        std::ofstream output(to / ("image_number_" + std::to_string(frame.number) + ".raw"));
+        output.write(reinterpret_cast<const char*>(frame.data), frame.size);
+    }
+    ::sync();
+    const auto took{seconds_since(start)};
+    std::cout << "file per frame: " << frames.count << " frames, " << frames.count * frames.data.size() / took / (1024.0 * 1024.0)
+        << " MB/s, " << took * 1e6 / frames.count << "us per frame" << std::endl;
+}
+
+auto read_segments(const std::filesystem::path& from, Frames& frames) -> bool {
+    const auto segments{recording::list_segments(from)};
+    std::size_t next{0};
+    camera::Image image;
+    for (auto&& path : segments) {
+        recording::SegmentReader reader;
+        if (!reader.open(path) || reader.recovered()) {
+            std::cerr << "failed to read the index of " << path << "\n";
+            return false;
+        }
+        for (std::size_t i = 0; i < reader.size(); i++, next++) {
+            if (!reader.read(i, image) || !same(image, frames.at(next))) {
+                std::cerr << "frame " << next << " in " << path << " is not the frame that was written\n";
+                return false;
+            }
+        }
+        // find in the middle of the segment, by number and by time
+        const auto middle{frames.at(next - reader.size() / 2)};
+        const auto by_number{reader.find(middle.number)};
+        const auto by_time{reader.find_time(middle.timestamp - FRAME_TIME / 2)};
+        if (!by_number || !by_time || by_number != by_time || !reader.read(by_number.value(), image) || !same(image, middle)) {
+            std::cerr << "failed to find frame number " << middle.number << " in " << path << "\n";
+            return false;
+        }
+    }
+    std::cout << "read back " << next << " frames from " << segments.size() << " segments" << std::endl;
+    return next == frames.count;
+}
+
+// A segment that was not closed is missing its index
+auto read_unclosed(const std::filesystem::path& from, Frames& frames) -> bool {
+    const auto segments{recording::list_segments(from)};
+    if (segments.empty()) {
+        return false;
+    }
+    const auto path{segments.back()};
+    recording::SegmentReader reader;
+    if (!reader.open(path)) {
+        return false;
+    }
+    const auto count{reader.size()};
+    const auto first{reader.index().front().offset};
+    reader.close();
+    // cut the index, and half of the last frame
+    std::filesystem::resize_file(path, first + (count - 1) * (sizeof(recording::FrameHeader) + frames.data.size()) + frames.data.size() / 2);
+    if (!reader.open(path) || !reader.recovered() || reader.size() != count - 1) {
+        std::cerr << "failed to rebuild the index of " << path << ", found " << reader.size() << " frames instead of " << count - 1 << "\n";
+        return false;
+    }
+    std::cout << "rebuilt the index of the segment that was not closed, with " << reader.size() << " frames" << std::endl;
+    return true;
+}
+
+// Read all the segments through the memory mappings, and play them as if they were coming from a camera.
+// This is after the last segment was cut by read_unclosed, so its last frame is missing.
+auto check_replay(const std::filesystem::path& from, Frames& frames) -> bool {
+    auto reader{std::make_shared<recording::RecordingReader>()};
+    if (!reader->open(from) || reader->size() != frames.count - 1) {
+        std::cerr << "failed to read the recording from " << from << "\n";
+        return false;
+    }
+    for (std::size_t i = 0; i < reader->size(); i++) {
+        const auto expected{frames.at(i)};
+        if (!same(camera::Image{reader->at(i)}, expected) || reader->find(expected.number) != i ||
+                reader->find_time(expected.timestamp) != i || (i > 0 && reader->find_time(expected.timestamp - FRAME_TIME / 2) != i)) {
+            std::cerr << "frame " << i << " is not found in the mapped recording\n";
+            return false;
+        }
+    }
+    // the frames that were skipped
+    if (reader->find(100) || !reader->find(101) || reader->find_time(frames.at(frames.count - 1).timestamp)) {
+        std::cerr << "found frames that were not recorded\n";
+        return false;
+    }
+    std::stop_source stop_source;
+    std::size_t next{0};
+    auto in_order = [&next, &frames](camera::ImageView image) {
+        return image.number == frames.at(next++).number;
+    };
+    // as fast as possible, with the frames in order, and then stop in the middle
+    auto replay{recording::make_replay(reader, in_order, stop_source.get_token(), recording::ReplaySettings{.timing = recording::ReplayTiming::MaxSpeed})};
+    recording::wait(*replay);
+    const auto fast{recording::statistics(*replay)};
+    std::cout << fast << std::endl;
+    next = 0;
+    replay = recording::make_replay(reader, [&next](camera::ImageView) { return ++next < 5; }, stop_source.get_token(), recording::ReplaySettings{.timing = recording::ReplayTiming::MaxSpeed});
+    recording::wait(*replay);
+    if (fast.frames != reader->size() || next != 5 || recording::statistics(*replay).frames != 5) {
+        std::cerr << "the replay did not pass the frames in order\n";
+        return false;
+    }
+    // at 10 times the original speed, this should take a 10th of the time between the first and the last frame
+    constexpr double SPEED = 10;
+    const std::size_t count{std::min<std::size_t>(reader->size(), 30)};
+    next = 0;
+    replay = recording::make_replay(reader, in_order, stop_source.get_token(),
+        recording::ReplaySettings{.timing = recording::ReplayTiming::Original, .speed = SPEED, .from = 0, .count = count, .loop = false});
+    recording::wait(*replay);
+    const auto timed{recording::statistics(*replay)};
+    const std::chrono::microseconds expected{static_cast<int64_t>((reader->at(count - 1).timestamp - reader->at(0).timestamp) / SPEED / 1000)};
+    std::cout << timed << ", expected " << expected.count() << "us" << std::endl;
+    return timed.frames == count && timed.elapsed >= expected && timed.elapsed < expected + std::chrono::milliseconds{50};
+}
+
+// Each one of the 4 planes is smooth, and they are at different levels, as with a real scene behind a color filter.
+// The noise is the number of levels that are random in each pixel, 256 for noise only.
+auto sensor_frame(uint32_t width, uint32_t height, unsigned noise, camera::PixelFormat format, std::vector<uint8_t>& data) -> camera::ImageView {
+    data.resize(std::size_t{width} * height);
+    uint32_t seed{12345};
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            seed = seed * 1664525 + 1013904223;
+            const auto plane{(y % 2) * 2 + x % 2};
+            const auto level{(x + y) / 16 + plane * 40 + (seed >> 24) % noise};
+            data[std::size_t{y} * width + x] = static_cast<uint8_t>(level);
+        }
+    }
+    return camera::ImageView{static_cast<uint32_t>(data.size()), width, height, 1, data.data(), format, FRAME_TIME};
+}
+
+auto round_trip(recording::BayerCodec& codec, const camera::ImageView& image, std::vector<uint8_t>& compressed) -> bool {
+    if (!codec.encode(image, compressed)) {
+        std::cerr << "failed to encode a " << image.width << "x" << image.height << " frame of " << image.type << "\n";
+        return false;
+    }
+    std::vector<uint8_t> single(image.size), threads(image.size);
+    if (recording::decoded_size(compressed.data(), compressed.size()) != image.size ||
+            !recording::bayer_decode(compressed.data(), compressed.size(), single.data(), single.size()) ||
+            !codec.decode(compressed.data(), compressed.size(), threads.data(), threads.size()) ||
+            !std::equal(single.begin(), single.end(), image.data) || single != threads) {
+        std::cerr << "the decoded " << image.width << "x" << image.height << " frame of " << image.type << " is not the original frame\n";
+        return false;
+    }
+    return true;
+}
+
+auto check_codec(const std::filesystem::path& to, Frames& frames) -> bool {
+    // more threads than tiles in some of the frames
+    auto codec{recording::BayerCodec::make(recording::CodecSettings{.threads = 4, .tile_rows = 16})};
+    if (!codec) {
+        return false;
+    }
+    std::vector<uint8_t> data, compressed;
+    for (auto format : {camera::PixelFormat::RawRGGB8, camera::PixelFormat::RawGR8, camera::PixelFormat::RawGB8, camera::PixelFormat::RawBG8, camera::PixelFormat::Mono8}) {
+        if (!round_trip(*codec, sensor_frame(frames.width, frames.height, 6, format, data), compressed)) {
+            return false;
+        }
+    }
+    // the last tile is shorter, and the tiles of noise are stored as they are
+    const auto before{codec->statistics().stored_tiles};
+    if (!round_trip(*codec, sensor_frame(frames.width, 70, 6, camera::PixelFormat::RawRGGB8, data), compressed) ||
+            !round_trip(*codec, sensor_frame(frames.width, frames.height, 256, camera::PixelFormat::RawRGGB8, data), compressed) ||
+            codec->statistics().stored_tiles == before || compressed.size() > data.size() + 4096) {
+        std::cerr << "the frame of noise was not stored as is\n";
+        return false;
+    }
+    // these are not supported
+    const auto odd{sensor_frame(frames.width - 1, frames.height, 6, camera::PixelFormat::RawRGGB8, data)};
+    std::vector<uint8_t> output(data.size());
+    if (codec->encode(odd, compressed) || codec->encode(camera::ImageView{odd.size, odd.width, odd.height, 1, odd.data, camera::PixelFormat::Mono10}, compressed)) {
+        std::cerr << "encoded a frame that is not supported\n";
+        return false;
+    }
+    // a frame that was cut
+    const auto image{sensor_frame(frames.width, frames.height, 6, camera::PixelFormat::RawRGGB8, data)};
+    if (!codec->encode(image, compressed) || recording::bayer_decode(compressed.data(), compressed.size() / 2, output.data(), image.size)) {
+        std::cerr << "decoded a frame that was cut\n";
+        return false;
+    }
+    // the speed, with a single thread and with all of them
+    constexpr std::size_t TIMES = 10;
+    for (std::size_t threads : {std::size_t{1}, std::size_t{0}}) {
+        auto timed{recording::BayerCodec::make(recording::CodecSettings{.threads = threads})};
+        for (std::size_t i = 0; i < TIMES; i++) {
+            (void)timed->encode(image, compressed);
+        }
+        std::cout << timed->statistics() << std::endl;
+    }
+    // and in the segments, read back with the segment reader, and with the memory mappings
+    auto settings{recording::SegmentSettings{.max_size = uint64_t{16} * 1024 * 1024, .max_duration = std::chrono::seconds{0}}};
+    settings.compression = recording::Compression::Bayer;
+    if (!write_segments(to, frames, settings) || !read_segments(to, frames)) {
+        return false;
+    }
+    recording::RecordingReader reader;
+    camera::Image decoded;
+    if (!reader.open(to) || reader.size() != frames.count) {
+        return false;
+    }
+    for (std::size_t i = 0; i < reader.size(); i++) {
+        if (reader.compression(i) != recording::Compression::Bayer || !reader.read(i, decoded) || !same(decoded, frames.at(i))) {
+            std::cerr << "frame " << i << " is not the frame that was compressed\n";
+            return false;
+        }
+    }
+    std::filesystem::remove_all(to);
+    return true;
+}
+
+auto same(const recording::FrameMetadata& meta, const camera::ImageView& expected) -> bool {
+    return meta.number == expected.number && meta.timestamp == expected.timestamp && meta.arrived == expected.arrived &&
+        meta.exposure == expected.exposure && meta.gain == expected.gain && meta.status == expected.status;
+}
+
+#ifdef BUILD_WITH_SIMULATED_CAMERA
+// The frames that were not received in full are passed on by the camera with their status, and this is what is written
+// to the metadata, with a simulated camera that is missing some of the packets of each frame
+auto record_incomplete_frames(const std::filesystem::path& path) -> bool {
+    constexpr std::size_t FRAMES = 10;
+    auto created{camera::make_simulated_context(camera::simulator::Settings{.cameras = 1, .width = 64, .height = 48, .fps = 200.0, .incomplete_rate = 1.0})};
+    if (!std::holds_alternative<camera::context_type>(created)) {
+        std::cerr << "failed to start the simulated camera: " << std::get<camera::error_type>(created) << "\n";
+        return false;
+    }
+    auto& ctx{std::get<camera::context_type>(created)};
+    const auto devices{camera::enumerate(*ctx)};
+    auto idle{devices.empty() ? nullptr : camera::create(*ctx, devices.front())};
+    recording::MetadataWriter writer;
+    if (!idle || !writer.open(path, "incomplete")) {
+        return false;
+    }
+    std::atomic<std::size_t> written{0};
+    std::stop_source stop_source;
+    auto cc{camera::From(std::move(idle))};
+    // only the thread of the camera is writing, and it stops after the frames that we need
+    auto capture{camera::make_async_context(*cc, [&](camera::ImageView image) {
+        if (writer.append(recording::FrameMetadata{image, 0, 0, image.size})) {
+            ++written;
+        }
+        return written < FRAMES;
+    }, stop_source.get_token())};
+    if (!capture || !camera::async_capture(*capture, *cc, camera::DEFAULT_NUMBER_OF_BUFFERS)) {
+        return false;
+    }
+    for (const auto deadline{clock_type::now() + std::chrono::seconds{5}}; written < FRAMES && clock_type::now() < deadline; ) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    stop_source.request_stop();
+    capture.reset();
+    (void)camera::Back(std::move(cc));
+    writer.close();
+    recording::MetadataReader meta;
+    if (!meta.open(path) || meta.size() < FRAMES) {
+        std::cerr << "got " << written << " frames from the simulated camera, expecting " << FRAMES << "\n";
+        return false;
+    }
+    const auto statuses{meta.column<uint32_t>(recording::Column::Status, 0)};
+    if (!std::all_of(statuses.begin(), statuses.end(), [](auto s) { return s == static_cast<uint32_t>(camera::ReceiveStatus::Incomplete); })) {
+        std::cerr << "the frames that the simulated camera did not deliver in full are not marked as incomplete in the metadata\n";
+        return false;
+    }
+    return true;
+}
+#endif
+
+// The metadata that was written with the segments, and a file with a few blocks
+auto check_metadata(const std::filesystem::path& from, Frames& frames) -> bool {
+    recording::MetadataReader meta;
+    if (!meta.open(from / recording::metadata_name("test")) || meta.size() != frames.count) {
+        std::cerr << "failed to read the metadata of " << frames.count << " frames from " << from << "\n";
+        return false;
+    }
+    std::size_t next{0};
+    for (auto&& path : recording::list_segments(from)) {
+        recording::SegmentReader reader;
+        if (!reader.open(path)) {
+            return false;
+        }
+        for (auto&& entry : reader.index()) {
+            const auto m{meta.at(next)};
+            if (!same(m, frames.at(next)) || m.offset != entry.offset || m.size != entry.size || m.segment != reader.header().sequence) {
+                std::cerr << "the metadata of frame " << next << " is not matching the frame: " << m << "\n";
+                return false;
+            }
+            ++next;
+        }
+    }
+    const auto exposures{meta.column<float>(recording::Column::Exposure, 0)};
+    const auto incomplete{std::count(meta.column<uint32_t>(recording::Column::Status, 0).begin(), meta.column<uint32_t>(recording::Column::Status, 0).end(),
+        static_cast<uint32_t>(camera::ReceiveStatus::Incomplete))};
+    if (exposures.size() != frames.count || exposures[7] != frames.at(7).exposure || incomplete != static_cast<long>(frames.count / 50) ||
+            !meta.column<uint32_t>(recording::Column::Number, 0).empty()) {
+        std::cerr << "the columns of the metadata are not matching the frames\n";
+        return false;
+    }
+    constexpr std::size_t COUNT = recording::METADATA_BLOCK * 2 + 100;
+    const auto path{from / "blocks.meta"};
+    {
+        recording::MetadataWriter writer;
+        if (!writer.open(path, "blocks")) {
+            return false;
+        }
+        for (std::size_t i = 0; i < COUNT; i++) {
+            if (!writer.append(recording::FrameMetadata{frames.at(i % frames.count), 0, i * 100, 100})) {
+                return false;
+            }
+        }
+    }
+    const auto start{clock_type::now()};
+    if (!meta.open(path) || meta.size() != COUNT || meta.blocks() != 3) {
+        std::cerr << "failed to read back " << COUNT << " frames of metadata\n";
+        return false;
+    }
+    uint64_t total{0};
+    std::size_t scanned{0};
+    for (std::size_t b = 0; b < meta.blocks(); b++) {
+        for (auto offset : meta.column<uint64_t>(recording::Column::Offset, b)) {
+            total += offset;
+            ++scanned;
+        }
+    }
+    std::cout << "metadata: " << meta.size() << " frames in " << meta.blocks() << " blocks, scanned a column in " << seconds_since(start) * 1e6 << "us" << std::endl;
+    if (scanned != COUNT || total != (COUNT - 1) * COUNT / 2 * 100 || !same(meta.at(COUNT - 1), frames.at((COUNT - 1) % frames.count))) {
+        return false;
+    }
+#ifdef BUILD_WITH_SIMULATED_CAMERA
+    return record_incomplete_frames(from / "incomplete.meta");
+#else
+    return true;
+#endif
+}
+
+// Write the frames to 3 volumes from a thread for each volume, as the recorder is doing, and read them back
+// from the directory of the recording as a single recording, in order
+auto check_striping(const std::filesystem::path& to, Frames& frames, recording::Striping striping) -> bool {
+    constexpr std::size_t VOLUMES = 3;
+    std::vector<std::filesystem::path> volumes;
+    for (std::size_t v = 0; v < VOLUMES; v++) {
+        volumes.push_back(to / ("volume" + std::to_string(v)));
+    }
+    const auto directory{to / "recording"};
+    recording::StripedWriter writer;
+    if (!writer.open(volumes, directory, "test", recording::SegmentSettings{.max_size = uint64_t{16} * 1024 * 1024, .preallocate = false}, striping)) {
+        return false;
+    }
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::jthread> threads;
+    for (std::size_t v = 0; v < VOLUMES; v++) {
+        threads.emplace_back([&] {
+            Frames mine{frames.count, frames.width, frames.height};     // the frames are generated into the same buffer
+            for (auto i = next++; i < frames.count; i = next++) {
+                if (!writer.write(mine.at(i))) {
+                    failed = true;
+                }
+            }
+        });
+    }
+    threads.clear();
+    const auto stats{writer.statistics()};
+    const auto segments{writer.segments()};
+    if (failed || !writer.close()) {
+        std::cerr << "failed to write the frames to " << VOLUMES << " volumes\n";
+        return false;
+    }
+    std::cout << striping << " striping, " << frames.count << " frames into " << segments << " segments:" << std::endl;
+    for (auto&& v : stats) {
+        std::cout << "\t" << v << std::endl;
+        if (v.frames == 0 || v.capacity == 0) {
+            std::cerr << "nothing was written to the volume " << v.directory << "\n";
+            return false;
+        }
+    }
+    recording::RecordingReader reader;
+    if (!reader.open(directory) || reader.size() != frames.count) {
+        std::cerr << "failed to read the striped recording from " << directory << ", found " << reader.size() << " frames\n";
+        return false;
+    }
+    camera::Image image;
+    for (std::size_t i = 0; i < frames.count; i++) {
+        const auto expected{frames.at(i)};
+        if (!reader.read(i, image) || !same(image, expected) || reader.find(expected.number) != i) {
+            std::cerr << "frame " << i << " is not in its place in the striped recording\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Step through the default policy as the writer is falling behind, and back once it is keeping up
+auto check_governor() -> bool {
+    recording::Governor governor{"test", recording::GovernorSettings{.enabled = true}};
+    const auto start{clock_type::now()};
+    const auto at = [start](int ms) {
+        return start + std::chrono::milliseconds{ms};
+    };
+    using namespace std::chrono_literals;
+    const recording::Pressure calm{.depth = 0, .capacity = 8, .write = 10ms, .frame_time = 33ms, .dropped = 0};
+    auto queue{calm};
+    queue.depth = 4;
+    auto dropped{calm};
+    dropped.dropped = 1;
+    auto slow{calm};
+    slow.write = 32ms;
+    auto between{calm};
+    between.depth = 2;
+    const auto expect = [&governor](std::size_t step, const char* when) {
+        if (governor.step() != step) {
+            std::cerr << "the governor is at step " << governor.step() << " instead of " << step << " " << when << "\n";
+            return false;
+        }
+        return true;
+    };
+    auto success{governor.update(calm, at(0)) == 0 && governor.keep_preview(1) && governor.keep_recorded(4) && !governor.compress()};
+    success = success && governor.update(queue, at(250)) == 1 && expect(1, "when the queue is filling up") &&
+        !governor.keep_preview(1) && governor.keep_preview(4) && governor.keep_recorded(4);
+    success = success && governor.update(dropped, at(500)) == 2 && expect(2, "when frames were dropped") &&
+        !governor.keep_recorded(4) && governor.keep_recorded(5) && !governor.compress();
+    success = success && governor.update(slow, at(750)) == 3 && governor.compress() && governor.update(slow, at(1000)) == 3;
+    // it must be calm for the recovery time before each step back, and anything in between is starting again
+    success = success && governor.update(calm, at(1250)) == 3 && governor.update(calm, at(4000)) == 3 &&
+        governor.update(between, at(4100)) == 3 && governor.update(calm, at(4200)) == 3 && governor.update(calm, at(7200)) == 2 &&
+        governor.update(calm, at(10000)) == 2 && governor.update(calm, at(10200)) == 1 && expect(1, "after it was calm");
+    const auto stats{governor.statistics()};
+    std::cout << stats << std::endl;
+    return success && stats.raised == 3 && stats.lowered == 2 && stats.max_step == 3 && stats.recorded_skipped == 1 && stats.preview_skipped == 1;
+}
+
+// Keep the last frames in memory, and read them from some point in time
+auto check_ring(Frames& frames) -> bool {
+    constexpr std::size_t CAPACITY = 16;
+    auto ring{recording::FrameRing::make(CAPACITY, frames.data.size())};
+    if (!ring) {
+        return false;
+    }
+    const auto start{clock_type::now()};
+    const auto arrived = [start](std::size_t i) {
+        return start + std::chrono::nanoseconds{i * FRAME_TIME};
+    };
+    // more than the ring can hold, so the first frames are overwritten
+    constexpr std::size_t BEFORE = CAPACITY * 2;
+    for (std::size_t i = 0; i < BEFORE; i++) {
+        if (!ring->push(frames.at(i), arrived(i))) {
+            std::cerr << "failed to push frame " << i << " into the ring\n";
+            return false;
+        }
+    }
+    // the last 5 frames before the "event"
+    constexpr std::size_t WINDOW = 5;
+    if (const auto waiting = ring->pin(arrived(BEFORE - WINDOW)); waiting != WINDOW) {
+        std::cerr << "expecting " << WINDOW << " frames in the window before the event, but there are " << waiting << "\n";
+        return false;
+    }
+    // while the reader is behind, the ring is filling up, and then the new frames are dropped
+    std::size_t pushed{0};
+    while (ring->push(frames.at(BEFORE + pushed), arrived(BEFORE + pushed))) {
+        ++pushed;
+    }
+    if (pushed != CAPACITY - WINDOW) {
+        std::cerr << "pushed " << pushed << " frames into the ring after it was pinned, expecting " << CAPACITY - WINDOW << "\n";
+        return false;
+    }
+    camera::Image image;
+    for (std::size_t i = BEFORE - WINDOW; i < BEFORE + pushed; i++) {
+        const auto frame{ring->next()};
+        if (!frame) {
+            std::cerr << "missing frame " << i << " in the ring\n";
+            return false;
+        }
+        image = camera::Image{frame->image};
+        if (!same(image, frames.at(i)) || frame->arrived != arrived(i)) {
+            std::cerr << "frame " << i << " in the ring is not the frame that was pushed\n";
+            return false;
+        }
+        ring->release();
+    }
+    ring->unpin();
+    const auto stats{ring->statistics()};
+    std::cout << stats << std::endl;
+    return !ring->next() && stats.dropped == 1 && stats.overwritten == BEFORE + pushed - CAPACITY;
+}
+
+// Read back the tags of a DNG file that we wrote, each one is its first value (all we need here)
+auto read_dng(const std::filesystem::path& from, std::vector<uint8_t>& content) -> std::map<uint16_t, uint32_t> {
+    std::ifstream input(from, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    std::map<uint16_t, uint32_t> tags;
+    const auto read = [&content](std::size_t at, std::size_t size) -> uint32_t {
+        uint32_t value{0};
+        if (at + size <= content.size()) {
+            std::memcpy(&value, content.data() + at, size);
+        }
+        return value;
+    };
+    if (content.size() < 8 || read(0, 4) != 0x002A4949) {
+        return tags;
+    }
+    const auto ifd{read(4, 4)};
+    const auto count{read(ifd, 2)};
+    for (uint32_t i = 0; i < count; i++) {
+        const auto entry{ifd + 2 + i * 12};
+        const auto type{read(entry + 2, 2)};
+        const auto values{read(entry + 4, 4)};
+        const std::size_t size{type == 3 ? 2u : (type == 4 ? 4u : (type == 10 ? 8u : 1u))};
+        // the value is either in the entry, or at the offset in the entry
+        const auto at{size * values > 4 ? read(entry + 8, 4) : entry + 8};
+        tags[read(entry, 2)] = type == 1 || type == 2 ? read(at, std::min<std::size_t>(values, 4)) : read(at, std::min<std::size_t>(size, 4));
+    }
+    return tags;
+}
+
+// Save the frames in each of the formats, and check that what we read back is the same frame
+auto check_dng(const std::filesystem::path& to, Frames& frames) -> bool {
+    std::filesystem::create_directories(to);
+    recording::DngWriter dng;
+    std::vector<uint8_t> content;
+    const std::pair<camera::PixelFormat, uint32_t> patterns[] = {     // the CFA pattern, as the 4 bytes in a little endian value
+        {camera::PixelFormat::RawRGGB8, 0x02010100}, {camera::PixelFormat::RawGR8, 0x01020001},
+        {camera::PixelFormat::RawGB8, 0x01000201}, {camera::PixelFormat::RawBG8, 0x00010102}, {camera::PixelFormat::Mono8, 0}
+    };
+    for (auto [format, pattern] : patterns) {
+        auto frame{frames.at(0)};
+        frame.type = format;
+        const auto path{to / (std::string{camera::to_string(format)} + ".dng")};
+        if (!dng.write(path, frame)) {
+            std::cerr << "failed to write " << path << "\n";
+            return false;
+        }
+        auto tags{read_dng(path, content)};
+        const auto offset{tags[273]};
+        if (tags[256] != frame.width || tags[257] != frame.height || tags[258] != 8 || tags[279] != frame.size ||
+                tags[33422] != pattern || tags[262] != (pattern ? 32803u : 34892u) || tags[50706] != 0x00000101 ||
+                offset + frame.size != content.size() || !std::equal(frame.data, frame.data + frame.size, content.data() + offset)) {
+            std::cerr << "the DNG file " << path << " is not matching the frame that was written\n";
+            return false;
+        }
+    }
+    // the monochrome frames of more than 8 bits are raw sensor data as well
+    auto frame{frames.at(0)};
+    frame.type = camera::PixelFormat::Mono16;
+    frame.width /= 2;
+    if (!dng.write(to / "mono16.dng", frame)) {
+        return false;
+    }
+    if (auto tags{read_dng(to / "mono16.dng", content)}; tags[262] != 34892u || tags[258] != 16 || tags[50717] != 0xffff || tags.count(33422)) {
+        std::cerr << "the DNG file of a Mono16 frame is not a linear raw file\n";
+        return false;
+    }
+    // a format that we cannot save, and a frame that is smaller than its geometry
+    frame = frames.at(0);
+    frame.type = camera::PixelFormat::RGB8;
+    if (dng.write(to / "rgb.dng", frame)) {
+        return false;
+    }
+    frame.type = camera::PixelFormat::RawRGGB8;
+    frame.size /= 2;
+    if (dng.write(to / "half.dng", frame)) {
+        return false;
+    }
+    const auto start{clock_type::now()};
+    for (std::size_t i = 0; i < frames.count; i++) {
+        if (!dng.write(to / ("image_number_" + std::to_string(i) + ".dng"), frames.at(i))) {
+            return false;
+        }
+    }
+    ::sync();
+    const auto took{seconds_since(start)};
+    std::cout << "DNG file per frame: " << frames.count << " frames, " << frames.count * frames.data.size() / took / (1024.0 * 1024.0)
+        << " MB/s, " << took * 1e6 / frames.count << "us per frame" << std::endl;
+    return true;
+}
+
+}       // end of local namespace
+
+auto main(int argc, char** argv) -> int {
+    const std::filesystem::path base{argc > 1 ? argv[1] : "/tmp/recording_test"};
+    const auto count{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 300};
+    uint32_t width{1024}, height{768};
+    if (argc > 3 && std::sscanf(argv[3], "%ux%u", &width, &height) != 2) {
+        std::cerr << "invalid frame size " << argv[3] << ", expecting <width>x<height>\n";
+        return -1;
+    }
+    Frames frames{count, width, height};
+    std::filesystem::remove_all(base);
+    // small segments, so that we have a few of them
+    recording::SegmentSettings settings{.max_size = uint64_t{64} * 1024 * 1024 + frames.data.size() * 4, .max_duration = std::chrono::seconds{0}};
+    auto success{check_ring(frames) && check_governor()};
+    for (auto io : {recording::DiskIo::Buffered, recording::DiskIo::Direct}) {
+        for (auto uring : {true, false}) {
+            if (io == recording::DiskIo::Buffered && !uring) {
+                continue;
+            }
+            settings.io = io;
+            settings.direct.use_uring = uring;
+            const auto to{base / "segments"};
+            success = success && write_segments(to, frames, settings) && read_segments(to, frames) && check_metadata(to, frames) &&
+                read_unclosed(to, frames) && check_replay(to, frames);
+            std::filesystem::remove_all(to);
+        }
+    }
+    success = success && check_codec(base / "compressed", frames) &&
+        check_striping(base / "striped", frames, recording::Striping::RoundRobin) && check_striping(base / "by_load", frames, recording::Striping::Load);
+    write_files(base / "files", frames);
+    success = check_dng(base / "dng", frames) && success;
+    std::filesystem::remove_all(base);
+    std::cout << (success ? "success" : "failed") << std::endl;
+    return success ? 0 : -1;
+}
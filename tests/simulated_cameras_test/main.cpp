@@ -0,0 +1,264 @@
+// Load test for the capture pipeline, using the simulated cameras (build with -DSIMULATED_CAMERA=ON).
+// The simulation is controlled from the environment (see camera_controller/simulator/simulation.hh), for example:
+// SIMCAM_CAMERAS=8 SIMCAM_FPS=30 SIMCAM_JITTER_US=2000 SIMCAM_DROP_RATE=0.01 ./simulated_cameras_test 10
+// Since the simulated cameras are deterministic, the digest that is printed for each camera can be used to
+// compare two runs frame for frame.
+#include "camera_controller/camera.hh"
+#include "camera_controller/cameras_context.hh"
+#include "camera_controller/camera_group.hh"
+#include "camera_controller/camera_startup.hh"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <cstdlib>
+
+using namespace std::chrono_literals;
+
+struct CameraStats {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> missing{0};
+    std::atomic<uint64_t> digest{14695981039346656037ull};
+    unsigned long long last{0};
+    bool first{true};
+
+    // Note that this is only called from the camera thread
+    auto update(const camera::ImageView& image) -> void {
+        if (!first && image.number > last + 1) {
+            missing += image.number - last - 1;
+        }
+        first = false;
+        last = image.number;
+        ++frames;
+        auto d{digest.load()};
+        const auto mix = [&d](uint64_t v) {
+            d = (d ^ v) * 1099511628211ull;
+        };
+        mix(image.number);
+        constexpr uint32_t SAMPLES = 64;
+        for (uint32_t i = 0; i < SAMPLES && image.size; i++) {
+            mix(image.data[uint64_t{i} * image.size / SAMPLES]);
+        }
+        digest = d;
+    }
+};
+
+auto open_devices(const std::vector<camera::DeviceInfo>& devices, const camera::context_type& ctx) -> std::vector<std::shared_ptr<camera::IdleCamera>> {
+    std::vector<std::shared_ptr<camera::IdleCamera>> cameras;
+    const auto start{std::chrono::steady_clock::now()};
+    for (auto&& result : camera::open_all(ctx, devices, camera::CameraProfile{})) {
+        std::cout << result << std::endl;
+        if (result) {
+            cameras.push_back(std::move(result.camera));
+        } else {
+            std::cerr << "failed to open " << result.device << " for working\n";
+        }
+    }
+    std::cout << "opened " << cameras.size() << " cameras in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << "ms" << std::endl;
+    return cameras;
+}
+
+auto sync_test(std::shared_ptr<camera::IdleCamera>& camera, int max) -> bool {
+    auto capture_source{camera::From(std::move(camera))};
+    auto cc{camera::make_capture_context()};
+    auto success{0};
+    for (auto i = 0; i < max; i++) {
+        if (auto image = camera::capture_one(*capture_source, 1000, *cc); image) {
+            ++success;
+        }
+    }
+    camera = camera::Back(std::move(capture_source));
+    std::cout << "sync capture: read " << success << " out of " << max << " images" << std::endl;
+    return success > 0;
+}
+
+auto software_trigger_test(std::shared_ptr<camera::IdleCamera>& camera, int max) -> bool {
+    std::atomic<int> received{0};
+    std::stop_source stop_source;
+    auto software_ctx{camera::make_software_context(*camera, [&received](camera::ImageView) {
+        ++received;
+        return true;
+    }, stop_source.get_token(), 4)};
+    if (!software_ctx) {
+        std::cerr << "failed to start the software context for image acquisition" << std::endl;
+        return false;
+    }
+    auto cc{camera::From(std::move(camera))};
+    for (auto i = 0; i < max && camera::async_software_capture_one(*software_ctx, *cc); i++) {
+        std::this_thread::sleep_for(50ms);
+    }
+    software_ctx.reset();
+    camera = camera::Back(std::move(cc));
+    std::cout << "software trigger: received " << received << " out of " << max << " triggers" << std::endl;
+    return received > 0;
+}
+
+// Keep the frames in another thread for a while, without copying them
+auto lease_test(std::shared_ptr<camera::IdleCamera>& camera, std::chrono::milliseconds hold) -> bool {
+    std::mutex guard;
+    std::deque<camera::FrameLease> held;
+    std::stop_source stop_source;
+    auto cc{camera::From(std::move(camera))};
+    auto ctx{camera::make_async_lease_context(*cc, [&](camera::FrameLease frame) {
+        std::lock_guard lock{guard};
+        held.push_back(std::move(frame));
+        return true;
+    }, stop_source.get_token())};
+    if (!ctx || !camera::async_capture(*ctx, *cc, 4)) {
+        std::cerr << "failed to initiate the async lease capture\n";
+        return false;
+    }
+    std::jthread consumer([&](std::stop_token st) {
+        while (!st.stop_requested()) {
+            std::this_thread::sleep_for(hold);
+            std::lock_guard lock{guard};
+            if (!held.empty()) {
+                held.pop_front();
+            }
+        }
+    });
+    std::this_thread::sleep_for(1s);
+    consumer.request_stop();
+    consumer.join();
+    const auto stats{camera::lease_statistics(*ctx)};
+    ctx.reset();
+    held.clear();
+    camera = camera::Back(std::move(cc));
+    std::cout << "lease: " << stats << std::endl;
+    return stats.leased > 0;
+}
+
+// the processing here is slower than the frame rate, so a single thread would not keep up with the camera
+auto pool_test(std::shared_ptr<camera::IdleCamera>& camera, std::chrono::milliseconds work, camera::OverflowPolicy overflow) -> bool {
+    std::stop_source stop_source;
+    std::atomic<uint64_t> processed{0};
+    auto cc{camera::From(std::move(camera))};
+    auto ctx{camera::make_async_pool_context(*cc, [&](const camera::ImageView&) {
+        std::this_thread::sleep_for(work);
+        ++processed;
+        return true;
+    }, stop_source.get_token(), camera::DispatchSettings{.workers = 4, .ring_size = 4, .overflow = overflow})};
+    if (!ctx || !camera::async_capture(*ctx, *cc, camera::DEFAULT_NUMBER_OF_BUFFERS)) {
+        std::cerr << "failed to initiate the async pool capture\n";
+        return false;
+    }
+    std::this_thread::sleep_for(1s);
+    stop_source.request_stop();
+    const auto stats{camera::dispatch_statistics(*ctx)};
+    ctx.reset();
+    camera = camera::Back(std::move(cc));
+    std::cout << "pool (" << overflow << "): " << stats << ", processed by the workers " << processed << std::endl;
+    return processed > 0;
+}
+
+auto async_test(std::vector<std::shared_ptr<camera::IdleCamera>>& cameras, std::chrono::seconds duration) -> bool {
+    std::vector<CameraStats> stats(cameras.size());
+    std::vector<std::shared_ptr<camera::CapturingCamera>> capturing;
+    std::vector<camera::async_context_t> contexts;
+    std::stop_source stop_source;
+
+    for (std::size_t i = 0; i < cameras.size(); i++) {
+        capturing.push_back(camera::From(std::move(cameras[i])));
+        auto ctx{camera::make_async_context(*capturing.back(), [s = &stats[i]](camera::ImageView image) {
+            s->update(image);
+            return true;
+        }, stop_source.get_token())};
+        if (!ctx || !camera::async_capture(*ctx, *capturing.back(), camera::DEFAULT_NUMBER_OF_BUFFERS)) {
+            std::cerr << "failed to initiate the async capture for camera " << i << "\n";
+            return false;
+        }
+        contexts.push_back(std::move(ctx));
+    }
+    std::cout << "frames memory: " << camera::pool_statistics(*contexts.front()) << ", total capture memory: " << camera::capture_memory() << std::endl;
+    const auto start{std::chrono::steady_clock::now()};
+    std::this_thread::sleep_for(duration);
+    stop_source.request_stop();
+    contexts.clear();
+    const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+    for (std::size_t i = 0; i < capturing.size(); i++) {
+        cameras[i] = camera::Back(std::move(capturing[i]));
+    }
+
+    for (std::size_t i = 0; i < stats.size(); i++) {
+        std::cout << "camera " << i << ": " << stats[i].frames << " frames, " << (stats[i].frames / elapsed.count())
+            << " FPS, missing " << stats[i].missing << ", digest " << std::hex << stats[i].digest << std::dec << std::endl;
+    }
+    return true;
+}
+
+auto group_test(std::vector<std::shared_ptr<camera::IdleCamera>>&& cameras, std::chrono::seconds duration) -> bool {
+    auto group{camera::make_group(std::move(cameras), camera::GroupSettings{})};
+    if (!group) {
+        std::cerr << "failed to create the camera group\n";
+        return false;
+    }
+    std::stop_source stop_source;
+    uint64_t sets{0};
+    if (!camera::start(*group, [&sets](const camera::FrameSet& fs) {
+        sets += fs.complete() ? 1 : 0;
+        return true;
+    }, stop_source.get_token())) {
+        std::cerr << "failed to start the camera group\n";
+        return false;
+    }
+    std::this_thread::sleep_for(duration);
+    camera::stop(*group);
+    std::cout << "group of " << camera::size(*group) << " cameras delivered " << sets << " sets, "
+        << camera::statistics(*group) << std::endl;
+    return sets > 0;
+}
+
+auto main(int argc, char** argv) -> int {
+    const std::chrono::seconds duration{argc > 1 ? std::atoi(argv[1]) : 5};
+    auto devices_ctx{camera::make_context()};
+    if (std::holds_alternative<camera::error_type>(devices_ctx)) {
+        std::cerr << "failed to create device context: " << std::get<camera::error_type>(devices_ctx) << "\n";
+        return -1;
+    }
+
+    auto& ctx{std::get<camera::context_type>(devices_ctx)};  // this is safe now
+
+    const auto devices{camera::enumerate(*ctx.get())};
+    if (devices.empty()) {
+        std::cerr << "no device was detected\n";
+        return -1;
+    }
+    std::copy(devices.begin(), devices.end(), std::ostream_iterator<camera::DeviceInfo>(std::cout, "\n"));
+    auto cameras{open_devices(devices, ctx)};
+    if (cameras.size() != devices.size()) {
+        return -1;
+    }
+    if (!sync_test(cameras.front(), 5)) {
+        std::cerr << "failed to read images in sync mode\n";
+        return -1;
+    }
+    if (!software_trigger_test(cameras.front(), 5)) {
+        std::cerr << "failed to read images with software trigger\n";
+        return -1;
+    }
+    for (auto&& camera : cameras) {
+        if (!camera::set_hardware_trigger(*camera, camera::HardWareTriggerSource::Line0, camera::ActivationMode::RisingEdge)) {
+            std::cerr << "failed to set the hardware trigger\n";
+            return -1;
+        }
+    }
+    if (!lease_test(cameras.front(), 50ms)) {
+        std::cerr << "failed to lease images\n";
+        return -1;
+    }
+    // with the second, the workers are slower than the camera, so the camera thread is waiting for them
+    if (!pool_test(cameras.front(), 100ms, camera::OverflowPolicy::DropOldest) || !pool_test(cameras.front(), 200ms, camera::OverflowPolicy::Block)) {
+        std::cerr << "failed to process images with the workers pool\n";
+        return -1;
+    }
+    std::cout << "starting to capture from " << cameras.size() << " cameras for " << duration.count() << " seconds" << std::endl;
+    if (!async_test(cameras, duration)) {
+        return -1;
+    }
+    std::cout << "starting to capture from a group of " << cameras.size() << " cameras for " << duration.count() << " seconds" << std::endl;
+    return group_test(std::move(cameras), duration) ? 0 : -1;
+}
@@ -1,5 +1,6 @@
 #include "camera_controller/camera.hh"
 #include "camera_controller/cameras_context.hh"
+#include "streaming/preview.hh"
 #include <opencv2/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -11,29 +12,28 @@
 
 using namespace std::chrono_literals;
 
-inline auto colorize(cv::InputArray input, cv::OutputArray rgb) -> void {
-    cv::cvtColor(input, rgb, cv::COLOR_BayerRG2RGB);
-}
+// The images are debayered and reduced to half the size by the preview, on its own thread, so this is only drawing them
+streaming::preview_t preview;
 
-auto show_image(const std::uint8_t* data, int width, int height, int number, const char* name) -> void {
+auto show_image(const camera::ImageView& image, const char* name) -> void {
     using namespace std::string_literals;
     constexpr auto row_step = 30;       
     auto row = row_step;
+    const auto number{image.number};
 
-    cv::Mat rgb(height, width, CV_8UC1, (void*)data);
-    colorize(rgb, rgb);
-    cv::resize(rgb, rgb, cv::Size(), 0.5, 0.5);
+    cv::Mat bgr;
+    cv::cvtColor(cv::Mat(image.height, image.width, CV_8UC3, (void*)image.data), bgr, cv::COLOR_RGB2BGR);
     std::string buf("FrameData:  #: "s + std::to_string(number));
-    putText(rgb, buf.c_str(), cv::Point(row_step, row), cv::HersheyFonts::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 0, 255), 2);
+    putText(bgr, buf.c_str(), cv::Point(row_step, row), cv::HersheyFonts::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 0, 255), 2);
     row += row_step;
     auto title{"Image "s + name};
-    cv::imshow(title, rgb);
+    cv::imshow(title, bgr);
     cv::waitKey(1);
 }
 
 auto show_images(const camera::ImageView& frames) -> void {
     if (frames.size) {
-        show_image(frames.data, frames.width, frames.height, frames.number, "left");
+        (void)streaming::offer(*preview, 0, frames);
     } else {
         std::cerr << "missing frame cannot display\n";
     }
@@ -96,6 +96,9 @@ auto main(int argc, char** argv) -> int {
     }
     std::cout << "Starting to capture images using software trigger" << std::endl;
     std::stop_source stop_source;
+    preview = streaming::make_preview(streaming::PreviewSettings{.every = 1, .scale = 2, .budget = 0}, {devices.at(cix).id}, [](std::size_t, const camera::ImageView& rgb) {
+        show_image(rgb, "left");
+    }, stop_source.get_token());
     auto software_ctx{camera::make_software_context(*camera, capture_images_processing, stop_source.get_token(), 10)};
     if (!software_ctx) {
         std::cerr << "failed to start the software context for image acquisition" << std::endl;
@@ -107,5 +110,9 @@ auto main(int argc, char** argv) -> int {
         std::this_thread::sleep_for(500ms);
     }
     std::cout << "finish doing the software trigger test" << std::endl;
+    streaming::stop(*preview);
+    for (auto&& s : streaming::statistics(*preview)) {
+        std::cout << "preview " << s << std::endl;
+    }
     
 }
@@ -0,0 +1,395 @@
+// Stream frames over the loopback from the stream server to the stream receiver, this is not using any camera.
+// A thread for each stream is passing frames to the server at a fixed frame rate, and the receiver is checking
+// that every frame that is put back together is the frame that was sent. The frame rate is doubled on every step
+// until more than 1% of the frames are lost, and for each step we print the throughput, the frames and the datagrams that
+// were lost, and the latency from passing the frame to the server until it was complete in the receiver.
+// Before that, the receiver is checked with a datagram that does not agree with the frame that it claims to be part of, and the preview is checked: the colors of a Bayer frame should come back in the RGB preview, and the frames of a few
+// cameras are passed to the preview at 30 FPS, to print how many previews were made and the CPU that they took.
+// After that, the frames are streamed at half of the highest frame rate, copied into the server, passed as leases (sent from the
+// buffer of the "camera"), and as leases with MSG_ZEROCOPY, to compare the CPU that is used for each Gbit that was sent. Note that over
+// the loopback the kernel is copying the zero copy frames anyway (this is printed), so this is only checking that the frames are
+// held until the kernel is done with them, the saving is only seen when streaming to another host.
+// The arguments are the number of streams, the frame size, the seconds of each step and the rate of each stream in Mbit/s (0 for no pacing), for example:
+// ./streaming_benchmark 2 2048x1500 2 0
+#include "streaming/stream_server.hh"
+#include "streaming/stream_receiver.hh"
+#include "streaming/preview.hh"
+#include <chrono>
+#include <vector>
+#include <array>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr uint16_t PORT = 5999;
+constexpr double MAX_LOSS = 0.01;
+constexpr std::size_t LEASED_BUFFERS = 4;      // for each stream, like the buffers of a camera
+
+// How the frames are passed to the server
+enum class Sending {
+    Copy,
+    Lease,
+    ZeroCopy
+};
+
+auto operator << (std::ostream& os, Sending sending) -> std::ostream& {
+    switch (sending) {
+        case Sending::Copy:
+            return os << "copy";
+        case Sending::Lease:
+            return os << "lease";
+        case Sending::ZeroCopy:
+            return os << "zero copy";
+    }
+    return os << "unknown";
+}
+
+struct Step {
+    double fps{0};
+    uint64_t sent{0};               // frames that were passed to the server
+    uint64_t received{0};
+    uint64_t corrupted{0};
+    std::vector<double> latency{};  // milliseconds
+    std::vector<streaming::StreamStatistics> server{};
+    streaming::ReceiverStatistics receiver{};
+    std::chrono::duration<double> elapsed{0};
+    uint64_t starved{0};            // frames that were not sent since all the buffers were still held by the server
+
+    auto loss() const -> double {
+        return sent ? 1.0 - static_cast<double>(received) / sent : 1.0;
+    }
+
+    auto datagram_loss() const -> double {
+        const auto datagrams{std::accumulate(server.begin(), server.end(), uint64_t{0}, [](auto n, auto&& s) { return n + s.datagrams; })};
+        return datagrams ? 1.0 - static_cast<double>(receiver.datagrams) / datagrams : 0.0;
+    }
+
+    // milliseconds of CPU for each Gbit, for all the streams
+    auto cpu_per_gigabit() const -> double {
+        const auto bytes{std::accumulate(server.begin(), server.end(), uint64_t{0}, [](auto n, auto&& s) { return n + s.bytes; })};
+        const auto cpu{std::accumulate(server.begin(), server.end(), std::chrono::nanoseconds{0}, [](auto n, auto&& s) { return n + s.copy + s.cpu; })};
+        return bytes ? std::chrono::duration<double, std::milli>(cpu).count() / (static_cast<double>(bytes) * 8 / 1e9) : 0.0;
+    }
+};
+
+auto operator << (std::ostream& os, const Step& step) -> std::ostream& {
+    const auto dropped{std::accumulate(step.server.begin(), step.server.end(), uint64_t{0}, [](auto n, auto&& s) { return n + s.dropped; })};
+    os << std::fixed << std::setprecision(1) << std::setw(7) << step.fps << " FPS: "
+        << std::setw(8) << step.receiver.bytes * 8 / step.elapsed.count() / 1e6 << " Mbit/s, received " << step.received << " of " << step.sent
+        << " frames (" << std::setprecision(2) << step.loss() * 100 << "% lost, " << dropped << " dropped by the server, "
+        << step.receiver.expired + step.receiver.evicted << " incomplete, " << step.datagram_loss() * 100 << "% of the datagrams lost)";
+    if (step.corrupted) {
+        os << ", " << step.corrupted << " corrupted";
+    }
+    if (step.starved) {
+        os << ", " << step.starved << " without a free buffer";
+    }
+    if (step.latency.empty()) {
+        return os;
+    }
+    const auto mean{std::accumulate(step.latency.begin(), step.latency.end(), 0.0) / step.latency.size()};
+    const auto p99{step.latency[std::min(step.latency.size() - 1, step.latency.size() * 99 / 100)]};
+    return os << ", latency ms min " << step.latency.front() << " mean " << mean << " p99 " << p99 << " max " << step.latency.back();
+}
+
+// every frame is a bit different, so that we can tell them apart in the receiver
+auto stamp(std::vector<uint8_t>& data, uint64_t number) -> void {
+    for (std::size_t j = 0; j < data.size(); j += 1024) {
+        data[j] = static_cast<uint8_t>(number + j / 1024);
+    }
+}
+
+auto stamped(const camera::ImageView& image) -> bool {
+    for (std::size_t j = 0; j < image.size; j += 1024) {
+        if (image.data[j] != static_cast<uint8_t>(image.number + j / 1024)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// a Bayer frame where all the pixels of each color have the same value, should be the same color in the preview
+auto check_downscale(camera::PixelFormat format, std::array<uint8_t, 4> quad, std::array<uint8_t, 3> expected) -> bool {
+    constexpr uint32_t width{64}, height{48}, scale{4};
+    std::vector<uint8_t> data(width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            data[y * width + x] = quad[(y % 2) * 2 + x % 2];
+        }
+    }
+    std::vector<uint8_t> rgb;
+    const auto preview{streaming::downscale(camera::ImageView{width * height, width, height, 1, data.data(), format}, scale, rgb)};
+    if (!preview || preview->width != width / scale || preview->height != height / scale || preview->type != camera::PixelFormat::RGB8) {
+        std::cerr << "failed to make a preview of " << format << "\n";
+        return false;
+    }
+    for (std::size_t i = 0; i < rgb.size(); i += 3) {
+        if (!std::equal(expected.begin(), expected.end(), rgb.begin() + i)) {
+            std::cerr << "the preview of " << format << " is " << int(rgb[i]) << ", " << int(rgb[i + 1]) << ", " << int(rgb[i + 2]) << " at " << i / 3
+                << " and not " << int(expected[0]) << ", " << int(expected[1]) << ", " << int(expected[2]) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+auto check_preview(std::size_t cameras, uint32_t width, uint32_t height) -> bool {
+    if (!(check_downscale(camera::PixelFormat::RawRGGB8, {200, 100, 100, 50}, {200, 100, 50}) &&
+            check_downscale(camera::PixelFormat::RawBG8, {50, 90, 110, 200}, {200, 100, 50}) &&
+            check_downscale(camera::PixelFormat::RawGR8, {100, 200, 50, 100}, {200, 100, 50}))) {
+        return false;
+    }
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < cameras; i++) {
+        ids.push_back("camera-" + std::to_string(i));
+    }
+    constexpr double FPS{30};
+    const streaming::PreviewSettings settings{.fps = 10, .scale = 4, .budget = 0.1};
+    std::atomic<uint64_t> wrong{0};
+    auto preview{streaming::make_preview(settings, ids, [&wrong, width, height](std::size_t, const camera::ImageView& rgb) {
+        wrong += rgb.width == width / 4 && rgb.height == height / 4 ? 0 : 1;
+    }, std::stop_token{})};
+    std::vector<uint8_t> data(std::size_t{width} * height);
+    const auto start{clock_type::now()};
+    for (uint64_t number = 1; number <= 3 * FPS; number++) {
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(number / FPS)));
+        stamp(data, number);
+        for (std::size_t i = 0; i < cameras; i++) {
+            (void)streaming::offer(*preview, i, camera::ImageView{static_cast<uint32_t>(data.size()), width, height, number, data.data(), camera::PixelFormat::RawRGGB8});
+        }
+    }
+    streaming::stop(*preview);
+    auto ok{wrong == 0};
+    for (auto&& s : streaming::statistics(*preview)) {
+        std::cout << "preview " << s << std::endl;
+        // at most a preview for every 3 frames, and at least one
+        ok = ok && s.previews > 0 && s.previews <= s.offered / 3 + 1;
+    }
+    if (!ok) {
+        std::cerr << "the previews are not of the expected size or rate\n";
+    }
+    return ok;
+}
+
+// The buffers of a "camera", a buffer is only stamped with a new frame after the server released its lease
+struct LeasedBuffers {
+    explicit LeasedBuffers(std::size_t size) : tracker{std::make_shared<camera::LeaseTracker>()} {
+        tracker->set_buffers(LEASED_BUFFERS);
+        for (auto&& b : buffers) {
+            b.data.resize(size);
+        }
+    }
+
+    auto lease(const camera::ImageView& image) -> camera::FrameLease {
+        for (auto&& b : buffers) {
+            if (!b.held.exchange(true)) {
+                stamp(b.data, image.number);
+                auto leased{image};
+                leased.data = b.data.data();
+                return camera::FrameLease::make(leased, tracker, [&b] { b.held = false; });
+            }
+        }
+        return {};
+    }
+
+    struct Buffer {
+        std::vector<uint8_t> data;
+        std::atomic<bool> held{false};
+    };
+    std::array<Buffer, LEASED_BUFFERS> buffers;
+    std::shared_ptr<camera::LeaseTracker> tracker;
+};
+
+// A frame of 2 datagrams, with a datagram in the middle that claims to be of the same frame, but of a larger one,
+// this must be rejected, and not written past the end of the frame, as well as a datagram of a frame above the limit of the receiver
+auto check_mismatch() -> bool {
+    constexpr uint32_t width{40}, height{50}, payload{1000};
+    std::vector<uint8_t> data(width * height);
+    stamp(data, 1);
+    std::atomic<uint64_t> good{0};
+    auto receiver{streaming::make_receiver(streaming::ReceiverSettings{.address = "127.0.0.1", .port = PORT, .slots = 2},
+        [&good](uint32_t, const camera::ImageView& image) {
+            good += image.size == width * height && stamped(image) ? 1 : 0;
+            return true;
+        }, std::stop_token{})};
+    const auto fd{::socket(AF_INET, SOCK_DGRAM, 0)};
+    if (!receiver || fd < 0) {
+        std::cerr << "failed to create the receiver or the socket to check it\n";
+        return false;
+    }
+    sockaddr_in to{.sin_family = AF_INET, .sin_port = htons(PORT), .sin_addr = {}, .sin_zero = {}};
+    ::inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+    const auto send = [&](streaming::DatagramHeader header, uint32_t fragment, const uint8_t* from, std::size_t size) {
+        header.fragment = fragment;
+        std::vector<uint8_t> datagram(sizeof(header) + size);
+        std::memcpy(datagram.data(), &header, sizeof(header));
+        std::memcpy(datagram.data() + sizeof(header), from, size);
+        (void)::sendto(fd, datagram.data(), datagram.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    };
+    const camera::ImageView image{static_cast<uint32_t>(data.size()), width, height, 1, data.data(), camera::PixelFormat::Mono8};
+    const streaming::DatagramHeader header{image, streaming::camera_key("camera-0"), payload};
+    send(header, 0, data.data(), payload);
+    auto larger{image};
+    larger.size = 100 * payload;
+    larger.height = larger.size / width;
+    const std::vector<uint8_t> garbage(payload, 0xff);
+    send(streaming::DatagramHeader{larger, header.camera, payload}, 50, garbage.data(), payload);
+    // and a frame that is too large to allocate a slot for it
+    auto huge{image};
+    huge.size = 3'000'000'000u;
+    send(streaming::DatagramHeader{huge, header.camera, payload}, 0, garbage.data(), payload);
+    send(header, 1, data.data() + payload, data.size() - payload);
+    const auto until{clock_type::now() + std::chrono::seconds{1}};
+    while (good == 0 && clock_type::now() < until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    }
+    ::close(fd);
+    streaming::stop(*receiver);
+    const auto stats{streaming::statistics(*receiver)};
+    std::cout << "mismatched datagram: receiver " << stats << std::endl;
+    if (good != 1 || stats.invalid != 2 || stats.frames != 1) {
+        std::cerr << "the receiver did not reject the datagram that does not agree with its frame, or the frame that is too large\n";
+        return false;
+    }
+    return true;
+}
+
+auto run_step(std::size_t streams, uint32_t width, uint32_t height, double fps, std::chrono::seconds duration, double rate, Sending sending = Sending::Copy) -> Step {
+    Step step{.fps = fps};
+    std::vector<std::string> cameras;
+    for (std::size_t i = 0; i < streams; i++) {
+        cameras.push_back("stream-" + std::to_string(i));
+    }
+    const auto size{std::size_t{width} * height};
+    std::atomic<uint64_t> received{0};
+    auto receiver{streaming::make_receiver(streaming::ReceiverSettings{.address = "127.0.0.1", .port = PORT, .slots = 2 * streams + 2, .frame_size = size},
+        [&step, &received](uint32_t, const camera::ImageView& image) {
+            step.latency.push_back((image.arrived - image.timestamp) / 1e6);
+            step.corrupted += stamped(image) ? 0 : 1;
+            ++received;
+            return true;
+        }, std::stop_token{})};
+    // the server is holding the leases until it is stopped, so the buffers are destroyed after it
+    std::vector<std::unique_ptr<LeasedBuffers>> leased;
+    for (std::size_t i = 0; i < streams; i++) {
+        leased.push_back(std::make_unique<LeasedBuffers>(sending == Sending::Copy ? 0 : size));
+    }
+    auto server{streaming::make_server(streaming::ServerSettings{
+        .address = "127.0.0.1", .port = PORT, .zerocopy = sending == Sending::ZeroCopy, .stream = {.rate = rate}
+    }, cameras, std::stop_token{})};
+    if (!(receiver && server)) {
+        return step;
+    }
+    const auto start{clock_type::now()};
+    const auto frames{static_cast<uint64_t>(fps * duration.count())};
+    const auto interval{std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / fps))};
+    std::atomic<uint64_t> starved{0};
+    std::vector<std::jthread> feeders;
+    for (std::size_t i = 0; i < streams; i++) {
+        feeders.emplace_back([&, i] {
+            std::vector<uint8_t> data(sending == Sending::Copy ? size : 0);
+            for (uint64_t number = 1; number <= frames; number++) {
+                std::this_thread::sleep_until(start + interval * number);
+                // the latency is measured from here, so the time of the frame is the host time
+                camera::ImageView image{static_cast<uint32_t>(size), width, height, number, data.data(), camera::PixelFormat::RawRGGB8, camera::host_time()};
+                if (sending == Sending::Copy) {
+                    stamp(data, number);
+                    (void)streaming::send(*server, i, image);
+                } else if (auto frame = leased[i]->lease(image); frame) {
+                    (void)streaming::send(*server, i, std::move(frame));
+                } else {
+                    ++starved;
+                }
+            }
+        });
+    }
+    feeders.clear();
+    streaming::stop(*server);
+    // the last datagrams may still be waiting in the socket
+    const auto sent{frames * streams};
+    const auto until{clock_type::now() + std::chrono::milliseconds{500}};
+    while (received < sent && clock_type::now() < until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    }
+    streaming::stop(*receiver);
+    step.elapsed = clock_type::now() - start;
+    step.sent = sent;
+    step.received = received;
+    step.starved = starved;
+    step.server = streaming::statistics(*server);
+    step.receiver = streaming::statistics(*receiver);
+    std::sort(step.latency.begin(), step.latency.end());
+    return step;
+}
+
+}       // end of local namespace
+
+auto main(int argc, char** argv) -> int {
+    const auto streams{static_cast<std::size_t>(std::max(1, argc > 1 ? std::atoi(argv[1]) : 2))};
+    uint32_t width{2048}, height{1500};
+    if (argc > 2 && std::sscanf(argv[2], "%ux%u", &width, &height) != 2) {
+        std::cerr << "invalid frame size " << argv[2] << ", expecting <width>x<height>\n";
+        return -1;
+    }
+    const std::chrono::seconds duration{std::max(1, argc > 3 ? std::atoi(argv[3]) : 2)};
+    const auto rate{argc > 4 ? std::atof(argv[4]) : 0.0};
+    std::cout << "streaming " << streams << " streams of " << width << " X " << height << " frames over the loopback, "
+        << duration.count() << " seconds for each step" << std::endl;
+    if (!check_mismatch() || !check_preview(streams, width, height)) {
+        return -1;
+    }
+    double sustained{0};
+    for (double fps = 5; fps <= 1000; fps *= 2) {
+        const auto step{run_step(streams, width, height, fps, duration, rate)};
+        if (step.sent == 0) {
+            std::cerr << "failed to create the server or the receiver on port " << PORT << "\n";
+            return -1;
+        }
+        std::cout << step << std::endl;
+        if (step.corrupted) {
+            std::cerr << "frames were not received as they were sent\n";
+            return -1;
+        }
+        if (step.loss() > MAX_LOSS) {
+            for (auto&& s : step.server) {
+                std::cout << "\t" << s << std::endl;
+            }
+            std::cout << "\treceiver: " << step.receiver << std::endl;
+            break;
+        }
+        sustained = fps;
+    }
+    std::cout << "the highest frame rate without losing more than " << MAX_LOSS * 100 << "% of the frames is " << sustained
+        << " FPS for each stream (" << sustained * streams * width * height * 8 / 1e6 << " Mbit/s)" << std::endl;
+    if (sustained == 0) {
+        return -1;
+    }
+    for (auto sending : {Sending::Copy, Sending::Lease, Sending::ZeroCopy}) {
+        const auto step{run_step(streams, width, height, sustained / 2, duration, rate, sending)};
+        std::cout << std::setw(10) << sending << ": " << step << std::endl;
+        for (auto&& s : step.server) {
+            std::cout << "\t" << s << std::endl;
+        }
+        std::cout << std::setw(10) << sending << ": " << std::setprecision(1) << step.cpu_per_gigabit() << " ms of CPU for each Gbit that was sent" << std::endl;
+        if (step.corrupted) {
+            std::cerr << "frames were not received as they were sent with " << sending << "\n";
+            return -1;
+        }
+    }
+    return 0;
+}